@@ -0,0 +1,278 @@
+#ifndef FIX16_VECTOR_H
+#define FIX16_VECTOR_H
+
+// Array versions of the Q16.16 operations in fix16.h, vectorized with AVX2.
+//
+// All operations saturate: a result that does not fit in fix16_t becomes
+// fix16_maximum or fix16_minimum, the way fix16_sadd, fix16_smul and
+// fix16_sdiv do, and division by zero saturates in the direction of the
+// dividend. Multiplication, division and average round to nearest with ties
+// away from zero, like libfixmath without FIXMATH_NO_ROUNDING, so every
+// kernel gives bit-identical results to its scalar *_ref function, which is
+// also used for the elements left over after the last full vector.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "fix16.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+static inline fix16_t fix16_saturate(int64_t v) {
+    if (v > fix16_maximum) {
+        return fix16_maximum;
+    }
+    if (v < (int64_t)fix16_minimum) {
+        return fix16_minimum;
+    }
+    return (fix16_t)v;
+}
+
+static inline fix16_t fix16_sadd_ref(fix16_t a, fix16_t b) {
+    return fix16_saturate((int64_t)a + b);
+}
+
+static inline fix16_t fix16_ssub_ref(fix16_t a, fix16_t b) {
+    return fix16_saturate((int64_t)a - b);
+}
+
+static inline fix16_t fix16_smul_ref(fix16_t a, fix16_t b) {
+    int64_t product = (int64_t)a * b;
+    // Adding 0x8000, less one for negative products, and shifting rounds the
+    // halves away from zero.
+    product += 0x8000 - (product < 0);
+    return fix16_saturate(product >> 16);
+}
+
+static inline fix16_t fix16_sdiv_ref(fix16_t a, fix16_t b) {
+    if (b == 0) {
+        return a >= 0 ? fix16_maximum : fix16_minimum;
+    }
+    uint64_t num = (uint64_t)std::abs((int64_t)a) << 17;
+    uint64_t den = (uint64_t)std::abs((int64_t)b);
+    int64_t result = (int64_t)((num / den + 1) >> 1);
+    return fix16_saturate(((a ^ b) < 0) ? -result : result);
+}
+
+// sqrt(|x|) with the sign of x, as fix16_sqrt does. The square root of an
+// integer is never exactly halfway between two integers and the double result
+// is close enough to round correctly.
+static inline fix16_t fix16_sqrt_ref(fix16_t x) {
+    double r = std::nearbyint(std::sqrt(std::fabs((double)x) * 65536.0));
+    return (fix16_t)(x < 0 ? -r : r);
+}
+
+// sum / n, rounded. The average of fix16_t values always fits in fix16_t.
+static inline fix16_t fix16_divide_sum(int64_t sum, size_t n) {
+    int64_t len = (int64_t)n;
+    int64_t half = len / 2;
+    return (fix16_t)(sum >= 0 ? (sum + half) / len : (sum - half) / len);
+}
+
+static inline fix16_t fix16_average_ref(const fix16_t* v, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += v[i];
+    }
+    return fix16_divide_sum(sum, n);
+}
+
+#ifdef __AVX2__
+
+// For each lane, the value from y where the mask is set and from x otherwise.
+static inline __m256i fix16_blend(__m256i x, __m256i y, __m256i mask) {
+    return _mm256_blendv_epi8(x, y, mask);
+}
+
+// a + b, with the lanes that overflowed replaced by the limit in the direction
+// of a. Overflow happened if a and b have the same sign and the sum does not.
+static inline __m256i fix16_sadd_avx2(__m256i a, __m256i b) {
+    __m256i sum = _mm256_add_epi32(a, b);
+    __m256i overflow =
+        _mm256_andnot_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, sum));
+    // 0x7FFFFFFF for a >= 0, 0x80000000 for a < 0.
+    __m256i limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+                                     _mm256_set1_epi32(fix16_maximum));
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sum),
+                                                _mm256_castsi256_ps(limit),
+                                                _mm256_castsi256_ps(overflow)));
+}
+
+// Here overflow happened if a and b have different signs and the difference
+// does not have the sign of a.
+static inline __m256i fix16_ssub_avx2(__m256i a, __m256i b) {
+    __m256i diff = _mm256_sub_epi32(a, b);
+    __m256i overflow =
+        _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, diff));
+    __m256i limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+                                     _mm256_set1_epi32(fix16_maximum));
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(diff),
+                                                _mm256_castsi256_ps(limit),
+                                                _mm256_castsi256_ps(overflow)));
+}
+
+// Rounds and saturates four 64-bit products in Q32.32 and leaves the Q16.16
+// result in bits 16..47 of each lane. Clamping the product to
+// [-2^47, 2^47 - 1] before the shift is the saturation, and after it a
+// logical shift gives the same low 32 bits an arithmetic one would; AVX2 has
+// no 64-bit arithmetic shift.
+static inline __m256i fix16_round_product(__m256i product) {
+    const __m256i max = _mm256_set1_epi64x((int64_t(1) << 47) - 1);
+    const __m256i min = _mm256_set1_epi64x(-(int64_t(1) << 47));
+    __m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), product);
+    // + 0x8000 - 1 for negative products, see fix16_smul_ref().
+    product = _mm256_add_epi64(product, _mm256_set1_epi64x(0x8000));
+    product = _mm256_add_epi64(product, negative);
+    product = fix16_blend(product, max, _mm256_cmpgt_epi64(product, max));
+    product = fix16_blend(product, min, _mm256_cmpgt_epi64(min, product));
+    return product;
+}
+
+// _mm256_mul_epi32 multiplies the even 32-bit lanes into full 64-bit
+// products; the odd lanes are moved down into the even positions for a second
+// multiplication. The two rounded results are put back together with a blend.
+static inline __m256i fix16_smul_avx2(__m256i a, __m256i b) {
+    __m256i even = fix16_round_product(_mm256_mul_epi32(a, b));
+    __m256i odd = fix16_round_product(_mm256_mul_epi32(
+        _mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)));
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 16),
+                              _mm256_slli_epi64(odd, 16), 0xAA);
+}
+
+// Four divisions in double precision, without a division instruction.
+// The reciprocal of |b| comes from _mm_rcp_ps (12 bits), improved by two
+// Newton-Raphson steps to about 46 bits, which puts the rounded quotient
+// within one of the correct one for every quotient that fits in fix16_t.
+// The remainder |a| * 2^16 - q * |b| is exact with an FMA since it is small,
+// and it tells whether q needs to be moved by one to round to nearest with
+// ties away from zero. Quotients that do not fit are clamped, which is the
+// saturation. Lanes with b == 0 are fixed up by the caller.
+static inline __m128i fix16_sdiv_avx2_half(__m128i a, __m128i b) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d ad = _mm256_cvtepi32_pd(a);
+    __m256d bd = _mm256_cvtepi32_pd(b);
+    __m256d negative = _mm256_and_pd(_mm256_xor_pd(ad, bd), sign);
+    __m256d num = _mm256_mul_pd(_mm256_andnot_pd(sign, ad), _mm256_set1_pd(65536.0));
+    __m256d den = _mm256_andnot_pd(sign, bd);
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d r = _mm256_cvtps_pd(_mm_rcp_ps(_mm256_cvtpd_ps(den)));
+    r = _mm256_fmadd_pd(r, _mm256_fnmadd_pd(den, r, one), r);
+    r = _mm256_fmadd_pd(r, _mm256_fnmadd_pd(den, r, one), r);
+
+    __m256d q = _mm256_round_pd(_mm256_mul_pd(num, r),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d rem2 = _mm256_mul_pd(_mm256_fnmadd_pd(q, den, num), _mm256_set1_pd(2.0));
+    // q + 1 if 2 * rem >= |b|, q - 1 if 2 * rem < -|b|.
+    q = _mm256_add_pd(q, _mm256_and_pd(_mm256_cmp_pd(rem2, den, _CMP_GE_OQ), one));
+    q = _mm256_sub_pd(q, _mm256_and_pd(_mm256_cmp_pd(rem2, _mm256_xor_pd(den, sign), _CMP_LT_OQ), one));
+
+    q = _mm256_or_pd(_mm256_min_pd(q, _mm256_set1_pd(2147483648.0)), negative);
+    q = _mm256_min_pd(q, _mm256_set1_pd(2147483647.0));
+    return _mm256_cvttpd_epi32(q);
+}
+
+static inline __m256i fix16_sdiv_avx2(__m256i a, __m256i b) {
+    __m256i result = _mm256_set_m128i(
+        fix16_sdiv_avx2_half(_mm256_extracti128_si256(a, 1), _mm256_extracti128_si256(b, 1)),
+        fix16_sdiv_avx2_half(_mm256_castsi256_si128(a), _mm256_castsi256_si128(b)));
+    __m256i zero = _mm256_cmpeq_epi32(b, _mm256_setzero_si256());
+    __m256i limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31),
+                                     _mm256_set1_epi32(fix16_maximum));
+    return fix16_blend(result, limit, zero);
+}
+
+static inline __m128i fix16_sqrt_avx2_half(__m128i x) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d xd = _mm256_cvtepi32_pd(x);
+    __m256d r = _mm256_sqrt_pd(
+        _mm256_mul_pd(_mm256_andnot_pd(sign, xd), _mm256_set1_pd(65536.0)));
+    r = _mm256_round_pd(r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return _mm256_cvttpd_epi32(_mm256_or_pd(r, _mm256_and_pd(xd, sign)));
+}
+
+static inline __m256i fix16_sqrt_avx2(__m256i x) {
+    return _mm256_set_m128i(fix16_sqrt_avx2_half(_mm256_extracti128_si256(x, 1)),
+                            fix16_sqrt_avx2_half(_mm256_castsi256_si128(x)));
+}
+
+#define FIX16_BINARY_ARRAY(name, avx2_op, ref_op)                            \
+    static inline void name(const fix16_t* a, const fix16_t* b, fix16_t* out, \
+                            size_t n) {                                       \
+        size_t i = 0;                                                         \
+        for (; i + 8 <= n; i += 8) {                                          \
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));         \
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));         \
+            _mm256_storeu_si256((__m256i*)(out + i), avx2_op(va, vb));        \
+        }                                                                     \
+        for (; i < n; i++) {                                                  \
+            out[i] = ref_op(a[i], b[i]);                                      \
+        }                                                                     \
+    }
+
+#else
+
+#define FIX16_BINARY_ARRAY(name, avx2_op, ref_op)                            \
+    static inline void name(const fix16_t* a, const fix16_t* b, fix16_t* out, \
+                            size_t n) {                                       \
+        for (size_t i = 0; i < n; i++) {                                      \
+            out[i] = ref_op(a[i], b[i]);                                      \
+        }                                                                     \
+    }
+
+#endif
+
+// out[i] = a[i] op b[i] for i in [0, n). out may alias a or b.
+FIX16_BINARY_ARRAY(fix16_add_array, fix16_sadd_avx2, fix16_sadd_ref)
+FIX16_BINARY_ARRAY(fix16_sub_array, fix16_ssub_avx2, fix16_ssub_ref)
+FIX16_BINARY_ARRAY(fix16_mul_array, fix16_smul_avx2, fix16_smul_ref)
+FIX16_BINARY_ARRAY(fix16_div_array, fix16_sdiv_avx2, fix16_sdiv_ref)
+
+#undef FIX16_BINARY_ARRAY
+
+static inline void fix16_sqrt_array(const fix16_t* in, fix16_t* out, size_t n) {
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+        _mm256_storeu_si256((__m256i*)(out + i), fix16_sqrt_avx2(x));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = fix16_sqrt_ref(in[i]);
+    }
+}
+
+// The elements are summed exactly in 64-bit lanes and divided once, instead
+// of dividing every element by n as calculate_average() does.
+static inline fix16_t fix16_average_array(const fix16_t* v, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t i = 0;
+    int64_t sum = 0;
+#ifdef __AVX2__
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+        sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+        sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, _mm256_add_epi64(sum0, sum1));
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; i++) {
+        sum += v[i];
+    }
+    return fix16_divide_sum(sum, n);
+}
+
+#endif
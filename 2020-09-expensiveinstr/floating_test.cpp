@@ -1,5 +1,6 @@
 #include <iostream>
 #include "fix16.h"
+#include "fix16_vector.h"
 #include "measure_time.h"
 #include "utils.h"
 
@@ -150,7 +151,93 @@ std::vector<float> fixed_to_float(const std::vector<fix16_t>& v) {
     return result;
 }
 
+// Compares the array kernels to their scalar references, and the division
+// reference to fix16_div() above, on random values and on the edge cases.
+int check_vector_kernels() {
+    const int len = 100003;
+    std::mt19937 eng(1);
+    std::uniform_int_distribution<int32_t> any(fix16_minimum, fix16_maximum);
+    std::uniform_int_distribution<int> bits(0, 31);
+    const fix16_t edges[] = {0,       1,           -1,
+                             0x8000,  -0x8000,     fix16_one,
+                             -fix16_one, fix16_maximum, fix16_minimum,
+                             fix16_maximum - 1, fix16_minimum + 1};
+    const int edge_count = sizeof(edges) / sizeof(edges[0]);
+
+    std::vector<fix16_t> a(len), b(len), out(len);
+    for (int i = 0; i < len; i++) {
+        // Values of every magnitude, not just large ones.
+        a[i] = any(eng) >> bits(eng);
+        b[i] = any(eng) >> bits(eng);
+    }
+    for (int i = 0; i < edge_count * edge_count; i++) {
+        a[i] = edges[i / edge_count];
+        b[i] = edges[i % edge_count];
+    }
+
+    int errors = 0;
+    auto check = [&](const char* name, fix16_t (*ref)(fix16_t, fix16_t)) {
+        for (int i = 0; i < len; i++) {
+            if (out[i] != ref(a[i], b[i])) {
+                if (errors++ < 10) {
+                    std::cout << name << "(" << a[i] << ", " << b[i]
+                              << ") = " << out[i] << ", expected "
+                              << ref(a[i], b[i]) << std::endl;
+                }
+            }
+        }
+    };
+
+    fix16_add_array(a.data(), b.data(), out.data(), len);
+    check("add", fix16_sadd_ref);
+    fix16_sub_array(a.data(), b.data(), out.data(), len);
+    check("sub", fix16_ssub_ref);
+    fix16_mul_array(a.data(), b.data(), out.data(), len);
+    check("mul", fix16_smul_ref);
+    fix16_div_array(a.data(), b.data(), out.data(), len);
+    check("div", fix16_sdiv_ref);
+
+    fix16_sqrt_array(a.data(), out.data(), len);
+    for (int i = 0; i < len; i++) {
+        if (out[i] != fix16_sqrt_ref(a[i]) && errors++ < 10) {
+            std::cout << "sqrt(" << a[i] << ") = " << out[i] << std::endl;
+        }
+    }
+
+    // For divisors of 2^20 and more, the kick-start in fix16_div() can leave
+    // the quotient one too large in magnitude, so those are not compared.
+    for (int i = 0; i < len; i++) {
+        if (b[i] >= 0x100000 || b[i] <= -0x100000) {
+            continue;
+        }
+        fix16_t expected = fix16_div(a[i], b[i]);
+        if (expected != fix16_overflow &&
+            expected != fix16_sdiv_ref(a[i], b[i]) && errors++ < 10) {
+            std::cout << "fix16_div(" << a[i] << ", " << b[i]
+                      << ") = " << expected << ", reference "
+                      << fix16_sdiv_ref(a[i], b[i]) << std::endl;
+        }
+    }
+
+    for (int n = 0; n < 40; n++) {
+        if (fix16_average_array(a.data(), n) != fix16_average_ref(a.data(), n) &&
+            errors++ < 10) {
+            std::cout << "average of " << n << " elements" << std::endl;
+        }
+    }
+    if (fix16_average_array(a.data(), len) != fix16_average_ref(a.data(), len)) {
+        errors++;
+    }
+
+    std::cout << "Vector kernel check: " << errors << " errors" << std::endl;
+    return errors;
+}
+
 int main(int argc, const char* argv[]) {
+    if (check_vector_kernels() != 0) {
+        return 1;
+    }
+
     const int arr_len = 10000;
     const int loop_count = 10000;
     std::vector<fix16_t> v_fixed = create_random_array<fix16_t>(
@@ -184,5 +271,72 @@ int main(int argc, const char* argv[]) {
         std::cout << "Fix point average sum is " << fix16_to_float(sum)
                   << std::endl;
     }
+    {
+        measure_time m("vectorized fix-point average");
+        fix16_t sum = fix16_from_int(0);
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_fixed[0], v_fixed[1]);
+            sum += fix16_average_array(v_fixed.data(), v_fixed.size());
+        }
+        std::cout << "Vectorized fix point average sum is "
+                  << fix16_to_float(sum) << std::endl;
+    }
+
+    // The same divisions by the length, element by element, into an array.
+    std::vector<float> out_float(arr_len);
+    std::vector<fix16_t> out_fixed(arr_len);
+    std::vector<fix16_t> len_fixed(arr_len, fix16_from_int(arr_len));
+    {
+        measure_time m("float divide array");
+        float len = arr_len;
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_float[0], v_float[1]);
+            for (int j = 0; j < arr_len; j++) {
+                out_float[j] = v_float[j] / len;
+            }
+        }
+        std::cout << "Float divide array " << out_float[0] << std::endl;
+    }
+    {
+        measure_time m("fix-point divide array");
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_fixed[0], v_fixed[1]);
+            for (int j = 0; j < arr_len; j++) {
+                out_fixed[j] = fix16_div(v_fixed[j], len_fixed[j]);
+            }
+        }
+        std::cout << "Fix point divide array " << fix16_to_float(out_fixed[0])
+                  << std::endl;
+    }
+    {
+        measure_time m("vectorized fix-point divide array");
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_fixed[0], v_fixed[1]);
+            fix16_div_array(v_fixed.data(), len_fixed.data(), out_fixed.data(),
+                            arr_len);
+        }
+        std::cout << "Vectorized fix point divide array "
+                  << fix16_to_float(out_fixed[0]) << std::endl;
+    }
+    {
+        measure_time m("float multiply array");
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_float[0], v_float[1]);
+            for (int j = 0; j < arr_len; j++) {
+                out_float[j] = v_float[j] * v_float[j];
+            }
+        }
+        std::cout << "Float multiply array " << out_float[0] << std::endl;
+    }
+    {
+        measure_time m("vectorized fix-point multiply array");
+        for (int i = 0; i < loop_count; i++) {
+            std::swap(v_fixed[0], v_fixed[1]);
+            fix16_mul_array(v_fixed.data(), v_fixed.data(), out_fixed.data(),
+                            arr_len);
+        }
+        std::cout << "Vectorized fix point multiply array "
+                  << fix16_to_float(out_fixed[0]) << std::endl;
+    }
     return 0;
 }
\ No newline at end of file
@@ -3,29 +3,18 @@
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <limits>
 
-namespace jsl {
-
-struct simple_hasher {
-    size_t m_limit;
-    void set_limit(size_t limit) { m_limit = limit; }
-    size_t limit_input(size_t val) { return val % m_limit; }
-    size_t limit_input(size_t val, size_t limit) { return val % m_limit; }
-};
+#include "common/hashers.h"
 
-struct shift_hasher {
-    size_t m_limit;
-    void set_limit(size_t limit) { m_limit = limit - 1; }
-    size_t limit_input(size_t val) { return (val & m_limit); }
-    size_t limit_input(size_t val, size_t limit) { return (val & (limit - 1)); }
-};
+namespace jsl {
 
 template <typename T, typename F = shift_hasher>
 class hash_map {
    public:
     hash_map(size_t capacity)
         : m_log_size(next_pow2_log(capacity)),
-          m_size(1 << m_log_size),
+          m_size(F::table_size(size_t(1) << m_log_size)),
           m_used(0),
           m_used_and_deleted(0),
           m_rehashing_threshhold(m_size * 0.7) {
@@ -195,8 +184,11 @@ class hash_map {
         return capacity <= 16 ? 4 : (64 - __builtin_clzl(capacity - 1));
     }
 
-    size_t get_free_entry(char* value_used_array, int len, T* value) {
-        size_t entry = m_limiter.limit_input(m_hasher(*value), len);
+    size_t get_free_entry(char* value_used_array,
+                          size_t len,
+                          F& limiter,
+                          T* value) {
+        size_t entry = limiter.limit_input(m_hasher(*value));
 
         // We guarantee that there will always be a place for a new item,
         // because we regrow it before it is full
@@ -216,7 +208,9 @@ class hash_map {
 
     void grow_and_rehash(size_t log_new_size) {
         assert(log_new_size >= m_log_size);
-        size_t new_size = 1 << log_new_size;
+        size_t new_size = F::table_size(size_t(1) << log_new_size);
+        F new_limiter;
+        new_limiter.set_limit(new_size);
 
         size_t count = 0;
         char* new_values = nullptr;
@@ -232,8 +226,8 @@ class hash_map {
 
         for (int i = 0; i < m_size; i++) {
             if (m_value_used[i] == BUCKET_USED) {
-                size_t entry =
-                    get_free_entry(new_values_used, new_size, get(m_values, i));
+                size_t entry = get_free_entry(new_values_used, new_size,
+                                              new_limiter, get(m_values, i));
 
                 new_values_used[entry] = BUCKET_USED;
                 std::memcpy(&new_values[entry * sizeof(T)],
@@ -252,7 +246,7 @@ class hash_map {
         m_used = count;
         m_used_and_deleted = count;
         m_rehashing_threshhold = m_size * 0.7;
-        m_limiter.set_limit(m_size);
+        m_limiter = new_limiter;
     }
 };
 
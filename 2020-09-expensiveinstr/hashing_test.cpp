@@ -7,7 +7,7 @@
 using namespace jsl;
 using namespace argparse;
 
-enum hash_type_e { SIMPLE, SHIFT };
+enum hash_type_e { SIMPLE, SHIFT, PRIME, LIBDIVIDE, FASTMOD };
 
 bool parse_args(int argc,
                 const char* argv[],
@@ -16,7 +16,9 @@ bool parse_args(int argc,
     ArgumentParser parser("test123", "123");
 
     parser.add_argument("-h", "--hash",
-                        "Type of the hash function (simple, shift)", true);
+                        "Type of the hash function (simple, shift, prime, "
+                        "libdivide, fastmod)",
+                        true);
     parser.add_argument("-s", "--size", "Size of the hash map (s, m, l)", true);
 
     auto err = parser.parse(argc, argv);
@@ -32,6 +34,12 @@ bool parse_args(int argc,
             out_hash_type = hash_type_e::SIMPLE;
         } else if (hash_type == "shift") {
             out_hash_type = hash_type_e::SHIFT;
+        } else if (hash_type == "prime") {
+            out_hash_type = hash_type_e::PRIME;
+        } else if (hash_type == "libdivide") {
+            out_hash_type = hash_type_e::LIBDIVIDE;
+        } else if (hash_type == "fastmod") {
+            out_hash_type = hash_type_e::FASTMOD;
         } else {
             std::cout << "Unknown value for --hash\n";
             return false;
@@ -102,6 +110,12 @@ int main(int argc, const char* argv[]) {
         found = run_test<simple_hasher, int>(size);
     } else if (hash_type == hash_type_e::SHIFT) {
         found = run_test<shift_hasher, int>(size);
+    } else if (hash_type == hash_type_e::PRIME) {
+        found = run_test<prime_hasher, int>(size);
+    } else if (hash_type == hash_type_e::LIBDIVIDE) {
+        found = run_test<libdivide_hasher, int>(size);
+    } else if (hash_type == hash_type_e::FASTMOD) {
+        found = run_test<fastmod_hasher, int>(size);
     }
 
     std::cout << "Found " << found << std::endl;
@@ -0,0 +1,343 @@
+// Locks that scale better than spinlock under contention.
+//
+// spinlock (spinlock.h) lets all waiters spin on the same cache line, so
+// every release sends that line to every waiter, and the thread that wins is
+// whichever gets the line first. The locks below fix one or both problems:
+//
+//  - ticket_lock: a thread takes a ticket and waits until it is served.
+//    First come, first served; the waiters still share the line of the
+//    counter being served, but only read it, and back off in proportion to
+//    their distance from the front of the queue.
+//  - mcs_lock: waiters form a linked queue and each spins on a flag in its
+//    own node; a release writes only the successor's flag.
+//  - clh_lock: the same queue linked the other way: each waiter spins on its
+//    predecessor's node, and takes that node over after the release.
+//  - futex_mutex: spins for a short while and then sleeps in the kernel,
+//    like std::mutex but with a bounded adaptive spin phase first.
+//  - rw_lock: readers increment one of several reader counters on separate
+//    cache lines, picked by the CPU a thread first ran on, so readers do not
+//    contend with each other. A writer raises a flag and waits until all
+//    counters are zero; readers that see the flag back off, so writers are
+//    not starved.
+//
+// All of them are BasicLockable (rw_lock also has lock_shared() and
+// unlock_shared()) and work with std::lock_guard. mcs_lock and clh_lock keep
+// the queue nodes of a thread in thread-local storage; a thread can hold up
+// to MAX_NESTED_LOCKS of them at the same time and has to release them in
+// reverse order.
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <emmintrin.h>
+
+static constexpr int CACHE_LINE_SIZE = 64;
+static constexpr int MAX_NESTED_LOCKS = 8;
+
+static inline void futex_wait(std::atomic<int>* addr, int expected) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE,
+            expected, nullptr, nullptr, 0);
+}
+
+static inline void futex_wake(std::atomic<int>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, count,
+            nullptr, nullptr, 0);
+}
+
+// Spins with PAUSE, and gives the core away now and then in case the thread
+// being waited for is not running.
+struct spin_wait {
+    static constexpr int YIELD_TIMEOUT = 1000;
+    int count = 0;
+
+    void pause(int times = 1) {
+        for (int i = 0; i < times; i++) {
+            _mm_pause();
+        }
+        count += times;
+        if (count >= YIELD_TIMEOUT) {
+            count = 0;
+            std::this_thread::yield();
+        }
+    }
+};
+
+struct ticket_lock {
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned> next_ticket = {0};
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned> now_serving = {0};
+
+    void lock() noexcept {
+        unsigned ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+        spin_wait w;
+        for (;;) {
+            unsigned serving = now_serving.load(std::memory_order_acquire);
+            if (serving == ticket) {
+                return;
+            }
+            // Threads further back in the queue look less often.
+            w.pause(static_cast<int>(ticket - serving) * 16);
+        }
+    }
+
+    bool try_lock() noexcept {
+        unsigned serving = now_serving.load(std::memory_order_relaxed);
+        unsigned expected = serving;
+        return next_ticket.compare_exchange_strong(expected, serving + 1,
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept {
+        unsigned serving = now_serving.load(std::memory_order_relaxed);
+        now_serving.store(serving + 1, std::memory_order_release);
+    }
+};
+
+struct alignas(CACHE_LINE_SIZE) mcs_node {
+    std::atomic<mcs_node*> next;
+    std::atomic<bool> locked;
+};
+
+struct mcs_lock {
+    alignas(CACHE_LINE_SIZE) std::atomic<mcs_node*> tail = {nullptr};
+    mcs_node* holder = nullptr;  // Written by the holder only.
+
+    void lock() noexcept {
+        mcs_node* node = push_node();
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->locked.store(true, std::memory_order_relaxed);
+
+        mcs_node* prev = tail.exchange(node, std::memory_order_acq_rel);
+        if (prev != nullptr) {
+            prev->next.store(node, std::memory_order_release);
+            spin_wait w;
+            while (node->locked.load(std::memory_order_acquire)) {
+                w.pause();
+            }
+        }
+        holder = node;
+    }
+
+    void unlock() noexcept {
+        mcs_node* node = holder;
+        mcs_node* next = node->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            // No successor yet: try to mark the queue empty.
+            mcs_node* expected = node;
+            if (tail.compare_exchange_strong(expected, nullptr,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+                pop_node();
+                return;
+            }
+            // A successor is between its exchange and linking itself in.
+            spin_wait w;
+            while ((next = node->next.load(std::memory_order_acquire)) ==
+                   nullptr) {
+                w.pause();
+            }
+        }
+        next->locked.store(false, std::memory_order_release);
+        pop_node();
+    }
+
+   private:
+    struct node_stack {
+        mcs_node nodes[MAX_NESTED_LOCKS];
+        int depth = 0;
+    };
+
+    static node_stack& nodes() {
+        static thread_local node_stack stack;
+        return stack;
+    }
+
+    static mcs_node* push_node() {
+        node_stack& s = nodes();
+        return &s.nodes[s.depth++];
+    }
+
+    static void pop_node() { nodes().depth--; }
+};
+
+// Padded rather than aligned: plain new does not honour alignas in C++11.
+struct clh_node {
+    std::atomic<bool> locked;
+    char padding[CACHE_LINE_SIZE - sizeof(std::atomic<bool>)];
+};
+
+struct clh_lock {
+    alignas(CACHE_LINE_SIZE) std::atomic<clh_node*> tail;
+    clh_node* holder = nullptr;       // Written by the holder only.
+    clh_node* predecessor = nullptr;  // Ditto.
+
+    clh_lock() {
+        clh_node* dummy = new clh_node;
+        dummy->locked.store(false, std::memory_order_relaxed);
+        tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    ~clh_lock() { delete tail.load(std::memory_order_relaxed); }
+
+    clh_lock(const clh_lock&) = delete;
+    clh_lock& operator=(const clh_lock&) = delete;
+
+    void lock() noexcept {
+        clh_node* node = free_nodes().take();
+        node->locked.store(true, std::memory_order_relaxed);
+        clh_node* prev = tail.exchange(node, std::memory_order_acq_rel);
+        spin_wait w;
+        while (prev->locked.load(std::memory_order_acquire)) {
+            w.pause();
+        }
+        holder = node;
+        predecessor = prev;
+    }
+
+    void unlock() noexcept {
+        clh_node* node = holder;
+        // Nobody else uses the predecessor's node any more; the own node now
+        // belongs to the successor (or to the lock, as its tail).
+        free_nodes().give(predecessor);
+        node->locked.store(false, std::memory_order_release);
+    }
+
+   private:
+    struct node_pool {
+        std::vector<clh_node*> nodes;
+
+        clh_node* take() {
+            if (nodes.empty()) {
+                return new clh_node;
+            }
+            clh_node* n = nodes.back();
+            nodes.pop_back();
+            return n;
+        }
+
+        void give(clh_node* n) { nodes.push_back(n); }
+
+        ~node_pool() {
+            for (clh_node* n : nodes) {
+                delete n;
+            }
+        }
+    };
+
+    static node_pool& free_nodes() {
+        static thread_local node_pool pool;
+        return pool;
+    }
+};
+
+// 0: unlocked, 1: locked, 2: locked and a thread may be sleeping
+// (Drepper, "Futexes Are Tricky").
+struct futex_mutex {
+    static constexpr int SPIN_COUNT = 100;
+    std::atomic<int> state = {0};
+
+    void lock() noexcept {
+        int c = 0;
+        if (state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+            return;
+        }
+        // Spin while the holder is likely to release soon.
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            _mm_pause();
+            c = 0;
+            if (state.load(std::memory_order_relaxed) == 0 &&
+                state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        // Announce a sleeper; whoever takes the lock from here on leaves it
+        // at 2, so the next unlock wakes someone.
+        if (c != 2) {
+            c = state.exchange(2, std::memory_order_acquire);
+        }
+        while (c != 0) {
+            futex_wait(&state, 2);
+            c = state.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    bool try_lock() noexcept {
+        int c = 0;
+        return state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    void unlock() noexcept {
+        if (state.exchange(0, std::memory_order_release) == 2) {
+            futex_wake(&state, 1);
+        }
+    }
+};
+
+struct rw_lock {
+    static constexpr int READER_SLOTS = 64;
+
+    struct alignas(CACHE_LINE_SIZE) reader_counter {
+        std::atomic<int> count = {0};
+    };
+
+    reader_counter readers[READER_SLOTS];
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> writer = {false};
+    futex_mutex writer_mutex;
+
+    void lock_shared() noexcept {
+        std::atomic<int>& count = readers[reader_slot()].count;
+        spin_wait w;
+        for (;;) {
+            count.fetch_add(1, std::memory_order_seq_cst);
+            if (!writer.load(std::memory_order_seq_cst)) {
+                return;
+            }
+            // A writer is waiting or inside: let it go first.
+            count.fetch_sub(1, std::memory_order_relaxed);
+            while (writer.load(std::memory_order_relaxed)) {
+                w.pause();
+            }
+        }
+    }
+
+    void unlock_shared() noexcept {
+        readers[reader_slot()].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock() noexcept {
+        writer_mutex.lock();
+        writer.store(true, std::memory_order_seq_cst);
+        spin_wait w;
+        for (int i = 0; i < READER_SLOTS; i++) {
+            while (readers[i].count.load(std::memory_order_seq_cst) != 0) {
+                w.pause();
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    void unlock() noexcept {
+        writer.store(false, std::memory_order_release);
+        writer_mutex.unlock();
+    }
+
+   private:
+    // Fixed per thread, so unlock_shared() finds the counter lock_shared()
+    // used even if the thread has moved to another CPU since.
+    static int reader_slot() {
+        static thread_local int slot = -1;
+        if (slot < 0) {
+            int cpu = sched_getcpu();
+            slot = (cpu < 0 ? 0 : cpu) % READER_SLOTS;
+        }
+        return slot;
+    }
+};
@@ -1,6 +1,10 @@
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <mutex>
+#include <pthread.h>
 #include <thread>
+#include "locks.h"
 #include "measure_time.h"
 #include "spinlock.h"
 #include "utils.h"
@@ -12,6 +16,161 @@ struct accum {
     int padding[31];
 };
 
+// How long every lock runs for each thread count.
+static constexpr int LOCK_BENCHMARK_MS = 500;
+// Every LATENCY_SAMPLE_RATE-th acquisition is timed.
+static constexpr int LATENCY_SAMPLE_RATE = 8;
+// Every WRITE_RATE-th access in the read-mostly test is a write.
+static constexpr int WRITE_RATE = 64;
+
+// Gives a plain lock the rw_lock interface; readers take it exclusively.
+template <typename Lock>
+struct exclusive_only {
+    Lock l;
+    void lock() { l.lock(); }
+    void unlock() { l.unlock(); }
+    void lock_shared() { l.lock(); }
+    void unlock_shared() { l.unlock(); }
+};
+
+struct pthread_rw_lock {
+    pthread_rwlock_t l = PTHREAD_RWLOCK_INITIALIZER;
+    void lock() { pthread_rwlock_wrlock(&l); }
+    void unlock() { pthread_rwlock_unlock(&l); }
+    void lock_shared() { pthread_rwlock_rdlock(&l); }
+    void unlock_shared() { pthread_rwlock_unlock(&l); }
+};
+
+static uint32_t percentile(std::vector<uint32_t>& v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t k = std::min(v.size() - 1, static_cast<size_t>(v.size() * p));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// Runs num_threads threads for LOCK_BENCHMARK_MS. Each thread takes the lock
+// in a loop with a short critical section; with read_mostly, all but every
+// WRITE_RATE-th access take the shared side. Prints acquisitions per second
+// and the time to acquire the lock: median, 99th and 99.9th percentile.
+template <typename Lock>
+void benchmark_lock(const char* name, int num_threads, bool read_mostly) {
+    typedef std::chrono::steady_clock clock;
+    Lock l;
+    std::atomic<bool> start = {false};
+    std::atomic<bool> stop = {false};
+    uint64_t protected_count = 0;
+    volatile uint64_t shared_data = 0;
+    std::vector<uint64_t> acquisitions(num_threads);
+    std::vector<uint64_t> writes(num_threads);
+    std::vector<std::vector<uint32_t>> latencies(num_threads);
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    auto f = [&](int thread_id) {
+        std::vector<uint32_t>& lat = latencies[thread_id];
+        uint64_t count = 0;
+        uint64_t written = 0;
+        while (!start.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        while (!stop.load(std::memory_order_relaxed)) {
+            bool sample = count % LATENCY_SAMPLE_RATE == 0;
+            bool write = !read_mostly || count % WRITE_RATE == 0;
+            clock::time_point t0;
+            if (sample) {
+                t0 = clock::now();
+            }
+            if (write) {
+                l.lock();
+            } else {
+                l.lock_shared();
+            }
+            if (sample) {
+                lat.push_back(static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - t0)
+                        .count()));
+            }
+            if (write) {
+                protected_count++;
+                shared_data = shared_data + 1;
+                written++;
+                l.unlock();
+            } else {
+                uint64_t tmp = shared_data;
+                (void)tmp;
+                l.unlock_shared();
+            }
+            count++;
+        }
+        acquisitions[thread_id] = count;
+        writes[thread_id] = written;
+    };
+
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(f, i);
+    }
+    clock::time_point begin = clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOCK_BENCHMARK_MS));
+    stop.store(true, std::memory_order_relaxed);
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].join();
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+
+    uint64_t total = 0, total_writes = 0;
+    std::vector<uint32_t> all;
+    for (int i = 0; i < num_threads; i++) {
+        total += acquisitions[i];
+        total_writes += writes[i];
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    if (total_writes != protected_count) {
+        std::cout << "FAIL: " << name << " let " << total_writes
+                  << " writes through but counted " << protected_count
+                  << std::endl;
+    }
+
+    std::cout << name << ", threads = " << num_threads
+              << ", acquisitions/s = " << static_cast<uint64_t>(total / seconds)
+              << ", latency p50 = " << percentile(all, 0.5)
+              << " ns, p99 = " << percentile(all, 0.99)
+              << " ns, p99.9 = " << percentile(all, 0.999) << " ns"
+              << std::endl;
+}
+
+// Acquisitions per second and tail latency of every lock for 1, 2, 4, ...
+// threads up to the number of cores. More threads than cores are left out:
+// the queue locks hand the lock over in order, and a waiter that is not
+// running stalls everybody behind it.
+static void run_lock_benchmarks() {
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads);
+
+    for (int t : thread_counts) {
+        benchmark_lock<exclusive_only<std::mutex>>("std::mutex", t, false);
+        benchmark_lock<exclusive_only<spinlock>>("spinlock", t, false);
+        benchmark_lock<exclusive_only<ticket_lock>>("ticket_lock", t, false);
+        benchmark_lock<exclusive_only<mcs_lock>>("mcs_lock", t, false);
+        benchmark_lock<exclusive_only<clh_lock>>("clh_lock", t, false);
+        benchmark_lock<exclusive_only<futex_mutex>>("futex_mutex", t, false);
+    }
+
+    for (int t : thread_counts) {
+        benchmark_lock<exclusive_only<std::mutex>>("Read-mostly, std::mutex", t,
+                                                   true);
+        benchmark_lock<pthread_rw_lock>("Read-mostly, pthread_rwlock", t, true);
+        benchmark_lock<rw_lock>("Read-mostly, rw_lock", t, true);
+    }
+}
+
 int main(int argc, char* argv[]) {
     std::vector<int> v = create_random_array<int>(100 * MB, 0, 100 * MB);
     int num_threads = 4;  // std::thread::hardware_concurrency();
@@ -272,5 +431,7 @@ int main(int argc, char* argv[]) {
         std::cout << "Result = " << res << std::endl;
     }
 
+    run_lock_benchmarks();
+
     return 0;
 }
\ No newline at end of file
@@ -1,9 +1,27 @@
 #include <cstring>
 #include "measure_time.h"
+#include "scan.h"
 #include "utils.h"
 
 static constexpr int MB = 1024 * 1024;
 
+static int checksum(const std::vector<int>& result) {
+    int res = 0;
+    for (int i = 0; i < result.size(); i++) {
+        res += result[i];
+    }
+    return res;
+}
+
+static void check(const char* name,
+                  const std::vector<int>& result,
+                  const std::vector<int>& expected) {
+    std::cout << "Result = " << checksum(result) << std::endl;
+    if (result != expected) {
+        std::cout << "FAIL: " << name << " differs from the serial version\n";
+    }
+}
+
 int main(int argc, char** argv) {
     std::vector<int> v = create_random_array<int>(100 * MB, 0, 100 * MB);
     std::vector<int> result(100 * MB, 0);
@@ -69,5 +87,67 @@ int main(int argc, char** argv) {
 
     std::cout << "Result = " << res << std::endl;
 
+    // The scan library: the same inclusive scan, and the other kinds of scan
+    // compared against plain loops.
+    std::vector<int> expected(result.size());
+    expected[0] = v[0];
+    for (int i = 1; i < v.size(); i++) {
+        expected[i] = expected[i - 1] + v[i];
+    }
+
+    {
+        measure_time m("Serial AVX2 prefix sums");
+        serial_inclusive_scan(v.data(), result.data(), v.size());
+    }
+    check("Serial AVX2 prefix sums", result, expected);
+
+    {
+        measure_time m("Blocked parallel prefix sums");
+        parallel_inclusive_scan(v.data(), result.data(), v.size());
+    }
+    check("Blocked parallel prefix sums", result, expected);
+
+    {
+        measure_time m("Blocked parallel prefix sums in place");
+        std::copy(v.begin(), v.end(), result.begin());
+        parallel_inclusive_scan(result.data(), result.data(), result.size());
+    }
+    check("Blocked parallel prefix sums in place", result, expected);
+
+    expected[0] = 0;
+    for (int i = 1; i < v.size(); i++) {
+        expected[i] = expected[i - 1] + v[i - 1];
+    }
+    {
+        measure_time m("Blocked parallel exclusive prefix sums");
+        parallel_exclusive_scan(v.data(), result.data(), v.size());
+    }
+    check("Blocked parallel exclusive prefix sums", result, expected);
+
+    expected[0] = v[0];
+    for (int i = 1; i < v.size(); i++) {
+        expected[i] = std::max(expected[i - 1], v[i]);
+    }
+    {
+        measure_time m("Blocked parallel running maximum");
+        parallel_inclusive_scan(v.data(), result.data(), v.size(), scan_max());
+    }
+    check("Blocked parallel running maximum", result, expected);
+
+    // Segments of random length, on average 1000 elements.
+    std::vector<uint8_t> flags(v.size());
+    for (int i = 0; i < v.size(); i++) {
+        flags[i] = i == 0 || v[i] % 1000 == 0;
+    }
+    for (int i = 0; i < v.size(); i++) {
+        expected[i] = flags[i] ? v[i] : expected[i - 1] + v[i];
+    }
+    {
+        measure_time m("Blocked parallel segmented prefix sums");
+        parallel_segmented_scan(v.data(), flags.data(), result.data(),
+                                v.size());
+    }
+    check("Blocked parallel segmented prefix sums", result, expected);
+
     return 0;
 }
\ No newline at end of file
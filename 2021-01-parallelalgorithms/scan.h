@@ -0,0 +1,376 @@
+// Prefix sums (scans) over large arrays, multi-threaded with OpenMP.
+//
+// The parallel scans are blocked two-pass scans. The input is cut into
+// super-blocks of SCAN_BLOCK elements per thread, and for each super-block:
+//  1. every thread reduces its block to a single value,
+//  2. every thread combines the carry of the previous super-blocks with the
+//     values of the threads before it, which gives the starting value of its
+//     block (an exclusive scan of the block values),
+//  3. every thread scans its block starting from that value.
+// A block is small enough to stay in the L2 cache between the first and the
+// third step, so the input is read from memory once and the output written
+// once, the same traffic as the serial loop. For large arrays the scan is
+// limited by memory bandwidth, not by the additions.
+//
+// The operators are any associative function object with an identity:
+//
+//     struct my_op {
+//         template <typename T> T operator()(T a, T b) const;
+//         template <typename T> static T identity();
+//     };
+//
+// scan_plus, scan_max and scan_min are provided. For int32_t with those three
+// the blocks are scanned and reduced with AVX2: a scan of eight lanes in a
+// register takes three shift-and-add steps, then the carry of the previous
+// vector is broadcast and added. Other types and operators use scalar loops.
+// Floating-point addition is not associative, so a parallel float sum can
+// differ from the serial one in the last bits.
+//
+// The segmented scan restarts at every element whose flag is non-zero.
+//
+// in and out may be the same array.
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <omp.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+struct scan_plus {
+    template <typename T>
+    T operator()(T a, T b) const {
+        return a + b;
+    }
+    template <typename T>
+    static T identity() {
+        return T(0);
+    }
+};
+
+struct scan_max {
+    template <typename T>
+    T operator()(T a, T b) const {
+        return std::max(a, b);
+    }
+    template <typename T>
+    static T identity() {
+        return std::numeric_limits<T>::lowest();
+    }
+};
+
+struct scan_min {
+    template <typename T>
+    T operator()(T a, T b) const {
+        return std::min(a, b);
+    }
+    template <typename T>
+    static T identity() {
+        return std::numeric_limits<T>::max();
+    }
+};
+
+// Elements per thread in a super-block: 128 kB of int32_t.
+static constexpr size_t SCAN_BLOCK = 32 * 1024;
+
+// Below this many elements the scans run on the calling thread.
+static constexpr size_t SCAN_SERIAL_SIZE = 64 * 1024;
+
+// The AVX2 versions of the operators, for int32_t.
+template <typename Op>
+struct scan_simd {
+    static constexpr bool available = false;
+};
+
+#ifdef __AVX2__
+template <>
+struct scan_simd<scan_plus> {
+    static constexpr bool available = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+    static __m256i identity() { return _mm256_setzero_si256(); }
+};
+
+template <>
+struct scan_simd<scan_max> {
+    static constexpr bool available = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+    static __m256i identity() {
+        return _mm256_set1_epi32(std::numeric_limits<int32_t>::lowest());
+    }
+};
+
+template <>
+struct scan_simd<scan_min> {
+    static constexpr bool available = true;
+    static __m256i apply(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+    static __m256i identity() {
+        return _mm256_set1_epi32(std::numeric_limits<int32_t>::max());
+    }
+};
+
+// Inclusive scan of the eight lanes of x.
+template <typename V>
+static inline __m256i scan_register(__m256i x, __m256i id) {
+    // Within each 128-bit half: shift by one and by two lanes, filling the
+    // lanes shifted in with the identity.
+    x = V::apply(x, _mm256_blend_epi32(_mm256_slli_si256(x, 4), id, 0x11));
+    x = V::apply(x, _mm256_blend_epi32(_mm256_slli_si256(x, 8), id, 0x33));
+    // The last lane of the low half into every lane of the high half.
+    __m256i low = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(3));
+    return V::apply(x, _mm256_blend_epi32(low, id, 0x0F));
+}
+#endif
+
+template <typename T, typename Op>
+using scan_use_simd =
+    std::integral_constant<bool,
+                           std::is_same<T, int32_t>::value &&
+                               scan_simd<Op>::available>;
+
+template <typename T, typename Op>
+T scan_reduce_block(const T* in, size_t n, Op op, std::false_type) {
+    T acc = Op::template identity<T>();
+    for (size_t i = 0; i < n; i++) {
+        acc = op(acc, in[i]);
+    }
+    return acc;
+}
+
+// Scans in[0, n) starting from carry and returns the value after the last
+// element. The exclusive scan writes the value before each element.
+template <typename T, typename Op>
+T scan_block(const T* in,
+             T* out,
+             size_t n,
+             Op op,
+             T carry,
+             bool exclusive,
+             std::false_type) {
+    for (size_t i = 0; i < n; i++) {
+        T next = op(carry, in[i]);
+        out[i] = exclusive ? carry : next;
+        carry = next;
+    }
+    return carry;
+}
+
+#ifdef __AVX2__
+template <typename T, typename Op>
+T scan_reduce_block(const T* in, size_t n, Op op, std::true_type) {
+    typedef scan_simd<Op> V;
+    __m256i acc0 = V::identity(), acc1 = V::identity();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = V::apply(acc0, _mm256_loadu_si256((const __m256i*)(in + i)));
+        acc1 = V::apply(acc1, _mm256_loadu_si256((const __m256i*)(in + i + 8)));
+    }
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256((__m256i*)lanes, V::apply(acc0, acc1));
+    T acc = Op::template identity<T>();
+    for (int l = 0; l < 8; l++) {
+        acc = op(acc, lanes[l]);
+    }
+    for (; i < n; i++) {
+        acc = op(acc, in[i]);
+    }
+    return acc;
+}
+
+template <typename T, typename Op>
+T scan_block(const T* in,
+             T* out,
+             size_t n,
+             Op op,
+             T carry,
+             bool exclusive,
+             std::true_type) {
+    typedef scan_simd<Op> V;
+    const __m256i id = V::identity();
+    const __m256i last = _mm256_set1_epi32(7);
+    const __m256i rotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+    __m256i vcarry = _mm256_set1_epi32(carry);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = scan_register<V>(
+            _mm256_loadu_si256((const __m256i*)(in + i)), id);
+        __m256i result;
+        if (exclusive) {
+            // Every lane gets the inclusive value of the lane before it.
+            __m256i shifted = _mm256_permutevar8x32_epi32(x, rotate);
+            result = V::apply(vcarry, _mm256_blend_epi32(shifted, id, 0x01));
+        } else {
+            result = V::apply(vcarry, x);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), result);
+        vcarry = V::apply(vcarry, _mm256_permutevar8x32_epi32(x, last));
+    }
+
+    carry = _mm256_cvtsi256_si32(vcarry);
+    return scan_block(in + i, out + i, n - i, op, carry, exclusive,
+                      std::false_type());
+}
+#endif
+
+// The blocked two-pass scan on any carry type: reduce(begin, end) gives the
+// value of a range, combine(a, b) joins the values of two adjacent ranges and
+// scan(begin, end, carry) writes the output of a range.
+template <typename Carry, typename Reduce, typename Combine, typename Scan>
+void blocked_parallel_scan(size_t n,
+                           Carry identity,
+                           Reduce reduce,
+                           Combine combine,
+                           Scan scan,
+                           int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = omp_get_max_threads();
+    }
+    if (num_threads == 1 || n < SCAN_SERIAL_SIZE) {
+        scan(0, n, identity);
+        return;
+    }
+
+    std::vector<Carry> sums(num_threads, identity);
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        const size_t t = omp_get_thread_num();
+        const size_t nt = omp_get_num_threads();
+        const size_t super_block = SCAN_BLOCK * nt;
+        Carry carry = identity;
+
+        for (size_t base = 0; base < n; base += super_block) {
+            const size_t len = std::min(super_block, n - base);
+            const size_t begin = base + len * t / nt;
+            const size_t end = base + len * (t + 1) / nt;
+
+            sums[t] = reduce(begin, end);
+
+#pragma omp barrier
+
+            // Every thread does the small exclusive scan of the block values
+            // itself, instead of waiting for one thread to do it.
+            Carry offset = carry;
+            for (size_t i = 0; i < t; i++) {
+                offset = combine(offset, sums[i]);
+            }
+            Carry next = offset;
+            for (size_t i = t; i < nt; i++) {
+                next = combine(next, sums[i]);
+            }
+            carry = next;
+
+            scan(begin, end, offset);
+
+            // sums is overwritten in the next super-block.
+#pragma omp barrier
+        }
+    }
+}
+
+template <typename T, typename Op>
+void parallel_scan(const T* in,
+                   T* out,
+                   size_t n,
+                   Op op,
+                   bool exclusive,
+                   int num_threads) {
+    typedef scan_use_simd<T, Op> simd;
+    blocked_parallel_scan(
+        n, Op::template identity<T>(),
+        [=](size_t begin, size_t end) -> T {
+            return scan_reduce_block(in + begin, end - begin, op, simd());
+        },
+        op,
+        [=](size_t begin, size_t end, T carry) -> void {
+            scan_block(in + begin, out + begin, end - begin, op, carry,
+                       exclusive, simd());
+        },
+        num_threads);
+}
+
+// out[i] = in[0] op in[1] op ... op in[i]
+template <typename T, typename Op = scan_plus>
+void parallel_inclusive_scan(const T* in,
+                             T* out,
+                             size_t n,
+                             Op op = Op(),
+                             int num_threads = 0) {
+    parallel_scan(in, out, n, op, false, num_threads);
+}
+
+// out[0] = identity, out[i] = in[0] op ... op in[i - 1]
+template <typename T, typename Op = scan_plus>
+void parallel_exclusive_scan(const T* in,
+                             T* out,
+                             size_t n,
+                             Op op = Op(),
+                             int num_threads = 0) {
+    parallel_scan(in, out, n, op, true, num_threads);
+}
+
+// Single-threaded, with AVX2 where available.
+template <typename T, typename Op = scan_plus>
+void serial_inclusive_scan(const T* in, T* out, size_t n, Op op = Op()) {
+    scan_block(in, out, n, op, Op::template identity<T>(), false,
+               scan_use_simd<T, Op>());
+}
+
+template <typename T>
+struct segmented_carry {
+    T value;
+    bool restarted;  // The range contains the start of a segment.
+};
+
+// An inclusive scan that starts again at every i with flags[i] != 0:
+// out[i] = in[s] op ... op in[i], where s is the last start at or before i.
+template <typename T, typename Op = scan_plus>
+void parallel_segmented_scan(const T* in,
+                             const uint8_t* flags,
+                             T* out,
+                             size_t n,
+                             Op op = Op(),
+                             int num_threads = 0) {
+    typedef segmented_carry<T> carry_t;
+    const carry_t identity = {Op::template identity<T>(), false};
+
+    blocked_parallel_scan(
+        n, identity,
+        [=](size_t begin, size_t end) -> carry_t {
+            carry_t acc = identity;
+            for (size_t i = begin; i < end; i++) {
+                if (flags[i]) {
+                    acc.value = in[i];
+                    acc.restarted = true;
+                } else {
+                    acc.value = op(acc.value, in[i]);
+                }
+            }
+            return acc;
+        },
+        [=](carry_t a, carry_t b) -> carry_t {
+            if (b.restarted) {
+                return b;
+            }
+            carry_t r = {op(a.value, b.value), a.restarted};
+            return r;
+        },
+        [=](size_t begin, size_t end, carry_t carry) -> void {
+            T acc = carry.value;
+            for (size_t i = begin; i < end; i++) {
+                acc = flags[i] ? in[i] : op(acc, in[i]);
+                out[i] = acc;
+            }
+        },
+        num_threads);
+}
+
+#endif  // SCAN_H
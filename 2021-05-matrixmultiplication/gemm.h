@@ -0,0 +1,322 @@
+#pragma once
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// GotoBLAS-style GEMM, C = A * B (or C += A * B), on row-major matrices with
+// leading dimensions lda, ldb and ldc.
+//
+// The loops are blocked for the memory hierarchy:
+//   * NC columns of B: a KC x NC packed panel of B lives in L3
+//   * MC rows of A: a MC x KC packed block of A lives in L2
+//   * KC depth: one MR x KC micro-panel of A and one KC x NR micro-panel of B
+//     live in L1 while the microkernel streams through them
+// The microkernel keeps an MR x NR block of C in registers for the whole KC loop.
+//
+// Packing rearranges A into MR-row micro-panels (for each k, MR consecutive
+// values of one column) and B into NR-column micro-panels (for each k, NR
+// consecutive values of one row), both zero padded, so the microkernel reads
+// both operands sequentially and never needs edge checks.
+
+template <typename T>
+struct gemm_params {
+    static constexpr int MR = 4;
+    static constexpr int NR = 4;
+    static constexpr int MC = 64;
+    static constexpr int KC = 256;
+    static constexpr int NC = 1024;
+};
+
+template <>
+struct gemm_params<float> {
+    // 6 x 16 floats = 12 YMM accumulators, 2 B loads and 6 broadcasts per k.
+    // (6 + 16) * KC * 4 bytes = 22 kB of micro-panels in L1.
+    static constexpr int MR = 6;
+    static constexpr int NR = 16;
+    static constexpr int MC = 144;   // 144 x 256 x 4 = 144 kB A block in L2
+    static constexpr int KC = 256;
+    static constexpr int NC = 4080;  // 256 x 4080 x 4 = 4 MB B panel in L3
+};
+
+template <>
+struct gemm_params<double> {
+    // 6 x 8 doubles = 12 YMM accumulators.
+    // (6 + 8) * KC * 8 bytes = 28 kB of micro-panels in L1.
+    static constexpr int MR = 6;
+    static constexpr int NR = 8;
+    static constexpr int MC = 96;    // 96 x 256 x 8 = 192 kB A block in L2
+    static constexpr int KC = 256;
+    static constexpr int NC = 2040;  // 256 x 2040 x 8 = 4 MB B panel in L3
+};
+
+// Packs the mc x kc block of A starting at a into MR-row micro-panels.
+template <typename T>
+void gemm_pack_a(int mc, int kc, const T* a, int lda, T* a_packed) {
+    constexpr int MR = gemm_params<T>::MR;
+
+    for (int i = 0; i < mc; i += MR) {
+        int mr = std::min(MR, mc - i);
+        for (int k = 0; k < kc; k++) {
+            for (int ii = 0; ii < mr; ii++) {
+                a_packed[ii] = a[(i + ii) * lda + k];
+            }
+            for (int ii = mr; ii < MR; ii++) {
+                a_packed[ii] = T(0);
+            }
+            a_packed += MR;
+        }
+    }
+}
+
+// Packs the kc x nc block of B starting at b into NR-column micro-panels.
+template <typename T>
+void gemm_pack_b(int kc, int nc, const T* b, int ldb, T* b_packed) {
+    constexpr int NR = gemm_params<T>::NR;
+
+    for (int j = 0; j < nc; j += NR) {
+        int nr = std::min(NR, nc - j);
+        for (int k = 0; k < kc; k++) {
+            const T* b_k = b + k * ldb + j;
+            if (nr == NR) {
+                std::memcpy(b_packed, b_k, NR * sizeof(T));
+            } else {
+                for (int jj = 0; jj < nr; jj++) {
+                    b_packed[jj] = b_k[jj];
+                }
+                for (int jj = nr; jj < NR; jj++) {
+                    b_packed[jj] = T(0);
+                }
+            }
+            b_packed += NR;
+        }
+    }
+}
+
+// Computes the full MR x NR block c = (accumulate ? c : 0) + a_panel * b_panel.
+template <typename T>
+class gemm_micro_kernel {
+public:
+    static void run(int kc, const T* a, const T* b, T* c, int ldc, bool accumulate) {
+        constexpr int MR = gemm_params<T>::MR;
+        constexpr int NR = gemm_params<T>::NR;
+        T acc[MR][NR] = {};
+
+        for (int k = 0; k < kc; k++) {
+            for (int i = 0; i < MR; i++) {
+                for (int j = 0; j < NR; j++) {
+                    acc[i][j] += a[i] * b[j];
+                }
+            }
+            a += MR;
+            b += NR;
+        }
+
+        for (int i = 0; i < MR; i++) {
+            for (int j = 0; j < NR; j++) {
+                c[i * ldc + j] = accumulate ? c[i * ldc + j] + acc[i][j] : acc[i][j];
+            }
+        }
+    }
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+template <>
+class gemm_micro_kernel<float> {
+public:
+    static void run(int kc, const float* a, const float* b, float* c, int ldc, bool accumulate) {
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+        for (int k = 0; k < kc; k++) {
+            __m256 b0 = _mm256_load_ps(b);
+            __m256 b1 = _mm256_load_ps(b + 8);
+            __m256 a_i;
+
+            a_i = _mm256_broadcast_ss(a + 0);
+            c00 = _mm256_fmadd_ps(a_i, b0, c00);
+            c01 = _mm256_fmadd_ps(a_i, b1, c01);
+            a_i = _mm256_broadcast_ss(a + 1);
+            c10 = _mm256_fmadd_ps(a_i, b0, c10);
+            c11 = _mm256_fmadd_ps(a_i, b1, c11);
+            a_i = _mm256_broadcast_ss(a + 2);
+            c20 = _mm256_fmadd_ps(a_i, b0, c20);
+            c21 = _mm256_fmadd_ps(a_i, b1, c21);
+            a_i = _mm256_broadcast_ss(a + 3);
+            c30 = _mm256_fmadd_ps(a_i, b0, c30);
+            c31 = _mm256_fmadd_ps(a_i, b1, c31);
+            a_i = _mm256_broadcast_ss(a + 4);
+            c40 = _mm256_fmadd_ps(a_i, b0, c40);
+            c41 = _mm256_fmadd_ps(a_i, b1, c41);
+            a_i = _mm256_broadcast_ss(a + 5);
+            c50 = _mm256_fmadd_ps(a_i, b0, c50);
+            c51 = _mm256_fmadd_ps(a_i, b1, c51);
+
+            a += 6;
+            b += 16;
+        }
+
+        store_row(c + 0 * ldc, c00, c01, accumulate);
+        store_row(c + 1 * ldc, c10, c11, accumulate);
+        store_row(c + 2 * ldc, c20, c21, accumulate);
+        store_row(c + 3 * ldc, c30, c31, accumulate);
+        store_row(c + 4 * ldc, c40, c41, accumulate);
+        store_row(c + 5 * ldc, c50, c51, accumulate);
+    }
+
+private:
+    static void store_row(float* c, __m256 r0, __m256 r1, bool accumulate) {
+        if (accumulate) {
+            r0 = _mm256_add_ps(r0, _mm256_loadu_ps(c));
+            r1 = _mm256_add_ps(r1, _mm256_loadu_ps(c + 8));
+        }
+        _mm256_storeu_ps(c, r0);
+        _mm256_storeu_ps(c + 8, r1);
+    }
+};
+
+template <>
+class gemm_micro_kernel<double> {
+public:
+    static void run(int kc, const double* a, const double* b, double* c, int ldc, bool accumulate) {
+        __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+        __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+        __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+        __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+        __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+        __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+        for (int k = 0; k < kc; k++) {
+            __m256d b0 = _mm256_load_pd(b);
+            __m256d b1 = _mm256_load_pd(b + 4);
+            __m256d a_i;
+
+            a_i = _mm256_broadcast_sd(a + 0);
+            c00 = _mm256_fmadd_pd(a_i, b0, c00);
+            c01 = _mm256_fmadd_pd(a_i, b1, c01);
+            a_i = _mm256_broadcast_sd(a + 1);
+            c10 = _mm256_fmadd_pd(a_i, b0, c10);
+            c11 = _mm256_fmadd_pd(a_i, b1, c11);
+            a_i = _mm256_broadcast_sd(a + 2);
+            c20 = _mm256_fmadd_pd(a_i, b0, c20);
+            c21 = _mm256_fmadd_pd(a_i, b1, c21);
+            a_i = _mm256_broadcast_sd(a + 3);
+            c30 = _mm256_fmadd_pd(a_i, b0, c30);
+            c31 = _mm256_fmadd_pd(a_i, b1, c31);
+            a_i = _mm256_broadcast_sd(a + 4);
+            c40 = _mm256_fmadd_pd(a_i, b0, c40);
+            c41 = _mm256_fmadd_pd(a_i, b1, c41);
+            a_i = _mm256_broadcast_sd(a + 5);
+            c50 = _mm256_fmadd_pd(a_i, b0, c50);
+            c51 = _mm256_fmadd_pd(a_i, b1, c51);
+
+            a += 6;
+            b += 8;
+        }
+
+        store_row(c + 0 * ldc, c00, c01, accumulate);
+        store_row(c + 1 * ldc, c10, c11, accumulate);
+        store_row(c + 2 * ldc, c20, c21, accumulate);
+        store_row(c + 3 * ldc, c30, c31, accumulate);
+        store_row(c + 4 * ldc, c40, c41, accumulate);
+        store_row(c + 5 * ldc, c50, c51, accumulate);
+    }
+
+private:
+    static void store_row(double* c, __m256d r0, __m256d r1, bool accumulate) {
+        if (accumulate) {
+            r0 = _mm256_add_pd(r0, _mm256_loadu_pd(c));
+            r1 = _mm256_add_pd(r1, _mm256_loadu_pd(c + 4));
+        }
+        _mm256_storeu_pd(c, r0);
+        _mm256_storeu_pd(c + 4, r1);
+    }
+};
+
+#endif
+
+// Multiplies a packed mc x kc block of A with a packed kc x nc panel of B into C.
+// Partial tiles on the right and bottom edge go through a small stack buffer.
+template <typename T>
+void gemm_macro_kernel(int mc, int nc, int kc, const T* a_packed, const T* b_packed,
+                       T* c, int ldc, bool accumulate) {
+    constexpr int MR = gemm_params<T>::MR;
+    constexpr int NR = gemm_params<T>::NR;
+    alignas(64) T c_tmp[MR * NR];
+
+    for (int j = 0; j < nc; j += NR) {
+        int nr = std::min(NR, nc - j);
+        const T* b_panel = b_packed + j * kc;
+
+        for (int i = 0; i < mc; i += MR) {
+            int mr = std::min(MR, mc - i);
+            const T* a_panel = a_packed + i * kc;
+            T* c_ij = c + i * ldc + j;
+
+            if (mr == MR && nr == NR) {
+                gemm_micro_kernel<T>::run(kc, a_panel, b_panel, c_ij, ldc, accumulate);
+            } else {
+                gemm_micro_kernel<T>::run(kc, a_panel, b_panel, c_tmp, NR, false);
+                for (int ii = 0; ii < mr; ii++) {
+                    for (int jj = 0; jj < nr; jj++) {
+                        T v = c_tmp[ii * NR + jj];
+                        c_ij[ii * ldc + jj] = accumulate ? c_ij[ii * ldc + jj] + v : v;
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+T* gemm_allocate_packed(size_t count) {
+    size_t bytes = (count * sizeof(T) + 63) / 64 * 64;
+    return static_cast<T*>(aligned_alloc(64, bytes));
+}
+
+// C (m x n) = A (m x k) * B (k x n)
+template <typename T>
+void gemm(int m, int n, int k, const T* a, int lda, const T* b, int ldb, T* c, int ldc) {
+    constexpr int MR = gemm_params<T>::MR;
+    constexpr int NR = gemm_params<T>::NR;
+    constexpr int MC = gemm_params<T>::MC;
+    constexpr int KC = gemm_params<T>::KC;
+    constexpr int NC = gemm_params<T>::NC;
+    static_assert(MC % MR == 0, "MC must be a multiple of MR");
+    static_assert(NC % NR == 0, "NC must be a multiple of NR");
+
+    if (k == 0) {
+        for (int i = 0; i < m; i++) {
+            std::fill(c + i * ldc, c + i * ldc + n, T(0));
+        }
+        return;
+    }
+
+    T* a_packed = gemm_allocate_packed<T>(MC * KC);
+    T* b_packed = gemm_allocate_packed<T>(KC * (NC + NR));
+
+    for (int jc = 0; jc < n; jc += NC) {
+        int nc = std::min(NC, n - jc);
+        for (int pc = 0; pc < k; pc += KC) {
+            int kc = std::min(KC, k - pc);
+            gemm_pack_b(kc, nc, b + pc * ldb + jc, ldb, b_packed);
+
+            for (int ic = 0; ic < m; ic += MC) {
+                int mc = std::min(MC, m - ic);
+                gemm_pack_a(mc, kc, a + ic * lda + pc, lda, a_packed);
+                gemm_macro_kernel(mc, nc, kc, a_packed, b_packed, c + ic * ldc + jc, ldc, pc != 0);
+            }
+        }
+    }
+
+    free(a_packed);
+    free(b_packed);
+}
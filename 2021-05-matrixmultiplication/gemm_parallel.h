@@ -0,0 +1,135 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <omp.h>
+#include "gemm.h"
+
+// Multi-threaded version of gemm() from gemm.h. Threads are arranged in a
+// rows x cols grid and every thread owns one macro-tile of C, so no two
+// threads ever write the same element of C.
+//
+// For every (jc, pc) iteration all threads pack one KC x NC panel of B
+// together into a shared buffer (it stays in the shared L3). Each thread then
+// packs the MC x KC blocks of A for its own rows into a private buffer (which
+// stays in its private L2) and runs the macro kernel over its columns of the
+// shared B panel. A barrier separates the use of a B panel from the packing of
+// the next one.
+
+static inline void gemm_pin_thread_to_core(int core) {
+    static const int core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core % core_count, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+}
+
+// Picks the rows x cols factorization of num_threads whose macro-tiles are
+// closest to square for an m x n matrix C.
+static inline void gemm_thread_grid(int m, int n, int num_threads, int& grid_rows, int& grid_cols) {
+    grid_rows = num_threads;
+    grid_cols = 1;
+    double best = -1.0;
+
+    for (int r = 1; r <= num_threads; r++) {
+        if (num_threads % r != 0) {
+            continue;
+        }
+        int c = num_threads / r;
+        double tile_m = static_cast<double>(m) / r;
+        double tile_n = static_cast<double>(n) / c;
+        double ratio = tile_m < tile_n ? tile_m / tile_n : tile_n / tile_m;
+        if (ratio > best) {
+            best = ratio;
+            grid_rows = r;
+            grid_cols = c;
+        }
+    }
+}
+
+// Splits [0, total) into parts pieces aligned to granularity and returns the
+// index-th piece as [begin, end).
+static inline void gemm_split_range(int total, int parts, int index, int granularity,
+                                    int& begin, int& end) {
+    int units = (total + granularity - 1) / granularity;
+    int unit_begin = static_cast<int>(static_cast<long>(units) * index / parts);
+    int unit_end = static_cast<int>(static_cast<long>(units) * (index + 1) / parts);
+    begin = std::min(unit_begin * granularity, total);
+    end = std::min(unit_end * granularity, total);
+}
+
+// C (m x n) = A (m x k) * B (k x n), using num_threads threads, optionally pinned
+// so that thread i runs on core i.
+template <typename T>
+void gemm_parallel(int m, int n, int k, const T* a, int lda, const T* b, int ldb, T* c, int ldc,
+                   int num_threads, bool pin_threads = true) {
+    constexpr int MR = gemm_params<T>::MR;
+    constexpr int NR = gemm_params<T>::NR;
+    constexpr int MC = gemm_params<T>::MC;
+    constexpr int KC = gemm_params<T>::KC;
+    constexpr int NC = gemm_params<T>::NC;
+
+    if (num_threads <= 1 || k == 0) {
+        gemm(m, n, k, a, lda, b, ldb, c, ldc);
+        return;
+    }
+
+    int grid_rows, grid_cols;
+    gemm_thread_grid(m, n, num_threads, grid_rows, grid_cols);
+
+    T* b_packed = gemm_allocate_packed<T>(KC * (NC + NR));
+
+    // The calling thread becomes thread 0 of the team; its affinity is restored at the end.
+    cpu_set_t caller_cpu_set;
+    pthread_getaffinity_np(pthread_self(), sizeof(caller_cpu_set), &caller_cpu_set);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        if (pin_threads) {
+            gemm_pin_thread_to_core(tid);
+        }
+
+        int row_begin, row_end;
+        gemm_split_range(m, grid_rows, tid / grid_cols, MR, row_begin, row_end);
+
+        T* a_packed = gemm_allocate_packed<T>(MC * KC);
+
+        for (int jc = 0; jc < n; jc += NC) {
+            int nc = std::min(NC, n - jc);
+            int nc_panels = (nc + NR - 1) / NR;
+
+            int col_begin, col_end;
+            gemm_split_range(nc, grid_cols, tid % grid_cols, NR, col_begin, col_end);
+
+            for (int pc = 0; pc < k; pc += KC) {
+                int kc = std::min(KC, k - pc);
+
+                #pragma omp for schedule(static)
+                for (int p = 0; p < nc_panels; p++) {
+                    int nr = std::min(NR, nc - p * NR);
+                    gemm_pack_b(kc, nr, b + pc * ldb + jc + p * NR, ldb, b_packed + p * NR * kc);
+                }
+                // Implicit barrier: the whole B panel is packed.
+
+                if (col_begin < col_end) {
+                    for (int ic = row_begin; ic < row_end; ic += MC) {
+                        int mc = std::min(MC, row_end - ic);
+                        gemm_pack_a(mc, kc, a + ic * lda + pc, lda, a_packed);
+                        gemm_macro_kernel(mc, col_end - col_begin, kc, a_packed,
+                                          b_packed + col_begin * kc,
+                                          c + ic * ldc + jc + col_begin, ldc, pc != 0);
+                    }
+                }
+
+                #pragma omp barrier
+            }
+        }
+
+        free(a_packed);
+    }
+
+    pthread_setaffinity_np(pthread_self(), sizeof(caller_cpu_set), &caller_cpu_set);
+    free(b_packed);
+}
@@ -53,7 +53,7 @@ int main(int argc, char** argv) {
             LIKWID_MARKER_START(name.c_str());
             matrix<double>::multiply_interchanged(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -66,7 +66,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled<8>(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -78,7 +78,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled<12>(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -90,7 +90,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled<16>(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -102,7 +102,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled<32>(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -114,7 +114,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled<48>(out2, in1, in2);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -126,7 +126,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 8);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -138,7 +138,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 12);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -150,7 +150,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 24);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -162,7 +162,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 48);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -174,7 +174,7 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 60);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -186,7 +186,55 @@ int main(int argc, char** argv) {
             matrix<double>::multiply_tiled_avx(out2, in1, in2, 80);
             LIKWID_MARKER_STOP(name.c_str());
 
-            if (out1 != out2) {
+            if (!out1.approx_equal(out2, 1e-9)) {
+                std::cout << "MATRICES NOT SAME!!!\n";
+            } else {
+                std::cout << "Matrices same!!!\n";
+            }
+        }
+        {
+            std::string name = "GEMM_" + std::to_string(n);
+            LIKWID_MARKER_START(name.c_str());
+            matrix<double>::multiply_gemm(out2, in1, in2);
+            LIKWID_MARKER_STOP(name.c_str());
+
+            if (!out1.approx_equal(out2, 1e-9)) {
+                std::cout << "MATRICES NOT SAME!!!\n";
+            } else {
+                std::cout << "Matrices same!!!\n";
+            }
+        }
+
+        matrix<float> out1_f(n, n), out2_f(n, n), in1_f(n, n), in2_f(n, n);
+
+        fill_random(in1_f);
+        fill_random(in2_f);
+
+        {
+            std::string name = "Float_Interchanged_" + std::to_string(n);
+            LIKWID_MARKER_START(name.c_str());
+            matrix<float>::multiply_interchanged(out1_f, in1_f, in2_f);
+            LIKWID_MARKER_STOP(name.c_str());
+        }
+        {
+            std::string name = "Float_Tiled_AVX_48_" + std::to_string(n);
+            LIKWID_MARKER_START(name.c_str());
+            matrix<float>::multiply_tiled_avx(out2_f, in1_f, in2_f, 48);
+            LIKWID_MARKER_STOP(name.c_str());
+
+            if (!out1_f.approx_equal(out2_f, 1e-4f)) {
+                std::cout << "MATRICES NOT SAME!!!\n";
+            } else {
+                std::cout << "Matrices same!!!\n";
+            }
+        }
+        {
+            std::string name = "Float_GEMM_" + std::to_string(n);
+            LIKWID_MARKER_START(name.c_str());
+            matrix<float>::multiply_gemm(out2_f, in1_f, in2_f);
+            LIKWID_MARKER_STOP(name.c_str());
+
+            if (!out1_f.approx_equal(out2_f, 1e-4f)) {
                 std::cout << "MATRICES NOT SAME!!!\n";
             } else {
                 std::cout << "Matrices same!!!\n";
@@ -1,23 +1,35 @@
 #ifdef __AVX__
 #include <immintrin.h>
 #endif
-#include <cassert>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include "../common/buffer_2d.h"
+#include "gemm.h"
+#ifdef _OPENMP
+#include "gemm_parallel.h"
+#endif
 
+// Row-major matrix in one contiguous, 64-byte aligned buffer_2d. Row i starts
+// at m_data + i * m_stride. By default the stride (leading dimension) is picked
+// by buffer_2d to avoid cache set conflicts between rows; an explicit stride
+// (at least cols) is used as is, e.g. to reproduce the conflicts.
 template <typename T>
 class matrix {
    public:
-    matrix(int rows, int cols)
-        : m_data(allocate_matrix(rows, cols)), m_rows(rows), m_cols(cols) {}
-
-    ~matrix() { free_matrix(m_data, m_rows, m_cols); }
+    matrix(int rows, int cols, int stride = buffer_2d<T>::AUTO_STRIDE)
+        : m_buffer(rows, cols, stride),
+          m_rows(rows),
+          m_cols(cols),
+          m_stride(m_buffer.stride()),
+          m_data(m_buffer.data()) {}
 
     matrix(const matrix& m) = delete;
 
     static bool multiply_naive(matrix& out, matrix& in1, matrix& in2) {
-        T** c = out.m_data;
-        T** a = in1.m_data;
-        T** b = in2.m_data;
+        row_view c(out);
+        row_view a(in1);
+        row_view b(in2);
         int n;
 
         if (!verify_multiplication_params(out, in1, in2)) {
@@ -39,9 +51,9 @@ class matrix {
     }
 
     static bool multiply_interchanged(matrix& out, matrix& in1, matrix& in2) {
-        T** c = out.m_data;
-        T** a = in1.m_data;
-        T** b = in2.m_data;
+        row_view c(out);
+        row_view a(in1);
+        row_view b(in2);
         int n;
 
         if (!verify_multiplication_params(out, in1, in2)) {
@@ -68,9 +80,9 @@ class matrix {
 
     template <int tile_size>
     static bool multiply_tiled(matrix& out, matrix& in1, matrix& in2) {
-        T** c = out.m_data;
-        T** a = in1.m_data;
-        T** b = in2.m_data;
+        row_view c(out);
+        row_view a(in1);
+        row_view b(in2);
         int n;
 
         if (!verify_multiplication_params(out, in1, in2)) {
@@ -109,14 +121,56 @@ class matrix {
                                    matrix& in1,
                                    matrix& in2,
                                    int tile_size) {
-        assert(false);
+        // Specialized for double and float below, on top of multiply_tiled_avx_lanes.
+        static_assert(sizeof(T) == 0, "multiply_tiled_avx needs AVX and float or double elements");
         return false;
     }
 
-    int rows() { return m_rows; }
-    int cols() { return m_cols; }
+    // Packed, cache blocked multiplication with a register blocked microkernel
+    // (see gemm.h). Works for any out (m x n) = in1 (m x k) * in2 (k x n).
+    static bool multiply_gemm(matrix& out, const matrix& in1, const matrix& in2) {
+        if (!verify_gemm_params(out, in1, in2)) {
+            return false;
+        }
+
+        gemm<T>(out.m_rows, out.m_cols, in1.m_cols,
+                in1.m_data, in1.m_stride,
+                in2.m_data, in2.m_stride,
+                out.m_data, out.m_stride);
+
+        return true;
+    }
+
+#ifdef _OPENMP
+    // Same as multiply_gemm, with C split into one macro-tile per thread
+    // (see gemm_parallel.h). Thread i is pinned to core i.
+    static bool multiply_gemm_parallel(matrix& out, const matrix& in1, const matrix& in2,
+                                       int num_threads) {
+        if (!verify_gemm_params(out, in1, in2)) {
+            return false;
+        }
+
+        gemm_parallel<T>(out.m_rows, out.m_cols, in1.m_cols,
+                         in1.m_data, in1.m_stride,
+                         in2.m_data, in2.m_stride,
+                         out.m_data, out.m_stride, num_threads);
+
+        return true;
+    }
+#endif
+
+    int rows() const { return m_rows; }
+    int cols() const { return m_cols; }
+    int stride() const { return m_stride; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
 
-    T& operator()(int row, int col) { return m_data[row][col]; }
+    T* row(int row) { return m_data + static_cast<size_t>(row) * m_stride; }
+    const T* row(int row) const { return m_data + static_cast<size_t>(row) * m_stride; }
+
+    T& operator()(int row, int col) { return this->row(row)[col]; }
+    const T& operator()(int row, int col) const { return this->row(row)[col]; }
 
     bool operator==(const matrix& m) {
         if (m.m_rows != m_rows)
@@ -126,7 +180,7 @@ class matrix {
 
         for (int i = 0; i < m_rows; i++) {
             for (int j = 0; j < m_cols; j++) {
-                if (m.m_data[i][j] != m_data[i][j])
+                if (m(i, j) != (*this)(i, j))
                     return false;
             }
         }
@@ -136,27 +190,42 @@ class matrix {
 
     bool operator!=(const matrix& m) { return !(*this == m); }
 
-   private:
-    T** m_data;
-    int m_rows;
-    int m_cols;
+    // The kernels sum in different orders, and -ffast-math lets the compiler
+    // reorder the sums further, so results are compared with a relative tolerance.
+    bool approx_equal(const matrix& m, T rel_tolerance) const {
+        if (m.m_rows != m_rows || m.m_cols != m_cols)
+            return false;
 
-    static T** allocate_matrix(int rows, int cols) {
-        T** matrix = new T*[rows];
-        if (rows) {
-            matrix[0] = new T[rows * cols];
-            for (int i = 1; i < rows; ++i)
-                matrix[i] = matrix[0] + i * cols;
+        for (int i = 0; i < m_rows; i++) {
+            for (int j = 0; j < m_cols; j++) {
+                T diff = std::abs(m(i, j) - (*this)(i, j));
+                T scale = std::max(std::abs(m(i, j)), std::abs((*this)(i, j)));
+                if (diff > rel_tolerance * scale)
+                    return false;
+            }
         }
 
-        return matrix;
+        return true;
     }
 
-    static void free_matrix(T** matrix, int rows, int cols) {
-        if (rows)
-            delete[] matrix[0];
-        delete[] matrix;
-    }
+   private:
+    buffer_2d<T> m_buffer;
+    // Copies of the buffer geometry, in the types the kernels use.
+    int m_rows;
+    int m_cols;
+    int m_stride;
+    T* m_data;
+
+    // Gives the reference kernels c[i][j] syntax on top of the strided storage.
+    class row_view {
+       public:
+        row_view(matrix& m) : m_data(m.m_data), m_stride(m.m_stride) {}
+        T* operator[](int row) const { return m_data + static_cast<size_t>(row) * m_stride; }
+
+       private:
+        T* m_data;
+        int m_stride;
+    };
 
     static bool verify_multiplication_params(const matrix& out1,
                                              const matrix& in1,
@@ -170,6 +239,26 @@ class matrix {
         return true;
     }
 
+#ifdef __AVX__
+    // The body of multiply_tiled_avx for both element types. LANES is
+    // avx_lanes<T>, the AVX intrinsics for T.
+    template <typename LANES>
+    static bool multiply_tiled_avx_lanes(matrix& out,
+                                         matrix& in1,
+                                         matrix& in2,
+                                         int tile_size);
+#endif
+
+    static bool verify_gemm_params(const matrix& out1,
+                                   const matrix& in1,
+                                   const matrix& in2) {
+        if (out1.m_rows != in1.m_rows || out1.m_cols != in2.m_cols)
+            return false;
+        if (in1.m_cols != in2.m_rows)
+            return false;
+        return true;
+    }
+
     template <typename Q>
     friend std::ostream& operator<<(std::ostream& os, const matrix<Q>& m);
 };
@@ -178,7 +267,7 @@ template <typename T>
 std::ostream& operator<<(std::ostream& os, const matrix<T>& m) {
     for (int i = 0; i < m.m_rows; i++) {
         for (int j = 0; j < m.m_cols; j++) {
-            os << m.m_data[i][j] << " ";
+            os << m(i, j) << " ";
         }
         os << "\n";
     }
@@ -187,14 +276,39 @@ std::ostream& operator<<(std::ostream& os, const matrix<T>& m) {
 
 #ifdef __AVX__
 
+template <typename T>
+struct avx_lanes;
+
 template <>
-bool matrix<double>::multiply_tiled_avx(matrix<double>& out,
-                                        matrix<double>& in1,
-                                        matrix<double>& in2,
-                                        int tile_size) {
-    double** c = out.m_data;
-    double** a = in1.m_data;
-    double** b = in2.m_data;
+struct avx_lanes<double> {
+    typedef __m256d type;
+    static constexpr int width = 4;
+    static type set1(double v) { return _mm256_set1_pd(v); }
+    static type load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, type v) { _mm256_storeu_pd(p, v); }
+    static type fmadd(type a, type b, type c) { return _mm256_fmadd_pd(a, b, c); }
+};
+
+template <>
+struct avx_lanes<float> {
+    typedef __m256 type;
+    static constexpr int width = 8;
+    static type set1(float v) { return _mm256_set1_ps(v); }
+    static type load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, type v) { _mm256_storeu_ps(p, v); }
+    static type fmadd(type a, type b, type c) { return _mm256_fmadd_ps(a, b, c); }
+};
+
+template <typename T>
+template <typename LANES>
+bool matrix<T>::multiply_tiled_avx_lanes(matrix& out,
+                                         matrix& in1,
+                                         matrix& in2,
+                                         int tile_size) {
+    typedef typename LANES::type vec;
+    row_view c(out);
+    row_view a(in1);
+    row_view b(in2);
     int n;
 
     if (!verify_multiplication_params(out, in1, in2)) {
@@ -207,7 +321,7 @@ bool matrix<double>::multiply_tiled_avx(matrix<double>& out,
         return false;
     }
 
-    if (tile_size % 4 != 0) {
+    if (tile_size % LANES::width != 0) {
         return false;
     }
 
@@ -221,20 +335,16 @@ bool matrix<double>::multiply_tiled_avx(matrix<double>& out,
         for (int kk = 0; kk < n; kk += tile_size) {
             for (int jj = 0; jj < n; jj += tile_size) {
                 for (int i = ii; i < ii + tile_size; i++) {
-                    double* c_i = c[i];
-                    double* a_i = a[i];
+                    T* c_i = c[i];
+                    T* a_i = a[i];
                     for (int k = kk; k < kk + tile_size; k++) {
-                        double* b_k = b[k];
-                        __m256d a_i_k = _mm256_set1_pd(a_i[k]);
-                        /*for (int j = jj; j < jj + tile_size; j++) {
-                            c_i[j] = c_i[j] + a_i[k] * b_k[j];
-                        }*/
-
-                        for (int j = jj; j < jj + tile_size; j += 4) {
-                            __m256d c_i_j = _mm256_loadu_pd(c_i + j);
-                            __m256d b_k_j = _mm256_loadu_pd(b_k + j);
-                            c_i_j = _mm256_fmadd_pd(a_i_k, b_k_j, c_i_j);
-                            _mm256_storeu_pd(c_i + j, c_i_j);
+                        T* b_k = b[k];
+                        vec a_i_k = LANES::set1(a_i[k]);
+                        for (int j = jj; j < jj + tile_size; j += LANES::width) {
+                            vec c_i_j = LANES::load(c_i + j);
+                            vec b_k_j = LANES::load(b_k + j);
+                            c_i_j = LANES::fmadd(a_i_k, b_k_j, c_i_j);
+                            LANES::store(c_i + j, c_i_j);
                         }
                     }
                 }
@@ -245,4 +355,20 @@ bool matrix<double>::multiply_tiled_avx(matrix<double>& out,
     return true;
 }
 
+template <>
+bool matrix<double>::multiply_tiled_avx(matrix<double>& out,
+                                        matrix<double>& in1,
+                                        matrix<double>& in2,
+                                        int tile_size) {
+    return multiply_tiled_avx_lanes<avx_lanes<double>>(out, in1, in2, tile_size);
+}
+
+template <>
+bool matrix<float>::multiply_tiled_avx(matrix<float>& out,
+                                       matrix<float>& in1,
+                                       matrix<float>& in2,
+                                       int tile_size) {
+    return multiply_tiled_avx_lanes<avx_lanes<float>>(out, in1, in2, tile_size);
+}
+
 #endif
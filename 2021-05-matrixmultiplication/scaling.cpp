@@ -0,0 +1,84 @@
+#include <likwid.h>
+#include <omp.h>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "matrix.h"
+
+template <typename T>
+void fill_random(matrix<T>& m) {
+    std::uniform_real_distribution<T> unif{};
+    std::default_random_engine re;
+
+    for (int i = 0; i < m.rows(); i++) {
+        for (int j = 0; j < m.cols(); j++) {
+            m(i, j) = unif(re);
+        }
+    }
+}
+
+static constexpr std::array<int, 5> array_size = {480, 960, 1200, 1920, 2880};
+
+// Runs multiply_gemm_parallel with 1 ... max threads and prints GFLOP/s and the
+// speedup over one thread for every matrix size.
+template <typename T>
+void run_scaling(const std::string& type_name, int max_threads, T tolerance) {
+    for (int n : array_size) {
+        matrix<T> out_ref(n, n), out(n, n), in1(n, n), in2(n, n);
+
+        fill_random(in1);
+        fill_random(in2);
+
+        matrix<T>::multiply_gemm(out_ref, in1, in2);
+
+        double single_thread_gflops = 0.0;
+        double flops = 2.0 * n * n * n;
+        int repeat_count = std::max(1, static_cast<int>(4e9 / flops));
+
+        for (int threads = 1; threads <= max_threads; threads++) {
+            std::string name = type_name + "_GEMM_" + std::to_string(n) + "_threads_" + std::to_string(threads);
+
+            LIKWID_MARKER_START(name.c_str());
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeat_count; r++) {
+                matrix<T>::multiply_gemm_parallel(out, in1, in2, threads);
+            }
+            auto end = std::chrono::steady_clock::now();
+            LIKWID_MARKER_STOP(name.c_str());
+
+            double seconds = std::chrono::duration<double>(end - start).count() / repeat_count;
+            double gflops = flops / seconds * 1e-9;
+            if (threads == 1) {
+                single_thread_gflops = gflops;
+            }
+
+            std::cout << type_name << ", size = " << n << ", threads = " << threads
+                      << ", GFLOP/s = " << gflops
+                      << ", speedup = " << gflops / single_thread_gflops;
+            if (!out_ref.approx_equal(out, tolerance)) {
+                std::cout << ", MATRICES NOT SAME!!!";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int max_threads = omp_get_max_threads();
+    if (argc > 1) {
+        max_threads = std::stoi(argv[1]);
+    }
+
+    LIKWID_MARKER_INIT;
+    LIKWID_MARKER_THREADINIT;
+
+    run_scaling<float>("Float", max_threads, 1e-4f);
+    run_scaling<double>("Double", max_threads, 1e-9);
+
+    LIKWID_MARKER_CLOSE;
+
+    return 0;
+}
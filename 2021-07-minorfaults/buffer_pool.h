@@ -0,0 +1,365 @@
+/*******************************************************************************
+* FILE: buffer_pool.h
+* A pool of large anonymous mappings that are kept, already faulted in, between
+* calls.
+*
+* Mapping a fresh buffer for every call means every call pays a minor page
+* fault on the first touch of every page, and unmapping it afterwards throws
+* the populated pages away again. The pool keeps released buffers mapped and
+* hands them out again to requests of the same size class, so after the first
+* call the buffers are served without any page faults.
+*
+* Sizes are rounded up to a size class: a whole number of pages with at most
+* four significant bits, which wastes less than 25% of a buffer. A released
+* buffer can serve any request of its class.
+*
+* The released buffers are kept up to a high-water mark; when more memory than
+* that is cached, the least recently released buffers are unmapped. This
+* bounds the resident memory to what is in use plus the high-water mark.
+*
+* Buffers can be reserved ahead of time. Without the prefault thread the
+* reservation is mapped with MAP_POPULATE right away; with the prefault thread
+* the call returns immediately and the thread maps and populates the buffers
+* in the background, so the page faults are taken while the caller does other
+* work. A request that finds a reservation of its class still in progress
+* waits for it instead of faulting in a buffer of its own.
+*
+* The contents of a buffer served from the pool are not cleared, unless it is
+* taken with buffer_pool_acquire_zeroed().
+*******************************************************************************/
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BUFFER_POOL_MAX_RESERVATIONS 32
+
+typedef struct buffer_pool_block {
+   void *p;
+   size_t size;                    /* The size class of the mapping.     */
+   struct buffer_pool_block *next;
+} buffer_pool_block;
+
+typedef struct {
+   size_t size;                    /* Size class to map.                 */
+   int count;                      /* Buffers of that class still to map. */
+} buffer_pool_reservation;
+
+typedef struct {
+   pthread_mutex_t lock;
+   pthread_cond_t work;            /* Signals the prefault thread.       */
+   pthread_cond_t ready;           /* Signals that a reservation is done. */
+
+   buffer_pool_block *free_list;   /* Most recently released first.      */
+   buffer_pool_block *used_list;
+   size_t cached_bytes;            /* Mapped by the blocks on free_list. */
+   size_t used_bytes;
+   size_t high_water_mark;
+
+   buffer_pool_reservation reservations[BUFFER_POOL_MAX_RESERVATIONS];
+   int reservation_count;
+   size_t in_flight;               /* Class the thread is mapping, or 0. */
+
+   int prefault_thread_started;
+   int stop;
+   pthread_t prefault_thread;
+
+   long hits, misses, trimmed;     /* Statistics.                        */
+} buffer_pool;
+
+static size_t buffer_pool_size_class(size_t size)
+{
+   size_t page = (size_t) sysconf(_SC_PAGESIZE);
+   size_t pages = (size + page - 1) / page, step = 1;
+
+   if(pages == 0) pages = 1;
+   while(pages > 8 * step) step *= 2;
+   return ((pages + step - 1) / step) * step * page;
+}
+
+static void *buffer_pool_map(size_t size)
+{
+   void *p = mmap(0, size, PROT_READ|PROT_WRITE,
+      MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+   return (p == MAP_FAILED) ? NULL : p;
+}
+
+/* Puts a mapping on the free list, most recently released first. */
+static void buffer_pool_push_free(buffer_pool *pool, buffer_pool_block *b)
+{
+   b->next = pool->free_list;
+   pool->free_list = b;
+   pool->cached_bytes += b->size;
+}
+
+/* Unmaps the least recently released buffers until at most max_bytes are
+   cached. Called with the lock held. */
+static void buffer_pool_trim_locked(buffer_pool *pool, size_t max_bytes)
+{
+   while(pool->cached_bytes > max_bytes){
+      buffer_pool_block **last = &pool->free_list, *b;
+      while((*last)->next != NULL) last = &(*last)->next;
+      b = *last;
+      *last = NULL;
+      pool->cached_bytes -= b->size;
+      pool->trimmed++;
+      munmap(b->p, b->size);
+      free(b);
+   }
+}
+
+/* Whether a buffer of class size is reserved but not yet mapped. */
+static int buffer_pool_pending_locked(const buffer_pool *pool, size_t size)
+{
+   int i;
+
+   if(pool->in_flight == size) return(1);
+   for(i=0;i<pool->reservation_count;i++)
+      if(pool->reservations[i].size == size) return(1);
+   return(0);
+}
+
+static void *buffer_pool_prefault_main(void *arg)
+{
+   buffer_pool *pool = (buffer_pool *) arg;
+
+   pthread_mutex_lock(&pool->lock);
+   for(;;){
+      buffer_pool_block *b;
+      size_t size;
+
+      while(!pool->stop && pool->reservation_count == 0)
+         pthread_cond_wait(&pool->work, &pool->lock);
+      if(pool->stop) break;
+
+      size = pool->reservations[0].size;
+      if(--pool->reservations[0].count == 0){
+         int i;
+         pool->reservation_count--;
+         for(i=0;i<pool->reservation_count;i++)
+            pool->reservations[i] = pool->reservations[i + 1];
+      }
+      pool->in_flight = size;
+      pthread_mutex_unlock(&pool->lock);
+
+      b = (buffer_pool_block *) malloc(sizeof(buffer_pool_block));
+      if(b != NULL && (b->p = buffer_pool_map(size)) == NULL){
+         free(b);
+         b = NULL;
+      }
+
+      pthread_mutex_lock(&pool->lock);
+      if(b != NULL){
+         b->size = size;
+         buffer_pool_push_free(pool, b);
+      }
+      pool->in_flight = 0;
+      pthread_cond_broadcast(&pool->ready);
+   }
+   pthread_mutex_unlock(&pool->lock);
+   return(NULL);
+}
+
+/*******************************************************************************
+* Function: buffer_pool_init
+* Purpose: Initializes an empty pool that keeps up to high_water_mark bytes of
+* released buffers. With prefault_thread set, reservations are mapped by a
+* background thread. Upon failure, this function returns 0, upon sucess it
+* returns 1.
+*******************************************************************************/
+static int buffer_pool_init(buffer_pool *pool, size_t high_water_mark,
+   int prefault_thread)
+{
+   pool->free_list = NULL;
+   pool->used_list = NULL;
+   pool->cached_bytes = 0;
+   pool->used_bytes = 0;
+   pool->high_water_mark = high_water_mark;
+   pool->reservation_count = 0;
+   pool->in_flight = 0;
+   pool->prefault_thread_started = 0;
+   pool->stop = 0;
+   pool->hits = pool->misses = pool->trimmed = 0;
+
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->work, NULL);
+   pthread_cond_init(&pool->ready, NULL);
+
+   if(prefault_thread){
+      if(pthread_create(&pool->prefault_thread, NULL,
+         buffer_pool_prefault_main, pool) != 0){
+         fprintf(stderr, "Error starting the prefault thread.\n");
+         return(0);
+      }
+      pool->prefault_thread_started = 1;
+   }
+   return(1);
+}
+
+/*******************************************************************************
+* Function: buffer_pool_reserve
+* Purpose: Makes count buffers of at least size bytes available without page
+* faults. With the prefault thread this returns immediately.
+*******************************************************************************/
+static void buffer_pool_reserve(buffer_pool *pool, size_t size, int count)
+{
+   size = buffer_pool_size_class(size);
+
+   pthread_mutex_lock(&pool->lock);
+   if(pool->prefault_thread_started &&
+      pool->reservation_count < BUFFER_POOL_MAX_RESERVATIONS){
+      pool->reservations[pool->reservation_count].size = size;
+      pool->reservations[pool->reservation_count].count = count;
+      pool->reservation_count++;
+      pthread_cond_signal(&pool->work);
+      pthread_mutex_unlock(&pool->lock);
+      return;
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   for(;count>0;count--){
+      buffer_pool_block *b = (buffer_pool_block *) malloc(sizeof(buffer_pool_block));
+      if(b == NULL) return;
+      if((b->p = buffer_pool_map(size)) == NULL){
+         free(b);
+         return;
+      }
+      b->size = size;
+      pthread_mutex_lock(&pool->lock);
+      buffer_pool_push_free(pool, b);
+      pthread_mutex_unlock(&pool->lock);
+   }
+}
+
+/*******************************************************************************
+* Function: buffer_pool_take
+* Purpose: Returns a buffer of at least size bytes, a released one of the same
+* size class if there is one. Returns NULL if the memory cannot be mapped.
+* *recycled is set to 1 if the buffer comes from the free list, 0 if it was
+* mapped just now.
+*******************************************************************************/
+static void *buffer_pool_take(buffer_pool *pool, size_t size, int *recycled)
+{
+   buffer_pool_block **prev, *b;
+
+   size = buffer_pool_size_class(size);
+
+   pthread_mutex_lock(&pool->lock);
+   for(;;){
+      for(prev=&pool->free_list;*prev!=NULL;prev=&(*prev)->next){
+         if((*prev)->size == size) break;
+      }
+      if(*prev != NULL || !buffer_pool_pending_locked(pool, size)) break;
+      pthread_cond_wait(&pool->ready, &pool->lock);
+   }
+
+   if((b = *prev) != NULL){
+      *prev = b->next;
+      pool->cached_bytes -= size;
+      pool->hits++;
+      *recycled = 1;
+   }
+   else{
+      pool->misses++;
+      *recycled = 0;
+      pthread_mutex_unlock(&pool->lock);
+      if((b = (buffer_pool_block *) malloc(sizeof(buffer_pool_block))) == NULL)
+         return(NULL);
+      if((b->p = buffer_pool_map(size)) == NULL){
+         free(b);
+         return(NULL);
+      }
+      b->size = size;
+      pthread_mutex_lock(&pool->lock);
+   }
+
+   b->next = pool->used_list;
+   pool->used_list = b;
+   pool->used_bytes += size;
+   pthread_mutex_unlock(&pool->lock);
+   return(b->p);
+}
+
+/*******************************************************************************
+* Function: buffer_pool_acquire
+* Purpose: Returns a buffer of at least size bytes with undefined contents.
+*******************************************************************************/
+static void *buffer_pool_acquire(buffer_pool *pool, size_t size)
+{
+   int recycled;
+
+   return(buffer_pool_take(pool, size, &recycled));
+}
+
+/*******************************************************************************
+* Function: buffer_pool_acquire_zeroed
+* Purpose: Like buffer_pool_acquire(), but the first size bytes are zero, as
+* with calloc(). Freshly mapped buffers already are; recycled ones are cleared.
+*******************************************************************************/
+static void *buffer_pool_acquire_zeroed(buffer_pool *pool, size_t size)
+{
+   int recycled;
+   void *p = buffer_pool_take(pool, size, &recycled);
+
+   if(p != NULL && recycled) memset(p, 0, size);
+   return(p);
+}
+
+/*******************************************************************************
+* Function: buffer_pool_release
+* Purpose: Returns the buffer p, obtained from buffer_pool_acquire(), to the
+* pool, and trims the pool down to its high-water mark.
+*******************************************************************************/
+static void buffer_pool_release(buffer_pool *pool, void *p)
+{
+   buffer_pool_block **prev, *b;
+
+   if(p == NULL) return;
+
+   pthread_mutex_lock(&pool->lock);
+   for(prev=&pool->used_list;*prev!=NULL;prev=&(*prev)->next){
+      if((*prev)->p == p) break;
+   }
+   if((b = *prev) == NULL){
+      pthread_mutex_unlock(&pool->lock);
+      fprintf(stderr, "Releasing a buffer that is not from the pool.\n");
+      return;
+   }
+   *prev = b->next;
+   pool->used_bytes -= b->size;
+
+   buffer_pool_push_free(pool, b);
+   buffer_pool_trim_locked(pool, pool->high_water_mark);
+   pthread_mutex_unlock(&pool->lock);
+}
+
+/* Stops the prefault thread and unmaps every buffer, released or not. */
+static void buffer_pool_destroy(buffer_pool *pool)
+{
+   buffer_pool_block *b;
+
+   if(pool->prefault_thread_started){
+      pthread_mutex_lock(&pool->lock);
+      pool->stop = 1;
+      pthread_cond_signal(&pool->work);
+      pthread_mutex_unlock(&pool->lock);
+      pthread_join(pool->prefault_thread, NULL);
+   }
+
+   buffer_pool_trim_locked(pool, 0);
+   while((b = pool->used_list) != NULL){
+      pool->used_list = b->next;
+      munmap(b->p, b->size);
+      free(b);
+   }
+   pthread_cond_destroy(&pool->ready);
+   pthread_cond_destroy(&pool->work);
+   pthread_mutex_destroy(&pool->lock);
+}
+
+#endif
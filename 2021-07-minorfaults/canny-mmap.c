@@ -57,19 +57,79 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <malloc.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads() 1
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "image_map.h"
+#include "buffer_pool.h"
 
 #define VERBOSE 0
 #define BOOSTBLURFACTOR 90.0
 
+/* Use the fused, multi-threaded pipeline (canny_fused) unless the direction
+   image is requested. */
+#define FUSED_PIPELINE 1
+
+/* Number of times the image is processed; the page faults of every frame are
+   reported. The first frame maps the buffers, the following ones show the
+   steady state. */
+#define FRAME_COUNT 5
+
+/* Keep the large buffers mapped between frames (buffer_pool.h) instead of
+   mapping and unmapping them in every frame. */
+#define USE_BUFFER_POOL 1
+
+/* Map the buffers of the first frame in a background thread. */
+#define PREFAULT_THREAD 1
+
+/* Released buffers kept by the pool, in bytes. */
+#define POOL_HIGH_WATER_MARK (256UL << 20)
+
+/* Allocations below this size come from the malloc heap, which is not
+   trimmed while the pool is used. The line buffers, histograms and edge
+   stacks are allocated in every frame; with the glibc defaults the larger
+   ones are mapped and unmapped each time and fault again. */
+#define MALLOC_MMAP_THRESHOLD (16 << 20)
+
+#if USE_BUFFER_POOL
+static buffer_pool large_pool;
 
+void* malloc_large(size_t size) {
+    return buffer_pool_acquire(&large_pool, size);
+}
+
+/* For buffers whose users rely on calloc() semantics. */
+void* calloc_large(size_t size) {
+    return buffer_pool_acquire_zeroed(&large_pool, size);
+}
+
+void free_large(void* p, size_t size) {
+   (void)size;
+   buffer_pool_release(&large_pool, p);
+}
+#else
 void* malloc_large(size_t size) {
     return mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
 }
 
+/* Fresh anonymous mappings are zero-filled. */
+void* calloc_large(size_t size) {
+    return malloc_large(size);
+}
+
 void free_large(void* p, size_t size) {
    munmap(p, size);
 }
+#endif
 
 int read_pgm_image(char *infilename, unsigned char **image, int *rows,
     int *cols);
@@ -78,6 +138,8 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
 
 void canny(unsigned char *image, int rows, int cols, float sigma,
          float tlow, float thigh, unsigned char **edge, char *fname);
+void canny_fused(unsigned char *image, int rows, int cols, float sigma,
+         float tlow, float thigh, unsigned char **edge);
 void gaussian_smooth(unsigned char *image, int rows, int cols, float sigma,
         short int **smoothedim);
 void make_gaussian_kernel(float sigma, float **kernel, int *windowsize);
@@ -87,6 +149,8 @@ void magnitude_x_y(short int *delta_x, short int *delta_y, int rows, int cols,
         short int **magnitude);
 void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
         float tlow, float thigh, unsigned char *edge);
+void hysteresis_thresholds(int *hist, float tlow, float thigh,
+   int *lowthreshold, int *highthreshold);
 void radian_direction(short int *delta_x, short int *delta_y, int rows,
     int cols, float **dir_radians, int xdirtag, int ydirtag);
 double angle_radians(double x, double y);
@@ -101,7 +165,9 @@ int main(int argc, char *argv[])
    char composedfname[128];  /* Name of the output "direction" image */
    unsigned char *image;     /* The input image */
    unsigned char *edge;      /* The output edge image */
+   image_map input, output;  /* The mapped input and output files */
    int rows, cols;           /* The dimensions of the image. */
+   int frame;                /* The frame being processed. */
    float sigma,              /* Standard deviation of the gaussian kernel. */
 	 tlow,               /* Fraction of the high threshold in hysteresis. */
 	 thigh;              /* High hysteresis threshold control. The actual
@@ -140,13 +206,18 @@ int main(int argc, char *argv[])
    else dirfilename = NULL;
 
    /****************************************************************************
-   * Read in the image. This read function allocates memory for the image.
+   * Map the image. The pixels are used in place, nothing is copied.
    ****************************************************************************/
    if(VERBOSE) printf("Reading the image %s.\n", infilename);
-   if(read_pgm_image(infilename, &image, &rows, &cols) == 0){
+   if(image_map_open(infilename, "P5", &input) == 0){
       fprintf(stderr, "Error reading the input image, %s.\n", infilename);
       exit(1);
    }
+   image = input.pixels;
+   rows = input.rows;
+   cols = input.cols;
+   sprintf(outfilename, "%s_s_%3.2f_l_%3.2f_h_%3.2f.pgm", infilename,
+      sigma, tlow, thigh);
 
    /****************************************************************************
    * Perform the edge detection. All of the work takes place here.
@@ -158,10 +229,63 @@ int main(int argc, char *argv[])
       dirfilename = composedfname;
    }
 
+#if USE_BUFFER_POOL
+   /****************************************************************************
+   * Map the buffers that the first frame will need, in the background with
+   * the prefault thread. Later frames reuse the released buffers.
+   ****************************************************************************/
+   if(buffer_pool_init(&large_pool, POOL_HIGH_WATER_MARK, PREFAULT_THREAD) == 0){
+      exit(1);
+   }
+   mallopt(M_MMAP_THRESHOLD, MALLOC_MMAP_THRESHOLD);
+   mallopt(M_TRIM_THRESHOLD, POOL_HIGH_WATER_MARK);
+   if(FUSED_PIPELINE && (dirfilename == NULL)){
+      buffer_pool_reserve(&large_pool, rows*cols*sizeof(short), 1);
+   }
+   else{
+      buffer_pool_reserve(&large_pool, rows*cols*sizeof(float), 1);
+      buffer_pool_reserve(&large_pool, rows*cols*sizeof(short), 3);
+      buffer_pool_reserve(&large_pool, rows*cols*sizeof(unsigned char), 2);
+   }
+#endif
+
    struct timespec start;
    clock_gettime(CLOCK_MONOTONIC, &start);
 
-   canny(image, rows, cols, sigma, tlow, thigh, &edge, dirfilename);
+   /* The fused pipeline writes the edges straight into the output file. */
+   edge = NULL;
+   if(FUSED_PIPELINE && (dirfilename == NULL)){
+      if(image_map_create(outfilename, "P5", rows, cols, "", 255, &output) == 0){
+         fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
+         exit(1);
+      }
+   }
+
+   for(frame=0;frame<FRAME_COUNT;frame++){
+      struct timespec frame_start, frame_end;
+      struct rusage before, after;
+
+      getrusage(RUSAGE_SELF, &before);
+      clock_gettime(CLOCK_MONOTONIC, &frame_start);
+
+      if(FUSED_PIPELINE && (dirfilename == NULL)){
+         edge = output.pixels;
+         canny_fused(image, rows, cols, sigma, tlow, thigh, &edge);
+      }
+      else{
+         /* Only the edges of the last frame are written out. */
+         if(edge != NULL) free_large(edge, rows*cols*sizeof(unsigned char));
+         edge = NULL;
+         canny(image, rows, cols, sigma, tlow, thigh, &edge, dirfilename);
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &frame_end);
+      getrusage(RUSAGE_SELF, &after);
+      printf("Frame %d: %.3f s, minor faults %ld, major faults %ld\n", frame,
+         (frame_end.tv_sec - frame_start.tv_sec) +
+         (frame_end.tv_nsec - frame_start.tv_nsec) / 1000000000.0,
+         after.ru_minflt - before.ru_minflt, after.ru_majflt - before.ru_majflt);
+   }
 
    struct timespec end;
    clock_gettime(CLOCK_MONOTONIC, &end);
@@ -172,16 +296,29 @@ int main(int argc, char *argv[])
 
    printf("Total time: %.3f\n", seconds);
 
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+#if USE_BUFFER_POOL
+   printf("Buffer pool: %ld hits, %ld misses, %ld trimmed\n", large_pool.hits,
+      large_pool.misses, large_pool.trimmed);
+#endif
+   printf("Peak memory: %ld kB\n", usage.ru_maxrss);
+
    /****************************************************************************
    * Write out the edge image to a file.
    ****************************************************************************/
-   sprintf(outfilename, "%s_s_%3.2f_l_%3.2f_h_%3.2f.pgm", infilename,
-      sigma, tlow, thigh);
    if(VERBOSE) printf("Writing the edge iname in the file %s.\n", outfilename);
-   if(write_pgm_image(outfilename, edge, rows, cols, "", 255) == 0){
+   if(FUSED_PIPELINE && (dirfilename == NULL)){
+      image_map_close(&output);
+   }
+   else if(write_pgm_image(outfilename, edge, rows, cols, "", 255) == 0){
       fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
       exit(1);
    }
+   image_map_close(&input);
+#if USE_BUFFER_POOL
+   buffer_pool_destroy(&large_pool);
+#endif
 
    return 0;
 }
@@ -251,7 +388,9 @@ void canny(unsigned char *image, int rows, int cols, float sigma,
    * Perform non-maximal suppression.
    ****************************************************************************/
    if(VERBOSE) printf("Doing the non-maximal suppression.\n");
-   if((nms = (unsigned char *) malloc_large(rows*cols*sizeof(unsigned char)))==NULL){
+   /* non_max_supp() leaves row rows-2 and column cols-2 alone, and
+      apply_hysteresis() reads them, so nms has to start out zeroed. */
+   if((nms = (unsigned char *) calloc_large(rows*cols*sizeof(unsigned char)))==NULL){
       fprintf(stderr, "Error allocating the nms image.\n");
       exit(1);
    }
@@ -532,7 +671,7 @@ void gaussian_smooth(unsigned char *image, int rows, int cols, float sigma,
    free(dot_arr);
    free(sum_arr);
 
-   free_large(tempim, rows*cols);
+   free_large(tempim, rows*cols*sizeof(float));
    free(kernel);
 }
 
@@ -616,6 +755,49 @@ void follow_edges(unsigned char *edgemapptr, short *edgemagptr, short lowval,
    }
 }
 
+/*******************************************************************************
+* PROCEDURE: hysteresis_thresholds
+* PURPOSE: Computes the low and high hysteresis thresholds from the histogram
+* of the magnitude of the points that passed the non-maximal suppression.
+* NAME: Mike Heath
+* DATE: 2/15/96
+*******************************************************************************/
+void hysteresis_thresholds(int *hist, float tlow, float thigh,
+   int *lowthreshold, int *highthreshold)
+{
+   int r, numedges, highcount;
+   short int maximum_mag = 0;
+
+   /****************************************************************************
+   * Compute the number of pixels that passed the nonmaximal suppression.
+   ****************************************************************************/
+   for(r=1,numedges=0;r<32768;r++){
+      if(hist[r] != 0) maximum_mag = r;
+      numedges += hist[r];
+   }
+
+   highcount = (int)(numedges * thigh + 0.5);
+
+   /****************************************************************************
+   * Compute the high threshold value as the (100 * thigh) percentage point
+   * in the magnitude of the gradient histogram of all the pixels that passes
+   * non-maximal suppression. Then calculate the low threshold as a fraction
+   * of the computed high threshold value. John Canny said in his paper
+   * "A Computational Approach to Edge Detection" that "The ratio of the
+   * high to low threshold in the implementation is in the range two or three
+   * to one." That means that in terms of this implementation, we should
+   * choose tlow ~= 0.5 or 0.33333.
+   ****************************************************************************/
+   r = 1;
+   numedges = hist[1];
+   while((r<(maximum_mag-1)) && (numedges < highcount)){
+      r++;
+      numedges += hist[r];
+   }
+   *highthreshold = r;
+   *lowthreshold = (int)(*highthreshold * tlow + 0.5);
+}
+
 /*******************************************************************************
 * PROCEDURE: apply_hysteresis
 * PURPOSE: This routine finds edges that are above some high threshhold or
@@ -627,9 +809,7 @@ void follow_edges(unsigned char *edgemapptr, short *edgemagptr, short lowval,
 void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
 	float tlow, float thigh, unsigned char *edge)
 {
-   int r, c, pos, numedges, lowcount, highcount, lowthreshold, highthreshold,
-       i, hist[32768], rr, cc;
-   short int maximum_mag, sumpix;
+   int r, c, pos, lowthreshold, highthreshold, hist[32768];
 
    /****************************************************************************
    * Initialize the edge map to possible edges everywhere the non-maximal
@@ -666,34 +846,7 @@ void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
       }
    }
 
-   /****************************************************************************
-   * Compute the number of pixels that passed the nonmaximal suppression.
-   ****************************************************************************/
-   for(r=1,numedges=0;r<32768;r++){
-      if(hist[r] != 0) maximum_mag = r;
-      numedges += hist[r];
-   }
-
-   highcount = (int)(numedges * thigh + 0.5);
-
-   /****************************************************************************
-   * Compute the high threshold value as the (100 * thigh) percentage point
-   * in the magnitude of the gradient histogram of all the pixels that passes
-   * non-maximal suppression. Then calculate the low threshold as a fraction
-   * of the computed high threshold value. John Canny said in his paper
-   * "A Computational Approach to Edge Detection" that "The ratio of the
-   * high to low threshold in the implementation is in the range two or three
-   * to one." That means that in terms of this implementation, we should
-   * choose tlow ~= 0.5 or 0.33333.
-   ****************************************************************************/
-   r = 1;
-   numedges = hist[1];
-   while((r<(maximum_mag-1)) && (numedges < highcount)){
-      r++;
-      numedges += hist[r];
-   }
-   highthreshold = r;
-   lowthreshold = (int)(highthreshold * tlow + 0.5);
+   hysteresis_thresholds(hist, tlow, thigh, &lowthreshold, &highthreshold);
 
    if(VERBOSE){
       printf("The input low and high fractions of %f and %f computed to\n",
@@ -723,6 +876,169 @@ void apply_hysteresis(short int *mag, unsigned char *nms, int rows, int cols,
    }
 }
 
+/*******************************************************************************
+* PROCEDURE: non_max_supp_pixel
+* PURPOSE: Non-maximal suppression of a single point. magptr points to the
+* magnitude of the point, prevptr and nextptr to the magnitude of the point
+* above and below it. Returns NOEDGE or POSSIBLE_EDGE.
+*******************************************************************************/
+static inline unsigned char non_max_supp_pixel(const short *prevptr,
+   const short *magptr, const short *nextptr, short gx, short gy)
+{
+   short z1,z2;
+   short m00;
+   float mag1,mag2,xperp,yperp;
+
+   m00 = *magptr;
+   if(m00 == 0) return (unsigned char) NOEDGE;
+
+   xperp = -gx/((float)m00);
+   yperp = gy/((float)m00);
+
+   if(gx >= 0){
+      if(gy >= 0){
+              if (gx >= gy)
+              {
+                  /* 111 */
+                  /* Left point */
+                  z1 = magptr[-1];
+                  z2 = prevptr[-1];
+
+                  mag1 = (m00 - z1)*xperp + (z2 - z1)*yperp;
+
+                  /* Right point */
+                  z1 = magptr[1];
+                  z2 = nextptr[1];
+
+                  mag2 = (m00 - z1)*xperp + (z2 - z1)*yperp;
+              }
+              else
+              {
+                  /* 110 */
+                  /* Left point */
+                  z1 = prevptr[0];
+                  z2 = prevptr[-1];
+
+                  mag1 = (z1 - z2)*xperp + (z1 - m00)*yperp;
+
+                  /* Right point */
+                  z1 = nextptr[0];
+                  z2 = nextptr[1];
+
+                  mag2 = (z1 - z2)*xperp + (z1 - m00)*yperp;
+              }
+          }
+          else
+          {
+              if (gx >= -gy)
+              {
+                  /* 101 */
+                  /* Left point */
+                  z1 = magptr[-1];
+                  z2 = nextptr[-1];
+
+                  mag1 = (m00 - z1)*xperp + (z1 - z2)*yperp;
+
+                  /* Right point */
+                  z1 = magptr[1];
+                  z2 = prevptr[1];
+
+                  mag2 = (m00 - z1)*xperp + (z1 - z2)*yperp;
+              }
+              else
+              {
+                  /* 100 */
+                  /* Left point */
+                  z1 = nextptr[0];
+                  z2 = nextptr[-1];
+
+                  mag1 = (z1 - z2)*xperp + (m00 - z1)*yperp;
+
+                  /* Right point */
+                  z1 = prevptr[0];
+                  z2 = prevptr[1];
+
+                  mag2 = (z1 - z2)*xperp  + (m00 - z1)*yperp;
+              }
+          }
+      }
+      else
+      {
+          if (gy >= 0)
+          {
+              if (-gx >= gy)
+              {
+                  /* 011 */
+                  /* Left point */
+                  z1 = magptr[1];
+                  z2 = prevptr[1];
+
+                  mag1 = (z1 - m00)*xperp + (z2 - z1)*yperp;
+
+                  /* Right point */
+                  z1 = magptr[-1];
+                  z2 = nextptr[-1];
+
+                  mag2 = (z1 - m00)*xperp + (z2 - z1)*yperp;
+              }
+              else
+              {
+                  /* 010 */
+                  /* Left point */
+                  z1 = prevptr[0];
+                  z2 = prevptr[1];
+
+                  mag1 = (z2 - z1)*xperp + (z1 - m00)*yperp;
+
+                  /* Right point */
+                  z1 = nextptr[0];
+                  z2 = nextptr[-1];
+
+                  mag2 = (z2 - z1)*xperp + (z1 - m00)*yperp;
+              }
+          }
+          else
+          {
+              if (-gx > -gy)
+              {
+                  /* 001 */
+                  /* Left point */
+                  z1 = magptr[1];
+                  z2 = nextptr[1];
+
+                  mag1 = (z1 - m00)*xperp + (z1 - z2)*yperp;
+
+                  /* Right point */
+                  z1 = magptr[-1];
+                  z2 = prevptr[-1];
+
+                  mag2 = (z1 - m00)*xperp + (z1 - z2)*yperp;
+              }
+              else
+              {
+                  /* 000 */
+                  /* Left point */
+                  z1 = nextptr[0];
+                  z2 = nextptr[1];
+
+                  mag1 = (z2 - z1)*xperp + (m00 - z1)*yperp;
+
+                  /* Right point */
+                  z1 = prevptr[0];
+                  z2 = prevptr[-1];
+
+                  mag2 = (z2 - z1)*xperp + (m00 - z1)*yperp;
+              }
+          }
+      }
+
+   /* Now determine if the current point is a maximum point */
+
+   if ((mag1 > 0.0) || (mag2 > 0.0)) return (unsigned char) NOEDGE;
+   if (mag2 == 0.0) return (unsigned char) NOEDGE;
+   return (unsigned char) POSSIBLE_EDGE;
+}
+
 /*******************************************************************************
 * PROCEDURE: non_max_supp
 * PURPOSE: This routine applies non-maximal suppression to the magnitude of
@@ -736,9 +1052,7 @@ void non_max_supp(short *mag, short *gradx, short *grady, int nrows, int ncols,
     int rowcount, colcount,count;
     short *magrowptr,*magptr;
     short *gxrowptr,*gxptr;
-    short *gyrowptr,*gyptr,z1,z2;
-    short m00,gx,gy;
-    float mag1,mag2,xperp,yperp;
+    short *gyrowptr,*gyptr;
     unsigned char *resultrowptr, *resultptr;
     
 
@@ -766,167 +1080,740 @@ void non_max_supp(short *mag, short *gradx, short *grady, int nrows, int ncols,
       for(colcount=1,magptr=magrowptr,gxptr=gxrowptr,gyptr=gyrowptr,
          resultptr=resultrowptr;colcount<ncols-2; 
          colcount++,magptr++,gxptr++,gyptr++,resultptr++){   
-         m00 = *magptr;
-         if(m00 == 0){
-            *resultptr = (unsigned char) NOEDGE;
+         *resultptr = non_max_supp_pixel(magptr - ncols, magptr,
+            magptr + ncols, *gxptr, *gyptr);
+      }
+   }
+}
+
+/*******************************************************************************
+* FILE: canny_fused.c
+* Band-wise version of canny(). The gaussian smoothing, the derivatives, the
+* magnitude and the non-maximal suppression are fused: every worker walks
+* down a tile of the image and keeps only the last few rows of each stage in
+* rolling line buffers, which together fit in the L2 cache. Tiles are bands of
+* rows (split into columns on wide images) that are processed in parallel;
+* every tile recomputes the few halo rows and columns it needs from its
+* neighbours. Only the magnitude and the edge map are full-size images.
+*
+* The result is identical to the one of canny().
+*******************************************************************************/
+
+#define CANNY_MIN_BAND_ROWS 32
+#define CANNY_HYSTERESIS_BAND_ROWS 64
+
+typedef struct {
+   int windowsize;        /* Rows in the x-blurred ring buffer.            */
+   float *xblur;          /* Ring of x-blurred rows, row r at r%windowsize. */
+   float *dot;            /* Dot product summing row for the y-blur.       */
+   short int *smoothed;   /* Ring of 3 smoothed rows.                      */
+   short int *delta_x;    /* Ring of 3 x-derivative rows.                  */
+   short int *delta_y;    /* Ring of 3 y-derivative rows.                  */
+   short int *magnitude;  /* Ring of 3 magnitude rows.                     */
+   int hist[32768];       /* Histogram of the magnitude of possible edges. */
+} canny_workspace;
+
+typedef struct {
+   int *data;
+   int size;
+   int capacity;
+} canny_stack;
+
+static void canny_stack_push(canny_stack *stack, int pos)
+{
+   if(stack->size == stack->capacity){
+      stack->capacity = stack->capacity ? 2 * stack->capacity : 1024;
+      if((stack->data = (int *) realloc(stack->data,
+         stack->capacity * sizeof(int))) == NULL){
+         fprintf(stderr, "Error allocating the edge following stack.\n");
+         exit(1);
+      }
+   }
+   stack->data[stack->size++] = pos;
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_tile_width
+* PURPOSE: Widest tile whose line buffers fit in half of the L2 cache. The
+* halo columns are not counted.
+*******************************************************************************/
+static int canny_tile_width(int cols, int windowsize)
+{
+   long l2_size = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+   l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+   if(l2_size <= 0) l2_size = 1024 * 1024;
+
+   /* x-blurred rows, the y-blur dot row and 3 rows of 4 short stages */
+   long bytes_per_col = (windowsize + 1) * sizeof(float) + 12 * sizeof(short);
+   long width = (l2_size / 2) / bytes_per_col;
+
+   if(width < 256) width = 256;
+   return width >= cols ? cols : (int) width;
+}
+
+/*******************************************************************************
+* AVX2 kernels of the fused stages. They compute exactly the same values as
+* the scalar code: the operations are done in the same order and with the
+* same types (there is no FMA contraction without -mfma), the blur keeps the
+* divisions by the kernel sums, and the square root of the magnitude is
+* computed with rsqrt and then corrected to the exact rounded value.
+*******************************************************************************/
+#ifdef __AVX2__
+
+/* Columns [c_begin, c_end) of the x-blur where the whole kernel is inside the
+   image; returns the first column left for the scalar code. */
+static int canny_blur_x_avx2(unsigned char *imagerow, int c_begin, int c_end,
+   int c0, float *kernel, int center, float *sum_x, float *out)
+{
+   int c, cc;
+   __m256 dot, pixels;
+
+   for(c=c_begin;c+8<=c_end;c+=8){
+      dot = _mm256_setzero_ps();
+      for(cc=(-center);cc<=center;cc++){
+         pixels = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i *)(imagerow + c + cc))));
+         dot = _mm256_add_ps(dot, _mm256_mul_ps(pixels,
+            _mm256_broadcast_ss(kernel + center + cc)));
+      }
+      _mm256_storeu_ps(out + c - c0, _mm256_div_ps(dot, _mm256_loadu_ps(sum_x + c)));
+   }
+   return c;
+}
+
+/* (short)(dot * BOOSTBLURFACTOR / sum_y + 0.5) in double precision, as in
+   gaussian_smooth(); returns the first column left for the scalar code. */
+static int canny_blur_y_round_avx2(float *dot, int width, float sum_y,
+   short int *out)
+{
+   int c;
+   __m256 d;
+   __m256d lo, hi;
+   const __m256d boost = _mm256_set1_pd(BOOSTBLURFACTOR);
+   const __m256d sum = _mm256_set1_pd(sum_y);
+   const __m256d half = _mm256_set1_pd(0.5);
+
+   for(c=0;c+8<=width;c+=8){
+      d = _mm256_loadu_ps(dot + c);
+      lo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+      hi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+      lo = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(lo, boost), sum), half);
+      hi = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(hi, boost), sum), half);
+      _mm_storeu_si128((__m128i *)(out + c), _mm_packs_epi32(
+         _mm256_cvttpd_epi32(lo), _mm256_cvttpd_epi32(hi)));
+   }
+   return c;
+}
+
+/* (int)(0.5 + sqrt(sq)) for integer valued sq < 2^31. The estimate
+   sq * rsqrt(sq), with one Newton step, is within one of the result and is
+   then fixed by integer comparisons: the result is the m with
+   m*m - m + 1 <= sq <= m*m + m (or 0 for sq = 0). */
+static inline __m256i canny_round_sqrt_avx2(__m256 sq)
+{
+   __m256 r, estimate;
+   __m256i m, m2, s, inc, dec;
+
+   r = _mm256_rsqrt_ps(sq);
+   r = _mm256_mul_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.5f),
+      _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), sq), _mm256_mul_ps(r, r))));
+   estimate = _mm256_mul_ps(sq, r);
+   estimate = _mm256_blendv_ps(estimate, _mm256_setzero_ps(),
+      _mm256_cmp_ps(sq, _mm256_setzero_ps(), _CMP_EQ_OQ));
+   m = _mm256_cvttps_epi32(_mm256_add_ps(estimate, _mm256_set1_ps(0.5f)));
+
+   s = _mm256_cvtps_epi32(sq);
+   m2 = _mm256_mullo_epi32(m, m);
+   inc = _mm256_cmpgt_epi32(s, _mm256_add_epi32(m2, m));
+   dec = _mm256_and_si256(_mm256_cmpgt_epi32(m, _mm256_setzero_si256()),
+      _mm256_cmpgt_epi32(_mm256_sub_epi32(m2, m), _mm256_sub_epi32(s, _mm256_set1_epi32(1))));
+   return _mm256_add_epi32(_mm256_sub_epi32(m, inc), dec);
+}
+
+/* Interior columns [c_begin, c_end) of canny_gradient_row(); returns the first
+   column left for the scalar code. */
+static int canny_gradient_avx2(short int *prev, short int *cur,
+   short int *next, int s0, int m0, int c_begin, int c_end, short int *delta_x,
+   short int *delta_y, short int *magnitude)
+{
+   int c, i;
+   __m128i dx, dy;
+   __m256i dx32, dy32;
+   __m256 sq;
+
+   for(c=c_begin;c+8<=c_end;c+=8){
+      i = c - s0;
+      dx = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(cur + i + 1)),
+         _mm_loadu_si128((const __m128i *)(cur + i - 1)));
+      dy = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(next + i)),
+         _mm_loadu_si128((const __m128i *)(prev + i)));
+      _mm_storeu_si128((__m128i *)(delta_x + c - m0), dx);
+      _mm_storeu_si128((__m128i *)(delta_y + c - m0), dy);
+
+      dx32 = _mm256_cvtepi16_epi32(dx);
+      dy32 = _mm256_cvtepi16_epi32(dy);
+      sq = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_mullo_epi32(dx32, dx32)),
+         _mm256_cvtepi32_ps(_mm256_mullo_epi32(dy32, dy32)));
+      __m256i mag = canny_round_sqrt_avx2(sq);
+      _mm_storeu_si128((__m128i *)(magnitude + c - m0), _mm_packs_epi32(
+         _mm256_castsi256_si128(mag), _mm256_extracti128_si256(mag, 1)));
+   }
+   return c;
+}
+
+static inline __m256i canny_load_epi32(const short int *p)
+{
+   return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline __m256i canny_select(__m256i mask, __m256i if_true,
+   __m256i if_false)
+{
+   return _mm256_blendv_epi8(if_false, if_true, mask);
+}
+
+/* Columns [c_begin, c_end) of the non-maximal suppression of one row, the
+   vector form of non_max_supp_pixel(). All eight octants are handled with
+   masks: p = (gx >= 0), q = (gy >= 0) and h = the gradient is closer to the
+   x-axis than to the y-axis (the third test of non_max_supp_pixel()). Each
+   octant is of the form mag = A*xperp + B*yperp with integer A and B built
+   from the point z1 next to the center and the diagonal point z2. Returns
+   the first column left for the scalar code. */
+static int canny_nms_avx2(short int *mag_prev, short int *mag_cur,
+   short int *mag_next, short int *gx, short int *gy, int c_begin, int c_end,
+   unsigned char *edgerow, int *hist)
+{
+   int c, lane, bits;
+   __m256i m, n, s, w, e, nw, ne, sw, se, vx, vy, p, q, h, ax, ay;
+   __m256i z1, z2, a, b, result;
+   __m256 xperp, yperp, mag1, mag2, fm, noedge;
+   const __m256i zero = _mm256_setzero_si256();
+   __m128i packed;
+
+   for(c=c_begin;c+8<=c_end;c+=8){
+      m = canny_load_epi32(mag_cur + c);
+      w = canny_load_epi32(mag_cur + c - 1);
+      e = canny_load_epi32(mag_cur + c + 1);
+      n = canny_load_epi32(mag_prev + c);
+      nw = canny_load_epi32(mag_prev + c - 1);
+      ne = canny_load_epi32(mag_prev + c + 1);
+      s = canny_load_epi32(mag_next + c);
+      sw = canny_load_epi32(mag_next + c - 1);
+      se = canny_load_epi32(mag_next + c + 1);
+      vx = canny_load_epi32(gx + c);
+      vy = canny_load_epi32(gy + c);
+
+      p = _mm256_xor_si256(_mm256_cmpgt_epi32(zero, vx), _mm256_set1_epi32(-1));
+      q = _mm256_xor_si256(_mm256_cmpgt_epi32(zero, vy), _mm256_set1_epi32(-1));
+      ax = _mm256_abs_epi32(vx);
+      ay = _mm256_abs_epi32(vy);
+      h = _mm256_or_si256(_mm256_cmpgt_epi32(ax, ay), _mm256_and_si256(
+         _mm256_cmpeq_epi32(ax, ay), _mm256_or_si256(p, q)));
+
+      fm = _mm256_cvtepi32_ps(m);
+      xperp = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(zero, vx)), fm);
+      yperp = _mm256_div_ps(_mm256_cvtepi32_ps(vy), fm);
+
+      /* Left point */
+      z2 = canny_select(q, canny_select(p, nw, ne), canny_select(p, sw, se));
+      z1 = canny_select(h, canny_select(p, w, e), canny_select(q, n, s));
+      a = canny_select(h,
+         canny_select(p, _mm256_sub_epi32(m, z1), _mm256_sub_epi32(z1, m)),
+         canny_select(p, _mm256_sub_epi32(z1, z2), _mm256_sub_epi32(z2, z1)));
+      b = canny_select(h,
+         canny_select(q, _mm256_sub_epi32(z2, z1), _mm256_sub_epi32(z1, z2)),
+         canny_select(q, _mm256_sub_epi32(z1, m), _mm256_sub_epi32(m, z1)));
+      mag1 = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(a), xperp),
+         _mm256_mul_ps(_mm256_cvtepi32_ps(b), yperp));
+
+      /* Right point */
+      z2 = canny_select(q, canny_select(p, se, sw), canny_select(p, ne, nw));
+      z1 = canny_select(h, canny_select(p, e, w), canny_select(q, s, n));
+      a = canny_select(h,
+         canny_select(p, _mm256_sub_epi32(m, z1), _mm256_sub_epi32(z1, m)),
+         canny_select(p, _mm256_sub_epi32(z1, z2), _mm256_sub_epi32(z2, z1)));
+      b = canny_select(h,
+         canny_select(q, _mm256_sub_epi32(z2, z1), _mm256_sub_epi32(z1, z2)),
+         canny_select(q, _mm256_sub_epi32(z1, m), _mm256_sub_epi32(m, z1)));
+      mag2 = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(a), xperp),
+         _mm256_mul_ps(_mm256_cvtepi32_ps(b), yperp));
+
+      /* Now determine if the current point is a maximum point */
+      noedge = _mm256_or_ps(
+         _mm256_or_ps(_mm256_cmp_ps(mag1, _mm256_setzero_ps(), _CMP_GT_OQ),
+            _mm256_cmp_ps(mag2, _mm256_setzero_ps(), _CMP_GT_OQ)),
+         _mm256_cmp_ps(mag2, _mm256_setzero_ps(), _CMP_EQ_OQ));
+      noedge = _mm256_or_ps(noedge, _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, zero)));
+      result = canny_select(_mm256_castps_si256(noedge),
+         _mm256_set1_epi32(NOEDGE), _mm256_set1_epi32(POSSIBLE_EDGE));
+
+      packed = _mm_packs_epi32(_mm256_castsi256_si128(result),
+         _mm256_extracti128_si256(result, 1));
+      _mm_storel_epi64((__m128i *)(edgerow + c), _mm_packus_epi16(packed, packed));
+
+      bits = ~_mm256_movemask_ps(noedge) & 0xff;
+      for(lane=0;bits;lane++,bits>>=1){
+         if(bits & 1) hist[mag_cur[c + lane]]++;
+      }
+   }
+   return c;
+}
+
+#endif
+
+/*******************************************************************************
+* PROCEDURE: canny_blur_x_row
+* PURPOSE: Blurs columns [c0, c1) of one image row in the x-direction. Same
+* arithmetic as gaussian_smooth().
+*******************************************************************************/
+static void canny_blur_x_row(unsigned char *imagerow, int cols, int c0, int c1,
+   float *kernel, int center, float *sum_x, float *dot, float *out)
+{
+   int c, cc, vector_begin, vector_end;
+
+   /* Columns where the kernel is fully inside the image */
+   vector_begin = MIN(MAX(c0, center), c1);
+   vector_end = MAX(MIN(c1, cols - center), vector_begin);
+#ifdef __AVX2__
+   vector_end = canny_blur_x_avx2(imagerow, vector_begin, vector_end, c0,
+      kernel, center, sum_x, out);
+#else
+   vector_end = vector_begin;
+#endif
+
+   for(c=c0;c<c1;c++) dot[c - c0] = 0.0;
+   for(cc=(-center);cc<=center;cc++){
+      for(c=MAX(c0, -cc);c<MIN(c1, cols - cc);c++){
+         if(c == vector_begin) c = vector_end;
+         if(c >= MIN(c1, cols - cc)) break;
+         dot[c - c0] += (float)imagerow[c + cc] * kernel[center + cc];
+      }
+   }
+   for(c=c0;c<c1;c++){
+      if(c == vector_begin) c = vector_end;
+      if(c >= c1) break;
+      out[c - c0] = dot[c - c0] / sum_x[c];
+   }
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_blur_y_row
+* PURPOSE: Blurs one row in the y-direction from the ring of x-blurred rows.
+* Same arithmetic as gaussian_smooth().
+*******************************************************************************/
+static void canny_blur_y_row(canny_workspace *ws, int r, int rows, int width,
+   float *kernel, int center, float sum_y, short int *out)
+{
+   int c = 0, rr;
+   float *dot = ws->dot, *in;
+
+   for(c=0;c<width;c++) dot[c] = 0.0;
+   for(rr=MAX(-center, -r);rr<=MIN(center, rows-1-r);rr++){
+      in = ws->xblur + (long)((r + rr) % ws->windowsize) * width;
+      for(c=0;c<width;c++) dot[c] += in[c] * kernel[center + rr];
+   }
+#ifdef __AVX2__
+   c = canny_blur_y_round_avx2(dot, width, sum_y, out);
+#else
+   c = 0;
+#endif
+   for(;c<width;c++){
+      out[c] = (short int)(dot[c] * BOOSTBLURFACTOR / sum_y + 0.5);
+   }
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_gradient_row
+* PURPOSE: Computes the derivatives and the magnitude of the gradient for
+* columns [m0, m1) of row r. The smoothed rows hold columns [s0, s0 + width).
+* Same arithmetic as derrivative_x_y() and magnitude_x_y().
+*******************************************************************************/
+static void canny_gradient_row(short int *prev, short int *cur,
+   short int *next, int cols, int s0, int m0, int m1, short int *delta_x,
+   short int *delta_y, short int *magnitude)
+{
+   int c, i, sq1, sq2, vector_begin, vector_end;
+
+   /* Columns with both x neighbours */
+   vector_begin = MIN(MAX(m0, 1), m1);
+   vector_end = MAX(MIN(m1, cols - 1), vector_begin);
+#ifdef __AVX2__
+   vector_end = canny_gradient_avx2(prev, cur, next, s0, m0, vector_begin,
+      vector_end, delta_x, delta_y, magnitude);
+#else
+   vector_end = vector_begin;
+#endif
+
+   for(c=m0;c<m1;c++){
+      if(c == vector_begin) c = vector_end;
+      if(c >= m1) break;
+      i = c - s0;
+      if(cols == 1) delta_x[c - m0] = 0;
+      else if(c == 0) delta_x[c - m0] = cur[i+1] - cur[i];
+      else if(c == cols-1) delta_x[c - m0] = cur[i] - cur[i-1];
+      else delta_x[c - m0] = cur[i+1] - cur[i-1];
+
+      delta_y[c - m0] = next[i] - prev[i];
+
+      sq1 = (int)delta_x[c - m0] * (int)delta_x[c - m0];
+      sq2 = (int)delta_y[c - m0] * (int)delta_y[c - m0];
+      magnitude[c - m0] = (short)(0.5 + sqrt((float)sq1 + (float)sq2));
+   }
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_nms_row
+* PURPOSE: Non-maximal suppression of the columns [c0, c1) of row r. All row
+* pointers are indexed by image column. Writes POSSIBLE_EDGE or NOEDGE to the
+* edge row and adds the possible edges to the histogram.
+*******************************************************************************/
+static void canny_nms_row(short int *mag_prev, short int *mag_cur,
+   short int *mag_next, short int *gx, short int *gy, int r, int rows,
+   int cols, int c0, int c1, unsigned char *edgerow, int *hist)
+{
+   int c, vector_begin, vector_end;
+   unsigned char result;
+
+   /* Same points as non_max_supp(): the last two rows and columns and the
+      first row and column are never edges. */
+   if(r < 1 || r >= rows - 2){
+      memset(edgerow + c0, NOEDGE, c1 - c0);
+      return;
+   }
+
+   vector_begin = MIN(MAX(c0, 1), c1);
+   vector_end = MAX(MIN(c1, cols - 2), vector_begin);
+#ifdef __AVX2__
+   vector_end = canny_nms_avx2(mag_prev, mag_cur, mag_next, gx, gy,
+      vector_begin, vector_end, edgerow, hist);
+#else
+   vector_end = vector_begin;
+#endif
+
+   for(c=c0;c<c1;c++){
+      if(c == vector_begin) c = vector_end;
+      if(c >= c1) break;
+      if(c < 1 || c >= cols - 2){
+         edgerow[c] = NOEDGE;
+         continue;
+      }
+      result = non_max_supp_pixel(mag_prev + c, mag_cur + c, mag_next + c,
+         gx[c], gy[c]);
+      edgerow[c] = result;
+      if(result == POSSIBLE_EDGE) hist[mag_cur[c]]++;
+   }
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_fused_tile
+* PURPOSE: Runs the fused stages for the rows [r0, r1) and the columns [c0, c1)
+* of the image. Writes the magnitude and the initial hysteresis edge map
+* (POSSIBLE_EDGE or NOEDGE) of the tile and adds the possible edges to the
+* histogram of the workspace.
+*******************************************************************************/
+static void canny_fused_tile(unsigned char *image, int rows, int cols,
+   float *kernel, int center, float *sum_x, float *sum_y, int r0, int r1,
+   int c0, int c1, canny_workspace *ws, short int *magnitude,
+   unsigned char *edge)
+{
+   int r, next_x, next_s, next_m, last;
+   int m0, m1, s0, s1, width, mwidth;
+   short int *prev, *cur, *next, *mag_prev, *mag_cur, *mag_next;
+
+   /* Magnitude columns needed by the non-maximal suppression, smoothed
+      columns needed by the x-derivative. */
+   m0 = MAX(c0 - 1, 0);
+   m1 = MIN(c1 + 1, cols);
+   s0 = MAX(m0 - 1, 0);
+   s1 = MIN(m1 + 1, cols);
+   width = s1 - s0;
+   mwidth = m1 - m0;
+
+   next_m = MAX(r0 - 1, 0);
+   next_s = MAX(next_m - 1, 0);
+   next_x = MAX(next_s - center, 0);
+
+   for(r=r0;r<r1;r++){
+      /* Pull the stages forward until the magnitude of row r+1 is there. */
+      for(;next_m<=MIN(r + 1, rows - 1);next_m++){
+         for(;next_s<=MIN(next_m + 1, rows - 1);next_s++){
+            for(;next_x<=MIN(next_s + center, rows - 1);next_x++){
+               canny_blur_x_row(image + (long)next_x * cols, cols, s0, s1,
+                  kernel, center, sum_x, ws->dot,
+                  ws->xblur + (long)(next_x % ws->windowsize) * width);
+            }
+            canny_blur_y_row(ws, next_s, rows, width, kernel, center,
+               sum_y[next_s], ws->smoothed + (long)(next_s % 3) * width);
          }
-         else{
-            xperp = -(gx = *gxptr)/((float)m00);
-            yperp = (gy = *gyptr)/((float)m00);
+
+         last = rows - 1;
+         cur = ws->smoothed + (long)(next_m % 3) * width;
+         prev = next_m == 0 ? cur :
+            ws->smoothed + (long)((next_m - 1) % 3) * width;
+         next = next_m == last ? cur :
+            ws->smoothed + (long)((next_m + 1) % 3) * width;
+         canny_gradient_row(prev, cur, next, cols, s0, m0, m1,
+            ws->delta_x + (long)(next_m % 3) * mwidth,
+            ws->delta_y + (long)(next_m % 3) * mwidth,
+            ws->magnitude + (long)(next_m % 3) * mwidth);
+      }
+
+      mag_cur = ws->magnitude + (long)(r % 3) * mwidth - m0;
+      mag_prev = ws->magnitude + (long)((r + 2) % 3) * mwidth - m0;
+      mag_next = ws->magnitude + (long)((r + 1) % 3) * mwidth - m0;
+
+      memcpy(magnitude + (long)r * cols + c0, mag_cur + c0,
+         (c1 - c0) * sizeof(short));
+      canny_nms_row(mag_prev, mag_cur, mag_next,
+         ws->delta_x + (long)(r % 3) * mwidth - m0,
+         ws->delta_y + (long)(r % 3) * mwidth - m0,
+         r, rows, cols, c0, c1, edge + (long)r * cols, ws->hist);
+   }
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_follow_band
+* PURPOSE: Edge following restricted to the rows [r0, r1), without recursion.
+* The points on the stack are already marked as edges. Returns 1 if a point in
+* the first or the last row of the band was marked.
+*******************************************************************************/
+static int canny_follow_band(short int *mag, unsigned char *edge, int cols,
+   int r0, int r1, int lowval, canny_stack *stack)
+{
+   int i, pos, q, r, rq, boundary = 0;
+   int x[8] = {1,1,0,-1,-1,-1,0,1},
+       y[8] = {0,1,1,1,0,-1,-1,-1};
+
+   while(stack->size > 0){
+      pos = stack->data[--stack->size];
+      r = pos / cols;
+      if(r == r0 || r == r1 - 1) boundary = 1;
+
+      for(i=0;i<8;i++){
+         rq = r - y[i];
+         if(rq < r0 || rq >= r1) continue;
+         q = pos - y[i]*cols + x[i];
+         if((edge[q] == POSSIBLE_EDGE) && (mag[q] > lowval)){
+            edge[q] = (unsigned char) EDGE;
+            canny_stack_push(stack, q);
          }
+      }
+   }
+   return boundary;
+}
+
+/*******************************************************************************
+* PROCEDURE: apply_hysteresis_parallel
+* PURPOSE: Same as the edge following of apply_hysteresis(), on an edge map
+* that is already initialized. The image is split into bands of rows. Every
+* band follows the edges from its own seeds, stopping at the band border. Then
+* edges that cross a band border are picked up by the neighbouring band in the
+* next round; the rounds repeat until no band marks a point on its border.
+*******************************************************************************/
+void apply_hysteresis_parallel(short int *mag, unsigned char *edge, int rows,
+   int cols, int lowthreshold, int highthreshold)
+{
+   int bands = (rows + CANNY_HYSTERESIS_BAND_ROWS - 1) /
+      CANNY_HYSTERESIS_BAND_ROWS;
+   canny_stack *stacks;
+   int *boundary;
+   int again = 1;
+
+   if((stacks = (canny_stack *) calloc(bands, sizeof(canny_stack))) == NULL ||
+      (boundary = (int *) calloc(bands, sizeof(int))) == NULL){
+      fprintf(stderr, "Error allocating the hysteresis bands.\n");
+      exit(1);
+   }
 
-         if(gx >= 0){
-            if(gy >= 0){
-                    if (gx >= gy)
-                    {  
-                        /* 111 */
-                        /* Left point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr - ncols - 1);
-
-                        mag1 = (m00 - z1)*xperp + (z2 - z1)*yperp;
-                        
-                        /* Right point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr + ncols + 1);
-
-                        mag2 = (m00 - z1)*xperp + (z2 - z1)*yperp;
-                    }
-                    else
-                    {    
-                        /* 110 */
-                        /* Left point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols - 1);
-
-                        mag1 = (z1 - z2)*xperp + (z1 - m00)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols + 1);
-
-                        mag2 = (z1 - z2)*xperp + (z1 - m00)*yperp; 
-                    }
-                }
-                else
-                {
-                    if (gx >= -gy)
-                    {
-                        /* 101 */
-                        /* Left point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag1 = (m00 - z1)*xperp + (z1 - z2)*yperp;
-            
-                        /* Right point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag2 = (m00 - z1)*xperp + (z1 - z2)*yperp;
-                    }
-                    else
-                    {    
-                        /* 100 */
-                        /* Left point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag1 = (z1 - z2)*xperp + (m00 - z1)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag2 = (z1 - z2)*xperp  + (m00 - z1)*yperp; 
-                    }
-                }
+   #pragma omp parallel
+   {
+      int b, r, c, r0, r1, pos, nb;
+
+      /* Seeds: points above the high threshold. */
+      #pragma omp for schedule(dynamic)
+      for(b=0;b<bands;b++){
+         r0 = b * CANNY_HYSTERESIS_BAND_ROWS;
+         r1 = MIN(r0 + CANNY_HYSTERESIS_BAND_ROWS, rows);
+         for(pos=r0*cols;pos<r1*cols;pos++){
+            if((edge[pos] == POSSIBLE_EDGE) && (mag[pos] >= highthreshold)){
+               edge[pos] = EDGE;
+               canny_stack_push(&stacks[b], pos);
             }
-            else
-            {
-                if ((gy = *gyptr) >= 0)
-                {
-                    if (-gx >= gy)
-                    {          
-                        /* 011 */
-                        /* Left point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag1 = (z1 - m00)*xperp + (z2 - z1)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag2 = (z1 - m00)*xperp + (z2 - z1)*yperp;
-                    }
-                    else
-                    {
-                        /* 010 */
-                        /* Left point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols + 1);
-
-                        mag1 = (z2 - z1)*xperp + (z1 - m00)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols - 1);
-
-                        mag2 = (z2 - z1)*xperp + (z1 - m00)*yperp;
-                    }
-                }
-                else
-                {
-                    if (-gx > -gy)
-                    {
-                        /* 001 */
-                        /* Left point */
-                        z1 = *(magptr + 1);
-                        z2 = *(magptr + ncols + 1);
-
-                        mag1 = (z1 - m00)*xperp + (z1 - z2)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr - 1);
-                        z2 = *(magptr - ncols - 1);
-
-                        mag2 = (z1 - m00)*xperp + (z1 - z2)*yperp;
-                    }
-                    else
-                    {
-                        /* 000 */
-                        /* Left point */
-                        z1 = *(magptr + ncols);
-                        z2 = *(magptr + ncols + 1);
-
-                        mag1 = (z2 - z1)*xperp + (m00 - z1)*yperp;
-
-                        /* Right point */
-                        z1 = *(magptr - ncols);
-                        z2 = *(magptr - ncols - 1);
-
-                        mag2 = (z2 - z1)*xperp + (m00 - z1)*yperp;
-                    }
-                }
-            } 
-
-            /* Now determine if the current point is a maximum point */
-
-            if ((mag1 > 0.0) || (mag2 > 0.0))
-            {
-                *resultptr = (unsigned char) NOEDGE;
+         }
+         boundary[b] = canny_follow_band(mag, edge, cols, r0, r1,
+            lowthreshold, &stacks[b]);
+      }
+
+      while(1){
+         #pragma omp single
+         {
+            again = 0;
+            for(b=0;b<bands;b++){
+               again |= boundary[b];
+               boundary[b] = 0;
             }
-            else
-            {    
-                if (mag2 == 0.0)
-                    *resultptr = (unsigned char) NOEDGE;
-                else
-                    *resultptr = (unsigned char) POSSIBLE_EDGE;
+         }
+         if(!again) break;
+
+         /* Collect the border points next to an edge in the neighbouring
+            band. Nothing is written, so the bands can be read freely. */
+         #pragma omp for schedule(dynamic)
+         for(b=0;b<bands;b++){
+            r0 = b * CANNY_HYSTERESIS_BAND_ROWS;
+            r1 = MIN(r0 + CANNY_HYSTERESIS_BAND_ROWS, rows);
+            for(nb=0;nb<2;nb++){
+               r = nb == 0 ? r0 : r1 - 1;
+               int other = nb == 0 ? r0 - 1 : r1;
+               if(other < 0 || other >= rows) continue;
+               for(c=1;c<cols-1;c++){
+                  pos = r * cols + c;
+                  if((edge[pos] != POSSIBLE_EDGE) || (mag[pos] <= lowthreshold))
+                     continue;
+                  pos = other * cols + c;
+                  if(edge[pos-1] == EDGE || edge[pos] == EDGE ||
+                     edge[pos+1] == EDGE){
+                     canny_stack_push(&stacks[b], r * cols + c);
+                  }
+               }
             }
-        } 
-    }
+         }
+
+         #pragma omp for schedule(dynamic)
+         for(b=0;b<bands;b++){
+            int i, marked = 0;
+            r0 = b * CANNY_HYSTERESIS_BAND_ROWS;
+            r1 = MIN(r0 + CANNY_HYSTERESIS_BAND_ROWS, rows);
+            for(i=0;i<stacks[b].size;i++){
+               pos = stacks[b].data[i];
+               if(edge[pos] != EDGE){
+                  edge[pos] = EDGE;
+                  stacks[b].data[marked++] = pos;
+               }
+            }
+            stacks[b].size = marked;
+            boundary[b] = canny_follow_band(mag, edge, cols, r0, r1,
+               lowthreshold, &stacks[b]);
+         }
+      }
+
+      /* Set all the remaining possible edges to non-edges. */
+      #pragma omp for schedule(static)
+      for(r=0;r<rows;r++){
+         for(pos=r*cols;pos<(r+1)*cols;pos++){
+            if(edge[pos] != EDGE) edge[pos] = NOEDGE;
+         }
+      }
+   }
+
+   for(int b=0;b<bands;b++) free(stacks[b].data);
+   free(stacks);
+   free(boundary);
+}
+
+/*******************************************************************************
+* PROCEDURE: canny_fused
+* PURPOSE: To perform canny edge detection with the fused, multi-threaded
+* pipeline. Produces the same edge image as canny(). The edge image is
+* allocated unless *edge already points to rows*cols bytes.
+*******************************************************************************/
+void canny_fused(unsigned char *image, int rows, int cols, float sigma,
+         float tlow, float thigh, unsigned char **edge)
+{
+   int r, c, cc, windowsize, center, tile_width, bands, tiles, band_rows;
+   int lowthreshold, highthreshold, hist[32768];
+   float *kernel, *sum_x, *sum_y;
+   short int *magnitude;
+
+   make_gaussian_kernel(sigma, &kernel, &windowsize);
+   center = windowsize / 2;
+
+   /****************************************************************************
+   * Sum of the kernel weights that fall inside the image, per column and per
+   * row, accumulated in the same order as in gaussian_smooth().
+   ****************************************************************************/
+   if((sum_x = (float *) calloc(cols, sizeof(float))) == NULL ||
+      (sum_y = (float *) calloc(rows, sizeof(float))) == NULL){
+      fprintf(stderr, "Error allocating the kernel sums.\n");
+      exit(1);
+   }
+   for(cc=(-center);cc<=center;cc++){
+      for(c=MAX(0, -cc);c<MIN(cols, cols - cc);c++) sum_x[c] += kernel[center + cc];
+      for(r=MAX(0, -cc);r<MIN(rows, rows - cc);r++) sum_y[r] += kernel[center + cc];
+   }
+
+   if((magnitude = (short int *) malloc_large(rows*cols*sizeof(short))) == NULL){
+      fprintf(stderr, "Error allocating the magnitude image.\n");
+      exit(1);
+   }
+   if((*edge == NULL) &&
+      (*edge=(unsigned char *)malloc_large(rows*cols*sizeof(unsigned char))) ==NULL){
+      fprintf(stderr, "Error allocating the edge image.\n");
+      exit(1);
+   }
+
+   /****************************************************************************
+   * Tiles: a few bands of rows per thread, and columns as wide as the line
+   * buffers allow.
+   ****************************************************************************/
+   tile_width = canny_tile_width(cols, windowsize);
+   tiles = (cols + tile_width - 1) / tile_width;
+   band_rows = MAX(CANNY_MIN_BAND_ROWS,
+      (rows + 4 * omp_get_max_threads() - 1) / (4 * omp_get_max_threads()));
+   bands = (rows + band_rows - 1) / band_rows;
+
+   for(r=0;r<32768;r++) hist[r] = 0;
+
+   #pragma omp parallel
+   {
+      int t, i, r0, c0, width = MIN(tile_width + 4, cols);
+      canny_workspace *ws;
+
+      if((ws = (canny_workspace *) calloc(1, sizeof(canny_workspace))) == NULL ||
+         (ws->xblur = (float *) malloc((long)windowsize * width * sizeof(float))) == NULL ||
+         (ws->dot = (float *) malloc(width * sizeof(float))) == NULL ||
+         (ws->smoothed = (short int *) malloc(3 * width * sizeof(short))) == NULL ||
+         (ws->delta_x = (short int *) malloc(3 * width * sizeof(short))) == NULL ||
+         (ws->delta_y = (short int *) malloc(3 * width * sizeof(short))) == NULL ||
+         (ws->magnitude = (short int *) malloc(3 * width * sizeof(short))) == NULL){
+         fprintf(stderr, "Error allocating the line buffers.\n");
+         exit(1);
+      }
+      ws->windowsize = windowsize;
+
+      #pragma omp for schedule(dynamic)
+      for(t=0;t<bands*tiles;t++){
+         r0 = (t / tiles) * band_rows;
+         c0 = (t % tiles) * tile_width;
+         canny_fused_tile(image, rows, cols, kernel, center, sum_x, sum_y,
+            r0, MIN(r0 + band_rows, rows), c0, MIN(c0 + tile_width, cols), ws,
+            magnitude, *edge);
+      }
+
+      #pragma omp critical
+      for(i=0;i<32768;i++) hist[i] += ws->hist[i];
+
+      free(ws->xblur);
+      free(ws->dot);
+      free(ws->smoothed);
+      free(ws->delta_x);
+      free(ws->delta_y);
+      free(ws->magnitude);
+      free(ws);
+   }
+
+   /****************************************************************************
+   * Use hysteresis to mark the edge pixels.
+   ****************************************************************************/
+   hysteresis_thresholds(hist, tlow, thigh, &lowthreshold, &highthreshold);
+   apply_hysteresis_parallel(magnitude, *edge, rows, cols, lowthreshold,
+      highthreshold);
+
+   free_large(magnitude, rows*cols*sizeof(short));
+   free(sum_x);
+   free(sum_y);
+   free(kernel);
 }
 
 /*******************************************************************************
@@ -953,29 +1840,40 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
 {
    FILE *fp;
    char buf[71];
+   image_map im;
 
    /***************************************************************************
-   * Open the input image file for reading if a filename was given. If no
-   * filename was provided, set fp to read from standard input.
+   * Files are mapped and copied in one go, only standard input is read with
+   * stdio.
    ***************************************************************************/
-   if(infilename == NULL) fp = stdin;
-   else{
-      if((fp = fopen(infilename, "r")) == NULL){
-         fprintf(stderr, "Error reading the file %s in read_pgm_image().\n",
-            infilename);
+   if(infilename != NULL){
+      if(image_map_open(infilename, "P5", &im) == 0) return(0);
+      *rows = im.rows;
+      *cols = im.cols;
+      if(((*image) = (unsigned char *) malloc((size_t)im.rows * im.cols)) == NULL){
+         fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
+         image_map_close(&im);
          return(0);
       }
+      memcpy(*image, im.pixels, (size_t)im.rows * im.cols);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is read from standard input.
+   ***************************************************************************/
+   fp = stdin;
+
    /***************************************************************************
    * Verify that the image is in PGM format, read in the number of columns
    * and rows in the image and scan past all of the header information.
    ***************************************************************************/
    fgets(buf, 70, fp);
    if(strncmp(buf,"P5",2) != 0){
-      fprintf(stderr, "The file %s is not in PGM format in ", infilename);
+      fprintf(stderr, "The file %s is not in PGM format in ",
+         infilename != NULL ? infilename : "stdin");
       fprintf(stderr, "read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    do{ fgets(buf, 70, fp); }while(buf[0] == '#');  /* skip all comment lines */
@@ -987,17 +1885,14 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
    ***************************************************************************/
    if(((*image) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if((*rows) != fread((*image), (*cols), (*rows), fp)){
       fprintf(stderr, "Error reading the image data in read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       free((*image));
       return(0);
    }
 
-   if(fp != stdin) fclose(fp);
    return(1);
 }
 
@@ -1011,20 +1906,25 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
     int cols, char *comment, int maxval)
 {
    FILE *fp;
+   image_map im;
 
    /***************************************************************************
-   * Open the output image file for writing if a filename was given. If no
-   * filename was provided, set fp to write to standard output.
+   * Files are created with their final size and written through a mapping,
+   * only standard output is written with stdio.
    ***************************************************************************/
-   if(outfilename == NULL) fp = stdout;
-   else{
-      if((fp = fopen(outfilename, "w")) == NULL){
-         fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-            outfilename);
-         return(0);
-      }
+   if(outfilename != NULL){
+      if(image_map_create(outfilename, "P5", rows, cols, comment, maxval,
+         &im) == 0) return(0);
+      memcpy(im.pixels, image, (size_t)rows * cols);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is written to standard output.
+   ***************************************************************************/
+   fp = stdout;
+
    /***************************************************************************
    * Write the header information to the PGM file.
    ***************************************************************************/
@@ -1038,11 +1938,9 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
    ***************************************************************************/
    if(rows != fwrite(image, cols, rows, fp)){
       fprintf(stderr, "Error writing the image data in write_pgm_image().\n");
-      if(fp != stdout) fclose(fp);
       return(0);
    }
 
-   if(fp != stdout) fclose(fp);
    return(1);
 }
 
@@ -1063,29 +1961,43 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
    FILE *fp;
    char buf[71];
    int p, size;
+   image_map im;
 
    /***************************************************************************
-   * Open the input image file for reading if a filename was given. If no
-   * filename was provided, set fp to read from standard input.
+   * Files are mapped and split into the planar images in parallel, only
+   * standard input is read with stdio.
    ***************************************************************************/
-   if(infilename == NULL) fp = stdin;
-   else{
-      if((fp = fopen(infilename, "r")) == NULL){
-         fprintf(stderr, "Error reading the file %s in read_ppm_image().\n",
-            infilename);
+   if(infilename != NULL){
+      if(image_map_open(infilename, "P6", &im) == 0) return(0);
+      *rows = im.rows;
+      *cols = im.cols;
+      size = im.rows * im.cols;
+      if(((*image_red) = (unsigned char *) malloc(size)) == NULL ||
+         ((*image_grn) = (unsigned char *) malloc(size)) == NULL ||
+         ((*image_blu) = (unsigned char *) malloc(size)) == NULL){
+         fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
+         image_map_close(&im);
          return(0);
       }
+      image_map_deinterleave(&im, *image_red, *image_grn, *image_blu);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is read from standard input.
+   ***************************************************************************/
+   fp = stdin;
+
    /***************************************************************************
    * Verify that the image is in PPM format, read in the number of columns
    * and rows in the image and scan past all of the header information.
    ***************************************************************************/
    fgets(buf, 70, fp);
    if(strncmp(buf,"P6",2) != 0){
-      fprintf(stderr, "The file %s is not in PPM format in ", infilename);
+      fprintf(stderr, "The file %s is not in PPM format in ",
+         infilename != NULL ? infilename : "stdin");
       fprintf(stderr, "read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    do{ fgets(buf, 70, fp); }while(buf[0] == '#');  /* skip all comment lines */
@@ -1097,17 +2009,14 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
    ***************************************************************************/
    if(((*image_red) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if(((*image_grn) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if(((*image_blu) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
 
@@ -1118,7 +2027,6 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
       (*image_blu)[p] = (unsigned char)fgetc(fp);
    }
 
-   if(fp != stdin) fclose(fp);
    return(1);
 }
 
@@ -1134,20 +2042,26 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
 {
    FILE *fp;
    long size, p;
+   image_map im;
 
    /***************************************************************************
-   * Open the output image file for writing if a filename was given. If no
-   * filename was provided, set fp to write to standard output.
+   * Files are created with their final size and the planar images are
+   * interleaved into the mapping in parallel, only standard output is written
+   * with stdio.
    ***************************************************************************/
-   if(outfilename == NULL) fp = stdout;
-   else{
-      if((fp = fopen(outfilename, "w")) == NULL){
-         fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-            outfilename);
-         return(0);
-      }
+   if(outfilename != NULL){
+      if(image_map_create(outfilename, "P6", rows, cols, comment, maxval,
+         &im) == 0) return(0);
+      image_map_interleave(&im, image_red, image_grn, image_blu);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is written to standard output.
+   ***************************************************************************/
+   fp = stdout;
+
    /***************************************************************************
    * Write the header information to the PGM file.
    ***************************************************************************/
@@ -1166,6 +2080,5 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
       fputc(image_blu[p], fp);
    }
 
-   if(fp != stdout) fclose(fp);
    return(1);
 }
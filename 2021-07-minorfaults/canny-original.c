@@ -57,6 +57,7 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include "image_map.h"
 
 #define VERBOSE 0
 #define BOOSTBLURFACTOR 90.0
@@ -91,6 +92,7 @@ int main(int argc, char *argv[])
    char composedfname[128];  /* Name of the output "direction" image */
    unsigned char *image;     /* The input image */
    unsigned char *edge;      /* The output edge image */
+   image_map input;          /* The mapped input file */
    int rows, cols;           /* The dimensions of the image. */
    float sigma,              /* Standard deviation of the gaussian kernel. */
 	 tlow,               /* Fraction of the high threshold in hysteresis. */
@@ -130,13 +132,18 @@ int main(int argc, char *argv[])
    else dirfilename = NULL;
 
    /****************************************************************************
-   * Read in the image. This read function allocates memory for the image.
+   * Map the image. The pixels are used in place, nothing is copied.
    ****************************************************************************/
    if(VERBOSE) printf("Reading the image %s.\n", infilename);
-   if(read_pgm_image(infilename, &image, &rows, &cols) == 0){
+   if(image_map_open(infilename, "P5", &input) == 0){
       fprintf(stderr, "Error reading the input image, %s.\n", infilename);
       exit(1);
    }
+   image = input.pixels;
+   rows = input.rows;
+   cols = input.cols;
+   sprintf(outfilename, "%s_s_%3.2f_l_%3.2f_h_%3.2f.pgm", infilename,
+      sigma, tlow, thigh);
 
    /****************************************************************************
    * Perform the edge detection. All of the work takes place here.
@@ -165,13 +172,12 @@ int main(int argc, char *argv[])
    /****************************************************************************
    * Write out the edge image to a file.
    ****************************************************************************/
-   sprintf(outfilename, "%s_s_%3.2f_l_%3.2f_h_%3.2f.pgm", infilename,
-      sigma, tlow, thigh);
    if(VERBOSE) printf("Writing the edge iname in the file %s.\n", outfilename);
    if(write_pgm_image(outfilename, edge, rows, cols, "", 255) == 0){
       fprintf(stderr, "Error writing the edge image, %s.\n", outfilename);
       exit(1);
    }
+   image_map_close(&input);
 
    return 0;
 }
@@ -943,29 +949,40 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
 {
    FILE *fp;
    char buf[71];
+   image_map im;
 
    /***************************************************************************
-   * Open the input image file for reading if a filename was given. If no
-   * filename was provided, set fp to read from standard input.
+   * Files are mapped and copied in one go, only standard input is read with
+   * stdio.
    ***************************************************************************/
-   if(infilename == NULL) fp = stdin;
-   else{
-      if((fp = fopen(infilename, "r")) == NULL){
-         fprintf(stderr, "Error reading the file %s in read_pgm_image().\n",
-            infilename);
+   if(infilename != NULL){
+      if(image_map_open(infilename, "P5", &im) == 0) return(0);
+      *rows = im.rows;
+      *cols = im.cols;
+      if(((*image) = (unsigned char *) malloc((size_t)im.rows * im.cols)) == NULL){
+         fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
+         image_map_close(&im);
          return(0);
       }
+      memcpy(*image, im.pixels, (size_t)im.rows * im.cols);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is read from standard input.
+   ***************************************************************************/
+   fp = stdin;
+
    /***************************************************************************
    * Verify that the image is in PGM format, read in the number of columns
    * and rows in the image and scan past all of the header information.
    ***************************************************************************/
    fgets(buf, 70, fp);
    if(strncmp(buf,"P5",2) != 0){
-      fprintf(stderr, "The file %s is not in PGM format in ", infilename);
+      fprintf(stderr, "The file %s is not in PGM format in ",
+         infilename != NULL ? infilename : "stdin");
       fprintf(stderr, "read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    do{ fgets(buf, 70, fp); }while(buf[0] == '#');  /* skip all comment lines */
@@ -977,17 +994,14 @@ int read_pgm_image(char *infilename, unsigned char **image, int *rows,
    ***************************************************************************/
    if(((*image) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if((*rows) != fread((*image), (*cols), (*rows), fp)){
       fprintf(stderr, "Error reading the image data in read_pgm_image().\n");
-      if(fp != stdin) fclose(fp);
       free((*image));
       return(0);
    }
 
-   if(fp != stdin) fclose(fp);
    return(1);
 }
 
@@ -1001,20 +1015,25 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
     int cols, char *comment, int maxval)
 {
    FILE *fp;
+   image_map im;
 
    /***************************************************************************
-   * Open the output image file for writing if a filename was given. If no
-   * filename was provided, set fp to write to standard output.
+   * Files are created with their final size and written through a mapping,
+   * only standard output is written with stdio.
    ***************************************************************************/
-   if(outfilename == NULL) fp = stdout;
-   else{
-      if((fp = fopen(outfilename, "w")) == NULL){
-         fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-            outfilename);
-         return(0);
-      }
+   if(outfilename != NULL){
+      if(image_map_create(outfilename, "P5", rows, cols, comment, maxval,
+         &im) == 0) return(0);
+      memcpy(im.pixels, image, (size_t)rows * cols);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is written to standard output.
+   ***************************************************************************/
+   fp = stdout;
+
    /***************************************************************************
    * Write the header information to the PGM file.
    ***************************************************************************/
@@ -1028,11 +1047,9 @@ int write_pgm_image(char *outfilename, unsigned char *image, int rows,
    ***************************************************************************/
    if(rows != fwrite(image, cols, rows, fp)){
       fprintf(stderr, "Error writing the image data in write_pgm_image().\n");
-      if(fp != stdout) fclose(fp);
       return(0);
    }
 
-   if(fp != stdout) fclose(fp);
    return(1);
 }
 
@@ -1053,29 +1070,43 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
    FILE *fp;
    char buf[71];
    int p, size;
+   image_map im;
 
    /***************************************************************************
-   * Open the input image file for reading if a filename was given. If no
-   * filename was provided, set fp to read from standard input.
+   * Files are mapped and split into the planar images in parallel, only
+   * standard input is read with stdio.
    ***************************************************************************/
-   if(infilename == NULL) fp = stdin;
-   else{
-      if((fp = fopen(infilename, "r")) == NULL){
-         fprintf(stderr, "Error reading the file %s in read_ppm_image().\n",
-            infilename);
+   if(infilename != NULL){
+      if(image_map_open(infilename, "P6", &im) == 0) return(0);
+      *rows = im.rows;
+      *cols = im.cols;
+      size = im.rows * im.cols;
+      if(((*image_red) = (unsigned char *) malloc(size)) == NULL ||
+         ((*image_grn) = (unsigned char *) malloc(size)) == NULL ||
+         ((*image_blu) = (unsigned char *) malloc(size)) == NULL){
+         fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
+         image_map_close(&im);
          return(0);
       }
+      image_map_deinterleave(&im, *image_red, *image_grn, *image_blu);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is read from standard input.
+   ***************************************************************************/
+   fp = stdin;
+
    /***************************************************************************
    * Verify that the image is in PPM format, read in the number of columns
    * and rows in the image and scan past all of the header information.
    ***************************************************************************/
    fgets(buf, 70, fp);
    if(strncmp(buf,"P6",2) != 0){
-      fprintf(stderr, "The file %s is not in PPM format in ", infilename);
+      fprintf(stderr, "The file %s is not in PPM format in ",
+         infilename != NULL ? infilename : "stdin");
       fprintf(stderr, "read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    do{ fgets(buf, 70, fp); }while(buf[0] == '#');  /* skip all comment lines */
@@ -1087,17 +1118,14 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
    ***************************************************************************/
    if(((*image_red) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if(((*image_grn) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
    if(((*image_blu) = (unsigned char *) malloc((*rows)*(*cols))) == NULL){
       fprintf(stderr, "Memory allocation failure in read_ppm_image().\n");
-      if(fp != stdin) fclose(fp);
       return(0);
    }
 
@@ -1108,7 +1136,6 @@ int read_ppm_image(char *infilename, unsigned char **image_red,
       (*image_blu)[p] = (unsigned char)fgetc(fp);
    }
 
-   if(fp != stdin) fclose(fp);
    return(1);
 }
 
@@ -1124,20 +1151,26 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
 {
    FILE *fp;
    long size, p;
+   image_map im;
 
    /***************************************************************************
-   * Open the output image file for writing if a filename was given. If no
-   * filename was provided, set fp to write to standard output.
+   * Files are created with their final size and the planar images are
+   * interleaved into the mapping in parallel, only standard output is written
+   * with stdio.
    ***************************************************************************/
-   if(outfilename == NULL) fp = stdout;
-   else{
-      if((fp = fopen(outfilename, "w")) == NULL){
-         fprintf(stderr, "Error writing the file %s in write_pgm_image().\n",
-            outfilename);
-         return(0);
-      }
+   if(outfilename != NULL){
+      if(image_map_create(outfilename, "P6", rows, cols, comment, maxval,
+         &im) == 0) return(0);
+      image_map_interleave(&im, image_red, image_grn, image_blu);
+      image_map_close(&im);
+      return(1);
    }
 
+   /***************************************************************************
+   * Without a filename the image is written to standard output.
+   ***************************************************************************/
+   fp = stdout;
+
    /***************************************************************************
    * Write the header information to the PGM file.
    ***************************************************************************/
@@ -1156,6 +1189,5 @@ int write_ppm_image(char *outfilename, unsigned char *image_red,
       fputc(image_blu[p], fp);
    }
 
-   if(fp != stdout) fclose(fp);
    return(1);
 }
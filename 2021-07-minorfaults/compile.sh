@@ -0,0 +1,2 @@
+gcc -O3 canny-original.c -o canny-original -lm
+gcc -O3 -mavx2 -fopenmp -pthread canny-mmap.c -o canny-mmap -lm
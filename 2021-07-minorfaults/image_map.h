@@ -0,0 +1,250 @@
+/*******************************************************************************
+* FILE: image_map.h
+* Memory-mapped PGM (P5) and PPM (P6) files.
+*
+* An input file is mapped read-only and its header is parsed in place; the
+* pixels are used directly from the mapping, so nothing is read or copied up
+* front and the pages come straight from the page cache. An output file is
+* created with its final size and mapped shared; the pixels are written
+* straight into the file's pages.
+*
+* Only 8-bit images (maxval < 256) are supported.
+*******************************************************************************/
+#ifndef IMAGE_MAP_H
+#define IMAGE_MAP_H
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+   unsigned char *map;     /* The whole file.                          */
+   size_t map_size;
+   unsigned char *pixels;  /* The first pixel, inside the mapping.     */
+   int rows, cols;
+   int channels;           /* 1 for PGM, 3 (interleaved R/G/B) for PPM. */
+   int maxval;
+} image_map;
+
+/* Row r: cols * channels bytes. */
+static inline unsigned char *image_map_row(const image_map *im, int r)
+{
+   return im->pixels + (size_t)r * im->cols * im->channels;
+}
+
+static inline size_t image_map_row_size(const image_map *im)
+{
+   return (size_t)im->cols * im->channels;
+}
+
+/* Skips whitespace and comments, then reads a decimal number. */
+static int image_map_parse_number(const unsigned char **p,
+   const unsigned char *end, int *value)
+{
+   const unsigned char *s = *p;
+   long v = 0;
+
+   while(s < end){
+      if(*s == '#'){
+         while(s < end && *s != '\n') s++;
+      }
+      else if(isspace(*s)) s++;
+      else break;
+   }
+   if(s >= end || !isdigit(*s)) return(0);
+   while(s < end && isdigit(*s)){
+      v = v * 10 + (*s - '0');
+      if(v > 0x7fffffff) return(0);
+      s++;
+   }
+   *value = (int)v;
+   *p = s;
+   return(1);
+}
+
+/*******************************************************************************
+* Function: image_map_open
+* Purpose: Maps the image file filename, which must start with magic ("P5" or
+* "P6"). Upon failure, this function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+static int image_map_open(const char *filename, const char *magic,
+   image_map *im)
+{
+   int fd;
+   struct stat st;
+   const unsigned char *p, *end;
+
+   memset(im, 0, sizeof(*im));
+   im->channels = magic[1] == '6' ? 3 : 1;
+
+   if((fd = open(filename, O_RDONLY)) < 0){
+      fprintf(stderr, "Error reading the file %s in image_map_open().\n",
+         filename);
+      return(0);
+   }
+   if(fstat(fd, &st) != 0 || st.st_size < 3){
+      fprintf(stderr, "The file %s is too small in image_map_open().\n",
+         filename);
+      close(fd);
+      return(0);
+   }
+
+   im->map_size = st.st_size;
+   im->map = (unsigned char *) mmap(NULL, im->map_size, PROT_READ,
+      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+   close(fd);
+   if(im->map == MAP_FAILED){
+      fprintf(stderr, "Error mapping the file %s in image_map_open().\n",
+         filename);
+      im->map = NULL;
+      return(0);
+   }
+   madvise(im->map, im->map_size, MADV_SEQUENTIAL);
+
+   p = im->map;
+   end = im->map + im->map_size;
+   if(strncmp((const char *)p, magic, 2) != 0){
+      fprintf(stderr, "The file %s is not in %s format in image_map_open().\n",
+         filename, magic);
+      munmap(im->map, im->map_size);
+      im->map = NULL;
+      return(0);
+   }
+   p += 2;
+
+   if(!image_map_parse_number(&p, end, &im->cols) ||
+      !image_map_parse_number(&p, end, &im->rows) ||
+      !image_map_parse_number(&p, end, &im->maxval) ||
+      p >= end || !isspace(*p) || im->maxval <= 0 || im->maxval > 255){
+      fprintf(stderr, "Unsupported header in the file %s in image_map_open().\n",
+         filename);
+      munmap(im->map, im->map_size);
+      im->map = NULL;
+      return(0);
+   }
+   p++;  /* Single whitespace before the pixels */
+
+   if((size_t)(end - p) < (size_t)im->rows * image_map_row_size(im)){
+      fprintf(stderr, "The file %s is truncated in image_map_open().\n",
+         filename);
+      munmap(im->map, im->map_size);
+      im->map = NULL;
+      return(0);
+   }
+   im->pixels = (unsigned char *) p;
+   return(1);
+}
+
+/*******************************************************************************
+* Function: image_map_create
+* Purpose: Creates the file filename with a magic ("P5" or "P6") header for a
+* rows x cols image and maps it for writing. The pixels are written through
+* image_map_row() or im->pixels and reach the file when the image is closed.
+* Upon failure, this function returns 0, upon sucess it returns 1.
+*******************************************************************************/
+static int image_map_create(const char *filename, const char *magic, int rows,
+   int cols, const char *comment, int maxval, image_map *im)
+{
+   int fd;
+   char header[128];
+   int header_size;
+
+   memset(im, 0, sizeof(*im));
+   im->rows = rows;
+   im->cols = cols;
+   im->maxval = maxval;
+   im->channels = magic[1] == '6' ? 3 : 1;
+
+   if(comment != NULL && strlen(comment) <= 70)
+      header_size = snprintf(header, sizeof(header), "%s\n%d %d\n# %s\n%d\n",
+         magic, cols, rows, comment, maxval);
+   else
+      header_size = snprintf(header, sizeof(header), "%s\n%d %d\n%d\n",
+         magic, cols, rows, maxval);
+
+   if((fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0){
+      fprintf(stderr, "Error writing the file %s in image_map_create().\n",
+         filename);
+      return(0);
+   }
+
+   im->map_size = header_size + (size_t)rows * image_map_row_size(im);
+   if(ftruncate(fd, im->map_size) != 0){
+      fprintf(stderr, "Error sizing the file %s in image_map_create().\n",
+         filename);
+      close(fd);
+      return(0);
+   }
+   im->map = (unsigned char *) mmap(NULL, im->map_size,
+      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if(im->map == MAP_FAILED){
+      fprintf(stderr, "Error mapping the file %s in image_map_create().\n",
+         filename);
+      im->map = NULL;
+      return(0);
+   }
+
+   memcpy(im->map, header, header_size);
+   im->pixels = im->map + header_size;
+   return(1);
+}
+
+/* Unmaps the image; pixels written to a created image go to its file. */
+static void image_map_close(image_map *im)
+{
+   if(im->map != NULL) munmap(im->map, im->map_size);
+   memset(im, 0, sizeof(*im));
+}
+
+/*******************************************************************************
+* Function: image_map_deinterleave
+* Purpose: Splits the interleaved R/G/B pixels of a PPM image into three
+* planar images of rows * cols bytes. Rows are split between threads.
+*******************************************************************************/
+static void image_map_deinterleave(const image_map *im, unsigned char *red,
+   unsigned char *grn, unsigned char *blu)
+{
+   int r;
+
+#ifdef _OPENMP
+   #pragma omp parallel for schedule(static)
+#endif
+   for(r=0;r<im->rows;r++){
+      const unsigned char *in = image_map_row(im, r);
+      size_t pos = (size_t)r * im->cols;
+      int c;
+      for(c=0;c<im->cols;c++){
+         red[pos + c] = in[3*c];
+         grn[pos + c] = in[3*c + 1];
+         blu[pos + c] = in[3*c + 2];
+      }
+   }
+}
+
+/* The inverse of image_map_deinterleave(). */
+static void image_map_interleave(image_map *im, const unsigned char *red,
+   const unsigned char *grn, const unsigned char *blu)
+{
+   int r;
+
+#ifdef _OPENMP
+   #pragma omp parallel for schedule(static)
+#endif
+   for(r=0;r<im->rows;r++){
+      unsigned char *out = image_map_row(im, r);
+      size_t pos = (size_t)r * im->cols;
+      int c;
+      for(c=0;c<im->cols;c++){
+         out[3*c] = red[pos + c];
+         out[3*c + 1] = grn[pos + c];
+         out[3*c + 2] = blu[pos + c];
+      }
+   }
+}
+
+#endif
@@ -1 +1,2 @@
 clang++ -O3 -g -mavx2 -DLIKWID_PERFMON main.cpp -o main -llikwid
+clang++ -O3 -g -mavx2 -DLIKWID_PERFMON priority_queue.cpp -o priority_queue -llikwid
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <immintrin.h>
+
+// A D-ary min-heap priority queue, generalized from heapify<T, HeapSize, Branchless>
+// in heapsort.h. Logical element k lives at storage index k + D - 1, so the D children
+// of element k (logical D * k + 1 ... D * k + D) start at storage index D * (k + 1).
+// With a 64-byte aligned buffer and D * sizeof(T) == 64, all children of a node sit
+// in exactly one cache line and the minimum child is found with SIMD. Unused slots
+// are filled with std::numeric_limits<T>::max(), so the last child block can be
+// loaded in full without bound checks. Keys must not be NaN.
+//
+// push returns a handle which stays valid until the element is popped; the handle
+// is used for decrease_key (Dijkstra) and is recycled afterwards.
+
+template <typename T, int D>
+class dary_min_child {
+public:
+    // Returns the offset [0, D) of the smallest element in children[0 .. D - 1].
+    static int find(const T* children) {
+        int smallest = 0;
+        for (int j = 1; j < D; j++) {
+            if (children[j] < children[smallest]) {
+                smallest = j;
+            }
+        }
+        return smallest;
+    }
+};
+
+#ifdef __AVX2__
+
+static inline __m256 dary_hmin_ps(__m256 v) {
+    __m256 m = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_ps(m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return m;
+}
+
+static inline __m256i dary_hmin_epi32(__m256i v) {
+    __m256i m = _mm256_min_epi32(v, _mm256_permute2x128_si256(v, v, 1));
+    m = _mm256_min_epi32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_epi32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return m;
+}
+
+template <>
+class dary_min_child<float, 8> {
+public:
+    static int find(const float* children) {
+        __m256 v = _mm256_load_ps(children);
+        __m256 m = dary_hmin_ps(v);
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(v, m, _CMP_EQ_OQ));
+        return __builtin_ctz(mask);
+    }
+};
+
+template <>
+class dary_min_child<float, 16> {
+public:
+    static int find(const float* children) {
+        __m256 v0 = _mm256_load_ps(children);
+        __m256 v1 = _mm256_load_ps(children + 8);
+        __m256 m = dary_hmin_ps(_mm256_min_ps(v0, v1));
+        int mask0 = _mm256_movemask_ps(_mm256_cmp_ps(v0, m, _CMP_EQ_OQ));
+        int mask1 = _mm256_movemask_ps(_mm256_cmp_ps(v1, m, _CMP_EQ_OQ));
+        return __builtin_ctz(mask0 | (mask1 << 8));
+    }
+};
+
+template <>
+class dary_min_child<int32_t, 8> {
+public:
+    static int find(const int32_t* children) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(children));
+        __m256i m = dary_hmin_epi32(v);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, m)));
+        return __builtin_ctz(mask);
+    }
+};
+
+template <>
+class dary_min_child<int32_t, 16> {
+public:
+    static int find(const int32_t* children) {
+        __m256i v0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(children));
+        __m256i v1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(children + 8));
+        __m256i m = dary_hmin_epi32(_mm256_min_epi32(v0, v1));
+        int mask0 = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v0, m)));
+        int mask1 = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v1, m)));
+        return __builtin_ctz(mask0 | (mask1 << 8));
+    }
+};
+
+template <>
+class dary_min_child<double, 4> {
+public:
+    static int find(const double* children) {
+        __m256d v = _mm256_load_pd(children);
+        __m256d m = _mm256_min_pd(v, _mm256_permute2f128_pd(v, v, 1));
+        m = _mm256_min_pd(m, _mm256_shuffle_pd(m, m, 0x5));
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(v, m, _CMP_EQ_OQ));
+        return __builtin_ctz(mask);
+    }
+};
+
+template <>
+class dary_min_child<double, 8> {
+public:
+    static int find(const double* children) {
+        __m256d v0 = _mm256_load_pd(children);
+        __m256d v1 = _mm256_load_pd(children + 4);
+        __m256d m = _mm256_min_pd(v0, v1);
+        m = _mm256_min_pd(m, _mm256_permute2f128_pd(m, m, 1));
+        m = _mm256_min_pd(m, _mm256_shuffle_pd(m, m, 0x5));
+        int mask0 = _mm256_movemask_pd(_mm256_cmp_pd(v0, m, _CMP_EQ_OQ));
+        int mask1 = _mm256_movemask_pd(_mm256_cmp_pd(v1, m, _CMP_EQ_OQ));
+        return __builtin_ctz(mask0 | (mask1 << 4));
+    }
+};
+
+#endif
+
+template <typename T, int D = 64 / sizeof(T)>
+class dary_heap {
+    static_assert(std::is_arithmetic<T>::value, "dary_heap needs an arithmetic key type");
+    static_assert(D >= 2, "Heap arity must be at least 2");
+
+public:
+    using handle_t = int32_t;
+
+    dary_heap() : m_data(nullptr), m_size(0), m_capacity(0) {
+        reserve(D);
+    }
+
+    explicit dary_heap(int capacity) : m_data(nullptr), m_size(0), m_capacity(0) {
+        reserve(std::max(capacity, D));
+    }
+
+    ~dary_heap() { free(m_data); }
+
+    dary_heap(const dary_heap&) = delete;
+    dary_heap& operator=(const dary_heap&) = delete;
+
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const T& top() const {
+        assert(m_size > 0);
+        return m_data[slot(0)];
+    }
+
+    handle_t top_handle() const {
+        assert(m_size > 0);
+        return m_slot_handle[0];
+    }
+
+    handle_t push(const T& value) {
+        if (m_size == m_capacity) {
+            reserve(m_capacity * 2);
+        }
+
+        handle_t h = allocate_handle();
+        int k = m_size;
+        m_size++;
+        sift_up(k, value, h);
+        return h;
+    }
+
+    void pop() {
+        assert(m_size > 0);
+        release_handle(m_slot_handle[0]);
+
+        m_size--;
+        int last = m_size;
+        T value = m_data[slot(last)];
+        handle_t h = m_slot_handle[last];
+        m_data[slot(last)] = sentinel();
+
+        if (m_size > 0) {
+            sift_down(0, value, h);
+        }
+    }
+
+    // Replaces the smallest element with value; cheaper than pop + push. The handle
+    // of the old top is reused for the new element. Used by top-k selection where
+    // the heap holds the k largest elements seen.
+    handle_t replace_top(const T& value) {
+        assert(m_size > 0);
+        handle_t h = m_slot_handle[0];
+        sift_down(0, value, h);
+        return h;
+    }
+
+    void decrease_key(handle_t h, const T& value) {
+        int k = m_handle_slot[h];
+        assert(k >= 0 && k < m_size);
+        assert(!(m_data[slot(k)] < value));
+        sift_up(k, value, h);
+    }
+
+    const T& key(handle_t h) const {
+        return m_data[slot(m_handle_slot[h])];
+    }
+
+    bool contains(handle_t h) const {
+        return h >= 0 && h < static_cast<handle_t>(m_handle_slot.size()) && m_handle_slot[h] >= 0;
+    }
+
+    // Appends all elements and restores the heap property bottom-up
+    // (Floyd's heap construction, O(n) instead of O(n log n) for repeated pushes).
+    // Handles are assigned in input order; if out is not null they are stored there.
+    template <typename It>
+    void push_range(It first, It last, std::vector<handle_t>* out = nullptr) {
+        int count = static_cast<int>(std::distance(first, last));
+        if (m_size + count > m_capacity) {
+            reserve(std::max(m_capacity * 2, m_size + count));
+        }
+
+        for (It it = first; it != last; ++it) {
+            handle_t h = allocate_handle();
+            m_data[slot(m_size)] = *it;
+            m_slot_handle[m_size] = h;
+            m_handle_slot[h] = m_size;
+            m_size++;
+            if (out) {
+                out->push_back(h);
+            }
+        }
+
+        if (m_size < 2) {
+            return;
+        }
+
+        for (int k = parent(m_size - 1); k >= 0; k--) {
+            sift_down(k, m_data[slot(k)], m_slot_handle[k]);
+        }
+    }
+
+    void clear() {
+        std::fill(m_data, m_data + storage_size(m_capacity), sentinel());
+        m_size = 0;
+        m_handle_slot.clear();
+        m_free_handles.clear();
+    }
+
+private:
+    T* m_data;
+    int m_size;
+    int m_capacity;
+    std::vector<handle_t> m_slot_handle;
+    std::vector<int> m_handle_slot;
+    std::vector<handle_t> m_free_handles;
+
+    static constexpr T sentinel() { return std::numeric_limits<T>::max(); }
+
+    static int slot(int k) { return k + D - 1; }
+    static int parent(int k) { return (k - 1) / D; }
+    static int first_child(int k) { return D * k + 1; }
+
+    // Storage covers D - 1 leading padding slots plus a full child block for every
+    // possible parent, so child blocks can always be read with aligned loads.
+    static size_t storage_size(int capacity) {
+        size_t bytes = (static_cast<size_t>(capacity) + 2 * D) * sizeof(T);
+        return (bytes + 63) / 64 * 64 / sizeof(T);
+    }
+
+    void reserve(int capacity) {
+        size_t new_elems = storage_size(capacity);
+        T* new_data = static_cast<T*>(aligned_alloc(64, new_elems * sizeof(T)));
+        std::fill(new_data, new_data + new_elems, sentinel());
+        if (m_data) {
+            std::memcpy(new_data + slot(0), m_data + slot(0), m_size * sizeof(T));
+            free(m_data);
+        }
+        m_data = new_data;
+        m_capacity = capacity;
+        m_slot_handle.resize(capacity);
+    }
+
+    handle_t allocate_handle() {
+        if (!m_free_handles.empty()) {
+            handle_t h = m_free_handles.back();
+            m_free_handles.pop_back();
+            return h;
+        }
+        m_handle_slot.push_back(-1);
+        return static_cast<handle_t>(m_handle_slot.size() - 1);
+    }
+
+    void release_handle(handle_t h) {
+        m_handle_slot[h] = -1;
+        m_free_handles.push_back(h);
+    }
+
+    void place(int k, const T& value, handle_t h) {
+        m_data[slot(k)] = value;
+        m_slot_handle[k] = h;
+        m_handle_slot[h] = k;
+    }
+
+    // Hole-based sift: the element is written once at its final position. value is
+    // taken by copy because callers may pass a reference into m_data.
+    void sift_up(int k, T value, handle_t h) {
+        while (k > 0) {
+            int p = parent(k);
+            if (!(value < m_data[slot(p)])) {
+                break;
+            }
+            place(k, m_data[slot(p)], m_slot_handle[p]);
+            k = p;
+        }
+        place(k, value, h);
+    }
+
+    void sift_down(int k, T value, handle_t h) {
+        while (true) {
+            int c = first_child(k);
+            if (c >= m_size) {
+                break;
+            }
+            int smallest = c + dary_min_child<T, D>::find(m_data + slot(c));
+            if (!(m_data[slot(smallest)] < value)) {
+                break;
+            }
+            place(k, m_data[slot(smallest)], m_slot_handle[smallest]);
+            k = smallest;
+        }
+        place(k, value, h);
+    }
+};
@@ -0,0 +1,188 @@
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dary_heap.h"
+#include <likwid.h>
+
+static constexpr int NODE_COUNT = 1024 * 1024;
+static constexpr int EDGES_PER_NODE = 8;
+static constexpr int STREAM_SIZE = 64 * 1024 * 1024;
+static constexpr int TOP_K = 64 * 1024;
+
+struct graph_t {
+    std::vector<int> edge_start;
+    std::vector<int> edge_dest;
+    std::vector<float> edge_weight;
+};
+
+graph_t create_random_graph(int nodes, int edges_per_node) {
+    std::mt19937 eng(0);
+    std::uniform_int_distribution<int> node_dist(0, nodes - 1);
+    std::uniform_real_distribution<float> weight_dist(1.0f, 100.0f);
+
+    graph_t g;
+    g.edge_start.resize(nodes + 1);
+    for (int i = 0; i < nodes; i++) {
+        g.edge_start[i] = i * edges_per_node;
+        for (int j = 0; j < edges_per_node; j++) {
+            g.edge_dest.push_back(node_dist(eng));
+            g.edge_weight.push_back(weight_dist(eng));
+        }
+    }
+    g.edge_start[nodes] = nodes * edges_per_node;
+    return g;
+}
+
+// Reference: std::priority_queue without decrease-key, stale entries are skipped on pop.
+std::vector<float> dijkstra_std(const graph_t& g, int source) {
+    int n = g.edge_start.size() - 1;
+    std::vector<float> dist(n, std::numeric_limits<float>::max());
+    using entry_t = std::pair<float, int>;
+    std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> q;
+
+    dist[source] = 0.0f;
+    q.push({0.0f, source});
+
+    while (!q.empty()) {
+        entry_t e = q.top();
+        q.pop();
+        if (e.first > dist[e.second]) {
+            continue;
+        }
+        for (int i = g.edge_start[e.second]; i < g.edge_start[e.second + 1]; i++) {
+            int dest = g.edge_dest[i];
+            float d = e.first + g.edge_weight[i];
+            if (d < dist[dest]) {
+                dist[dest] = d;
+                q.push({d, dest});
+            }
+        }
+    }
+    return dist;
+}
+
+template <int D>
+std::vector<float> dijkstra_dary(const graph_t& g, int source) {
+    int n = g.edge_start.size() - 1;
+    std::vector<float> dist(n, std::numeric_limits<float>::max());
+    std::vector<int> handle(n, -1);
+    std::vector<int> handle_node;
+    dary_heap<float, D> q;
+
+    auto push = [&](int node, float d) {
+        int h = q.push(d);
+        if (h >= static_cast<int>(handle_node.size())) {
+            handle_node.resize(h + 1);
+        }
+        handle_node[h] = node;
+        handle[node] = h;
+    };
+
+    dist[source] = 0.0f;
+    push(source, 0.0f);
+
+    while (!q.empty()) {
+        float d_node = q.top();
+        int node = handle_node[q.top_handle()];
+        q.pop();
+        handle[node] = -1;
+
+        for (int i = g.edge_start[node]; i < g.edge_start[node + 1]; i++) {
+            int dest = g.edge_dest[i];
+            float d = d_node + g.edge_weight[i];
+            if (d < dist[dest]) {
+                dist[dest] = d;
+                if (handle[dest] >= 0) {
+                    q.decrease_key(handle[dest], d);
+                } else {
+                    push(dest, d);
+                }
+            }
+        }
+    }
+    return dist;
+}
+
+std::vector<float> top_k_std(const std::vector<float>& stream, int k) {
+    std::priority_queue<float, std::vector<float>, std::greater<float>> q(
+        std::greater<float>(), std::vector<float>(stream.begin(), stream.begin() + k));
+    for (size_t i = k; i < stream.size(); i++) {
+        if (stream[i] > q.top()) {
+            q.pop();
+            q.push(stream[i]);
+        }
+    }
+    std::vector<float> result;
+    while (!q.empty()) {
+        result.push_back(q.top());
+        q.pop();
+    }
+    return result;
+}
+
+template <int D>
+std::vector<float> top_k_dary(const std::vector<float>& stream, int k) {
+    dary_heap<float, D> q(k);
+    q.push_range(stream.begin(), stream.begin() + k);
+    for (size_t i = k; i < stream.size(); i++) {
+        if (stream[i] > q.top()) {
+            q.replace_top(stream[i]);
+        }
+    }
+    std::vector<float> result;
+    while (!q.empty()) {
+        result.push_back(q.top());
+        q.pop();
+    }
+    return result;
+}
+
+template <typename F>
+std::vector<float> run(const std::string& name, F f) {
+    LIKWID_MARKER_START(name.c_str());
+    std::vector<float> result = f();
+    LIKWID_MARKER_STOP(name.c_str());
+    return result;
+}
+
+void check(const std::string& name, const std::vector<float>& expected, const std::vector<float>& actual) {
+    if (expected != actual) {
+        std::cout << name << ": Not same\n";
+    } else {
+        std::cout << name << ": Same\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    graph_t g = create_random_graph(NODE_COUNT, EDGES_PER_NODE);
+
+    std::mt19937 eng(1);
+    std::uniform_real_distribution<float> dist(0.0f, 1000000.0f);
+    std::vector<float> stream(STREAM_SIZE);
+    for (auto& v : stream) {
+        v = dist(eng);
+    }
+
+    LIKWID_MARKER_INIT;
+
+    std::vector<float> d_ref = run("dijkstra_std", [&]() { return dijkstra_std(g, 0); });
+    check("dijkstra_dary_2", d_ref, run("dijkstra_dary_2", [&]() { return dijkstra_dary<2>(g, 0); }));
+    check("dijkstra_dary_4", d_ref, run("dijkstra_dary_4", [&]() { return dijkstra_dary<4>(g, 0); }));
+    check("dijkstra_dary_8", d_ref, run("dijkstra_dary_8", [&]() { return dijkstra_dary<8>(g, 0); }));
+    check("dijkstra_dary_16", d_ref, run("dijkstra_dary_16", [&]() { return dijkstra_dary<16>(g, 0); }));
+
+    std::vector<float> t_ref = run("top_k_std", [&]() { return top_k_std(stream, TOP_K); });
+    check("top_k_dary_2", t_ref, run("top_k_dary_2", [&]() { return top_k_dary<2>(stream, TOP_K); }));
+    check("top_k_dary_4", t_ref, run("top_k_dary_4", [&]() { return top_k_dary<4>(stream, TOP_K); }));
+    check("top_k_dary_8", t_ref, run("top_k_dary_8", [&]() { return top_k_dary<8>(stream, TOP_K); }));
+    check("top_k_dary_16", t_ref, run("top_k_dary_16", [&]() { return top_k_dary<16>(stream, TOP_K); }));
+
+    LIKWID_MARKER_CLOSE;
+
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include <cstdlib>
 #include <iostream>
+#include "../common/buffer_2d.h"
 
 template <typename T>
 void rotate_matrix_write(T* out, T* in, int n, int unused_count) {
@@ -43,18 +44,6 @@ void fill_matrix(T* out, int n, int unused_count) {
     }
 }
 
-template <typename T>
-T* allocate_matrix(int n, int unused_count) {
-    return (T*) malloc(n * (n + unused_count) * sizeof(T));
-}
-
-template <typename T>
-void free_matrix(T* t) {
-    free(t);
-}
-
-static constexpr int UNUSED_COUNT = 12;
-
 std::string get_test_suffix(int n, int repeat_count) {
     return "_" + std::to_string(n) + "_" + std::to_string(repeat_count);
 }
@@ -72,42 +61,43 @@ int main(int argc, char** argv) {
     for (int n = start_n; n <= end_n; n *= 2) {
         std::cout << "N = " << n << std::endl;
         int repeat_count = (end_n / n) * 16;
-        
-        int* in_matrix = allocate_matrix<int>(n, UNUSED_COUNT);
-        int* out_matrix1 = allocate_matrix<int>(n, UNUSED_COUNT);
-        int* out_matrix2 = allocate_matrix<int>(n, UNUSED_COUNT);
-        int* out_matrix3 = allocate_matrix<int>(n, UNUSED_COUNT);
+        buffer_2d<int> in_buffer(n, n);
+        buffer_2d<int> out_buffer1(n, n);
+        buffer_2d<int> out_buffer2(n, n);
+        buffer_2d<int> out_buffer3(n, n);
+        // Row padding that keeps the strided accesses free of cache set conflicts
+        int unused_count = in_buffer.stride() - n;
+
+        int* in_matrix = in_buffer.data();
+        int* out_matrix1 = out_buffer1.data();
+        int* out_matrix2 = out_buffer2.data();
+        int* out_matrix3 = out_buffer3.data();
 
         std::string read_name = "READ" + get_test_suffix(n, repeat_count);
         std::string write_name = "WRITE" + get_test_suffix(n, repeat_count);
         std::string write_nontemporal_name = "WRITE_NONTEMPORAL" + get_test_suffix(n, repeat_count);
-        fill_matrix<int>(in_matrix, n, UNUSED_COUNT);
+        fill_matrix<int>(in_matrix, n, unused_count);
 
         LIKWID_MARKER_START(read_name.c_str());
         for (int i = 0; i < repeat_count; i++) {
-            rotate_matrix_read(out_matrix1, in_matrix, n, UNUSED_COUNT);
+            rotate_matrix_read(out_matrix1, in_matrix, n, unused_count);
             escape(out_matrix1);
         }
         LIKWID_MARKER_STOP(read_name.c_str());
 
         LIKWID_MARKER_START(write_name.c_str());
         for (int i = 0; i < repeat_count; i++) {
-            rotate_matrix_write(out_matrix2, in_matrix, n, UNUSED_COUNT);
+            rotate_matrix_write(out_matrix2, in_matrix, n, unused_count);
             escape(out_matrix2);
         }
         LIKWID_MARKER_STOP(write_name.c_str());
 
         LIKWID_MARKER_START(write_nontemporal_name.c_str());
         for (int i = 0; i < repeat_count; i++) {
-            rotate_matrix_write_nontemporal(out_matrix3, in_matrix, n, UNUSED_COUNT);
+            rotate_matrix_write_nontemporal(out_matrix3, in_matrix, n, unused_count);
             escape(out_matrix3);
         }
         LIKWID_MARKER_STOP(write_nontemporal_name.c_str());
-
-        free_matrix(in_matrix);
-        free_matrix(out_matrix1);
-        free_matrix(out_matrix2);
-        free_matrix(out_matrix3);
     }
 
 
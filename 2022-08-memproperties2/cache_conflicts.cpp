@@ -28,10 +28,11 @@ int main(int argc, char **argv) {
     LIKWID_MARKER_INIT;
 
     for (int n = start_size; n <= end_size; n += 16) {
-        matrix<double> in1(n, n);
-        matrix<double> in2(n, n);
-        matrix<double> out1(n, n);
-        matrix<double> out2(n, n);
+        // Stride n instead of the default conflict-free stride, to keep the conflicts
+        matrix<double> in1(n, n, n);
+        matrix<double> in2(n, n, n);
+        matrix<double> out1(n, n, n);
+        matrix<double> out2(n, n, n);
 
         fill_random(in1);
         fill_random(in2);
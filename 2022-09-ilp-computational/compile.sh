@@ -0,0 +1,2 @@
+g++ -DLIKWID_PERFMON -std=c++17 -O3 -mavx2 -mfma -ffp-contract=off -I../common vector_math_test.cpp -o vector_math_test -llikwid
+g++ -DLIKWID_PERFMON -std=c++17 -O3 -mavx512f -mfma -ffp-contract=off -I../common vector_math_test.cpp -o vector_math_test_avx512 -llikwid
@@ -0,0 +1,299 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include "likwid.h"
+#include "vector_math.h"
+
+// Error of y in ULPs of the exact result, with the long double libm result as
+// the exact one.
+long double ulp_error(double y, long double ref) {
+    if (std::isnan(ref)) {
+        return std::isnan(y) ? 0.0L : INFINITY;
+    }
+    if (std::isinf(ref) || std::fabs(ref) > DBL_MAX) {
+        return (double) ref == y ? 0.0L : INFINITY;
+    }
+    if (std::isnan(y) || std::isinf(y)) {
+        return INFINITY;
+    }
+    int exponent;
+    std::frexp(ref, &exponent);
+    long double ulp = std::ldexp(1.0L, std::max(exponent - 53, -1074));
+    return std::fabs((long double) y - ref) / ulp;
+}
+
+struct input_range {
+    std::string name;
+    double min, max;
+    bool log_uniform;   // Uniform exponent between min and max (both > 0)
+    bool random_sign;
+};
+
+std::vector<double> generate_inputs(const input_range& range, size_t count, std::mt19937_64& generator) {
+    std::vector<double> values(count);
+    std::uniform_real_distribution<double> uniform(range.min, range.max);
+    std::uniform_real_distribution<double> exponent(std::log2(range.min), std::log2(range.max));
+    std::uniform_int_distribution<int> sign(0, 1);
+    for (auto& v : values) {
+        v = range.log_uniform ? std::exp2(exponent(generator)) : uniform(generator);
+        if (range.random_sign && sign(generator)) {
+            v = -v;
+        }
+    }
+    return values;
+}
+
+using array_function = void (*)(const double*, double*, size_t);
+using reference_function = long double (*)(long double);
+
+struct function_test {
+    std::string name;
+    array_function ulp1[3];   // N = 1, 2, 4
+    array_function fast[3];
+    reference_function reference;
+    std::vector<input_range> ranges;
+    std::vector<input_range> fast_ranges;
+    std::vector<double> specials;
+};
+
+template <typename V>
+std::vector<function_test> make_tests() {
+    using A = vmath_accuracy;
+    std::vector<input_range> trig = {
+        { "[-pi, pi]", -M_PI, M_PI, false, false },
+        { "[-1e4, 1e4]", -1e4, 1e4, false, false },
+        { "|x| < 2^20 pi/2", -VMATH_TRIG_MAX, VMATH_TRIG_MAX, false, false },
+        { "tiny", 1e-300, 1e-5, true, true },
+    };
+    std::vector<input_range> trig_full = trig;
+    trig_full.push_back({ "huge", VMATH_TRIG_MAX, 1e300, true, true });
+
+    std::vector<double> specials = { 0.0, -0.0, INFINITY, -INFINITY, NAN, 4.9e-324, -4.9e-324, DBL_MIN, DBL_MAX, -DBL_MAX };
+
+    return {
+        { "sin",
+          { vmath_sin<A::ULP1, 1, V>, vmath_sin<A::ULP1, 2, V>, vmath_sin<A::ULP1, 4, V> },
+          { vmath_sin<A::FAST, 1, V>, vmath_sin<A::FAST, 2, V>, vmath_sin<A::FAST, 4, V> },
+          [](long double x) { return sinl(x); }, trig_full, trig, specials },
+        { "cos",
+          { vmath_cos<A::ULP1, 1, V>, vmath_cos<A::ULP1, 2, V>, vmath_cos<A::ULP1, 4, V> },
+          { vmath_cos<A::FAST, 1, V>, vmath_cos<A::FAST, 2, V>, vmath_cos<A::FAST, 4, V> },
+          [](long double x) { return cosl(x); }, trig_full, trig, specials },
+        { "exp",
+          { vmath_exp<A::ULP1, 1, V>, vmath_exp<A::ULP1, 2, V>, vmath_exp<A::ULP1, 4, V> },
+          { vmath_exp<A::FAST, 1, V>, vmath_exp<A::FAST, 2, V>, vmath_exp<A::FAST, 4, V> },
+          [](long double x) { return expl(x); },
+          { { "[-1, 1]", -1.0, 1.0, false, false }, { "[-745, 710]", -745.2, 710.0, false, false },
+            { "tiny", 1e-300, 1e-5, true, true } },
+          { { "[-1, 1]", -1.0, 1.0, false, false }, { "[-708, 708]", -708.0, 708.0, false, false } },
+          specials },
+        { "log",
+          { vmath_log<A::ULP1, 1, V>, vmath_log<A::ULP1, 2, V>, vmath_log<A::ULP1, 4, V> },
+          { vmath_log<A::FAST, 1, V>, vmath_log<A::FAST, 2, V>, vmath_log<A::FAST, 4, V> },
+          [](long double x) { return logl(x); },
+          { { "[0.5, 2]", 0.5, 2.0, false, false }, { "normal", DBL_MIN, DBL_MAX, true, false },
+            { "subnormal", 4.9e-324, DBL_MIN, true, false } },
+          { { "[0.5, 2]", 0.5, 2.0, false, false }, { "normal", DBL_MIN, DBL_MAX, true, false } },
+          specials },
+        { "tanh",
+          { vmath_tanh<A::ULP1, 1, V>, vmath_tanh<A::ULP1, 2, V>, vmath_tanh<A::ULP1, 4, V> },
+          { vmath_tanh<A::FAST, 1, V>, vmath_tanh<A::FAST, 2, V>, vmath_tanh<A::FAST, 4, V> },
+          [](long double x) { return tanhl(x); },
+          { { "[-1, 1]", -1.0, 1.0, false, false }, { "[-25, 25]", -25.0, 25.0, false, false },
+            { "tiny", 1e-300, 1e-3, true, true } },
+          { { "[-1, 1]", -1.0, 1.0, false, false }, { "[-25, 25]", -25.0, 25.0, false, false } },
+          specials },
+    };
+}
+
+// Checks the error of every interleave factor against libm, and that all
+// interleave factors give the same bits.
+bool check(const std::string& backend, const function_test& test, const std::string& tier,
+           const array_function (&functions)[3], const std::vector<input_range>& ranges,
+           const std::vector<double>& specials, double max_ulp) {
+    std::mt19937_64 generator(42);
+    bool ok = true;
+
+    for (const input_range& range : ranges) {
+        std::vector<double> in = generate_inputs(range, 1000003, generator);
+        if (!specials.empty()) {
+            in.insert(in.begin(), specials.begin(), specials.end());
+        }
+        std::vector<double> out[3];
+        for (int f = 0; f < 3; f++) {
+            out[f].resize(in.size());
+            functions[f](in.data(), out[f].data(), in.size());
+        }
+
+        long double worst = 0.0L;
+        double worst_input = 0.0;
+        for (size_t i = 0; i < in.size(); i++) {
+            long double error = ulp_error(out[0][i], test.reference(in[i]));
+            if (error > worst) {
+                worst = error;
+                worst_input = in[i];
+            }
+            if (std::memcmp(&out[0][i], &out[1][i], sizeof(double)) != 0 ||
+                std::memcmp(&out[0][i], &out[2][i], sizeof(double)) != 0) {
+                std::cout << backend << " " << test.name << " " << tier << ": interleave factors differ at "
+                          << in[i] << "\n";
+                ok = false;
+                break;
+            }
+        }
+
+        bool range_ok = worst <= max_ulp;
+        std::cout << std::left << std::setw(8) << backend << std::setw(6) << test.name << std::setw(6) << tier
+                  << std::setw(18) << range.name << "max error " << std::setprecision(3) << (double) worst << " ULP";
+        if (!range_ok) {
+            std::cout << " at x = " << std::setprecision(17) << worst_input << "  FAILED";
+        }
+        std::cout << "\n";
+        ok &= range_ok;
+    }
+    return ok;
+}
+
+template <typename V>
+bool run_accuracy_tests(const std::string& backend) {
+    bool ok = true;
+    for (const function_test& test : make_tests<V>()) {
+        ok &= check(backend, test, "ULP1", test.ulp1, test.ranges, test.specials, 1.0);
+        ok &= check(backend, test, "FAST", test.fast, test.fast_ranges, {}, 3.5);
+    }
+
+    // sincos gives the same bits as sin and cos.
+    std::mt19937_64 generator(7);
+    std::vector<double> in = generate_inputs({ "", -1e5, 1e5, false, false }, 100003, generator);
+    std::vector<double> s(in.size()), c(in.size()), s_ref(in.size()), c_ref(in.size());
+    vmath_sincos<vmath_accuracy::ULP1, 2, V>(in.data(), s.data(), c.data(), in.size());
+    vmath_sin<vmath_accuracy::ULP1, 2, V>(in.data(), s_ref.data(), in.size());
+    vmath_cos<vmath_accuracy::ULP1, 2, V>(in.data(), c_ref.data(), in.size());
+    if (std::memcmp(s.data(), s_ref.data(), in.size() * sizeof(double)) != 0 ||
+        std::memcmp(c.data(), c_ref.data(), in.size() * sizeof(double)) != 0) {
+        std::cout << backend << " sincos differs from sin and cos\n";
+        ok = false;
+    }
+    return ok;
+}
+
+void initialize_data(std::vector<double> &values, int size)
+{
+    values.resize(size);
+    for (int i = 0; i < size; i++)
+    {
+        values[i] = i + 1.0 / (static_cast<double>(i) + 0.1);
+    }
+}
+
+double checksum(const std::vector<double>& v) {
+    double sum = 0.0;
+    for (double d : v) {
+        sum += d;
+    }
+    return sum;
+}
+
+template <vmath_accuracy A, int N>
+void run_benchmark_array(const std::string& name, const std::vector<double>& in, std::vector<double>& out,
+                         void (*f)(const double*, double*, size_t)) {
+    std::string region = name + (A == vmath_accuracy::ULP1 ? "_ulp1_" : "_fast_") + std::to_string(N);
+    LIKWID_MARKER_START(region.c_str());
+    f(in.data(), out.data(), in.size());
+    LIKWID_MARKER_STOP(region.c_str());
+    std::cout << region << " sum = " << checksum(out) << "\n";
+}
+
+template <vmath_accuracy A>
+void run_benchmarks_tier(const std::vector<double>& in, std::vector<double>& small_in, std::vector<double>& out) {
+    run_benchmark_array<A, 1>("sin", small_in, out, vmath_sin<A, 1>);
+    run_benchmark_array<A, 2>("sin", small_in, out, vmath_sin<A, 2>);
+    run_benchmark_array<A, 4>("sin", small_in, out, vmath_sin<A, 4>);
+    run_benchmark_array<A, 1>("exp", small_in, out, vmath_exp<A, 1>);
+    run_benchmark_array<A, 2>("exp", small_in, out, vmath_exp<A, 2>);
+    run_benchmark_array<A, 4>("exp", small_in, out, vmath_exp<A, 4>);
+    run_benchmark_array<A, 1>("log", in, out, vmath_log<A, 1>);
+    run_benchmark_array<A, 2>("log", in, out, vmath_log<A, 2>);
+    run_benchmark_array<A, 4>("log", in, out, vmath_log<A, 4>);
+    run_benchmark_array<A, 1>("tanh", small_in, out, vmath_tanh<A, 1>);
+    run_benchmark_array<A, 2>("tanh", small_in, out, vmath_tanh<A, 2>);
+    run_benchmark_array<A, 4>("tanh", small_in, out, vmath_tanh<A, 4>);
+}
+
+// The long chain of run_test_longchain in ilp_cos_test.cpp: cos is applied
+// cnt2 times to each value, so only the interleaved chains overlap.
+template <int N>
+void run_benchmark_longchain(const std::vector<double>& in, int cnt1, int cnt2) {
+    using P = vmath_pack<vmath_native, N>;
+    std::string name = "longchain_" + std::to_string(cnt2) + "_" + std::to_string(N);
+    std::vector<double> out(P::size);
+    P sum = P::set1(0.0);
+
+    LIKWID_MARKER_START(name.c_str());
+    for (int i = 0; i + P::size <= cnt1; i += P::size) {
+        P current = P::load(in.data() + i);
+        for (int j = 0; j < cnt2; j++) {
+            current = vmath_cos<vmath_accuracy::FAST>(current);
+        }
+        sum = sum + current;
+    }
+    LIKWID_MARKER_STOP(name.c_str());
+
+    sum.store(out.data());
+    std::cout << name << " sum = " << checksum(out) << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = run_accuracy_tests<vmath_scalar>("scalar");
+#if defined(__AVX2__) && defined(__FMA__)
+    ok &= run_accuracy_tests<vmath_avx2>("avx2");
+#endif
+#if defined(__AVX512F__)
+    ok &= run_accuracy_tests<vmath_avx512>("avx512");
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    ok &= run_accuracy_tests<vmath_neon>("neon");
+#endif
+#if defined(__ARM_FEATURE_SVE) && defined(__ARM_FEATURE_SVE_BITS) && __ARM_FEATURE_SVE_BITS > 0
+    ok &= run_accuracy_tests<vmath_sve>("sve");
+#endif
+    std::cout << (ok ? "All tests passed\n" : "Tests FAILED\n");
+
+    int size = argc > 1 ? std::atoi(argv[1]) : 16 * 1024 * 1024;
+    std::vector<double> data, small_data, out(size);
+    initialize_data(data, size);
+    small_data.resize(size);
+    for (int i = 0; i < size; i++) {
+        small_data[i] = std::fmod(data[i], 40.0) - 20.0;
+    }
+
+    LIKWID_MARKER_INIT;
+
+    {
+        LIKWID_MARKER_START("sin_libm");
+        for (int i = 0; i < size; i++) {
+            out[i] = std::sin(small_data[i]);
+        }
+        LIKWID_MARKER_STOP("sin_libm");
+        std::cout << "sin_libm sum = " << checksum(out) << "\n";
+    }
+
+    run_benchmarks_tier<vmath_accuracy::ULP1>(data, small_data, out);
+    run_benchmarks_tier<vmath_accuracy::FAST>(data, small_data, out);
+
+    for (int cnt2 : { 1, 4, 16, 64 }) {
+        run_benchmark_longchain<1>(data, size / cnt2, cnt2);
+        run_benchmark_longchain<2>(data, size / cnt2, cnt2);
+        run_benchmark_longchain<4>(data, size / cnt2, cnt2);
+    }
+
+    LIKWID_MARKER_CLOSE;
+
+    return ok ? 0 : 1;
+}
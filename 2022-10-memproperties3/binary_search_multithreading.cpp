@@ -1,6 +1,7 @@
 #include <vector>
 #include "likwid.h"
 #include "omp.h"
+#include "partitioned_lookup.h"
 
 #include <cassert>
 #include <string>
@@ -149,6 +150,33 @@ __attribute__((noinline)) binary_search_result_t run_test(std::vector<int>& sort
     return result;
 }
 
+__attribute__((noinline)) binary_search_result_t run_service_test(std::vector<int>& sorted_data, std::vector<int>& lookup_data, std::string test_name, int num_cores) {
+    binary_search_result_t result;
+    std::string name = test_name + "_" + std::to_string(sorted_data.size()) + "_" + std::to_string(num_cores);
+
+    partitioned_lookup_service service(sorted_data.data(), sorted_data.size(), num_cores);
+    std::vector<int32_t> results(lookup_data.size());
+
+    LIKWID_MARKER_START(name.c_str());
+    service.lookup(lookup_data.data(), lookup_data.size(), results.data());
+    LIKWID_MARKER_STOP(name.c_str());
+
+    int sum = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i] != -1) {
+            sum++;
+            if (sorted_data[results[i]] != lookup_data[i]) {
+                std::cout << "FAIL: wrong index for key " << lookup_data[i] << "\n";
+                break;
+            }
+        }
+    }
+
+    result.memory_accesses = 0;
+    result.index = sum;
+
+    return result;
+}
 
 void generate_data(int data_size, int lookup_size, std::vector<int>& sorted_data, std::vector<int>& lookup_data) {
     //assert(lookup_size % data_size == 0);
@@ -216,6 +244,9 @@ int main(int argc, char** argv) {
             std::cout << "NOPART, cores = " << cores << ", size = " << size/1024 << "K, " << "memory accesses = " 
                       << res.memory_accesses << ", found = " << res.index << std::endl;
 
+            res = run_service_test(sorted_data, lookup_data, "BINARYSEARCHSERVICE", cores);
+            std::cout << "SERVICE, cores = " << cores << ", size = " << size/1024 << "K, found = " << res.index << std::endl;
+
             quickpartition(&lookup_data[0], 0, lookup_data.size() - 1, lookup_data.size()/(2 * max_core_count));
 
             res = run_test(sorted_data, lookup_data, "BINARYSEARCHPART", cores);
@@ -0,0 +1,328 @@
+#pragma once
+
+// A parallel for loop that keeps each part of an array on the NUMA node of
+// the threads that work on it.
+//
+//     numa_executor exec(num_threads);
+//     exec.first_touch(n, [&](size_t begin, size_t end) { init(begin, end); });
+//     exec.parallel_for(n, [&](size_t begin, size_t end) { work(begin, end); });
+//
+// Linux puts a page on the node of the thread that first writes it. If one
+// thread initializes an array, all of it ends up on that thread's node, and
+// the threads of the other nodes read it over the interconnect. The executor
+// fixes that in three steps:
+//
+//  - The topology (the nodes, their CPUs and the distances between them) is
+//    read from /sys/devices/system/node. Without sysfs there is one node
+//    with all the CPUs the process may run on.
+//  - Every thread is pinned to a CPU for the duration of a loop, with the
+//    threads spread over the nodes in proportion to their CPUs. [0, n) is
+//    split into one contiguous range per node, sized by its number of
+//    threads, with the boundaries on multiples of grain. The split only
+//    depends on n, grain and the executor, so first_touch() and a later
+//    parallel_for() with the same n and grain give every element to the same
+//    node.
+//  - Each node's range is a work queue of grain-sized chunks. A thread
+//    claims chunks from its own node with an atomic fetch_add; only when
+//    that queue is empty does it take chunks from the other nodes, nearest
+//    first. first_touch() never does that, so every page is written by its
+//    own node.
+//
+// For the pages to follow the split, the array has to start on a page
+// boundary (mmap, posix_memalign) and grain elements have to be a multiple of
+// the page size. The default grain is 16K elements, which is a multiple of
+// 4 kB for any element size.
+//
+// If the OpenMP runtime gives a loop fewer threads than asked for, the
+// queues of the missing threads are drained by stealing, first_touch()
+// included.
+
+#include <omp.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static constexpr size_t NUMA_DEFAULT_GRAIN = 16 * 1024;
+
+struct numa_node_info {
+    int id;
+    std::vector<int> cpus;
+    std::vector<int> distance;  // Indexed by the position in numa_topology::nodes.
+};
+
+// Parses a sysfs CPU or node list like "0-3,8-11".
+inline std::vector<int> numa_parse_list(const std::string& s) {
+    std::vector<int> result;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = s.size();
+        }
+        std::string item = s.substr(pos, comma - pos);
+        size_t dash = item.find('-');
+        if (!item.empty() && item[0] >= '0' && item[0] <= '9') {
+            int first = std::atoi(item.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+            for (int i = first; i <= last; i++) {
+                result.push_back(i);
+            }
+        }
+        pos = comma + 1;
+    }
+    return result;
+}
+
+inline std::string numa_read_line(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+struct numa_topology {
+    std::vector<numa_node_info> nodes;
+
+    static numa_topology discover() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, &allowed);
+            }
+        }
+
+        numa_topology topology;
+        const std::string base = "/sys/devices/system/node/";
+        // The distance file of a node lists the online nodes in this order.
+        std::vector<int> online = numa_parse_list(numa_read_line(base + "online"));
+        for (int id : online) {
+            std::string dir = base + "node" + std::to_string(id) + "/";
+            numa_node_info node;
+            node.id = id;
+            for (int cpu : numa_parse_list(numa_read_line(dir + "cpulist"))) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            std::vector<int> distance;
+            std::string line = numa_read_line(dir + "distance");
+            size_t pos = 0;
+            while (pos < line.size()) {
+                size_t end = line.find(' ', pos);
+                if (end == std::string::npos) {
+                    end = line.size();
+                }
+                if (end > pos) {
+                    distance.push_back(std::atoi(line.c_str() + pos));
+                }
+                pos = end + 1;
+            }
+            node.distance = distance;
+            topology.nodes.push_back(node);
+        }
+
+        // Drop memory-only nodes and nodes the process may not run on, and
+        // reindex the distances to match.
+        std::vector<int> usable;
+        for (size_t i = 0; i < topology.nodes.size(); i++) {
+            if (!topology.nodes[i].cpus.empty()) {
+                usable.push_back(i);
+            }
+        }
+        std::vector<numa_node_info> nodes;
+        for (int i : usable) {
+            numa_node_info node = topology.nodes[i];
+            std::vector<int> distance;
+            for (int j : usable) {
+                bool known = topology.nodes[i].distance.size() == online.size();
+                distance.push_back(known ? topology.nodes[i].distance[j] : (i == j ? 10 : 20));
+            }
+            node.distance = distance;
+            nodes.push_back(node);
+        }
+        topology.nodes = nodes;
+
+        if (topology.nodes.empty()) {
+            numa_node_info node;
+            node.id = 0;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            node.distance.push_back(10);
+            topology.nodes.push_back(node);
+        }
+        return topology;
+    }
+
+    size_t num_cpus() const {
+        size_t count = 0;
+        for (const numa_node_info& node : nodes) {
+            count += node.cpus.size();
+        }
+        return count;
+    }
+};
+
+class numa_executor {
+public:
+    explicit numa_executor(int num_threads = omp_get_max_threads(),
+                           numa_topology topology = numa_topology::discover())
+        : m_topology(topology), m_num_threads(std::max(num_threads, 1)) {
+        const size_t num_nodes = m_topology.nodes.size();
+
+        // Thread t goes to CPU t * cpus / threads of the CPUs listed node by
+        // node, so each node gets threads in proportion to its CPUs.
+        std::vector<int> cpus;
+        std::vector<int> cpu_node;
+        for (size_t k = 0; k < num_nodes; k++) {
+            for (int cpu : m_topology.nodes[k].cpus) {
+                cpus.push_back(cpu);
+                cpu_node.push_back(k);
+            }
+        }
+        m_node_threads.assign(num_nodes, 0);
+        for (int t = 0; t < m_num_threads; t++) {
+            size_t c = static_cast<size_t>(t) * cpus.size() / m_num_threads;
+            m_thread_cpu.push_back(cpus[c]);
+            m_thread_node.push_back(cpu_node[c]);
+            m_node_threads[cpu_node[c]]++;
+        }
+
+        for (size_t k = 0; k < num_nodes; k++) {
+            std::vector<int> order;
+            for (size_t j = 0; j < num_nodes; j++) {
+                if (j != k) {
+                    order.push_back(j);
+                }
+            }
+            const std::vector<int>& distance = m_topology.nodes[k].distance;
+            std::stable_sort(order.begin(), order.end(),
+                             [&](int a, int b) { return distance[a] < distance[b]; });
+            m_steal_order.push_back(order);
+        }
+    }
+
+    template <typename FUNCTION>
+    void parallel_for(size_t n, FUNCTION f, size_t grain = NUMA_DEFAULT_GRAIN) {
+        run(n, grain, true, [&](size_t begin, size_t end, int) { f(begin, end); });
+    }
+
+    // Like parallel_for, but every chunk is run by a thread of the node that
+    // owns it. Use it to initialize memory the later loops will work on.
+    template <typename FUNCTION>
+    void first_touch(size_t n, FUNCTION f, size_t grain = NUMA_DEFAULT_GRAIN) {
+        run(n, grain, false, [&](size_t begin, size_t end, int) { f(begin, end); });
+    }
+
+    // f(begin, end) returns the sum of a chunk; the sums are added up.
+    template <typename T, typename FUNCTION>
+    T parallel_reduce(size_t n, T init, FUNCTION f, size_t grain = NUMA_DEFAULT_GRAIN) {
+        std::vector<T> partial(m_num_threads, T());
+        run(n, grain, true, [&](size_t begin, size_t end, int thread) {
+            partial[thread] += f(begin, end);
+        });
+        for (const T& p : partial) {
+            init += p;
+        }
+        return init;
+    }
+
+    int num_threads() const { return m_num_threads; }
+    const numa_topology& topology() const { return m_topology; }
+    int threads_on_node(size_t node) const { return m_node_threads[node]; }
+
+    // Chunks of the last loop that were run by a thread of another node.
+    size_t last_stolen_chunks() const { return m_stolen_chunks; }
+
+private:
+    struct alignas(64) node_queue {
+        std::atomic<size_t> next;
+        size_t end;
+    };
+
+    numa_topology m_topology;
+    int m_num_threads;
+    std::vector<int> m_thread_cpu;
+    std::vector<int> m_thread_node;
+    std::vector<int> m_node_threads;
+    std::vector<std::vector<int>> m_steal_order;
+    size_t m_stolen_chunks = 0;
+
+    // Runs body(begin, end, thread) over [0, n).
+    template <typename BODY>
+    void run(size_t n, size_t grain, bool steal, BODY body) {
+        grain = std::max<size_t>(grain, 1);
+        const size_t num_nodes = m_topology.nodes.size();
+
+        std::vector<node_queue> queues(num_nodes);
+        size_t begin = 0;
+        int threads_before = 0;
+        for (size_t k = 0; k < num_nodes; k++) {
+            threads_before += m_node_threads[k];
+            size_t end = n;
+            if (threads_before < m_num_threads) {
+                end = n / m_num_threads * threads_before +
+                      n % m_num_threads * threads_before / m_num_threads;
+                end = std::max(begin, end / grain * grain);
+            }
+            queues[k].next.store(begin, std::memory_order_relaxed);
+            queues[k].end = end;
+            begin = end;
+        }
+
+        std::atomic<size_t> stolen{0};
+
+        #pragma omp parallel num_threads(m_num_threads)
+        {
+            const int t = omp_get_thread_num();
+            const bool may_steal = steal || omp_get_num_threads() != m_num_threads;
+
+            cpu_set_t previous;
+            bool pinned = sched_getaffinity(0, sizeof(previous), &previous) == 0;
+            if (pinned) {
+                cpu_set_t mask;
+                CPU_ZERO(&mask);
+                CPU_SET(m_thread_cpu[t], &mask);
+                pinned = sched_setaffinity(0, sizeof(mask), &mask) == 0;
+            }
+
+            const int own = m_thread_node[t];
+            drain(queues[own], grain, body, t);
+            if (may_steal) {
+                size_t taken = 0;
+                for (int other : m_steal_order[own]) {
+                    taken += drain(queues[other], grain, body, t);
+                }
+                stolen.fetch_add(taken, std::memory_order_relaxed);
+            }
+
+            if (pinned) {
+                sched_setaffinity(0, sizeof(previous), &previous);
+            }
+        }
+
+        m_stolen_chunks = stolen.load(std::memory_order_relaxed);
+    }
+
+    // Runs chunks of q until it is empty, returns how many.
+    template <typename BODY>
+    static size_t drain(node_queue& q, size_t grain, BODY& body, int thread) {
+        size_t chunks = 0;
+        for (;;) {
+            size_t begin = q.next.fetch_add(grain, std::memory_order_relaxed);
+            if (begin >= q.end) {
+                return chunks;
+            }
+            body(begin, std::min(begin + grain, q.end), thread);
+            chunks++;
+        }
+    }
+};
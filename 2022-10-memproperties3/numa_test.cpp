@@ -2,6 +2,8 @@
 #include <string>
 #include "omp.h"
 #include "likwid.h"
+#include "numa_parallel.h"
+#include <atomic>
 #include <sys/mman.h>
 
 static void clobber() {
@@ -31,19 +33,14 @@ void copy_data_multithreaded_static(double* dst, double* src, size_t size, int n
 
 void copy_data_multithreaded_random(double* dst, double* src, size_t size, int num_cores) {
     static constexpr int PAGE_SIZE = 4 * 1024 / sizeof(double);
-    size_t current_index = 0;
+    std::atomic<size_t> current_index{0};
 
     #pragma omp parallel default(none) shared(src, dst, size, current_index) num_threads(num_cores)
     {
         srand(int(time(NULL)) ^ omp_get_thread_num());
 
         while(true) {
-            size_t start;
-            #pragma omp critical
-            {
-                start = current_index;
-                current_index += PAGE_SIZE;
-            }
+            size_t start = current_index.fetch_add(PAGE_SIZE, std::memory_order_relaxed);
 
             if (start >= size) {
                 break;
@@ -62,6 +59,38 @@ void copy_data_multithreaded_random(double* dst, double* src, size_t size, int n
     }
 }
 
+// Each page is written first by a thread of the node that later reads it.
+void initialize_data_numa(numa_executor& exec, double* values, size_t size) {
+    exec.first_touch(size, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            values[i] = 1.0 / (1.0 + static_cast<double>(i));
+        }
+    });
+}
+
+void copy_data_numa(numa_executor& exec, double* dst, double* src, size_t size) {
+    exec.first_touch(size, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+double __attribute__ ((noinline)) run_test_numa(numa_executor& exec, double* v, size_t size, std::string name) {
+    LIKWID_MARKER_START(name.c_str());
+
+    double sum = exec.parallel_reduce(size, 0.0, [&](size_t begin, size_t end) {
+        double s = 0;
+        for (size_t i = begin; i < end; i++) {
+            s += v[i];
+        }
+        return s;
+    });
+
+    LIKWID_MARKER_STOP(name.c_str());
+
+    return sum;
+}
 
 double __attribute__ ((noinline)) run_test(double* v, int size, int num_threads, std::string name) {
     double sum = 0;
@@ -84,11 +113,19 @@ int main(int argc, char **argv) {
     double* data_single = malloc_large_double(SIZE);
     double* data_multi_static = malloc_large_double(SIZE);
     double* data_multi_random = malloc_large_double(SIZE);
+    double* data_numa = malloc_large_double(SIZE);
+    double* data_numa_copy = malloc_large_double(SIZE);
     double r;
 
     int num_threads = omp_get_max_threads();
     std::cout << "Num threads " << num_threads << "\n";
 
+    numa_executor exec(num_threads);
+    for (size_t k = 0; k < exec.topology().nodes.size(); k++) {
+        std::cout << "Node " << exec.topology().nodes[k].id << ": " << exec.topology().nodes[k].cpus.size()
+                  << " cpus, " << exec.threads_on_node(k) << " threads\n";
+    }
+
     LIKWID_MARKER_INIT;
 
     for (int rep = 0; rep < 1; rep++) {
@@ -103,11 +140,21 @@ int main(int argc, char **argv) {
         copy_data_multithreaded_static(data_multi_static, data_single, SIZE, num_threads);
         r = run_test(data_multi_random, SIZE, num_threads, "STATIC");
         std::cout << "r = " << r << std::endl;
+
+        initialize_data_numa(exec, data_numa, SIZE);
+        r = run_test_numa(exec, data_numa, SIZE, "NUMA");
+        std::cout << "r = " << r << ", stolen chunks = " << exec.last_stolen_chunks() << std::endl;
+
+        copy_data_numa(exec, data_numa_copy, data_single, SIZE);
+        r = run_test_numa(exec, data_numa_copy, SIZE, "NUMA_COPY");
+        std::cout << "r = " << r << ", stolen chunks = " << exec.last_stolen_chunks() << std::endl;
     }
 
     free_large_double(data_single, SIZE);
     free_large_double(data_multi_static, SIZE);
     free_large_double(data_multi_random, SIZE);
+    free_large_double(data_numa, SIZE);
+    free_large_double(data_numa_copy, SIZE);
 
     LIKWID_MARKER_CLOSE;
 }
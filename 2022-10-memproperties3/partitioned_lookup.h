@@ -0,0 +1,355 @@
+#pragma once
+
+// Looks up batches of keys in a large sorted array with several threads.
+//
+//     partitioned_lookup_service service(sorted, n, num_threads);
+//     service.lookup(keys, count, results);  // results[i]: index of keys[i] or -1
+//
+// binary_search_multithreading.cpp shows that searching a large array gets
+// much faster if the keys are first split by value, so each thread only
+// touches the part of the array its keys can be in, and that part stays in
+// the cache. The service does that for every batch:
+//
+//  1. The sorted array is cut into partitions by value when the service is
+//     created. The key range is divided into 2^bits radix buckets (the key
+//     minus the smallest element, shifted right), and neighbouring buckets are
+//     grouped into partitions of about target_partition_size elements. Looking
+//     up the partition of a key is a subtraction, a shift and a table lookup.
+//  2. The keys of a batch are radix-partitioned in parallel: every thread
+//     counts the keys of its slice per partition, the counts are turned into
+//     offsets, and every thread copies its keys, with their positions in the
+//     batch, to their partitions.
+//  3. The partitions are handed out to the threads dynamically. Every
+//     partition is searched with the kernel that suits its size:
+//      - LINEAR for at most linear_max elements: compare the key with every
+//        element, eight at a time with AVX2, and count the smaller ones.
+//      - BINARY for at most binary_max elements, which is about what fits in
+//        L2: a branchless lower bound. The number of steps only depends on
+//        the partition size, so eight keys are searched in lockstep and
+//        their loads overlap.
+//      - EYTZINGER for larger partitions: the partition is stored in BFS
+//        order, so the next four levels of the search are in one place and
+//        can be prefetched while the current one is compared.
+//  4. Each result is written to the position its key had in the batch, so
+//     results come back in the original order.
+//
+// Batches can have up to 2^32 keys and are processed one after another; the
+// buffers for the partitioned keys are kept between batches. The sorted
+// array must stay alive and unchanged while the service uses it. If it has
+// duplicates, the index of the first one is returned.
+
+#include <omp.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+enum class lookup_kernel { LINEAR, BINARY, EYTZINGER };
+
+struct lookup_options {
+    size_t linear_max = 64;
+    size_t binary_max = 64 * 1024;  // 256 kB of int32_t.
+    size_t target_partition_size = 64 * 1024;
+    int radix_bits = 14;
+};
+
+class partitioned_lookup_service {
+public:
+    partitioned_lookup_service(const int32_t* sorted,
+                               size_t n,
+                               int num_threads = omp_get_max_threads(),
+                               lookup_options options = lookup_options())
+        : m_sorted(sorted), m_n(n), m_num_threads(std::max(num_threads, 1)), m_options(options) {
+        build_partitions();
+    }
+
+    // results[i] is the index of keys[i] in the sorted array, or -1.
+    void lookup(const int32_t* keys, size_t count, int32_t* results) {
+        const size_t num_parts = m_parts.size();
+        if (count == 0) {
+            return;
+        }
+        if (m_n == 0) {
+            std::fill(results, results + count, -1);
+            return;
+        }
+
+        m_part_keys.resize(count);
+        m_part_origin.resize(count);
+        m_counts.assign(m_num_threads * num_parts, 0);
+        m_key_begin.resize(num_parts + 1);
+
+        #pragma omp parallel num_threads(m_num_threads)
+        {
+            const size_t t = omp_get_thread_num();
+            const size_t nt = omp_get_num_threads();
+            const size_t begin = count * t / nt;
+            const size_t end = count * (t + 1) / nt;
+            size_t* counts = &m_counts[t * num_parts];
+
+            for (size_t i = begin; i < end; i++) {
+                counts[partition_of(keys[i])]++;
+            }
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                // Partition-major, so the keys of a partition are contiguous
+                // and each thread writes its own part of them.
+                size_t offset = 0;
+                for (size_t p = 0; p < num_parts; p++) {
+                    m_key_begin[p] = offset;
+                    for (size_t u = 0; u < nt; u++) {
+                        size_t c = m_counts[u * num_parts + p];
+                        m_counts[u * num_parts + p] = offset;
+                        offset += c;
+                    }
+                }
+                m_key_begin[num_parts] = offset;
+            }
+
+            for (size_t i = begin; i < end; i++) {
+                size_t pos = counts[partition_of(keys[i])]++;
+                m_part_keys[pos] = keys[i];
+                m_part_origin[pos] = static_cast<uint32_t>(i);
+            }
+
+            #pragma omp barrier
+
+            #pragma omp for schedule(dynamic, 1)
+            for (size_t p = 0; p < num_parts; p++) {
+                serve(m_parts[p], m_key_begin[p], m_key_begin[p + 1], results);
+            }
+        }
+    }
+
+    void lookup(const std::vector<int32_t>& keys, std::vector<int32_t>& results) {
+        results.resize(keys.size());
+        lookup(keys.data(), keys.size(), results.data());
+    }
+
+    size_t num_partitions() const { return m_parts.size(); }
+
+    size_t partitions_with(lookup_kernel kernel) const {
+        return std::count_if(m_parts.begin(), m_parts.end(),
+                             [&](const partition& p) { return p.kernel == kernel; });
+    }
+
+private:
+    static constexpr int INTERLEAVE = 8;
+    static constexpr size_t EYTZINGER_PREFETCH_DISTANCE = 16;  // Four levels ahead.
+
+    struct partition {
+        size_t first;  // In the sorted array.
+        size_t size;
+        lookup_kernel kernel;
+        std::vector<int32_t> eytzinger;  // 1-based, only for EYTZINGER.
+        std::vector<uint32_t> eytzinger_index;
+    };
+
+    const int32_t* m_sorted;
+    size_t m_n;
+    int m_num_threads;
+    lookup_options m_options;
+
+    int64_t m_min = 0;
+    int m_shift = 0;
+    std::vector<uint32_t> m_bucket_part;
+    std::vector<partition> m_parts;
+
+    // Reused between batches.
+    std::vector<int32_t> m_part_keys;
+    std::vector<uint32_t> m_part_origin;
+    std::vector<size_t> m_counts;
+    std::vector<size_t> m_key_begin;
+
+    size_t partition_of(int32_t key) const {
+        int64_t offset = static_cast<int64_t>(key) - m_min;
+        if (offset < 0) {
+            return 0;
+        }
+        size_t bucket = std::min<uint64_t>(static_cast<uint64_t>(offset) >> m_shift,
+                                           m_bucket_part.size() - 1);
+        return m_bucket_part[bucket];
+    }
+
+    void build_partitions() {
+        if (m_n == 0) {
+            partition p;
+            p.first = 0;
+            p.size = 0;
+            p.kernel = lookup_kernel::LINEAR;
+            m_parts.push_back(p);
+            m_bucket_part.assign(1, 0);
+            return;
+        }
+
+        m_min = m_sorted[0];
+        const uint64_t span = static_cast<uint64_t>(static_cast<int64_t>(m_sorted[m_n - 1]) - m_min);
+        const int bits = std::max(0, std::min(m_options.radix_bits, 24));
+        while ((span >> m_shift) >= (uint64_t(1) << bits)) {
+            m_shift++;
+        }
+        const size_t num_buckets = (span >> m_shift) + 1;
+
+        // Index of the first element of every bucket.
+        std::vector<size_t> bucket_first(num_buckets + 1);
+        for (size_t b = 0; b < num_buckets; b++) {
+            int64_t low = m_min + (static_cast<int64_t>(b) << m_shift);
+            bucket_first[b] = std::lower_bound(m_sorted, m_sorted + m_n, low,
+                                               [](int32_t e, int64_t v) { return e < v; }) -
+                              m_sorted;
+        }
+        bucket_first[num_buckets] = m_n;
+
+        const size_t target = std::max<size_t>(m_options.target_partition_size, 1);
+        m_bucket_part.resize(num_buckets);
+        size_t part_begin_bucket = 0;
+        for (size_t b = 0; b < num_buckets; b++) {
+            size_t size_with = bucket_first[b + 1] - bucket_first[part_begin_bucket];
+            if (b > part_begin_bucket && size_with > target) {
+                add_partition(bucket_first[part_begin_bucket], bucket_first[b]);
+                part_begin_bucket = b;
+            }
+            m_bucket_part[b] = m_parts.size();
+        }
+        add_partition(bucket_first[part_begin_bucket], m_n);
+    }
+
+    void add_partition(size_t first, size_t last) {
+        partition p;
+        p.first = first;
+        p.size = last - first;
+        if (p.size <= m_options.linear_max) {
+            p.kernel = lookup_kernel::LINEAR;
+        } else if (p.size <= m_options.binary_max) {
+            p.kernel = lookup_kernel::BINARY;
+        } else {
+            p.kernel = lookup_kernel::EYTZINGER;
+            p.eytzinger.resize(p.size + 1);
+            p.eytzinger_index.resize(p.size + 1);
+            size_t next = 0;
+            build_eytzinger(p, 1, next);
+        }
+        m_parts.push_back(std::move(p));
+    }
+
+    // In-order walk of the implicit tree fills it with the sorted elements.
+    void build_eytzinger(partition& p, size_t k, size_t& next) {
+        if (k > p.size) {
+            return;
+        }
+        build_eytzinger(p, 2 * k, next);
+        p.eytzinger[k] = m_sorted[p.first + next];
+        p.eytzinger_index[k] = static_cast<uint32_t>(p.first + next);
+        next++;
+        build_eytzinger(p, 2 * k + 1, next);
+    }
+
+    int32_t result_at(const partition& p, size_t lower_bound, int32_t key) const {
+        if (lower_bound < p.size && m_sorted[p.first + lower_bound] == key) {
+            return static_cast<int32_t>(p.first + lower_bound);
+        }
+        return -1;
+    }
+
+    void serve(const partition& p, size_t begin, size_t end, int32_t* results) const {
+        const int32_t* keys = m_part_keys.data();
+        const uint32_t* origin = m_part_origin.data();
+        switch (p.kernel) {
+            case lookup_kernel::LINEAR:
+                for (size_t i = begin; i < end; i++) {
+                    results[origin[i]] = result_at(p, count_less(p, keys[i]), keys[i]);
+                }
+                break;
+            case lookup_kernel::BINARY:
+                serve_binary(p, keys, origin, begin, end, results);
+                break;
+            case lookup_kernel::EYTZINGER:
+                for (size_t i = begin; i < end; i++) {
+                    results[origin[i]] = search_eytzinger(p, keys[i]);
+                }
+                break;
+        }
+    }
+
+    size_t count_less(const partition& p, int32_t key) const {
+        const int32_t* a = m_sorted + p.first;
+        size_t count = 0;
+        size_t j = 0;
+#ifdef __AVX2__
+        const __m256i k = _mm256_set1_epi32(key);
+        for (; j + 8 <= p.size; j += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + j));
+            __m256i less = _mm256_cmpgt_epi32(k, v);
+            count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+        }
+#endif
+        for (; j < p.size; j++) {
+            count += a[j] < key;
+        }
+        return count;
+    }
+
+    void serve_binary(const partition& p,
+                      const int32_t* keys,
+                      const uint32_t* origin,
+                      size_t begin,
+                      size_t end,
+                      int32_t* results) const {
+        const int32_t* a = m_sorted + p.first;
+        size_t i = begin;
+        for (; i + INTERLEAVE <= end; i += INTERLEAVE) {
+            const int32_t* base[INTERLEAVE];
+            for (int j = 0; j < INTERLEAVE; j++) {
+                base[j] = a;
+            }
+            size_t len = p.size;
+            while (len > 1) {
+                size_t half = len / 2;
+                for (int j = 0; j < INTERLEAVE; j++) {
+                    base[j] = base[j][half] < keys[i + j] ? base[j] + half : base[j];
+                }
+                len -= half;
+            }
+            for (int j = 0; j < INTERLEAVE; j++) {
+                size_t lb = (base[j] - a) + (*base[j] < keys[i + j]);
+                results[origin[i + j]] = result_at(p, lb, keys[i + j]);
+            }
+        }
+        for (; i < end; i++) {
+            const int32_t* base = a;
+            size_t len = p.size;
+            while (len > 1) {
+                size_t half = len / 2;
+                base = base[half] < keys[i] ? base + half : base;
+                len -= half;
+            }
+            size_t lb = (base - a) + (*base < keys[i]);
+            results[origin[i]] = result_at(p, lb, keys[i]);
+        }
+    }
+
+    int32_t search_eytzinger(const partition& p, int32_t key) const {
+        const int32_t* e = p.eytzinger.data();
+        const uintptr_t e_addr = reinterpret_cast<uintptr_t>(e);
+        size_t k = 1;
+        while (k <= p.size) {
+            // The prefetch may point past the end; it does not fault.
+            __builtin_prefetch(reinterpret_cast<const void*>(
+                e_addr + EYTZINGER_PREFETCH_DISTANCE * k * sizeof(int32_t)));
+            k = 2 * k + (e[k] < key);
+        }
+        // Undo the right turns after the last left turn: k is then the lower
+        // bound, or 0 if all elements are smaller.
+        k >>= __builtin_ffsll(~k);
+        if (k != 0 && e[k] == key) {
+            return static_cast<int32_t>(p.eytzinger_index[k]);
+        }
+        return -1;
+    }
+};
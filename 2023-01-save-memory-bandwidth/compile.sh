@@ -1 +1 @@
-clang++ -g -O3 -mavx2 -std=c++17 test.cpp -o test
+clang++ -g -O3 -mavx2 -std=c++17 -I../common test.cpp -o test
@@ -2,16 +2,17 @@
 #include <chrono>
 #include <mutex>
 #include <atomic>
+#include "sharded.h"
 
 class function_runner {
 public:
-    function_runner() : m_num_executed(0), m_run_function(false) {
+    function_runner() : m_run_function(false) {
     }
 
     template <typename FUNCTION>
     void run_async(FUNCTION f) {
         m_time_started = std::chrono::steady_clock::now();
-        m_num_executed = 0;
+        m_num_executed.reset();
         m_run_function = true;
 
         m_runner_thread = std::thread(run_function<FUNCTION>, f, this);
@@ -21,13 +22,13 @@ public:
         m_run_function = false;
         m_runner_thread.join();
 
-        m_num_executed = 0;
+        m_num_executed.reset();
     }
 
     void reset_execution_rate() {
         std::lock_guard<std::mutex> lock(m_mutex);
         m_time_started = std::chrono::steady_clock::now();
-        m_num_executed = 0;
+        m_num_executed.reset();
     }
 
     double get_execution_rate() {
@@ -35,11 +36,13 @@ public:
         auto current_time = std::chrono::steady_clock::now();
 
         std::chrono::duration<double> diff = current_time - m_time_started;
-        return static_cast<double>(m_num_executed) / diff.count();
+        return static_cast<double>(m_num_executed.read_total()) / diff.count();
     }
 private:
     std::chrono::time_point<std::chrono::steady_clock> m_time_started;
-    uint64_t m_num_executed;
+    // Counted by the runner thread without a lock; m_mutex only keeps
+    // m_time_started and the counter's reset point together.
+    per_thread_counter m_num_executed;
     std::mutex m_mutex;
     std::atomic<bool> m_run_function;
 
@@ -50,9 +53,7 @@ private:
         while (fr->m_run_function) {
             f();
 
-            fr->m_mutex.lock();
-            fr->m_num_executed++;
-            fr->m_mutex.unlock();
+            fr->m_num_executed.add();
         }
     }
 };
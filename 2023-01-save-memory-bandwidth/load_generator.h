@@ -0,0 +1,395 @@
+#pragma once
+
+// Runs several functions at the same time, each on its own pinned thread,
+// and measures how often they run and how long they take.
+//
+//     load_generator gen;
+//     size_t victim = gen.add_worker(f_victim);
+//     gen.add_worker(f_aggressor);
+//     gen.start(std::chrono::milliseconds(100));
+//     std::this_thread::sleep_for(std::chrono::seconds(1));
+//     gen.stop();
+//     double rate = gen.throughput(victim);
+//
+// This is function_runner for more than one function, with the measuring
+// kept out of the way of what is measured: each worker counts its calls in
+// its own cache line with a plain relaxed store, and keeps its own latency
+// histogram the same way, so the workers share nothing while they run.
+//
+// Modes:
+//  - CLOSED_LOOP calls the function again as soon as it returns. The latency
+//    is the duration of the call.
+//  - OPEN_LOOP starts calls at a fixed rate, call n at start + n / rate,
+//    whether or not the previous call took longer than planned. The latency
+//    is measured from the planned start, so time spent waiting behind a slow
+//    call counts. Measuring from the actual start would hide exactly the
+//    slowdowns an open-loop test is for.
+//
+// Timing a call costs two clock reads. For very short functions, set
+// latency_every to time only every n-th call; the count is always exact.
+//
+// A sampler thread reads all workers every sample period and stores, per
+// worker, the throughput and the latency percentiles of that period. The
+// latency histogram has four buckets per power of two, so a percentile is
+// accurate to about 25%.
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <immintrin.h>
+
+enum class load_mode { CLOSED_LOOP, OPEN_LOOP };
+
+struct load_worker_options {
+    load_mode mode = load_mode::CLOSED_LOOP;
+    double rate = 0.0;            // Calls per second, for OPEN_LOOP.
+    bool pin = true;
+    int cpu = -1;                 // -1: worker i runs on allowed CPU i % number of CPUs.
+    unsigned latency_every = 1;   // Time every n-th call.
+};
+
+class latency_histogram {
+public:
+    static constexpr int SUB_BITS = 2;
+    static constexpr int BUCKETS = 64 << SUB_BITS;
+
+    struct snapshot {
+        uint64_t counts[BUCKETS] = {};
+
+        uint64_t total() const {
+            uint64_t sum = 0;
+            for (uint64_t c : counts) {
+                sum += c;
+            }
+            return sum;
+        }
+
+        // Upper end of the bucket that holds the p-th fraction of calls.
+        uint64_t percentile(double p) const {
+            uint64_t n = total();
+            if (n == 0) {
+                return 0;
+            }
+            uint64_t rank = std::min<uint64_t>(n - 1, static_cast<uint64_t>(p * n));
+            uint64_t seen = 0;
+            for (int b = 0; b < BUCKETS; b++) {
+                seen += counts[b];
+                if (seen > rank) {
+                    return upper_bound(b);
+                }
+            }
+            return upper_bound(BUCKETS - 1);
+        }
+
+        snapshot operator-(const snapshot& other) const {
+            snapshot result;
+            for (int b = 0; b < BUCKETS; b++) {
+                result.counts[b] = counts[b] - other.counts[b];
+            }
+            return result;
+        }
+    };
+
+    // Only one thread may record.
+    void record(uint64_t ns) {
+        std::atomic<uint64_t>& c = m_counts[bucket(ns)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (std::atomic<uint64_t>& c : m_counts) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    snapshot read() const {
+        snapshot s;
+        for (int b = 0; b < BUCKETS; b++) {
+            s.counts[b] = m_counts[b].load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    // Values below 2^SUB_BITS get a bucket each; above that, the bucket is
+    // the position of the highest bit and the SUB_BITS bits after it.
+    static int bucket(uint64_t ns) {
+        if (ns < (1u << SUB_BITS)) {
+            return static_cast<int>(ns);
+        }
+        int high = 63 - __builtin_clzll(ns);
+        int sub = static_cast<int>((ns >> (high - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+        return ((high - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+
+    static uint64_t upper_bound(int b) {
+        if (b < (1 << SUB_BITS)) {
+            return b;
+        }
+        int high = (b >> SUB_BITS) + SUB_BITS - 1;
+        uint64_t sub = b & ((1 << SUB_BITS) - 1);
+        uint64_t low = (uint64_t(1) << high) | (sub << (high - SUB_BITS));
+        return low + (uint64_t(1) << (high - SUB_BITS)) - 1;
+    }
+
+private:
+    std::atomic<uint64_t> m_counts[BUCKETS] = {};
+};
+
+struct load_sample {
+    double time;        // Seconds since start(), at the end of the period.
+    double throughput;  // Calls per second in the period.
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+};
+
+class load_generator {
+public:
+    load_generator() : m_run(false), m_go(false) {
+    }
+
+    ~load_generator() {
+        if (m_run) {
+            stop();
+        }
+    }
+
+    // Adds a worker that calls f. Workers can only be added before start().
+    template <typename FUNCTION>
+    size_t add_worker(FUNCTION f, load_worker_options options = load_worker_options()) {
+        size_t id = m_workers.size();
+        m_workers.emplace_back(new worker());
+        worker* w = m_workers.back().get();
+        w->options = options;
+        w->body = [this, w, id, f]() mutable { run_worker(f, *w, id); };
+        return id;
+    }
+
+    void start(std::chrono::milliseconds sample_period = std::chrono::milliseconds(100)) {
+        m_run = true;
+        for (auto& w : m_workers) {
+            w->executed.store(0, std::memory_order_relaxed);
+            w->latency.clear();
+            w->samples.clear();
+            w->thread = std::thread(w->body);
+        }
+        m_time_started = clock::now();
+        m_go.store(true, std::memory_order_release);
+        m_sampler = std::thread(&load_generator::run_sampler, this, sample_period);
+    }
+
+    void stop() {
+        m_run = false;
+        for (auto& w : m_workers) {
+            w->thread.join();
+        }
+        m_sampler.join();
+        m_time_stopped = clock::now();
+        m_go.store(false, std::memory_order_relaxed);
+    }
+
+    size_t num_workers() const {
+        return m_workers.size();
+    }
+
+    // The CPUs this process may run on, in ascending order.
+    static std::vector<int> available_cpus() {
+        std::vector<int> cpus;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (cpus.empty()) {
+            unsigned n = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned cpu = 0; cpu < n; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // Calls per second from start() to stop(), or to now while running.
+    double throughput(size_t worker_id) const {
+        clock::time_point end = m_run ? clock::now() : m_time_stopped;
+        std::chrono::duration<double> diff = end - m_time_started;
+        return m_workers[worker_id]->executed.load(std::memory_order_relaxed) / diff.count();
+    }
+
+    // Over all calls timed since start().
+    uint64_t latency_percentile(size_t worker_id, double p) const {
+        return m_workers[worker_id]->latency.read().percentile(p);
+    }
+
+    std::vector<load_sample> samples(size_t worker_id) const {
+        std::lock_guard<std::mutex> lock(m_samples_mutex);
+        return m_workers[worker_id]->samples;
+    }
+
+    // Median of the per-period throughputs; unlike throughput() it is not
+    // pulled down by the threads starting up or a single bad period.
+    double median_throughput(size_t worker_id) const {
+        std::vector<load_sample> s = samples(worker_id);
+        if (s.empty()) {
+            return throughput(worker_id);
+        }
+        std::vector<double> rates;
+        for (const load_sample& sample : s) {
+            rates.push_back(sample.throughput);
+        }
+        std::nth_element(rates.begin(), rates.begin() + rates.size() / 2, rates.end());
+        return rates[rates.size() / 2];
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    // Spins for the last part of an open-loop wait, sleeps before that.
+    static constexpr std::chrono::microseconds SPIN_BEFORE_START{50};
+
+    struct alignas(64) worker {
+        std::atomic<uint64_t> executed{0};
+        latency_histogram latency;
+        load_worker_options options;
+        std::function<void()> body;
+        std::thread thread;
+
+        // Used by the sampler only.
+        uint64_t last_executed = 0;
+        latency_histogram::snapshot last_latency;
+        std::vector<load_sample> samples;
+    };
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::atomic<bool> m_run;
+    std::atomic<bool> m_go;
+    clock::time_point m_time_started;
+    clock::time_point m_time_stopped;
+    std::thread m_sampler;
+    mutable std::mutex m_samples_mutex;
+
+    static void pin_to_cpu(int cpu) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+
+    template <typename FUNCTION>
+    void run_worker(FUNCTION& f, worker& w, size_t id) {
+        const load_worker_options& o = w.options;
+        if (o.pin) {
+            if (o.cpu >= 0) {
+                pin_to_cpu(o.cpu);
+            } else {
+                std::vector<int> cpus = available_cpus();
+                pin_to_cpu(cpus[id % cpus.size()]);
+            }
+        }
+        while (!m_go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        const bool open_loop = o.mode == load_mode::OPEN_LOOP && o.rate > 0.0;
+        const double period_ns = open_loop ? 1e9 / o.rate : 0.0;
+        const unsigned latency_every = std::max(1u, o.latency_every);
+        const clock::time_point start = m_time_started;
+        uint64_t n = 0;
+
+        while (m_run.load(std::memory_order_relaxed)) {
+            const bool timed = n % latency_every == 0;
+            clock::time_point t0;
+            if (open_loop) {
+                t0 = start + std::chrono::nanoseconds(static_cast<uint64_t>(n * period_ns));
+                if (!wait_until(t0)) {
+                    break;
+                }
+            } else if (timed) {
+                t0 = clock::now();
+            }
+
+            f();
+
+            if (timed) {
+                w.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+            }
+            n++;
+            w.executed.store(n, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the generator was stopped while waiting.
+    bool wait_until(clock::time_point t) {
+        for (;;) {
+            clock::time_point now = clock::now();
+            if (now >= t) {
+                return true;
+            }
+            if (!m_run.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (t - now > SPIN_BEFORE_START) {
+                std::this_thread::sleep_for(t - now - SPIN_BEFORE_START);
+            } else {
+                _mm_pause();
+            }
+        }
+    }
+
+    void run_sampler(std::chrono::milliseconds period) {
+        for (auto& w : m_workers) {
+            w->last_executed = 0;
+            w->last_latency = w->latency.read();
+        }
+        clock::time_point last = m_time_started;
+        clock::time_point next = last + period;
+        while (m_run) {
+            std::this_thread::sleep_until(std::min(next, clock::now() + std::chrono::milliseconds(10)));
+            clock::time_point now = clock::now();
+            if (now < next && m_run) {
+                continue;
+            }
+            take_sample(last, now);
+            last = now;
+            next = now + period;
+        }
+    }
+
+    void take_sample(clock::time_point last, clock::time_point now) {
+        std::chrono::duration<double> elapsed = now - last;
+        std::chrono::duration<double> since_start = now - m_time_started;
+        if (elapsed.count() <= 0.0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_samples_mutex);
+        for (auto& w : m_workers) {
+            uint64_t executed = w->executed.load(std::memory_order_relaxed);
+            latency_histogram::snapshot latency = w->latency.read();
+            latency_histogram::snapshot period_latency = latency - w->last_latency;
+
+            load_sample s;
+            s.time = since_start.count();
+            s.throughput = (executed - w->last_executed) / elapsed.count();
+            s.p50_ns = period_latency.percentile(0.5);
+            s.p99_ns = period_latency.percentile(0.99);
+            s.p999_ns = period_latency.percentile(0.999);
+            w->samples.push_back(s);
+
+            w->last_executed = executed;
+            w->last_latency = latency;
+        }
+    }
+};
@@ -3,7 +3,10 @@
 #include <iostream>
 #include <limits>
 #include <cassert>
+#include <functional>
+#include <memory>
 #include "function_runner.h"
+#include "load_generator.h"
 #include "memcpy.h"
 
 using namespace std;
@@ -227,6 +230,178 @@ void test_memcpy_implementations(size_t elems) {
     free(dst);
 }
 
+// A kernel of the noisy neighbour matrix. make(elems) returns a function that
+// runs the kernel once on its own data set of elems elements.
+struct neighbour_kernel
+{
+    std::string name;
+    std::function<std::function<void()>(size_t)> make;
+};
+
+std::vector<neighbour_kernel> neighbour_kernels()
+{
+    auto binary_search_kernel = [](int (*search)(int *, int, int)) {
+        return [search](size_t elems) -> std::function<void()> {
+            auto sorted = std::make_shared<std::vector<int>>(generate_sorted_vector(elems));
+            auto lookup = std::make_shared<std::vector<int>>(create_lookup_data(*sorted));
+            auto i = std::make_shared<size_t>(0);
+            return [=]() {
+                int found = search(&(*sorted)[0], sorted->size(), (*lookup)[*i]);
+                OPAQUE(found);
+                if (++*i >= lookup->size())
+                {
+                    *i = 0;
+                }
+            };
+        };
+    };
+
+    auto memcpy_kernel = [](void (*copy)(uint32_t *, uint32_t *, int)) {
+        return [copy](size_t elems) -> std::function<void()> {
+            std::shared_ptr<uint32_t> src(allocate_buffer(elems), free_buffer);
+            std::shared_ptr<uint32_t> dst(allocate_buffer(elems), free_buffer);
+            fill_buffer(src.get(), elems);
+            fill_buffer(dst.get(), elems);
+            return [=]() {
+                uint32_t *d = dst.get();
+                copy(d, src.get(), elems);
+                OPAQUE(d);
+            };
+        };
+    };
+
+    return {
+        {"BINARY SEARCH", binary_search_kernel(binary_search)},
+        {"BINARY SEARCH BRANCHLESS", binary_search_kernel(binary_search_branchless)},
+        {"BINARY SEARCH NON-TEMPORAL", binary_search_kernel(binary_search_branchless_nt)},
+        {"DUMMY RUN", [](size_t elems) -> std::function<void()> { return [elems]() { dry_run(elems); }; }},
+        {"MEMCPY SIMPLE", memcpy_kernel(memcpy_simple)},
+        {"MEMCPY STREAMING STORES", memcpy_kernel(memcpy_streaming_stores)},
+        {"MEMCPY NT LOADS", memcpy_kernel(memcpy_nt_loads)},
+        {"MEMCPY STREAMING STORES NT LOADS", memcpy_kernel(memcpy_streaming_stores_nt_loads)},
+    };
+}
+
+static const std::chrono::milliseconds NEIGHBOUR_RUN_TIME(500);
+static const std::chrono::milliseconds NEIGHBOUR_SAMPLE_PERIOD(50);
+
+struct neighbour_result
+{
+    double throughput;
+    uint64_t p99_ns;
+};
+
+// Runs victim on cpus[0] next to aggressor k on cpus[1 + k]. There must be a
+// CPU for every aggressor, otherwise an aggressor time-slices with the victim
+// and the slowdown measures the scheduler instead of the memory system.
+neighbour_result run_neighbours(std::function<void()> victim, const std::vector<std::function<void()>> &aggressors,
+                                load_worker_options victim_options, const std::vector<int> &cpus)
+{
+    load_generator gen;
+    victim_options.cpu = cpus[0];
+    size_t id = gen.add_worker(victim, victim_options);
+    for (size_t k = 0; k < aggressors.size(); k++)
+    {
+        load_worker_options options;
+        options.cpu = cpus[1 + k];
+        gen.add_worker(aggressors[k], options);
+    }
+    gen.start(NEIGHBOUR_SAMPLE_PERIOD);
+    this_thread::sleep_for(NEIGHBOUR_RUN_TIME);
+    gen.stop();
+
+    neighbour_result result;
+    result.throughput = gen.median_throughput(id);
+    result.p99_ns = gen.latency_percentile(id, 0.99);
+    return result;
+}
+
+// For every pair of kernels, how much slower the row kernel (the victim) runs
+// while the column kernel (the aggressor) runs on another core, in a closed
+// loop; then the p99 latency of the victim in an open loop at half of the
+// rate it reaches alone. The last column has all the other kernels running at
+// once. A cell that needs more CPUs than the process may use is printed as
+// "-".
+void run_slowdown_matrix(size_t elems)
+{
+    std::vector<neighbour_kernel> kernels = neighbour_kernels();
+    const size_t n = kernels.size();
+    const std::vector<int> cpus = load_generator::available_cpus();
+
+    if (cpus.size() < 2)
+    {
+        std::cout << "Warning: noisy neighbour matrix needs at least 2 CPUs, have " << cpus.size()
+                  << ", skipping it\n";
+        return;
+    }
+    if (cpus.size() < n)
+    {
+        std::cout << "Warning: the ALL OTHERS column needs " << n << " CPUs, have " << cpus.size()
+                  << ", its cells are skipped (-)\n";
+    }
+
+    std::cout << "Noisy neighbour matrix, data set of " << elems * sizeof(int) / (1024.0 * 1024.0)
+              << " megabytes per kernel\n";
+    std::cout << "Columns:";
+    for (size_t a = 0; a < n; a++)
+    {
+        std::cout << " [" << kernels[a].name << "]";
+    }
+    std::cout << " [ALL OTHERS]\n";
+
+    std::vector<double> alone(n);
+    for (size_t v = 0; v < n; v++)
+    {
+        load_worker_options options;
+        options.latency_every = 16;
+        alone[v] = run_neighbours(kernels[v].make(elems), {}, options, cpus).throughput;
+    }
+
+    for (int open_loop = 0; open_loop < 2; open_loop++)
+    {
+        std::cout << (open_loop ? "Victim p99 latency in ns, open loop at 50% of its solo rate\n"
+                                : "Victim slowdown (solo throughput / throughput with aggressor), closed loop\n");
+        for (size_t v = 0; v < n; v++)
+        {
+            load_worker_options options;
+            options.latency_every = open_loop ? 1 : 16;
+            if (open_loop)
+            {
+                options.mode = load_mode::OPEN_LOOP;
+                options.rate = alone[v] / 2;
+            }
+
+            std::cout << kernels[v].name << ":";
+            for (size_t a = 0; a <= n; a++)
+            {
+                if (a == n && cpus.size() < n)
+                {
+                    std::cout << " -";
+                    continue;
+                }
+                std::vector<std::function<void()>> aggressors;
+                for (size_t k = 0; k < n; k++)
+                {
+                    if (k == a || (a == n && k != v))
+                    {
+                        aggressors.push_back(kernels[k].make(elems));
+                    }
+                }
+                neighbour_result r = run_neighbours(kernels[v].make(elems), aggressors, options, cpus);
+                if (open_loop)
+                {
+                    std::cout << " " << r.p99_ns;
+                }
+                else
+                {
+                    std::cout << " " << alone[v] / r.throughput;
+                }
+            }
+            std::cout << "\n";
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     test_memcpy_implementations(4*1024);
@@ -375,4 +550,6 @@ int main(int argc, char **argv)
         free(src2);
         free(dst);
     }
+
+    run_slowdown_matrix(round_to_16(LLC_CASE_SIZE_BYTES * 2 / sizeof(int)));
 }
\ No newline at end of file
@@ -84,9 +84,8 @@ void run_test1(std::string name, T& test_map, const std::vector<std::tuple<opera
 
 
 template<typename T>
-void run_test2(std::string name, T& test_map, const std::vector<std::tuple<operation_t, int64_t, test_struct>>& test_data) {
+size_t replay(T& test_map, const std::vector<std::tuple<operation_t, int64_t, test_struct>>& test_data) {
     size_t found = 0;
-    LIKWID_MARKER_START(name.c_str());
     for (int i = 0; i < test_data.size(); i++) {
         const std::tuple<operation_t, int64_t, test_struct>& test_case = test_data[i];
         int64_t key = std::get<1>(test_case);
@@ -111,10 +110,28 @@ void run_test2(std::string name, T& test_map, const std::vector<std::tuple<opera
             }
         }
     }
+    return found;
+}
+
+template<typename T>
+void run_test2(std::string name, T& test_map, const std::vector<std::tuple<operation_t, int64_t, test_struct>>& test_data) {
+    LIKWID_MARKER_START(name.c_str());
+    size_t found = replay(test_map, test_data);
     LIKWID_MARKER_STOP(name.c_str());
     printf("found = %zu\n", found);
 }
 
+// The oa_hash_map with a prime number of buckets and the given hasher. The
+// map is first brought to the state the maps in run_test() are in after the
+// check, then timed. Run one at a time, so only one extra map is allocated.
+template<size_t size, typename Hasher>
+void run_hasher_test(std::string name, const std::vector<std::tuple<operation_t, int64_t, test_struct>>& test_data, size_t expected_found) {
+    jsl::oa_hash_map<size, int64_t, test_struct, false, Hasher> oe_map;
+    EXPECT_EQUAL(replay(oe_map, test_data), expected_found);
+    run_test2(name, oe_map, test_data);
+    printf("%s:\n%s", name.c_str(), oe_map.get_statistics().c_str());
+}
+
 template<size_t size>
 void run_test(std::string name) {
     auto test_data = generate_test_data(size / 2, 8*1024*1024);
@@ -126,6 +143,7 @@ void run_test(std::string name) {
     test_map.reserve(size);
     abs_map.reserve(size);
 
+    size_t expected_found = 0;
     for (int i = 0; i < test_data.size(); i++) {
         std::tuple<operation_t, int64_t, test_struct>& test_case = test_data[i];
         int64_t key = std::get<1>(test_case);
@@ -135,6 +153,7 @@ void run_test(std::string name) {
             case GET: {
                 auto res1 = test_map.find(key);
                 test_struct* res2 = oe_map.get(key);
+                expected_found += res1 != test_map.end();
                 test_struct* res3 = sc_map.get(key);
                 auto res4 = abs_map.find(key);
                 EXPECT_EQUAL(res1 != test_map.end(), res2 != nullptr);
@@ -189,6 +208,10 @@ void run_test(std::string name) {
 
     printf("OE_MAP:\n%s", oe_map.get_statistics().c_str());
     printf("SC_MAP\n%s", sc_map.get_statistics().c_str());
+
+    run_hasher_test<size, jsl::prime_hasher>("oe_map_prime_" + name, test_data, expected_found);
+    run_hasher_test<size, jsl::libdivide_hasher>("oe_map_libdivide_" + name, test_data, expected_found);
+    run_hasher_test<size, jsl::fastmod_hasher>("oe_map_fastmod_" + name, test_data, expected_found);
 }
 
 
@@ -1,9 +1,10 @@
 #include <utility>
 #include <string>
+#include "../common/hashers.h"
 
 namespace jsl {
 
-template <unsigned int SIZE, typename KeyType, typename ValueType, bool debug = false>
+template <unsigned int SIZE, typename KeyType, typename ValueType, bool debug = false, typename Hasher = shift_hasher>
 class oa_hash_map {
 private:
     static constexpr KeyType EXTRACT_CONTROL_BITS = 3;
@@ -15,12 +16,17 @@ private:
     static constexpr KeyType ADD_CONTROL_BITS = 2;
 
     KeyType next_entry(KeyType entry) {
-        return (entry + 1 ) % SIZE;
+        entry++;
+        return entry == m_size ? 0 : entry;
+    }
+
+    KeyType first_entry(KeyType key) {
+        return m_limiter.limit_input(key);
     }
 
     template <bool force_emplace, typename... Args>
     std::pair<bool, ValueType*> emplace_private(KeyType key, const Args &... args) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
         bool free_bucket_found = false;
         KeyType free_bucket_index;
@@ -69,8 +75,9 @@ exit_while:
     }
 
 public:
-    oa_hash_map() {
-        m_hasharray = new KeyValueType[SIZE];
+    oa_hash_map() : m_size(Hasher::table_size(SIZE)) {
+        m_limiter.set_limit(m_size);
+        m_hasharray = new KeyValueType[m_size];
     }
 
     ~oa_hash_map() {
@@ -78,7 +85,7 @@ public:
     }
 
     ValueType* get(const KeyType& key) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
 
         while (true) {
@@ -117,7 +124,7 @@ public:
     }
 
     bool remove(KeyType key) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
 
         while(true) {
@@ -158,7 +165,7 @@ public:
         size_t misplaced_buckets = 0;
         size_t correctly_placed_buckets = 0;
 
-        for (size_t i = 0; i < SIZE; i++) {
+        for (size_t i = 0; i < m_size; i++) {
             KeyType control_bits = m_hasharray[i].key & EXTRACT_CONTROL_BITS;
             switch (control_bits) {
                 case ENTRY_FREE:
@@ -168,7 +175,7 @@ public:
                     deleted_buckets++;
                     break;
                 case ENTRY_USED: {
-                    KeyType bucket = (m_hasharray[i].key >> ADD_CONTROL_BITS) % SIZE;
+                    KeyType bucket = first_entry(m_hasharray[i].key >> ADD_CONTROL_BITS);
                     if (bucket == i) {
                         correctly_placed_buckets++;
                     } else {
@@ -181,7 +188,7 @@ public:
 
         std::string result;
         result.reserve(300);
-        result += "Total buckets: " + std::to_string(SIZE) + "\n";
+        result += "Total buckets: " + std::to_string(m_size) + "\n";
         result += "Used buckets: " + std::to_string(misplaced_buckets + correctly_placed_buckets) + "\n";
         result += "Correctly placed buckets: " + std::to_string(correctly_placed_buckets) + "\n";
         result += "Misplaced buckets: " + std::to_string(misplaced_buckets) + "\n";
@@ -215,6 +222,8 @@ private:
     };
 
     KeyValueType* m_hasharray;
+    size_t m_size;
+    Hasher m_limiter;
 };
 
 }
\ No newline at end of file
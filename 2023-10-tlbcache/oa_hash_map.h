@@ -1,10 +1,11 @@
 #include <utility>
 #include <string>
+#include "../common/hashers.h"
 #include <sys/mman.h>
 
 namespace jsl {
 
-template <unsigned int SIZE, typename KeyType, typename ValueType>
+template <unsigned int SIZE, typename KeyType, typename ValueType, typename Hasher = shift_hasher>
 class oa_hash_map {
 private:
     static constexpr KeyType EXTRACT_CONTROL_BITS = 3;
@@ -16,12 +17,17 @@ private:
     static constexpr KeyType ADD_CONTROL_BITS = 2;
 
     KeyType next_entry(KeyType entry) {
-        return (entry + 1 ) % SIZE;
+        entry++;
+        return entry == m_size ? 0 : entry;
+    }
+
+    KeyType first_entry(KeyType key) {
+        return m_limiter.limit_input(key);
     }
 
     template <bool force_emplace, typename... Args>
     std::pair<bool, ValueType*> emplace_private(KeyType key, const Args &... args) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
         bool free_bucket_found = false;
         KeyType free_bucket_index;
@@ -70,21 +76,22 @@ exit_while:
     }
 
 public:
-    oa_hash_map(bool use_large_pages) {
+    oa_hash_map(bool use_large_pages) : m_size(Hasher::table_size(SIZE)) {
+        m_limiter.set_limit(m_size);
         int large_pages = use_large_pages ? MAP_HUGETLB : 0;
-        m_hasharray = reinterpret_cast<KeyValueType*>(mmap(0, SIZE * sizeof(KeyValueType), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|large_pages, -1, 0));
-        new (m_hasharray) KeyValueType[SIZE];
+        m_hasharray = reinterpret_cast<KeyValueType*>(mmap(0, m_size * sizeof(KeyValueType), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|large_pages, -1, 0));
+        new (m_hasharray) KeyValueType[m_size];
     }
 
     ~oa_hash_map() {
-        for (int i = 0; i < SIZE; i++) {
+        for (size_t i = 0; i < m_size; i++) {
             m_hasharray[i].~KeyValueType();
         }
-        munmap(m_hasharray, SIZE * sizeof(KeyValueType));
+        munmap(m_hasharray, m_size * sizeof(KeyValueType));
     }
 
     ValueType* get(const KeyType& key) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
 
         while (true) {
@@ -123,7 +130,7 @@ public:
     }
 
     bool remove(KeyType key) {
-        KeyType bucket = key % SIZE;
+        KeyType bucket = first_entry(key);
         KeyType key_with_ctrl_bits = (key << ADD_CONTROL_BITS) | ENTRY_USED;
 
         while(true) {
@@ -164,7 +171,7 @@ public:
         size_t misplaced_buckets = 0;
         size_t correctly_placed_buckets = 0;
 
-        for (size_t i = 0; i < SIZE; i++) {
+        for (size_t i = 0; i < m_size; i++) {
             KeyType control_bits = m_hasharray[i].key & EXTRACT_CONTROL_BITS;
             switch (control_bits) {
                 case ENTRY_FREE:
@@ -174,7 +181,7 @@ public:
                     deleted_buckets++;
                     break;
                 case ENTRY_USED: {
-                    KeyType bucket = (m_hasharray[i].key >> ADD_CONTROL_BITS) % SIZE;
+                    KeyType bucket = first_entry(m_hasharray[i].key >> ADD_CONTROL_BITS);
                     if (bucket == i) {
                         correctly_placed_buckets++;
                     } else {
@@ -187,7 +194,7 @@ public:
 
         std::string result;
         result.reserve(300);
-        result += "Total buckets: " + std::to_string(SIZE) + "\n";
+        result += "Total buckets: " + std::to_string(m_size) + "\n";
         result += "Used buckets: " + std::to_string(misplaced_buckets + correctly_placed_buckets) + "\n";
         result += "Correctly placed buckets: " + std::to_string(correctly_placed_buckets) + "\n";
         result += "Misplaced buckets: " + std::to_string(misplaced_buckets) + "\n";
@@ -221,6 +228,8 @@ private:
     };
 
     KeyValueType* m_hasharray;
+    size_t m_size;
+    Hasher m_limiter;
 };
 
 }
\ No newline at end of file
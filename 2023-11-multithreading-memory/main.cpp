@@ -2,159 +2,358 @@
 #include <cstddef>
 #include <memory>
 #include <array>
-#include <mutex>
+#include <atomic>
 #include <vector>
 #include <iostream>
 #include <random>
 #include <chrono>
 #include <thread>
+#include <algorithm>
+#include <limits>
+#include <deque>
 
 #include <emmintrin.h>
 
-template<typename T, size_t SIZE=64>
-class thread_safe_queue_t {
-public:
-    thread_safe_queue_t():
-        front(0),
-        back(0)
-    { }
+#include "ring_buffer.h"
 
-    bool push(T v) {
-        std::unique_lock<std::mutex> lock(m_mutex); 
+struct data_packet_t{
+    static constexpr size_t PACKET_SIZE = 128;
+    int32_t keys[PACKET_SIZE];
+    int32_t idx[PACKET_SIZE];
+    // The keys can only be found in sorted[slice_begin, slice_end).
+    size_t slice_begin;
+    size_t slice_end;
+};
 
-        size_t new_front = front + 1;
-        if (new_front == SIZE) {
-            new_front = 0;
-        }
+// Packets are filled in place in the ring slots and never copied. Each worker
+// has its own single-producer single-consumer ring, except in SHARED mode,
+// where all workers take packets from one multi-consumer ring.
+using packet_queue_t = spsc_ring_t<data_packet_t, 64>;
+using shared_packet_queue_t = mpmc_ring_t<data_packet_t, 256>;
 
-        // List empty
-        if (new_front == back) {
-            return false;
-        }
+enum class dispatch_mode_t { RANGE, ROUND_ROBIN, SHARED };
 
-        m_array[new_front] = v;
-        front = new_front;
-        return true;
+static const char* to_string(dispatch_mode_t mode) {
+    switch (mode) {
+        case dispatch_mode_t::RANGE: return "RANGE";
+        case dispatch_mode_t::ROUND_ROBIN: return "ROUND_ROBIN";
+        case dispatch_mode_t::SHARED: return "SHARED";
     }
+    return "";
+}
 
-    bool pop(T& v) {
-        std::unique_lock<std::mutex> lock(m_mutex); 
+// What the dispatcher does with a packet whose queue is full: drop it, wait
+// for the worker to make room, or keep it in a local spill list and hand it
+// over before any newer packet of that queue (up to MAX_SPILLED packets, then
+// it drops).
+enum class backpressure_t { DROP, BLOCK, SPILL };
+
+static const char* to_string(backpressure_t backpressure) {
+    switch (backpressure) {
+        case backpressure_t::DROP: return "DROP";
+        case backpressure_t::BLOCK: return "BLOCK";
+        case backpressure_t::SPILL: return "SPILL";
+    }
+    return "";
+}
 
-        if (front == back) {
-            return false;
+struct dispatch_stats_t {
+    size_t packets = 0;  // Packets formed.
+    size_t dropped = 0;
+    size_t spilled = 0;  // Packets that went through the spill list.
+};
+
+// The packet being filled for one queue: a claimed ring slot, or the scratch
+// packet when the ring was full.
+template <typename queue_t>
+struct packet_builder_t {
+    static constexpr size_t MAX_SPILLED = 1024;
+
+    queue_t q;
+    ring_reservation_t slot;
+    data_packet_t* packet;
+    data_packet_t scratch;
+    size_t packet_size;
+    size_t slice_begin;
+    size_t slice_end;
+    std::deque<data_packet_t> spill;
+    dispatch_stats_t stats;
+
+    packet_builder_t() :
+        packet(nullptr),
+        packet_size(0),
+        slice_begin(0),
+        slice_end(0)
+    { }
+
+    void add(int32_t val, backpressure_t backpressure) {
+        if (packet_size == 0) {
+            start_packet(backpressure);
         }
 
-        size_t new_back = back + 1;
-        if (new_back == SIZE) {
-            new_back = 0;
+        packet->keys[packet_size] = val;
+        packet_size++;
+
+        if (packet_size == data_packet_t::PACKET_SIZE) {
+            finish_packet(backpressure);
         }
+    }
 
-        v = m_array[back];
-        back = new_back;
+    void start_packet(backpressure_t backpressure) {
+        bool claimed;
+        if (!spill.empty() && !flush_spill()) {
+            claimed = false;  // Spilled packets go first.
+        } else if (backpressure == backpressure_t::BLOCK) {
+            claimed = q.claim(slot);  // Only fails once the queue is closed.
+        } else {
+            claimed = q.try_claim(slot);
+        }
 
-        return true;
+        packet = claimed ? &q.slot(slot.first) : &scratch;
+        packet->slice_begin = slice_begin;
+        packet->slice_end = slice_end;
     }
 
-private:
-    std::mutex m_mutex;
-    std::array<T, SIZE> m_array;
-    size_t front;
-    size_t back;
+    void finish_packet(backpressure_t backpressure) {
+        stats.packets++;
+        if (packet != &scratch) {
+            q.publish(slot);
+        } else if (backpressure == backpressure_t::SPILL && spill.size() < MAX_SPILLED) {
+            spill.push_back(scratch);
+            stats.spilled++;
+        } else {
+            stats.dropped++;
+        }
+        packet_size = 0;
+    }
 
+    // Moves as many spilled packets to the ring as fit, returns true if the
+    // spill list is empty afterwards.
+    bool flush_spill() {
+        ring_reservation_t r;
+        while (!spill.empty() && q.try_claim(r, spill.size())) {
+            for (size_t i = 0; i < r.count; i++) {
+                q.slot(r.first + i) = spill.front();
+                spill.pop_front();
+            }
+            q.publish(r);
+        }
+        return spill.empty();
+    }
 };
 
-struct data_packet_t{
-    static constexpr size_t PACKET_SIZE = 128;
-    int32_t keys[PACKET_SIZE];
-    int32_t idx[PACKET_SIZE];
+// Written by one worker, read by the dispatcher to balance the load.
+struct alignas(64) worker_stats_t {
+    std::atomic<uint64_t> busy_ns{0};
+    std::atomic<uint64_t> keys{0};
 };
 
-using packet_queue_t = thread_safe_queue_t<data_packet_t>;
-
 struct packet_dispatcher_t {
-    struct packet_processor_t {
-        packet_queue_t q;
-        int32_t to_val;
-
-        data_packet_t packet;
-        size_t packet_size;
+    // Every REBALANCE_KEYS keys the RANGE dispatcher moves the boundaries.
+    static constexpr size_t REBALANCE_KEYS = 1024 * 1024;
 
-        packet_processor_t() : 
-          packet_size(0)
-        { }
-    };
-
-    std::vector<packet_processor_t> queues;
+    std::vector<packet_builder_t<packet_queue_t>> queues;
+    packet_builder_t<shared_packet_queue_t> shared_queue;
+    std::vector<worker_stats_t> worker_stats;
     size_t current_queue;
     size_t total_queues;
+    backpressure_t backpressure;
+
+    // Queue i gets the keys in (to_val[i - 1], to_val[i]], which can only be
+    // found in sorted[splits[i], splits[i + 1]). to_val is padded with
+    // INT32_MAX to a multiple of 4 for the SIMD search.
+    int32_t* sorted;
+    size_t sorted_size;
+    std::vector<size_t> splits;
+    std::vector<int32_t> to_val;
+
+    // Since the last rebalance.
+    std::vector<size_t> dispatched_keys;
+    std::vector<uint64_t> last_busy_ns;
+    std::vector<uint64_t> last_keys;
+    size_t keys_since_rebalance;
+    size_t rebalance_count;
 
-    packet_dispatcher_t(size_t num_queues, int32_t* sorted, size_t sorted_size) : 
+    packet_dispatcher_t(size_t num_queues, int32_t* sorted, size_t sorted_size, dispatch_mode_t mode, backpressure_t backpressure) : 
         queues(num_queues),
+        worker_stats(num_queues),
         current_queue(0),
-        total_queues(num_queues)
+        total_queues(num_queues),
+        backpressure(backpressure),
+        sorted(sorted),
+        sorted_size(sorted_size),
+        splits(num_queues + 1),
+        to_val((num_queues + 3) / 4 * 4, std::numeric_limits<int32_t>::max()),
+        dispatched_keys(num_queues, 0),
+        last_busy_ns(num_queues, 0),
+        last_keys(num_queues, 0),
+        keys_since_rebalance(0),
+        rebalance_count(0)
     {
-        for (size_t i = 0; i < num_queues; i++) {
-            queues[i].to_val = sorted[sorted_size / num_queues * (i + 1)];
+        for (size_t i = 0; i <= num_queues; i++) {
+            splits[i] = sorted_size / num_queues * i;
+        }
+        splits[num_queues] = sorted_size;
+        update_boundaries();
+
+        // Without range partitioning any key can go to any worker.
+        if (mode != dispatch_mode_t::RANGE) {
+            for (size_t i = 0; i < num_queues; i++) {
+                queues[i].slice_begin = 0;
+                queues[i].slice_end = sorted_size;
+            }
+        }
+        shared_queue.slice_begin = 0;
+        shared_queue.slice_end = sorted_size;
+    }
+
+    void update_boundaries() {
+        for (size_t i = 0; i < total_queues; i++) {
+            to_val[i] = sorted[splits[i + 1] - 1];
+            queues[i].slice_begin = splits[i];
+            queues[i].slice_end = splits[i + 1];
         }
-        queues[num_queues - 1].to_val = std::numeric_limits<int32_t>::max();
+        to_val[total_queues - 1] = std::numeric_limits<int32_t>::max();
+    }
+
+    // The queue is the number of boundaries below val: four compares per
+    // instruction instead of a branch per boundary.
+    size_t find_queue(int32_t val) const {
+        __m128i v = _mm_set1_epi32(val);
+        size_t count = 0;
+        for (size_t i = 0; i < to_val.size(); i += 4) {
+            __m128i bounds = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&to_val[i]));
+            __m128i below = _mm_cmpgt_epi32(v, bounds);
+            count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(below)));
+        }
+        return count;
     }
 
     // Enques a value until a packet is formed, then dispatch the packet
     void enqueue(int32_t val) {
-        size_t queues_size = queues.size();
-        for (size_t i = 0; i < queues_size; i++) {
-            if (val <= queues[i].to_val) {
-                queues[i].packet.keys[queues[i].packet_size] = val;
-                queues[i].packet_size++;
-
-                if (queues[i].packet_size == data_packet_t::PACKET_SIZE) {
-                    bool res = queues[i].q.push(queues[i].packet);
-                    if (res == false) {
-                        //std::cout << "Packet dropped\n";
-                    } else {
-                        //std::cout << "Packet pushed\n";
-                    }
-                    queues[i].packet_size = 0;
-                }
+        size_t q = find_queue(val);
+        queues[q].add(val, backpressure);
+        dispatched_keys[q]++;
 
+        keys_since_rebalance++;
+        if (keys_since_rebalance == REBALANCE_KEYS) {
+            rebalance();
+        }
+    }
+
+    // Moves the boundaries so every worker gets the same amount of work.
+    // The load of a queue is the number of keys sent to it times the time
+    // its worker needed per key, which also counts the keys that were dropped
+    // or are still queued. Assuming the load is spread evenly over a slice,
+    // the new splits are where the cumulative load reaches 1/n, 2/n, ... of
+    // the total; the boundaries only move halfway there to dampen noise.
+    // Slices stay contiguous, so each worker keeps searching one part of
+    // sorted that can stay in its cache.
+    void rebalance() {
+        std::vector<double> load(total_queues);
+        double total_load = 0.0;
+        for (size_t i = 0; i < total_queues; i++) {
+            uint64_t busy_ns = worker_stats[i].busy_ns.load(std::memory_order_relaxed);
+            uint64_t keys = worker_stats[i].keys.load(std::memory_order_relaxed);
+            if (keys == last_keys[i]) {
+                // No measurement for this worker yet, try again later.
+                keys_since_rebalance = 0;
                 return;
             }
+            double ns_per_key = double(busy_ns - last_busy_ns[i]) / double(keys - last_keys[i]);
+            load[i] = ns_per_key * dispatched_keys[i];
+            total_load += load[i];
         }
-    }
 
-    // Enques a value until a packet is formed, then dispatch the packet
-    void enqueue_round_robin(int32_t val) {
-        queues[current_queue].packet.keys[queues[current_queue].packet_size] = val;
-        queues[current_queue].packet_size++;
+        std::vector<size_t> new_splits(splits);
+        size_t q = 0;
+        double cumulative = 0.0;
+        for (size_t j = 1; j < total_queues; j++) {
+            double target = total_load * j / total_queues;
+            while (q < total_queues - 1 && cumulative + load[q] < target) {
+                cumulative += load[q];
+                q++;
+            }
+            double fraction = load[q] > 0.0 ? std::min((target - cumulative) / load[q], 1.0) : 0.0;
+            size_t split = splits[q] + size_t(fraction * (splits[q + 1] - splits[q]));
+            new_splits[j] = (splits[j] + split) / 2;
+        }
 
-        if (queues[current_queue].packet_size == data_packet_t::PACKET_SIZE) {
-            bool res = queues[current_queue].q.push(queues[current_queue].packet);
-            if (res == false) {
-                //std::cout << "Packet dropped\n";
+        // Every slice keeps at least one element.
+        for (size_t j = 1; j < total_queues; j++) {
+            new_splits[j] = std::max(new_splits[j], new_splits[j - 1] + 1);
+            new_splits[j] = std::min(new_splits[j], sorted_size - (total_queues - j));
+        }
+        splits = new_splits;
+        update_boundaries();
+
+        // A packet that is half full has keys from the old slice and gets
+        // keys from the new one.
+        for (size_t i = 0; i < total_queues; i++) {
+            if (queues[i].packet_size > 0) {
+                data_packet_t* packet = queues[i].packet;
+                packet->slice_begin = std::min(packet->slice_begin, splits[i]);
+                packet->slice_end = std::max(packet->slice_end, splits[i + 1]);
             }
-            queues[current_queue].packet_size = 0;
         }
 
+        for (size_t i = 0; i < total_queues; i++) {
+            last_busy_ns[i] = worker_stats[i].busy_ns.load(std::memory_order_relaxed);
+            last_keys[i] = worker_stats[i].keys.load(std::memory_order_relaxed);
+            dispatched_keys[i] = 0;
+        }
+        keys_since_rebalance = 0;
+        rebalance_count++;
+    }
+
+    // Enques a value until a packet is formed, then dispatch the packet
+    void enqueue_round_robin(int32_t val) {
+        queues[current_queue].add(val, backpressure);
+
         current_queue++;
         if (current_queue == total_queues) {
             current_queue = 0;
         }
     }
+
+    void enqueue_shared(int32_t val) {
+        shared_queue.add(val, backpressure);
+    }
+
+    // Wakes up the workers blocked on an empty queue and the generator
+    // blocked on a full one.
+    void close() {
+        for (size_t i = 0; i < total_queues; i++) {
+            queues[i].q.close();
+        }
+        shared_queue.q.close();
+    }
+
+    dispatch_stats_t stats() const {
+        dispatch_stats_t total = shared_queue.stats;
+        for (size_t i = 0; i < total_queues; i++) {
+            total.packets += queues[i].stats.packets;
+            total.dropped += queues[i].stats.dropped;
+            total.spilled += queues[i].stats.spilled;
+        }
+        return total;
+    }
 };
 
-template <bool assign_round_robin = true>
-void generate_data(packet_dispatcher_t* dispatcher, int32_t min, int32_t max, bool* finish) {
+template <dispatch_mode_t mode>
+void generate_data(packet_dispatcher_t* dispatcher, int32_t min, int32_t max, std::atomic<bool>* finish) {
     std::random_device                  rand_dev;
     std::mt19937                        generator(rand_dev());
     std::uniform_int_distribution<int32_t>  distr(min, max);
 
-    if (assign_round_robin) {
-        while (!*finish) {
-            dispatcher->enqueue_round_robin(distr(generator));
-        }
-    } else {
-        while (!*finish) {
-            dispatcher->enqueue(distr(generator));
+    while (!finish->load(std::memory_order_relaxed)) {
+        int32_t val = distr(generator);
+        if (mode == dispatch_mode_t::RANGE) {
+            dispatcher->enqueue(val);
+        } else if (mode == dispatch_mode_t::ROUND_ROBIN) {
+            dispatcher->enqueue_round_robin(val);
+        } else {
+            dispatcher->enqueue_shared(val);
         }
     }
 }
@@ -181,37 +380,58 @@ int32_t binary_search(int32_t* sorted, size_t sorted_size, int32_t key) {
     return std::numeric_limits<int32_t>::min();
 }
 
+template <typename queue_t>
 struct binary_search_params_t {
     int32_t* sorted;
-    size_t sorted_size;
-    packet_queue_t* my_queue;
+    queue_t* my_queue;
+    worker_stats_t* stats;
 
-    bool* finish;
+    std::atomic<bool>* finish;
     std::pair<size_t, uint64_t>* res;
 };
 
-void binary_search_packet(binary_search_params_t params) {
+// Takes up to PACKET_BATCH packets at a time and searches them in place in
+// the ring, each one only in the slice of sorted it was dispatched for. A
+// spinning worker polls the queue with _mm_pause until finish is
+// set; a blocking one sleeps in acquire() until packets arrive or the queue
+// is closed.
+template <typename queue_t, bool blocking>
+void binary_search_packet(binary_search_params_t<queue_t> params) {
+    static constexpr size_t PACKET_BATCH = 4;
+
     int32_t* sorted = params.sorted;
-    size_t sorted_size = params.sorted_size;
-    packet_queue_t* my_queue = params.my_queue;
-    bool* finish = params.finish;
+    queue_t* my_queue = params.my_queue;
+    worker_stats_t* stats = params.stats;
+    std::atomic<bool>* finish = params.finish;
     std::pair<size_t, uint64_t>* res = params.res;
 
-    data_packet_t packet;
     size_t total_packets = 0;
 
     uint64_t time = 0;
 
-    while(!*finish) {
-        bool res = my_queue->pop(packet);
+    while(!finish->load(std::memory_order_relaxed)) {
+        ring_reservation_t r;
+        bool res = blocking ? my_queue->acquire(r, PACKET_BATCH) : my_queue->try_acquire(r, PACKET_BATCH);
         if (res) {
             std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-            for (size_t i = 0; i < packet.PACKET_SIZE; ++i) {
-                packet.idx[i] = binary_search(sorted, sorted_size, packet.keys[i]);
+            for (size_t p = 0; p < r.count; ++p) {
+                data_packet_t& packet = my_queue->slot(r.first + p);
+                int32_t* slice = sorted + packet.slice_begin;
+                size_t slice_size = packet.slice_end - packet.slice_begin;
+                for (size_t i = 0; i < packet.PACKET_SIZE; ++i) {
+                    int32_t idx = binary_search(slice, slice_size, packet.keys[i]);
+                    packet.idx[i] = idx == std::numeric_limits<int32_t>::min() ? idx : idx + int32_t(packet.slice_begin);
+                }
             }
             std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-            time += std::chrono::duration_cast<std::chrono::nanoseconds> (end - begin).count();
-            total_packets++;
+            my_queue->release(r);
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> (end - begin).count();
+            time += elapsed;
+            total_packets += r.count;
+            stats->busy_ns.store(time, std::memory_order_relaxed);
+            stats->keys.store(total_packets * data_packet_t::PACKET_SIZE, std::memory_order_relaxed);
+        } else if (blocking) {
+            break;  // Closed.
         } else {
             _mm_pause();
         }
@@ -228,41 +448,56 @@ void generate_sorted_array(int32_t* array, size_t size) {
     }
 }
 
-template<bool use_round_robin>
-void run_test(size_t sorted_size, size_t num_threads) {
-    bool finish = false;
+template<dispatch_mode_t mode, bool blocking>
+void run_test(size_t sorted_size, size_t num_threads, backpressure_t backpressure) {
+    std::atomic<bool> finish(false);
 
     std::vector<int32_t> sorted_from(sorted_size);
     generate_sorted_array(sorted_from.data(), sorted_size);
 
-    int32_t* sorted = (int32_t*) malloc(sizeof(int32_t) * sorted_size);
-
-    packet_dispatcher_t packet_dispatcher(num_threads, sorted_from.data(), sorted_size);
+    packet_dispatcher_t packet_dispatcher(num_threads, sorted_from.data(), sorted_size, mode, backpressure);
 
-    std::thread generator_thread(generate_data<use_round_robin>, &packet_dispatcher, sorted_from[0] - 10, sorted_from[sorted_size - 1] + 10, &finish);
+    std::thread generator_thread(generate_data<mode>, &packet_dispatcher, sorted_from[0] - 10, sorted_from[sorted_size - 1] + 10, &finish);
     std::vector<std::thread> search_threads;
     std::vector<std::pair<size_t, uint64_t>> search_results;
     search_results.resize(num_threads);
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     for (size_t i = 0; i < num_threads; ++i) {
-        binary_search_params_t params;
-        params.sorted_size = sorted_size;
-        params.my_queue = &(packet_dispatcher.queues[i].q);
-        params.sorted = sorted_from.data();
-        params.finish = &finish;
-        params.res = &search_results[i];
-
-        search_threads.emplace_back(binary_search_packet, params);
+        if (mode == dispatch_mode_t::SHARED) {
+            binary_search_params_t<shared_packet_queue_t> params;
+            params.my_queue = &(packet_dispatcher.shared_queue.q);
+            params.sorted = sorted_from.data();
+            params.stats = &packet_dispatcher.worker_stats[i];
+            params.finish = &finish;
+            params.res = &search_results[i];
+
+            search_threads.emplace_back(binary_search_packet<shared_packet_queue_t, blocking>, params);
+        } else {
+            binary_search_params_t<packet_queue_t> params;
+            params.my_queue = &(packet_dispatcher.queues[i].q);
+            params.sorted = sorted_from.data();
+            params.stats = &packet_dispatcher.worker_stats[i];
+            params.finish = &finish;
+            params.res = &search_results[i];
+
+            search_threads.emplace_back(binary_search_packet<packet_queue_t, blocking>, params);
+        }
     }
 
-    std::cout << "SIZE = " << sorted_size << ", ROUND_ROBIN = " << use_round_robin << "\n";
+    std::cout << "SIZE = " << sorted_size << ", MODE = " << to_string(mode) << ", BLOCKING = " << blocking
+              << ", BACKPRESSURE = " << to_string(backpressure) << "\n";
     std::cout << "Threads started. Waiting 5 seconds\n";
 
     using namespace std::chrono_literals;
 
     std::this_thread::sleep_for(5s);
 
+    // Closing the queues first also releases a generator blocked on a full
+    // queue.
     finish = true;
+    packet_dispatcher.close();
     generator_thread.join();
 
     uint64_t all_threads_runtime = 0;
@@ -273,13 +508,28 @@ void run_test(size_t sorted_size, size_t num_threads) {
         all_threads_packets += search_results[i].first;
         all_threads_runtime += search_results[i].second;
         std::cout << "Thr " << i << ": total packets = " << search_results[i].first 
-                  << ", average time per packet " << search_results[i].second / search_results[i].first << "\n";
+                  << ", average time per packet " << search_results[i].second / std::max<size_t>(search_results[i].first, 1) << "\n";
     }
 
-    std::cout << "For all threads: total packets = " << all_threads_packets 
-              << ", average time per packet = " << all_threads_runtime / all_threads_packets << "\n";
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dispatch_stats_t stats = packet_dispatcher.stats();
 
-    free(sorted);
+    std::cout << "For all threads: total packets = " << all_threads_packets 
+              << ", average time per packet = " << all_threads_runtime / std::max<size_t>(all_threads_packets, 1) << "\n";
+    std::cout << "Throughput = " << all_threads_packets / seconds << " packets/s ("
+              << all_threads_packets * data_packet_t::PACKET_SIZE / seconds / 1e6 << " M keys/s)"
+              << ", packets formed = " << stats.packets
+              << ", dropped = " << stats.dropped
+              << " (" << 100.0 * stats.dropped / std::max<size_t>(stats.packets, 1) << "%)"
+              << ", spilled = " << stats.spilled << "\n";
+
+    if (mode == dispatch_mode_t::RANGE) {
+        std::cout << "Rebalanced " << packet_dispatcher.rebalance_count << " times, slice sizes:";
+        for (size_t i = 0; i < num_threads; i++) {
+            std::cout << " " << packet_dispatcher.splits[i + 1] - packet_dispatcher.splits[i];
+        }
+        std::cout << "\n";
+    }
 }
 
 int main() {
@@ -289,9 +539,13 @@ int main() {
 
     for (size_t s = start_size; s <= end_size; s *= 4) {
         size_t size = s - 348;
-        run_test<true>(size, THREAD_COUNT);
-        run_test<false>(size, THREAD_COUNT);
+        run_test<dispatch_mode_t::ROUND_ROBIN, false>(size, THREAD_COUNT, backpressure_t::DROP);
+        run_test<dispatch_mode_t::RANGE, false>(size, THREAD_COUNT, backpressure_t::DROP);
+        run_test<dispatch_mode_t::RANGE, false>(size, THREAD_COUNT, backpressure_t::BLOCK);
+        run_test<dispatch_mode_t::RANGE, false>(size, THREAD_COUNT, backpressure_t::SPILL);
+        run_test<dispatch_mode_t::RANGE, true>(size, THREAD_COUNT, backpressure_t::BLOCK);
+        run_test<dispatch_mode_t::SHARED, false>(size, THREAD_COUNT, backpressure_t::BLOCK);
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+// Bounded lock-free rings for passing packets between threads.
+//
+// spsc_ring_t has one producer and one consumer. The producer owns the tail
+// index and the consumer the head index; each index sits on its own cache
+// line together with the owner's cached copy of the other index, so the two
+// threads only touch each other's line when the cached copy says the ring is
+// full or empty.
+//
+// mpmc_ring_t allows any number of producers and consumers (Dmitry Vyukov's
+// bounded queue). Every slot carries a sequence number that says whether it
+// is free or full for the current lap; producers and consumers claim
+// positions with a compare-and-swap on their index and then work on the slot
+// without any further synchronization.
+//
+// Both rings hand out slots in place instead of copying values in and out:
+//
+//     ring_reservation_t r;
+//     if (ring.try_claim(r, 4)) {                 // Up to 4 free slots.
+//         for (size_t i = 0; i < r.count; i++) {
+//             fill(ring.slot(r.first + i));
+//         }
+//         ring.publish(r);                        // Visible to consumers.
+//     }
+//
+// and try_acquire() / release() do the same on the consumer side. Positions
+// are absolute and only wrap in slot(). A reservation must be published or
+// released before its owner claims or acquires again. try_push() / try_pop()
+// and the _batch variants are copying wrappers around the same calls.
+//
+// claim() and acquire() wait until slots are available: they spin with
+// _mm_pause for a while and then sleep on a futex. Threads that never call
+// them cost the other side one fence and one load per publish or release.
+// close() wakes all waiters; from then on claim() and acquire() return false
+// instead of waiting, so consumers drain what is left and then stop.
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+#include <emmintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static constexpr size_t RING_CACHE_LINE = 64;
+static constexpr int RING_SPIN_COUNT = 1024;
+
+struct ring_reservation_t {
+    size_t first;
+    size_t count;
+};
+
+// Lets threads sleep until the other side of a ring makes progress. A waiter
+// registers first and then re-checks the ring; a notifier changes the ring
+// and then checks for waiters. The seq_cst operations on both sides make sure
+// one of them sees the other, so no wakeup is lost.
+class futex_event_t {
+public:
+    uint32_t prepare_wait() {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_relaxed);
+    }
+
+    void cancel_wait() {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wait(uint32_t epoch) {
+        syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) != 0) {
+            m_epoch.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, &m_epoch, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+    std::atomic<uint32_t> m_epoch{0};
+    std::atomic<uint32_t> m_waiters{0};
+};
+
+// Calls try_fn until it succeeds or the ring is closed: first spinning, then
+// sleeping on the event.
+template<typename TryFn, typename ClosedFn>
+bool ring_wait(futex_event_t& event, TryFn try_fn, ClosedFn closed_fn) {
+    for (int i = 0; i < RING_SPIN_COUNT; i++) {
+        if (try_fn()) {
+            return true;
+        }
+        if (closed_fn()) {
+            return false;
+        }
+        _mm_pause();
+    }
+
+    while (true) {
+        uint32_t epoch = event.prepare_wait();
+        if (try_fn()) {
+            event.cancel_wait();
+            return true;
+        }
+        if (closed_fn()) {
+            event.cancel_wait();
+            return false;
+        }
+        event.wait(epoch);
+    }
+}
+
+template<typename T, size_t SIZE = 64>
+class spsc_ring_t {
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+    static constexpr size_t MASK = SIZE - 1;
+
+public:
+    T& slot(size_t pos) { return m_slots[pos & MASK]; }
+
+    // Producer side.
+    bool try_claim(ring_reservation_t& r, size_t max = 1) {
+        size_t tail = m_producer.tail.load(std::memory_order_relaxed);
+        size_t free = SIZE - (tail - m_producer.cached_head);
+        if (free < max) {
+            m_producer.cached_head = m_consumer.head.load(std::memory_order_acquire);
+            free = SIZE - (tail - m_producer.cached_head);
+            if (free == 0) {
+                return false;
+            }
+        }
+        r.first = tail;
+        r.count = free < max ? free : max;
+        return true;
+    }
+
+    void publish(const ring_reservation_t& r) {
+        m_producer.tail.store(r.first + r.count, std::memory_order_release);
+        m_not_empty.notify();
+    }
+
+    bool claim(ring_reservation_t& r, size_t max = 1) {
+        return ring_wait(m_not_full,
+                         [&] { return try_claim(r, max); },
+                         [&] { return is_closed(); });
+    }
+
+    // Consumer side.
+    bool try_acquire(ring_reservation_t& r, size_t max = 1) {
+        size_t head = m_consumer.head.load(std::memory_order_relaxed);
+        size_t full = m_consumer.cached_tail - head;
+        if (full < max) {
+            m_consumer.cached_tail = m_producer.tail.load(std::memory_order_acquire);
+            full = m_consumer.cached_tail - head;
+            if (full == 0) {
+                return false;
+            }
+        }
+        r.first = head;
+        r.count = full < max ? full : max;
+        return true;
+    }
+
+    void release(const ring_reservation_t& r) {
+        m_consumer.head.store(r.first + r.count, std::memory_order_release);
+        m_not_full.notify();
+    }
+
+    bool acquire(ring_reservation_t& r, size_t max = 1) {
+        return ring_wait(m_not_empty,
+                         [&] { return try_acquire(r, max); },
+                         [&] { return is_closed(); });
+    }
+
+    // Copying wrappers.
+    bool try_push(const T& v) { return try_push_batch(&v, 1) == 1; }
+    bool try_pop(T& v) { return try_pop_batch(&v, 1) == 1; }
+
+    size_t try_push_batch(const T* v, size_t n) {
+        ring_reservation_t r;
+        if (n == 0 || !try_claim(r, n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < r.count; i++) {
+            slot(r.first + i) = v[i];
+        }
+        publish(r);
+        return r.count;
+    }
+
+    size_t try_pop_batch(T* v, size_t n) {
+        ring_reservation_t r;
+        if (n == 0 || !try_acquire(r, n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < r.count; i++) {
+            v[i] = slot(r.first + i);
+        }
+        release(r);
+        return r.count;
+    }
+
+    void close() {
+        m_closed.store(true, std::memory_order_seq_cst);
+        m_not_empty.notify();
+        m_not_full.notify();
+    }
+
+    bool is_closed() const { return m_closed.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(RING_CACHE_LINE) producer_t {
+        std::atomic<size_t> tail{0};
+        size_t cached_head = 0;
+    };
+
+    struct alignas(RING_CACHE_LINE) consumer_t {
+        std::atomic<size_t> head{0};
+        size_t cached_tail = 0;
+    };
+
+    producer_t m_producer;
+    consumer_t m_consumer;
+    alignas(RING_CACHE_LINE) futex_event_t m_not_empty;
+    alignas(RING_CACHE_LINE) futex_event_t m_not_full;
+    std::atomic<bool> m_closed{false};
+    alignas(RING_CACHE_LINE) T m_slots[SIZE];
+};
+
+template<typename T, size_t SIZE = 64>
+class mpmc_ring_t {
+    static_assert(SIZE > 1 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+    static constexpr size_t MASK = SIZE - 1;
+
+public:
+    mpmc_ring_t() {
+        for (size_t i = 0; i < SIZE; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    T& slot(size_t pos) { return m_cells[pos & MASK].value; }
+
+    // A cell at position pos is free when its sequence is pos, and full when
+    // it is pos + 1. Both claim and acquire count the cells in a row that are
+    // ready, then take all of them with one compare-and-swap.
+    bool try_claim(ring_reservation_t& r, size_t max = 1) {
+        return try_reserve(m_enqueue_pos.pos, 0, r, max);
+    }
+
+    void publish(const ring_reservation_t& r) {
+        for (size_t i = 0; i < r.count; i++) {
+            size_t pos = r.first + i;
+            m_cells[pos & MASK].sequence.store(pos + 1, std::memory_order_release);
+        }
+        m_not_empty.notify();
+    }
+
+    bool claim(ring_reservation_t& r, size_t max = 1) {
+        return ring_wait(m_not_full,
+                         [&] { return try_claim(r, max); },
+                         [&] { return is_closed(); });
+    }
+
+    bool try_acquire(ring_reservation_t& r, size_t max = 1) {
+        return try_reserve(m_dequeue_pos.pos, 1, r, max);
+    }
+
+    void release(const ring_reservation_t& r) {
+        for (size_t i = 0; i < r.count; i++) {
+            size_t pos = r.first + i;
+            m_cells[pos & MASK].sequence.store(pos + SIZE, std::memory_order_release);
+        }
+        m_not_full.notify();
+    }
+
+    bool acquire(ring_reservation_t& r, size_t max = 1) {
+        return ring_wait(m_not_empty,
+                         [&] { return try_acquire(r, max); },
+                         [&] { return is_closed(); });
+    }
+
+    bool try_push(const T& v) { return try_push_batch(&v, 1) == 1; }
+    bool try_pop(T& v) { return try_pop_batch(&v, 1) == 1; }
+
+    size_t try_push_batch(const T* v, size_t n) {
+        ring_reservation_t r;
+        if (n == 0 || !try_claim(r, n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < r.count; i++) {
+            slot(r.first + i) = v[i];
+        }
+        publish(r);
+        return r.count;
+    }
+
+    size_t try_pop_batch(T* v, size_t n) {
+        ring_reservation_t r;
+        if (n == 0 || !try_acquire(r, n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < r.count; i++) {
+            v[i] = slot(r.first + i);
+        }
+        release(r);
+        return r.count;
+    }
+
+    void close() {
+        m_closed.store(true, std::memory_order_seq_cst);
+        m_not_empty.notify();
+        m_not_full.notify();
+    }
+
+    bool is_closed() const { return m_closed.load(std::memory_order_relaxed); }
+
+private:
+    // ready is 0 for producers (cell free) and 1 for consumers (cell full).
+    bool try_reserve(std::atomic<size_t>& index, size_t ready, ring_reservation_t& r, size_t max) {
+        if (max > SIZE) {
+            max = SIZE;
+        }
+        size_t pos = index.load(std::memory_order_relaxed);
+        while (true) {
+            size_t seq = m_cells[pos & MASK].sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq - (pos + ready));
+            if (diff < 0) {
+                return false;  // Full for producers, empty for consumers.
+            }
+            if (diff > 0) {
+                pos = index.load(std::memory_order_relaxed);  // Lost a race.
+                continue;
+            }
+
+            size_t count = 1;
+            while (count < max &&
+                   m_cells[(pos + count) & MASK].sequence.load(std::memory_order_acquire) == pos + count + ready) {
+                count++;
+            }
+
+            if (index.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                r.first = pos;
+                r.count = count;
+                return true;
+            }
+        }
+    }
+
+    struct alignas(RING_CACHE_LINE) cell_t {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    struct alignas(RING_CACHE_LINE) index_t {
+        std::atomic<size_t> pos{0};
+    };
+
+    index_t m_enqueue_pos;
+    index_t m_dequeue_pos;
+    alignas(RING_CACHE_LINE) futex_event_t m_not_empty;
+    alignas(RING_CACHE_LINE) futex_event_t m_not_full;
+    std::atomic<bool> m_closed{false};
+    cell_t m_cells[SIZE];
+};
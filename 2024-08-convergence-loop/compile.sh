@@ -1 +1 @@
-g++ -O3 -mavx2 -I../common convergence_loop.cpp -o convergence_loop
+g++ -O3 -mavx2 -fopenmp-simd -I../common convergence_loop.cpp -o convergence_loop
@@ -3,6 +3,7 @@
 #include <immintrin.h>
 #include <cmath>
 #include "likwid.h"
+#include "converge.h"
 
 struct result_t {
     double pi_4;
@@ -153,6 +154,20 @@ exit:
     return { reduce(sum), tmp[3] };
 }
 
+// One term of the Leibnitz formula per k: 1/(4k + 1) - 1/(4k + 3), computed
+// exactly as calculate_pi() does, so the sums are bit-identical.
+static double pi_term(double k) {
+    double x1 = 1.0 / (4.0 * k + 1.0);
+    double x2 = -1.0 / (4.0 * k + 3.0);
+    return x1 + x2;
+}
+
+template <int W>
+result_t calculate_pi_converge(double convergence_diff) {
+    converge_result r = converge<W>(pi_term, convergence_diff);
+    return { r.sum, 4.0 * r.terms + 3.0 };
+}
+
 int main(int argc, char** argv) {
     static constexpr double pi4 = M_PI_4;
     
@@ -162,6 +177,35 @@ int main(int argc, char** argv) {
     result_t pi_compiler = calculate_pi(0.0);
     LIKWID_MARKER_STOP("compiler_pi");
 
+    LIKWID_MARKER_START("converge8_pi");
+    result_t pi_converge8 = calculate_pi_converge<8>(0.0);
+    LIKWID_MARKER_STOP("converge8_pi");
+
+    LIKWID_MARKER_START("converge16_pi");
+    result_t pi_converge16 = calculate_pi_converge<16>(0.0);
+    LIKWID_MARKER_STOP("converge16_pi");
+
+    LIKWID_MARKER_START("converge64_pi");
+    result_t pi_converge64 = calculate_pi_converge<64>(0.0);
+    LIKWID_MARKER_STOP("converge64_pi");
+
+    // The engine must stop at the same term with the same sum as the scalar
+    // loop, also for tolerances that stop it early.
+    const double tolerances[] = { 0.0, 1e-18, 1e-17, 4e-17, 1e-12, 1e-6, 0.1, 1.0 };
+    for (double tolerance : tolerances) {
+        result_t expected = calculate_pi(tolerance);
+        result_t actual = calculate_pi_converge<16>(tolerance);
+        if (actual.pi_4 != expected.pi_4 || actual.last_member != expected.last_member) {
+            std::cout << "converge differs from calculate_pi for tolerance " << tolerance << "\n";
+            return 1;
+        }
+    }
+    if (pi_converge8.pi_4 != pi_compiler.pi_4 || pi_converge16.pi_4 != pi_compiler.pi_4 ||
+        pi_converge64.pi_4 != pi_compiler.pi_4) {
+        std::cout << "converge differs from calculate_pi\n";
+        return 1;
+    }
+
     LIKWID_MARKER_START("vector3_pi1");
     result_t pi_vector31 = calculate_pi_vector3(1e-18);
     LIKWID_MARKER_STOP("vector3_pi1");
@@ -189,6 +233,7 @@ int main(int argc, char** argv) {
     std::cout << "vector3_3 diff " << std::abs(pi4 - pi_vector33.pi_4) << "\n";
     std::cout << "vector1 diff " << std::abs(pi4 - pi_vector11.pi_4) << "\n";
     std::cout << "vector2 diff " << std::abs(pi4 - pi_vector21.pi_4) << "\n";
+    std::cout << "converge diff " << std::abs(pi4 - pi_converge16.pi_4) << "\n";
 
     std::cout << "compiler last member " << pi_compiler.last_member << "\n";
     std::cout << "vector3_1 last member " << pi_vector31.last_member << "\n";
@@ -196,6 +241,7 @@ int main(int argc, char** argv) {
     std::cout << "vector3_3 last member " << pi_vector33.last_member << "\n";
     std::cout << "vector1 last member " << pi_vector11.last_member << "\n";
     std::cout << "vector2 last member " << pi_vector21.last_member << "\n";
+    std::cout << "converge last member " << pi_converge16.last_member << "\n";
 
     LIKWID_MARKER_CLOSE;
 
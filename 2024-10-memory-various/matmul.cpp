@@ -1,37 +1,38 @@
 #include "../common/argparse.h"
+#include "../common/buffer_2d.h"
 #include <cstring>
 #include <likwid.h>
 
-void matrix_mul(double* c, double* a, double* b, int n) {
+// All matrices are n x n with row stride stride (in elements).
+void matrix_mul(double* c, double* a, double* b, int n, size_t stride) {
     for (int i = 0; i < n; ++i) {
         for (int j = 0; j < n; ++j) {
-            c[i * n + j] = 0.0;
+            c[i * stride + j] = 0.0;
             for (int k = 0; k < n; ++k) {
-                c[i * n + j] += a[i * n + k] + b[k * n + j];
+                c[i * stride + j] += a[i * stride + k] + b[k * stride + j];
             }
         }
     }
 }
 
-void matrix_mul_transposed(double* c, double* a, double* b, int n) {
-    double* b_transposed = (double*) malloc(sizeof(double) * n * n);
+void matrix_mul_transposed(double* c, double* a, double* b, int n, size_t stride) {
+    buffer_2d<double> b_transposed_buffer(n, n, stride);
+    double* b_transposed = b_transposed_buffer.data();
 
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < n; j++) {
-            b_transposed[i*n + j] = b[j*n + i];
+            b_transposed[i * stride + j] = b[j * stride + i];
         }
     }
 
     for (int i = 0; i < n; ++i) {
         for (int j = 0; j < n; ++j) {
-            c[i * n + j] = 0.0;
+            c[i * stride + j] = 0.0;
             for (int k = 0; k < n; ++k) {
-                c[i * n + j] += a[i * n + k] + b_transposed[j * n + k];
+                c[i * stride + j] += a[i * stride + k] + b_transposed[j * stride + k];
             }
         }
     }
-
-    free(b_transposed);
 }
 
 static void clobber() {
@@ -96,22 +97,34 @@ int main(int argc, const char* argv[]) {
 
     std::cout << "Dimension " << matrix_dim << ", repeat count " << repeat_count << "\n";
 
-    double * a = (double*) malloc(matrix_size * sizeof(double));
-    double * b = (double*) malloc(matrix_size * sizeof(double));
-    double * c0 = (double*) malloc(matrix_size * sizeof(double));
-    double * c1 = (double*) malloc(matrix_size * sizeof(double));
-
-    fill_buffer(a, matrix_size);
-    fill_buffer(b, matrix_size);
-    fill_buffer(c0, matrix_size);
-    fill_buffer(c1, matrix_size);
+    buffer_2d<double> a_buffer(matrix_dim, matrix_dim);
+    buffer_2d<double> b_buffer(matrix_dim, matrix_dim);
+    buffer_2d<double> c0_buffer(matrix_dim, matrix_dim);
+    buffer_2d<double> c1_buffer(matrix_dim, matrix_dim);
+    size_t const stride = a_buffer.stride();
+    size_t const buffer_size = matrix_dim * stride;
+
+    double * a = a_buffer.data();
+    double * b = b_buffer.data();
+    double * c0 = c0_buffer.data();
+    double * c1 = c1_buffer.data();
+
+    auto fill_matrix = [&](double* m) {
+        for (size_t i = 0; i < matrix_dim; ++i) {
+            fill_buffer(m + i * stride, matrix_dim);
+        }
+    };
+    fill_matrix(a);
+    fill_matrix(b);
+    fill_matrix(c0);
+    fill_matrix(c1);
 
     LIKWID_MARKER_INIT;
 
-    run_test(repeat_count, "regular", [&]() -> void { matrix_mul(c0, a, b, matrix_dim); });
-    run_test(repeat_count, "transposed", [&]() -> void { matrix_mul_transposed(c1, a, b, matrix_dim); });
+    run_test(repeat_count, "regular", [&]() -> void { matrix_mul(c0, a, b, matrix_dim, stride); });
+    run_test(repeat_count, "transposed", [&]() -> void { matrix_mul_transposed(c1, a, b, matrix_dim, stride); });
 
-    buffers_same(c0, c1, matrix_size);
+    buffers_same(c0, c1, buffer_size);
 
     LIKWID_MARKER_CLOSE;
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "../common/argparse.h"
 #include "likwid.h"
+#include "transpose.h"
+#include "../common/buffer_2d.h"
 
-void matrix_transpose_tiled_in(float* out, const float* in, size_t n) {
+// The matrices are n x n with row stride stride (in elements).
+void matrix_transpose_tiled_in(float* out, const float* in, size_t n, size_t stride) {
     const size_t TILE_SIZE = 16;
     const size_t ii_end = n / TILE_SIZE * TILE_SIZE;
     const size_t jj_end = n / TILE_SIZE * TILE_SIZE;
@@ -10,7 +13,7 @@ void matrix_transpose_tiled_in(float* out, const float* in, size_t n) {
         for (size_t jj = 0; jj < jj_end; jj+=TILE_SIZE) {
             for (size_t i = 0; i < TILE_SIZE; i++) {
                 for (size_t j = 0; j < TILE_SIZE; j++) {
-                    out[(jj + j)* n + ii + i] = in[(ii + i) * n + jj + j];
+                    out[(jj + j) * stride + ii + i] = in[(ii + i) * stride + jj + j];
                 }
             }
         }
@@ -18,7 +21,7 @@ void matrix_transpose_tiled_in(float* out, const float* in, size_t n) {
         // Drain loop for the last few columns in the matrix
         for(size_t i = ii; i < ii + TILE_SIZE; i++) {
             for (size_t j = jj_end; j < n; j++) {
-                out[j*n + i] = in[i * n + j];
+                out[j * stride + i] = in[i * stride + j];
             }
         }
     }
@@ -26,13 +29,13 @@ void matrix_transpose_tiled_in(float* out, const float* in, size_t n) {
     // Drain loop for the last few rows in the matrix
     for (size_t i = ii_end; i < n; i++) {
         for (size_t j = 0; j < n; j++) {
-            out[j*n + i] = in[i * n + j];
+            out[j * stride + i] = in[i * stride + j];
         }
     }
 }
 
 
-void matrix_transpose_tiled_out(float* out, const float* in, size_t n) {
+void matrix_transpose_tiled_out(float* out, const float* in, size_t n, size_t stride) {
     const size_t TILE_SIZE = 16;
     const size_t ii_end = n / TILE_SIZE * TILE_SIZE;
     const size_t jj_end = n / TILE_SIZE * TILE_SIZE;
@@ -41,7 +44,7 @@ void matrix_transpose_tiled_out(float* out, const float* in, size_t n) {
         for (size_t jj = 0; jj < jj_end; jj+=TILE_SIZE) {
             for (size_t i = 0; i < TILE_SIZE; i++) {
                 for (size_t j = 0; j < TILE_SIZE; j++) {
-                    out[(ii + i)* n + jj + j] = in[(jj + j) * n + ii + i];
+                    out[(ii + i) * stride + jj + j] = in[(jj + j) * stride + ii + i];
                 }
             }
         }
@@ -49,7 +52,7 @@ void matrix_transpose_tiled_out(float* out, const float* in, size_t n) {
         // Drain loop for the last few columns in the matrix
         for(size_t i = ii; i < ii + TILE_SIZE; i++) {
             for (size_t j = jj_end; j < n; j++) {
-                out[i*n + j] = in[j * n + i];
+                out[i * stride + j] = in[j * stride + i];
             }
         }
     }
@@ -57,7 +60,7 @@ void matrix_transpose_tiled_out(float* out, const float* in, size_t n) {
     // Drain loop for the last few rows in the matrix
     for (size_t i = ii_end; i < n; i++) {
         for (size_t j = 0; j < n; j++) {
-            out[i*n + j] = in[j * n + i];
+            out[i * stride + j] = in[j * stride + i];
         }
     }
 }
@@ -142,10 +145,10 @@ void free_matrix(float** m) {
     free(m);
 }
 
-void assert_matrices_equal(float* in0, float** in1, size_t rows, size_t columns) {
+void assert_matrices_equal(float* in0, size_t stride, float** in1, size_t rows, size_t columns) {
     for (size_t i = 0; i < rows; i++) {
         for (size_t j = 0; j < columns; j++) {
-            if (in0[i * columns + j] != in1[i][j]) {
+            if (in0[i * stride + j] != in1[i][j]) {
                 std::cout << "Matrices not equal at position [" << i << ", " << j << "]" << std::endl;
                 return;
             }
@@ -154,20 +157,70 @@ void assert_matrices_equal(float* in0, float** in1, size_t rows, size_t columns)
     std::cout << "Matrices same\n";
 }
 
-void copy_matrix(float** dest, float* src, size_t rows, size_t columns) {
+void copy_matrix(float** dest, float* src, size_t stride, size_t rows, size_t columns) {
     for (size_t i = 0; i < rows; i++) {
         for (size_t j = 0; j < columns; j++) {
-            dest[i][j] = src[i * columns + j];
+            dest[i][j] = src[i * stride + j];
         }
     }
 }
 
+template <typename T>
+void assert_transposed(T const * out, T const * in, size_t n, size_t stride) {
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            if (out[j * stride + i] != in[i * stride + j]) {
+                std::cout << "Matrix not transposed at position [" << i << ", " << j << "]" << std::endl;
+                return;
+            }
+        }
+    }
+    std::cout << "Matrix transposed\n";
+}
+
+// Runs the SIMD kernels from transpose.h on matrices with row stride n + padding,
+// or with the conflict-free stride picked by buffer_2d if auto_padding is set.
+// With padding 0 and a power-of-two n, the rows of a tile map to the same cache sets.
+template <typename T>
+void run_simd_tests(size_t n, size_t padding, bool auto_padding, size_t repeat_count, const std::string& type_name) {
+    size_t stride = auto_padding ? buffer_2d<T>::AUTO_STRIDE : n + padding;
+    buffer_2d<T> in_buffer(n, n, stride);
+    buffer_2d<T> out_buffer(n, n, stride);
+    buffer_2d<T> in_place_buffer(n, n, stride);
+    stride = in_buffer.stride();
+
+    std::string suffix = "_" + type_name + "_stride_" + std::to_string(stride);
+
+    T* in = in_buffer.data();
+    T* out = out_buffer.data();
+    T* in_place = in_place_buffer.data();
+
+    for (size_t i = 0; i < n; i++) {
+        fill_buffer<T>(in + i * stride, n);
+    }
+    std::memcpy(in_place, in, n * stride * sizeof(T));
+
+    run_test(repeat_count, "simd_tiled" + suffix, [&] ()-> void { transpose_simd_tiled(out, stride, in, stride, n, n); });
+    assert_transposed(out, in, n, stride);
+
+    std::memset(out, 0, n * stride * sizeof(T));
+    run_test(repeat_count, "recursive" + suffix, [&] ()-> void { transpose_recursive(out, stride, in, stride, n, n); });
+    assert_transposed(out, in, n, stride);
+
+    // An odd number of in-place transposes leaves the transposed input behind
+    size_t inplace_repeat_count = repeat_count / 2 * 2 + 1;
+    run_test(inplace_repeat_count, "inplace" + suffix, [&] ()-> void { transpose_inplace(in_place, stride, n); });
+    assert_transposed(in_place, in, n, stride);
+}
+
 using namespace argparse;
 
 int main(int argc, const char* argv[]) {
     ArgumentParser parser("matrix_rotate", "matrix_rotate");
 
     parser.add_argument("-d", "--dimension", "Matrix dimension", true);
+    parser.add_argument("-p", "--padding", "Row padding in elements", false);
+    parser.add_argument("-a", "--auto-padding", "Conflict-free row padding", false);
 
     auto err = parser.parse(argc, argv);
     if (err) {
@@ -184,34 +237,48 @@ int main(int argc, const char* argv[]) {
         }
     }
 
+    size_t padding = 0;
+
+    if (parser.exists("p")) {
+        padding = parser.get<size_t>("p");
+    }
+
+    bool auto_padding = parser.exists("a");
+
     LIKWID_MARKER_INIT;
 
     size_t matrix_size = matrix_dim * matrix_dim;
     size_t repeat_count = 1024 * 1024 * 1024 / matrix_size;
 
-    float* in_matrix = (float*) malloc(matrix_size * sizeof(float));
+    size_t stride = auto_padding ? buffer_2d<float>::AUTO_STRIDE : matrix_dim + padding;
+    buffer_2d<float> in_buffer(matrix_dim, matrix_dim, stride);
+    buffer_2d<float> matrix2_buffer(matrix_dim, matrix_dim, stride);
+    buffer_2d<float> matrix3_buffer(matrix_dim, matrix_dim, stride);
+    stride = in_buffer.stride();
+
+    float* in_matrix = in_buffer.data();
     float** in_matrix_full = allocate_matrix(matrix_dim, matrix_dim);
-    float* matrix2 = (float*) malloc(matrix_size * sizeof(float));
-    float* matrix3 = (float*) malloc(matrix_size * sizeof(float));
+    float* matrix2 = matrix2_buffer.data();
+    float* matrix3 = matrix3_buffer.data();
     float** out_matrix_full = allocate_matrix(matrix_dim, matrix_dim);
 
-    fill_buffer<float>(in_matrix, matrix_size);
-    copy_matrix(in_matrix_full, in_matrix, matrix_dim, matrix_dim);
-    std::memset(matrix2, 0, matrix_size * sizeof(float));
-    std::memset(matrix3, 0, matrix_size * sizeof(float));
+    for (size_t i = 0; i < matrix_dim; i++) {
+        fill_buffer<float>(in_matrix + i * stride, matrix_dim);
+    }
+    copy_matrix(in_matrix_full, in_matrix, stride, matrix_dim, matrix_dim);
 
     std::cout << "Matrix dimension " << matrix_dim << ", repeat count " << repeat_count << std::endl;
 
-    run_test(repeat_count, "tiled_in_linear", [&] ()-> void { matrix_transpose_tiled_in(matrix2, in_matrix, matrix_dim); });
-    run_test(repeat_count, "tiled_out_linear", [&] ()-> void { matrix_transpose_tiled_out(matrix3, in_matrix, matrix_dim); });
+    run_test(repeat_count, "tiled_in_linear", [&] ()-> void { matrix_transpose_tiled_in(matrix2, in_matrix, matrix_dim, stride); });
+    run_test(repeat_count, "tiled_out_linear", [&] ()-> void { matrix_transpose_tiled_out(matrix3, in_matrix, matrix_dim, stride); });
     run_test(repeat_count, "tiled_full_out_linear", [&] ()-> void { matrix_transpose_out_cstyle_tiled(out_matrix_full, in_matrix_full, matrix_dim); });
 
-    assert_buffers_equal(matrix2, matrix3, matrix_size);
-    assert_matrices_equal(matrix2, out_matrix_full, matrix_dim, matrix_dim);
+    assert_buffers_equal(matrix2, matrix3, matrix_dim * stride);
+    assert_matrices_equal(matrix2, stride, out_matrix_full, matrix_dim, matrix_dim);
+
+    run_simd_tests<float>(matrix_dim, padding, auto_padding, repeat_count, "float");
+    run_simd_tests<double>(matrix_dim, padding, auto_padding, std::max<size_t>(repeat_count / 2, 1), "double");
 
-    free(in_matrix);
-    free(matrix2);
-    free(matrix3);
     free_matrix(in_matrix_full);
     free_matrix(out_matrix_full);
 
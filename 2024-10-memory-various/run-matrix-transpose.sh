@@ -6,4 +6,10 @@ python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_tran
 python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 500"
 python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 1000"
 python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 2000"
-python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 5000"
\ No newline at end of file
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 5000"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 1024"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 1024 -p 16"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 2048"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 2048 -p 16"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 4096"
+python3 ../scripts/stat.py -n 10 -c "likwid-perfctr -g MEM -C 0 -m ./matrix_transpose -d 4096 -p 16"
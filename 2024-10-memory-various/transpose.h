@@ -0,0 +1,335 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "../common/cache_geometry.h"
+
+// Matrix transpose kernels with explicit row strides (in elements), so the
+// same code runs on tightly packed and on padded matrices.
+//
+// out[j * out_stride + i] = in[i * in_stride + j] for a rows x cols input.
+//
+// The innermost operation transposes one BLOCK x BLOCK tile in registers
+// (8 x 8 floats or 4 x 4 doubles with AVX2): BLOCK row loads, a shuffle
+// network, BLOCK row stores. Both the reads and the writes are then full
+// vector-width accesses to consecutive memory instead of one strided scalar
+// access per element.
+
+template <typename T>
+class transpose_kernel {
+public:
+    static constexpr size_t BLOCK = 1;
+
+    static void transpose_block(T* out, size_t out_stride, const T* in, size_t in_stride, bool stream) {
+        out[0] = in[0];
+    }
+
+    static void swap_blocks(T* a, T* b, size_t stride) {
+        std::swap(a[0], b[0]);
+    }
+};
+
+#ifdef __AVX2__
+
+template <>
+class transpose_kernel<float> {
+public:
+    static constexpr size_t BLOCK = 8;
+
+    static void transpose_block(float* out, size_t out_stride, const float* in, size_t in_stride, bool stream) {
+        __m256 r[8];
+        load(r, in, in_stride);
+        transpose_registers(r);
+        if (stream) {
+            store_stream(out, out_stride, r);
+        } else {
+            store(out, out_stride, r);
+        }
+    }
+
+    // Replaces the tile at a with the transpose of the tile at b and vice versa.
+    static void swap_blocks(float* a, float* b, size_t stride) {
+        __m256 ra[8], rb[8];
+        load(ra, a, stride);
+        load(rb, b, stride);
+        transpose_registers(ra);
+        transpose_registers(rb);
+        store(a, stride, rb);
+        store(b, stride, ra);
+    }
+
+private:
+    static void load(__m256* r, const float* in, size_t stride) {
+        for (int i = 0; i < 8; i++) {
+            r[i] = _mm256_loadu_ps(in + i * stride);
+        }
+    }
+
+    static void store(float* out, size_t stride, const __m256* r) {
+        for (int i = 0; i < 8; i++) {
+            _mm256_storeu_ps(out + i * stride, r[i]);
+        }
+    }
+
+    static void store_stream(float* out, size_t stride, const __m256* r) {
+        for (int i = 0; i < 8; i++) {
+            _mm256_stream_ps(out + i * stride, r[i]);
+        }
+    }
+
+    static void transpose_registers(__m256* r) {
+        __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+        __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+        __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+        __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+        __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+        __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+        r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+        r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+        r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+        r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+        r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+        r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+        r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    }
+};
+
+template <>
+class transpose_kernel<double> {
+public:
+    static constexpr size_t BLOCK = 4;
+
+    static void transpose_block(double* out, size_t out_stride, const double* in, size_t in_stride, bool stream) {
+        __m256d r[4];
+        load(r, in, in_stride);
+        transpose_registers(r);
+        if (stream) {
+            store_stream(out, out_stride, r);
+        } else {
+            store(out, out_stride, r);
+        }
+    }
+
+    static void swap_blocks(double* a, double* b, size_t stride) {
+        __m256d ra[4], rb[4];
+        load(ra, a, stride);
+        load(rb, b, stride);
+        transpose_registers(ra);
+        transpose_registers(rb);
+        store(a, stride, rb);
+        store(b, stride, ra);
+    }
+
+private:
+    static void load(__m256d* r, const double* in, size_t stride) {
+        for (int i = 0; i < 4; i++) {
+            r[i] = _mm256_loadu_pd(in + i * stride);
+        }
+    }
+
+    static void store(double* out, size_t stride, const __m256d* r) {
+        for (int i = 0; i < 4; i++) {
+            _mm256_storeu_pd(out + i * stride, r[i]);
+        }
+    }
+
+    static void store_stream(double* out, size_t stride, const __m256d* r) {
+        for (int i = 0; i < 4; i++) {
+            _mm256_stream_pd(out + i * stride, r[i]);
+        }
+    }
+
+    static void transpose_registers(__m256d* r) {
+        __m256d t0 = _mm256_unpacklo_pd(r[0], r[1]);
+        __m256d t1 = _mm256_unpackhi_pd(r[0], r[1]);
+        __m256d t2 = _mm256_unpacklo_pd(r[2], r[3]);
+        __m256d t3 = _mm256_unpackhi_pd(r[2], r[3]);
+
+        r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+        r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+        r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+        r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+    }
+};
+
+#endif
+
+// Leaf size of the recursive drivers, in elements. A LEAF x LEAF tile of input
+// and output (2 x 32 x 32 x 8 bytes at most) comfortably fits in L1.
+static constexpr size_t TRANSPOSE_LEAF = 32;
+
+// Non-temporal stores need BLOCK-aligned output rows and only pay off when the
+// output does not fit in the last level cache anyway.
+template <typename T>
+bool transpose_use_streaming(T* out, size_t out_stride, size_t out_rows) {
+    constexpr size_t BLOCK = transpose_kernel<T>::BLOCK;
+    constexpr size_t alignment = BLOCK * sizeof(T);
+
+    if (BLOCK == 1 || alignment % 32 != 0) {
+        return false;
+    }
+    if (reinterpret_cast<uintptr_t>(out) % alignment != 0 || out_stride % BLOCK != 0) {
+        return false;
+    }
+    return out_rows * out_stride * sizeof(T) > cache_geometry::get().last_level_size();
+}
+
+template <typename T>
+void transpose_leaf(T* out, size_t out_stride, const T* in, size_t in_stride,
+                    size_t rows, size_t cols, bool stream) {
+    constexpr size_t BLOCK = transpose_kernel<T>::BLOCK;
+    size_t rows_end = rows / BLOCK * BLOCK;
+    size_t cols_end = cols / BLOCK * BLOCK;
+
+    for (size_t i = 0; i < rows_end; i += BLOCK) {
+        for (size_t j = 0; j < cols_end; j += BLOCK) {
+            transpose_kernel<T>::transpose_block(out + j * out_stride + i, out_stride,
+                                                 in + i * in_stride + j, in_stride, stream);
+        }
+        // Drain loop for the last few columns
+        for (size_t ii = i; ii < i + BLOCK; ii++) {
+            for (size_t j = cols_end; j < cols; j++) {
+                out[j * out_stride + ii] = in[ii * in_stride + j];
+            }
+        }
+    }
+
+    // Drain loop for the last few rows
+    for (size_t i = rows_end; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            out[j * out_stride + i] = in[i * in_stride + j];
+        }
+    }
+}
+
+// Splits a range in two, keeping the first half a multiple of BLOCK so that all
+// full tiles in the recursion stay aligned to the original matrix.
+template <typename T>
+size_t transpose_split(size_t size) {
+    constexpr size_t BLOCK = transpose_kernel<T>::BLOCK;
+    size_t half = size / 2;
+    return std::max(half / BLOCK * BLOCK, BLOCK);
+}
+
+template <typename T>
+void transpose_recursive_impl(T* out, size_t out_stride, const T* in, size_t in_stride,
+                              size_t rows, size_t cols, bool stream) {
+    if (rows <= TRANSPOSE_LEAF && cols <= TRANSPOSE_LEAF) {
+        transpose_leaf(out, out_stride, in, in_stride, rows, cols, stream);
+    } else if (rows >= cols) {
+        size_t half = transpose_split<T>(rows);
+        transpose_recursive_impl(out, out_stride, in, in_stride, half, cols, stream);
+        transpose_recursive_impl(out + half, out_stride, in + half * in_stride, in_stride,
+                                 rows - half, cols, stream);
+    } else {
+        size_t half = transpose_split<T>(cols);
+        transpose_recursive_impl(out, out_stride, in, in_stride, rows, half, stream);
+        transpose_recursive_impl(out + half * out_stride, out_stride, in + half, in_stride,
+                                 rows, cols - half, stream);
+    }
+}
+
+// Single level of tiling, with the register transpose as the inner kernel.
+template <typename T>
+void transpose_simd_tiled(T* out, size_t out_stride, const T* in, size_t in_stride,
+                          size_t rows, size_t cols) {
+    transpose_leaf(out, out_stride, in, in_stride, rows, cols, false);
+}
+
+// Cache-oblivious transpose: the larger dimension is halved until the
+// sub-matrix fits a leaf, so every level of the cache hierarchy sees blocked
+// accesses without knowing its size. Uses non-temporal stores when the output
+// is larger than the last level cache.
+template <typename T>
+void transpose_recursive(T* out, size_t out_stride, const T* in, size_t in_stride,
+                         size_t rows, size_t cols) {
+    bool stream = transpose_use_streaming(out, out_stride, cols);
+    transpose_recursive_impl(out, out_stride, in, in_stride, rows, cols, stream);
+    if (stream) {
+        _mm_sfence();
+    }
+}
+
+// Swaps the rows x cols sub-matrix a with the transpose of the cols x rows
+// sub-matrix b: a[i][j] <-> b[j][i].
+template <typename T>
+void transpose_swap_leaf(T* a, T* b, size_t stride, size_t rows, size_t cols) {
+    constexpr size_t BLOCK = transpose_kernel<T>::BLOCK;
+    size_t rows_end = rows / BLOCK * BLOCK;
+    size_t cols_end = cols / BLOCK * BLOCK;
+
+    for (size_t i = 0; i < rows_end; i += BLOCK) {
+        for (size_t j = 0; j < cols_end; j += BLOCK) {
+            transpose_kernel<T>::swap_blocks(a + i * stride + j, b + j * stride + i, stride);
+        }
+        for (size_t ii = i; ii < i + BLOCK; ii++) {
+            for (size_t j = cols_end; j < cols; j++) {
+                std::swap(a[ii * stride + j], b[j * stride + ii]);
+            }
+        }
+    }
+
+    for (size_t i = rows_end; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            std::swap(a[i * stride + j], b[j * stride + i]);
+        }
+    }
+}
+
+template <typename T>
+void transpose_swap_recursive(T* a, T* b, size_t stride, size_t rows, size_t cols) {
+    if (rows <= TRANSPOSE_LEAF && cols <= TRANSPOSE_LEAF) {
+        transpose_swap_leaf(a, b, stride, rows, cols);
+    } else if (rows >= cols) {
+        size_t half = transpose_split<T>(rows);
+        transpose_swap_recursive(a, b, stride, half, cols);
+        transpose_swap_recursive(a + half * stride, b + half, stride, rows - half, cols);
+    } else {
+        size_t half = transpose_split<T>(cols);
+        transpose_swap_recursive(a, b, stride, rows, half);
+        transpose_swap_recursive(a + half, b + half * stride, stride, rows, cols - half);
+    }
+}
+
+template <typename T>
+void transpose_inplace_recursive(T* m, size_t stride, size_t n) {
+    constexpr size_t BLOCK = transpose_kernel<T>::BLOCK;
+
+    if (n <= BLOCK) {
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = i + 1; j < n; j++) {
+                std::swap(m[i * stride + j], m[j * stride + i]);
+            }
+        }
+        return;
+    }
+
+    // [ A  B ]      [ A' C' ]
+    // [ C  D ]  ->  [ B' D' ]
+    size_t half = transpose_split<T>(n);
+    transpose_inplace_recursive(m, stride, half);
+    transpose_inplace_recursive(m + half * stride + half, stride, n - half);
+    transpose_swap_recursive(m + half, m + half * stride, stride, half, n - half);
+}
+
+// In-place transpose of a square n x n matrix with row stride stride.
+template <typename T>
+void transpose_inplace(T* m, size_t stride, size_t n) {
+    transpose_inplace_recursive(m, stride, n);
+}
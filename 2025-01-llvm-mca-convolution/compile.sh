@@ -0,0 +1 @@
+g++ -DLIKWID_PERFMON -std=c++17 -mavx2 -mfma -fopenmp -O3 -I../common convolution-engine.cpp -o convolution-engine -llikwid
@@ -0,0 +1,165 @@
+#include <random>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+
+#include "likwid.h"
+#include "convolution.h"
+
+std::vector<float> generate_random_floats(size_t count, float min, float max) {
+    std::mt19937 generator(count);
+    std::uniform_real_distribution<float> distribution(min, max);
+
+    std::vector<float> random_numbers(count);
+    for (auto& num : random_numbers) {
+        num = distribution(generator);
+    }
+
+    return random_numbers;
+}
+
+bool compare_buffers(const float* v0, const float* v1, size_t count, const std::string& name) {
+    for (size_t i = 0; i < count; i++) {
+        if (std::abs(v0[i] - v1[i]) > 0.0001 * std::max(1.0f, std::abs(v0[i]))) {
+            std::cout << name << ": difference at i " << i << ", v0 " << v0[i] << ", v1 " << v1[i] << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+void reference_same(float* out, const float* in, size_t size, const float* kernel, size_t kernel_size,
+                    convolution_border border) {
+    convolution_same_scalar(out, in, size, 0, size, kernel, kernel_size, border);
+}
+
+bool test_1d(size_t size, size_t kernel_size, convolution_border border, int num_threads) {
+    std::vector<float> kernel = generate_random_floats(kernel_size, 0.0f, 1.0f);
+    std::vector<float> input = generate_random_floats(size, -1.0f, 1.0f);
+    std::vector<float> expected(size);
+    std::vector<float> out(size);
+
+    reference_same(expected.data(), input.data(), size, kernel.data(), kernel_size, border);
+    convolution_same(out.data(), input.data(), size, kernel.data(), kernel_size, border, num_threads);
+
+    std::string name = "1D size " + std::to_string(size) + " kernel " + std::to_string(kernel_size) +
+                       " border " + std::to_string(static_cast<int>(border)) + " threads " + std::to_string(num_threads);
+    return compare_buffers(expected.data(), out.data(), size, name);
+}
+
+bool test_2d(size_t rows, size_t cols, size_t kx, size_t ky, convolution_border border, int num_threads) {
+    std::vector<float> kernel_x = generate_random_floats(kx, 0.0f, 1.0f);
+    std::vector<float> kernel_y = generate_random_floats(ky, 0.0f, 1.0f);
+    std::vector<float> values = generate_random_floats(rows * cols, -1.0f, 1.0f);
+
+    buffer_2d<float> in(rows, cols);
+    buffer_2d<float> out(rows, cols);
+    for (size_t r = 0; r < rows; r++) {
+        std::copy(values.begin() + r * cols, values.begin() + (r + 1) * cols, in.row(r));
+    }
+
+    convolution_separable_2d(out, in, kernel_x.data(), kx, kernel_y.data(), ky, border, num_threads, 16);
+
+    // Reference: full horizontal pass, then vertical pass, one output at a time
+    std::vector<float> tmp(rows * cols);
+    for (size_t r = 0; r < rows; r++) {
+        reference_same(tmp.data() + r * cols, in.row(r), cols, kernel_x.data(), kx, border);
+    }
+    std::vector<float> column(rows), column_out(rows);
+    for (size_t c = 0; c < cols; c++) {
+        for (size_t r = 0; r < rows; r++) {
+            column[r] = tmp[r * cols + c];
+        }
+        reference_same(column_out.data(), column.data(), rows, kernel_y.data(), ky, border);
+        for (size_t r = 0; r < rows; r++) {
+            if (std::abs(column_out[r] - out(r, c)) > 0.0001 * std::max(1.0f, std::abs(column_out[r]))) {
+                std::cout << "2D " << rows << "x" << cols << " kernel " << kx << "x" << ky << ": difference at ("
+                          << r << ", " << c << "), expected " << column_out[r] << ", got " << out(r, c) << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void run_tests() {
+    bool ok = true;
+    const convolution_border borders[] = { convolution_border::ZERO, convolution_border::CLAMP, convolution_border::REFLECT };
+
+    for (convolution_border border: borders) {
+        for (size_t kernel_size = 1; kernel_size <= 40; kernel_size++) {
+            for (size_t size: { 1ul, 2ul, 7ul, 31ul, 64ul, 100ul, 1001ul }) {
+                ok &= test_1d(size, kernel_size, border, 1);
+            }
+            ok &= test_1d(100003, kernel_size, border, 4);
+        }
+        ok &= test_2d(37, 53, 5, 3, border, 3);
+        ok &= test_2d(100, 250, 7, 7, border, 4);
+        ok &= test_2d(5, 400, 33, 9, border, 2);
+    }
+
+    std::cout << (ok ? "All tests passed\n" : "Tests FAILED\n");
+}
+
+void run_benchmark_1d(size_t size, size_t kernel_size, int num_threads) {
+    std::vector<float> kernel = generate_random_floats(kernel_size, 0.0f, 1.0f);
+    std::vector<float> input = generate_random_floats(size, 0.0f, 1.0f);
+    std::vector<float> out(size);
+
+    std::string suffix = "_" + std::to_string(kernel_size) + "_" + std::to_string(num_threads);
+
+    std::string name_generic = "convolution_generic" + suffix;
+    LIKWID_MARKER_START(name_generic.c_str());
+    for (int i = 0; i < 20; i++) {
+        convolution_generic(out.data(), input.data(), size - kernel_size + 1, kernel.data(), kernel_size);
+    }
+    LIKWID_MARKER_STOP(name_generic.c_str());
+
+    std::string name_same = "convolution_same" + suffix;
+    LIKWID_MARKER_START(name_same.c_str());
+    for (int i = 0; i < 20; i++) {
+        convolution_same(out.data(), input.data(), size, kernel.data(), kernel_size, convolution_border::CLAMP, num_threads);
+    }
+    LIKWID_MARKER_STOP(name_same.c_str());
+}
+
+void run_benchmark_2d(size_t rows, size_t cols, size_t kernel_size, int num_threads) {
+    std::vector<float> kernel = generate_random_floats(kernel_size, 0.0f, 1.0f);
+    buffer_2d<float> in(rows, cols);
+    buffer_2d<float> out(rows, cols);
+
+    std::string name = "convolution_separable_2d_" + std::to_string(kernel_size) + "_" + std::to_string(num_threads);
+    LIKWID_MARKER_START(name.c_str());
+    for (int i = 0; i < 5; i++) {
+        convolution_separable_2d(out, in, kernel.data(), kernel_size, kernel.data(), kernel_size,
+                                 convolution_border::REFLECT, num_threads);
+    }
+    LIKWID_MARKER_STOP(name.c_str());
+}
+
+int main(int argc, char** argv) {
+    int num_threads = argc > 1 ? std::atoi(argv[1]) : omp_get_max_threads();
+
+    run_tests();
+
+    LIKWID_MARKER_INIT;
+
+    for (size_t kernel_size: { 3, 5, 7, 9, 15, 31, 33 }) {
+        run_benchmark_1d(10000000, kernel_size, 1);
+        if (num_threads > 1) {
+            run_benchmark_1d(10000000, kernel_size, num_threads);
+        }
+    }
+
+    for (size_t kernel_size: { 3, 7, 15 }) {
+        run_benchmark_2d(4096, 4096, kernel_size, 1);
+        if (num_threads > 1) {
+            run_benchmark_2d(4096, 4096, kernel_size, num_threads);
+        }
+    }
+
+    LIKWID_MARKER_CLOSE;
+
+    return 0;
+}
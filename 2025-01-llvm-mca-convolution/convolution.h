@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "../common/buffer_2d.h"
+
+// Convolution engine built from the outer-loop kernels in convolution-mca.cpp.
+//
+// out[i] = sum(k = 0 .. kernel_size - 1) in[i + k] * kernel[k]
+//
+// Kernel sizes 3 ... 31 go through a dispatch table of kernels where the
+// kernel size is a template parameter, so the inner loop over the kernel is
+// fully unrolled (the same effect as the hand-written convolution_outerloop_5).
+// Other sizes use the generic kernel, which unrolls by four and dispatches the
+// remainder through a switch.
+//
+// The "same" variants produce one output per input, centered on kernel_size / 2,
+// and synthesize the missing values at the borders (zero, clamp or reflect), so
+// callers do not have to pad the inputs. Only the first and last kernel_size
+// outputs go through a small scratch buffer; the interior reads the input in place.
+
+enum class convolution_border {
+    ZERO,     // 000|abcd|000
+    CLAMP,    // aaa|abcd|ddd
+    REFLECT,  // dcb|abcd|cba
+};
+
+static constexpr int CONVOLUTION_MIN_FIXED_SIZE = 3;
+static constexpr int CONVOLUTION_MAX_FIXED_SIZE = 31;
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#ifndef _mm256_alignr_ps
+#define _mm256_alignr_ps(a,b,imm8) _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(a), _mm256_castps_si256(b), (imm8)*4))
+#endif
+
+static constexpr size_t CONVOLUTION_VECTOR_SIZE = 8;
+using convolution_vec_t = __m256;
+
+// Unrolled with a fold expression so alignr sees a constant offset at any optimization level.
+template <size_t... offset>
+__m256 convolution_outerloop2_innerloop_impl(size_t kk, const float * kernel, __m256 inval_0, __m256 inval_1, __m256 out,
+                                             std::index_sequence<offset...>) {
+    __m256 result = out;
+    ((result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_alignr_ps(inval_1, inval_0, offset),
+                                                   _mm256_broadcast_ss(kernel + kk + offset)))), ...);
+    return result;
+}
+
+template <int end>
+__m256 convolution_outerloop2_innerloop(size_t kk, const float * kernel, __m256 inval_0, __m256 inval_1, __m256 out) {
+    return convolution_outerloop2_innerloop_impl(kk, kernel, inval_0, inval_1, out, std::make_index_sequence<end>());
+}
+
+static inline __m256 convolution_vec_zero() { return _mm256_setzero_ps(); }
+static inline __m256 convolution_vec_load(const float* p) { return _mm256_loadu_ps(p); }
+static inline void convolution_vec_store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+
+// Moves the window four floats forward: inval_0 = in[i .. i + 8), inval_1 = in[i + 4 .. i + 12)
+static inline void convolution_vec_advance(const float* in, __m256& inval_0, __m256& inval_1) {
+    inval_0 = inval_1;
+    inval_1 = _mm256_set_m128(_mm_loadu_ps(in + 8), _mm256_extractf128_ps(inval_1, 1));
+}
+
+#elif defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+static constexpr size_t CONVOLUTION_VECTOR_SIZE = 4;
+using convolution_vec_t = float32x4_t;
+
+template <size_t... offset>
+float32x4_t convolution_outerloop2_innerloop_impl(size_t kk, const float * kernel, float32x4_t inval_0, float32x4_t inval_1,
+                                                  float32x4_t out, std::index_sequence<offset...>) {
+    float32x4_t result = out;
+    ((result = vaddq_f32(result, vmulq_f32(vextq_f32(inval_0, inval_1, offset), vld1q_dup_f32(kernel + kk + offset)))), ...);
+    return result;
+}
+
+template <int end>
+float32x4_t convolution_outerloop2_innerloop(size_t kk, const float * kernel, float32x4_t inval_0, float32x4_t inval_1, float32x4_t out) {
+    return convolution_outerloop2_innerloop_impl(kk, kernel, inval_0, inval_1, out, std::make_index_sequence<end>());
+}
+
+static inline float32x4_t convolution_vec_zero() { return vdupq_n_f32(0.0f); }
+static inline float32x4_t convolution_vec_load(const float* p) { return vld1q_f32(p); }
+static inline void convolution_vec_store(float* p, float32x4_t v) { vst1q_f32(p, v); }
+
+// Moves the window four floats forward: inval_0 = in[i .. i + 4), inval_1 = in[i + 4 .. i + 8)
+static inline void convolution_vec_advance(const float* in, float32x4_t& inval_0, float32x4_t& inval_1) {
+    inval_0 = inval_1;
+    inval_1 = vld1q_f32(in + 4);
+}
+
+#else
+#error Unsupported architecture
+#endif
+
+// Number of floats read past in + i by one vector iteration of a kernel of kernel_size.
+static inline size_t convolution_vector_reach(size_t kernel_size) {
+    return (kernel_size + 3) / 4 * 4 + CONVOLUTION_VECTOR_SIZE;
+}
+
+static inline void convolution_scalar(float* out, const float* in, size_t begin, size_t end,
+                                      const float* kernel, size_t kernel_size) {
+    for (size_t i = begin; i < end; i++) {
+        float sum = 0.0f;
+        for (size_t k = 0; k < kernel_size; k++) {
+            sum += in[i + k] * kernel[k];
+        }
+        out[i] = sum;
+    }
+}
+
+// Returns the first output index the vector loop must not touch, so that it never
+// reads past in[out_size + kernel_size - 1].
+static inline size_t convolution_vector_end(size_t out_size, size_t kernel_size) {
+    size_t in_size = out_size + kernel_size - 1;
+    size_t reach = convolution_vector_reach(kernel_size);
+    if (in_size < reach) {
+        return 0;
+    }
+    size_t last_start = std::min(in_size - reach, out_size - std::min(out_size, CONVOLUTION_VECTOR_SIZE));
+    return (last_start / CONVOLUTION_VECTOR_SIZE + 1) * CONVOLUTION_VECTOR_SIZE;
+}
+
+// Valid convolution with the kernel size known at compile time. Writes out_size
+// outputs and reads out_size + KERNEL_SIZE - 1 inputs.
+template <int KERNEL_SIZE>
+void convolution_fixed(float* out, const float* in, size_t out_size, const float* kernel) {
+    constexpr size_t kernel_size_vec_end = KERNEL_SIZE / 4 * 4;
+    constexpr int remainder = KERNEL_SIZE % 4;
+    size_t vector_end = convolution_vector_end(out_size, KERNEL_SIZE);
+
+    for (size_t i = 0; i < vector_end; i += CONVOLUTION_VECTOR_SIZE) {
+        convolution_vec_t out_v = convolution_vec_zero();
+
+        convolution_vec_t inval_0;
+        convolution_vec_t inval_1 = convolution_vec_load(in + i);
+        for (size_t kk = 0; kk < kernel_size_vec_end; kk += 4) {
+            convolution_vec_advance(in + i + kk, inval_0, inval_1);
+            out_v = convolution_outerloop2_innerloop<4>(kk, kernel, inval_0, inval_1, out_v);
+        }
+        if constexpr (remainder != 0) {
+            convolution_vec_advance(in + i + kernel_size_vec_end, inval_0, inval_1);
+            out_v = convolution_outerloop2_innerloop<remainder>(kernel_size_vec_end, kernel, inval_0, inval_1, out_v);
+        }
+
+        convolution_vec_store(out + i, out_v);
+    }
+
+    convolution_scalar(out, in, vector_end, out_size, kernel, KERNEL_SIZE);
+}
+
+// Valid convolution for any kernel size (convolution_outerloop2 with bounds checks).
+static inline void convolution_generic(float* out, const float* in, size_t out_size,
+                                       const float* kernel, size_t kernel_size) {
+    size_t const kernel_size_vec_end = kernel_size / 4 * 4;
+    size_t vector_end = convolution_vector_end(out_size, kernel_size);
+
+    for (size_t i = 0; i < vector_end; i += CONVOLUTION_VECTOR_SIZE) {
+        convolution_vec_t out_v = convolution_vec_zero();
+
+        convolution_vec_t inval_0;
+        convolution_vec_t inval_1 = convolution_vec_load(in + i);
+        for (size_t kk = 0; kk < kernel_size_vec_end; kk += 4) {
+            convolution_vec_advance(in + i + kk, inval_0, inval_1);
+            out_v = convolution_outerloop2_innerloop<4>(kk, kernel, inval_0, inval_1, out_v);
+        }
+
+        switch (kernel_size - kernel_size_vec_end) {
+            case 0: break;
+            case 1:
+                convolution_vec_advance(in + i + kernel_size_vec_end, inval_0, inval_1);
+                out_v = convolution_outerloop2_innerloop<1>(kernel_size_vec_end, kernel, inval_0, inval_1, out_v);
+                break;
+            case 2:
+                convolution_vec_advance(in + i + kernel_size_vec_end, inval_0, inval_1);
+                out_v = convolution_outerloop2_innerloop<2>(kernel_size_vec_end, kernel, inval_0, inval_1, out_v);
+                break;
+            case 3:
+                convolution_vec_advance(in + i + kernel_size_vec_end, inval_0, inval_1);
+                out_v = convolution_outerloop2_innerloop<3>(kernel_size_vec_end, kernel, inval_0, inval_1, out_v);
+                break;
+            default:
+                assert(false && "Unreachable");
+        }
+
+        convolution_vec_store(out + i, out_v);
+    }
+
+    convolution_scalar(out, in, vector_end, out_size, kernel, kernel_size);
+}
+
+using convolution_fixed_fn = void (*)(float*, const float*, size_t, const float*);
+
+template <size_t... I>
+constexpr std::array<convolution_fixed_fn, sizeof...(I)> convolution_make_table(std::index_sequence<I...>) {
+    return {{(I >= CONVOLUTION_MIN_FIXED_SIZE ? &convolution_fixed<(I >= CONVOLUTION_MIN_FIXED_SIZE ? I : CONVOLUTION_MIN_FIXED_SIZE)> : nullptr)...}};
+}
+
+// Indexed by kernel size; nullptr where the generic kernel is used.
+static constexpr std::array<convolution_fixed_fn, CONVOLUTION_MAX_FIXED_SIZE + 1> convolution_table =
+    convolution_make_table(std::make_index_sequence<CONVOLUTION_MAX_FIXED_SIZE + 1>());
+
+// Valid convolution: out_size = in_size - kernel_size + 1 outputs.
+static inline void convolution_valid(float* out, const float* in, size_t out_size,
+                                     const float* kernel, size_t kernel_size) {
+    if (kernel_size <= CONVOLUTION_MAX_FIXED_SIZE && convolution_table[kernel_size] != nullptr) {
+        convolution_table[kernel_size](out, in, out_size, kernel);
+    } else {
+        convolution_generic(out, in, out_size, kernel, kernel_size);
+    }
+}
+
+// Maps index i of an input of size n to an index inside [0, n), or -1 for a zero.
+static inline long convolution_border_index(long i, long n, convolution_border border) {
+    if (i >= 0 && i < n) {
+        return i;
+    }
+    switch (border) {
+        case convolution_border::ZERO:
+            return -1;
+        case convolution_border::CLAMP:
+            return i < 0 ? 0 : n - 1;
+        case convolution_border::REFLECT:
+            if (n == 1) {
+                return 0;
+            }
+            while (i < 0 || i >= n) {
+                i = i < 0 ? -i : 2 * (n - 1) - i;
+            }
+            return i;
+    }
+    return -1;
+}
+
+// Copies in[begin .. end) into scratch, synthesizing out-of-range values.
+static inline void convolution_fill_extended(float* scratch, const float* in, long n,
+                                             long begin, long end, convolution_border border) {
+    for (long i = begin; i < end; i++) {
+        long idx = convolution_border_index(i, n, border);
+        scratch[i - begin] = idx < 0 ? 0.0f : in[idx];
+    }
+}
+
+// "Same" convolution outputs [begin, end), one at a time with border lookups.
+static inline void convolution_same_scalar(float* out, const float* in, size_t size, size_t begin, size_t end,
+                                           const float* kernel, size_t kernel_size, convolution_border border) {
+    long anchor = kernel_size / 2;
+    for (size_t i = begin; i < end; i++) {
+        float sum = 0.0f;
+        for (size_t k = 0; k < kernel_size; k++) {
+            long idx = convolution_border_index(static_cast<long>(i + k) - anchor, size, border);
+            sum += idx < 0 ? 0.0f : in[idx] * kernel[k];
+        }
+        out[i] = sum;
+    }
+}
+
+// "Same" convolution of one row: size outputs, out[i] centered on in[i].
+// scratch must hold at least 3 * kernel_size + CONVOLUTION_VECTOR_SIZE floats.
+static inline void convolution_same_row(float* out, const float* in, size_t size,
+                                        const float* kernel, size_t kernel_size,
+                                        convolution_border border, float* scratch) {
+    long n = size;
+    long k = kernel_size;
+    long anchor = k / 2;
+
+    if (n < 2 * k) {
+        // Short row: extend all of it
+        std::vector<float> extended(n + k - 1);
+        convolution_fill_extended(extended.data(), in, n, -anchor, n - anchor + k - 1, border);
+        convolution_valid(out, extended.data(), n, kernel, kernel_size);
+        return;
+    }
+
+    // Left border: outputs [0, anchor)
+    convolution_fill_extended(scratch, in, n, -anchor, k - 1, border);
+    convolution_valid(out, scratch, anchor, kernel, kernel_size);
+
+    // Interior: outputs [anchor, n - k + anchor + 1) read the input in place
+    convolution_valid(out + anchor, in, n - k + 1, kernel, kernel_size);
+
+    // Right border: outputs [n - k + anchor + 1, n)
+    long right_begin = n - k + anchor + 1;
+    long right_count = n - right_begin;
+    convolution_fill_extended(scratch, in, n, right_begin - anchor, n - anchor + k - 1, border);
+    convolution_valid(out + right_begin, scratch, right_count, kernel, kernel_size);
+}
+
+// "Same" 1D convolution, split into num_threads chunks of outputs.
+static inline void convolution_same(float* out, const float* in, size_t size,
+                                    const float* kernel, size_t kernel_size,
+                                    convolution_border border, int num_threads = 1) {
+    size_t anchor = kernel_size / 2;
+    size_t chunk = (size + num_threads - 1) / std::max(num_threads, 1);
+
+    if (num_threads <= 1 || chunk < 4 * kernel_size) {
+        std::vector<float> scratch(3 * kernel_size + CONVOLUTION_VECTOR_SIZE);
+        convolution_same_row(out, in, size, kernel, kernel_size, border, scratch.data());
+        return;
+    }
+
+    // Only the chunks at the two ends see the borders; they compute those few
+    // outputs with the scalar loop.
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++) {
+        size_t begin = std::min(t * chunk, size);
+        size_t end = std::min(begin + chunk, size);
+        if (begin >= end) {
+            continue;
+        }
+
+        size_t interior_begin = std::max(begin, anchor);
+        size_t interior_end = std::min(end, size - kernel_size + anchor + 1);
+
+        convolution_same_scalar(out, in, size, begin, std::min(end, interior_begin), kernel, kernel_size, border);
+        if (interior_begin < interior_end) {
+            convolution_valid(out + interior_begin, in + interior_begin - anchor,
+                              interior_end - interior_begin, kernel, kernel_size);
+        }
+        convolution_same_scalar(out, in, size, std::max(begin, interior_end), end, kernel, kernel_size, border);
+    }
+}
+
+// Separable 2D "same" convolution: rows with kernel_x, then columns with kernel_y.
+//
+// The image is split into bands of output rows which are distributed over the
+// threads. Every band runs the horizontal pass over its rows plus the vertical
+// halo into a small per-thread buffer, then the vertical pass from that buffer,
+// so the intermediate image is never materialized in full.
+static inline void convolution_separable_2d(buffer_2d<float>& out, const buffer_2d<float>& in,
+                                            const float* kernel_x, size_t kernel_x_size,
+                                            const float* kernel_y, size_t kernel_y_size,
+                                            convolution_border border, int num_threads = 1,
+                                            size_t band_rows = 32) {
+    assert(out.rows() == in.rows() && out.cols() == in.cols());
+
+    const long rows = in.rows();
+    const size_t cols = in.cols();
+    const long anchor_y = kernel_y_size / 2;
+    const long band_count = (rows + band_rows - 1) / band_rows;
+
+    #pragma omp parallel num_threads(std::max(num_threads, 1))
+    {
+        size_t tmp_rows = band_rows + kernel_y_size - 1;
+        buffer_2d<float> tmp(tmp_rows, cols);
+        std::vector<float> zero_row(cols, 0.0f);
+        std::vector<float> scratch(3 * kernel_x_size + CONVOLUTION_VECTOR_SIZE);
+        std::vector<const float*> tmp_row_ptr(tmp_rows);
+
+        #pragma omp for schedule(dynamic)
+        for (long band = 0; band < band_count; band++) {
+            long row_begin = band * band_rows;
+            long row_end = std::min<long>(row_begin + band_rows, rows);
+            long src_begin = row_begin - anchor_y;
+            long src_end = row_end - anchor_y + kernel_y_size - 1;
+
+            // Horizontal pass over the band and its halo. Rows outside the image
+            // map to a zero row or to an existing image row, per the border mode.
+            for (long r = src_begin; r < src_end; r++) {
+                long src = convolution_border_index(r, rows, border);
+                if (src < 0) {
+                    tmp_row_ptr[r - src_begin] = zero_row.data();
+                    continue;
+                }
+                float* tmp_row = tmp.row(r - src_begin);
+                convolution_same_row(tmp_row, in.row(src), cols, kernel_x, kernel_x_size, border, scratch.data());
+                tmp_row_ptr[r - src_begin] = tmp_row;
+            }
+
+            // Vertical pass
+            for (long r = row_begin; r < row_end; r++) {
+                float* out_row = out.row(r);
+                const float* const* window = tmp_row_ptr.data() + (r - row_begin);
+
+                const float* src0 = window[0];
+                float k0 = kernel_y[0];
+                for (size_t j = 0; j < cols; j++) {
+                    out_row[j] = src0[j] * k0;
+                }
+                for (size_t k = 1; k < kernel_y_size; k++) {
+                    const float* src = window[k];
+                    float kk = kernel_y[k];
+                    for (size_t j = 0; j < cols; j++) {
+                        out_row[j] += src[j] * kk;
+                    }
+                }
+            }
+        }
+    }
+}
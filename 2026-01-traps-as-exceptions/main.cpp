@@ -10,6 +10,8 @@
 #include <setjmp.h>
 
 #include <immintrin.h>
+#include <thread>
+#include "fp_guarded.h"
 static constexpr size_t LANE_COUNT = 4;
 
 void generate_non_negative_doubles(double* p, size_t n) {
@@ -387,6 +389,72 @@ size_t calculate_square_roots_vec_count_nan_cpp_exceptions(double* out, double *
 }
 #pragma STDC FENV_ACCESS OFF
 
+// The same kernel for fp_guarded_run(): the vector loop without any checks,
+// and a checked scalar fallback for the chunks where a square root was
+// invalid. Chunk sizes are multiples of LANE_COUNT except for the last one.
+size_t count_sqrt_nans_guarded(double* out, double* in, size_t n, fp_guard_mode mode) {
+    uint64_t total_nans = 0;
+
+    auto kernel = [=](size_t begin, size_t end) {
+        size_t i = begin;
+        for (; i + LANE_COUNT <= end; i += LANE_COUNT) {
+            __m256d r = _mm256_sqrt_pd(_mm256_loadu_pd(in + i));
+            _mm256_storeu_pd(out + i, r);
+        }
+        for (; i < end; i++) {
+            out[i] = std::sqrt(in[i]);
+        }
+    };
+
+    auto fallback = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            out[i] = std::sqrt(in[i]);
+            total_nans += (in[i] < 0.0);
+        }
+    };
+
+    fp_guard_options options;
+    options.mode = mode;
+    options.chunk_size = 1024;
+    fp_guarded_run(kernel, {0, n}, fallback, options);
+
+    return total_nans;
+}
+
+size_t count_sqrt_nans_guarded_trap(double* out, double* in, size_t n) {
+    LIKWID_MARKER_START(__FUNCTION__);
+    size_t total_nans = count_sqrt_nans_guarded(out, in, n, fp_guard_mode::TRAP);
+    LIKWID_MARKER_STOP(__FUNCTION__);
+    return total_nans;
+}
+
+size_t count_sqrt_nans_guarded_sticky(double* out, double* in, size_t n) {
+    LIKWID_MARKER_START(__FUNCTION__);
+    size_t total_nans = count_sqrt_nans_guarded(out, in, n, fp_guard_mode::STICKY);
+    LIKWID_MARKER_STOP(__FUNCTION__);
+    return total_nans;
+}
+
+// Every thread traps in its own slice; the counts only add up if each
+// thread's trap returns to that thread's kernel.
+size_t count_sqrt_nans_guarded_threads(double* out, double* in, size_t n, size_t thread_count) {
+    std::vector<size_t> nans(thread_count);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; t++) {
+        size_t begin = n * t / thread_count;
+        size_t end = n * (t + 1) / thread_count;
+        threads.emplace_back([=, &nans] {
+            nans[t] = count_sqrt_nans_guarded(out + begin, in + begin, end - begin, fp_guard_mode::TRAP);
+        });
+    }
+    size_t total_nans = 0;
+    for (size_t t = 0; t < thread_count; t++) {
+        threads[t].join();
+        total_nans += nans[t];
+    }
+    return total_nans;
+}
+
 int main() {
     static constexpr size_t vector_size = 1000*1024+3;
     static constexpr size_t repeat_count = 100;
@@ -407,10 +475,13 @@ int main() {
                         out1(vector_size),
                         out2(vector_size),
                         out3(vector_size),
-                        out4(vector_size);
+                        out4(vector_size),
+                        out5(vector_size),
+                        out6(vector_size);
 
     size_t nan_scalar0, nan_scalar1, nan_scalar2, nan_scalar3, nan0, nan1, nan2, nan3;
     size_t nan4 = 0;
+    size_t nan5, nan6, nan_threads;
 
     for (size_t i = 0; i < repeat_count; i++) {
         nan_scalar0 = count_sqrt_nans_baseline0(out_scalar0.data(), in.data(), vector_size);
@@ -452,6 +523,19 @@ int main() {
         escape(out3.data());
     }
 
+    for (size_t i = 0; i < repeat_count; i++) {
+        nan5 = count_sqrt_nans_guarded_trap(out5.data(), in.data(), vector_size);
+        escape(out5.data());
+    }
+
+    for (size_t i = 0; i < repeat_count; i++) {
+        nan6 = count_sqrt_nans_guarded_sticky(out6.data(), in.data(), vector_size);
+        escape(out6.data());
+    }
+
+    // Slices of 1000*1024+3 / 4 elements: the last slice also has a partial chunk.
+    nan_threads = count_sqrt_nans_guarded_threads(out5.data(), in.data(), vector_size, 4);
+
     // for (size_t i = 0; i < repeat_count; i++) {
     //     nan4 = calculate_square_roots_vec_count_nan_cpp_exceptions(out4.data(), in.data(), vector_size);
     //     clobber();
@@ -459,6 +543,7 @@ int main() {
 
     std::cout << "nan_scalar0 = " << nan_scalar0 << ", nan_scalar1 = " << nan_scalar1 << ", nan_scalar2 = " << nan_scalar2 << "\n";
     std::cout << "nan0 = " << nan0 << ", nan1 = " << nan1 << ", nan2 = " << nan2 << ", nan3 = " << nan3 << ", nan4 = " << nan4 << "\n";
+    std::cout << "guarded trap = " << nan5 << ", guarded sticky = " << nan6 << ", guarded 4 threads = " << nan_threads << "\n";
 
     LIKWID_MARKER_CLOSE;
 
@@ -0,0 +1,122 @@
+#pragma once
+
+// Row-major 2D buffer whose row pitch is chosen to avoid cache set conflicts.
+//
+// When the row pitch is a multiple of (sets x line size) of a cache, walking
+// down a column hits the same cache set in every row and only `ways` rows fit
+// in the cache at a time (see 2023-02-cache-conflicts). Walking down a column
+// with a pitch of s cache lines touches sets / gcd(s, sets) different sets, so
+// the pitch is increased line by line until every per-core cache (L1 and L2)
+// sees enough different sets for the rows of the buffer. With power-of-two set
+// counts this means an odd number of cache lines per row, i.e. at most one
+// cache line of padding per row.
+//
+// The last level cache is not considered: it is physically indexed with a
+// hashed slice selection, so the virtual row pitch says little about its sets.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include "cache_geometry.h"
+
+// Smallest row pitch in bytes, at least min_bytes and a multiple of the cache
+// line size, for which a column of rows rows does not collapse into a few sets.
+static inline size_t conflict_free_pitch(size_t min_bytes, size_t rows) {
+    const cache_geometry& geometry = cache_geometry::get();
+    const size_t line_size = geometry.line_size();
+    size_t lines = std::max<size_t>((min_bytes + line_size - 1) / line_size, 1);
+
+    auto is_conflict_free = [&](size_t candidate) {
+        for (const auto& level : geometry.levels()) {
+            if (level.level > 2) {
+                continue;
+            }
+            size_t distinct_sets = level.sets / std::gcd(candidate, level.sets);
+            if (distinct_sets < std::min(level.sets, rows)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Bounded search; 64 extra lines always reach an odd count and cover any
+    // realistic non power-of-two set count.
+    for (size_t candidate = lines; candidate < lines + 64; candidate++) {
+        if (is_conflict_free(candidate)) {
+            return candidate * line_size;
+        }
+    }
+    return lines * line_size;
+}
+
+// Row stride in elements of T for a rows x cols buffer.
+template <typename T>
+size_t conflict_free_stride(size_t rows, size_t cols) {
+    size_t pitch = conflict_free_pitch(cols * sizeof(T), rows);
+    return (pitch + sizeof(T) - 1) / sizeof(T);
+}
+
+template <typename T>
+class buffer_2d {
+    static_assert(std::is_trivially_copyable<T>::value, "buffer_2d holds plain data only");
+
+public:
+    // Picks a conflict-free stride from the cache geometry.
+    static constexpr size_t AUTO_STRIDE = 0;
+
+    buffer_2d() : m_data(nullptr), m_rows(0), m_cols(0), m_stride(0) {}
+
+    // stride is in elements. AUTO_STRIDE picks a conflict-free one, any other
+    // value (at least cols) is used as is, e.g. to reproduce cache conflicts.
+    buffer_2d(size_t rows, size_t cols, size_t stride = AUTO_STRIDE)
+        : m_rows(rows),
+          m_cols(cols),
+          m_stride(stride == AUTO_STRIDE ? conflict_free_stride<T>(rows, cols) : std::max(stride, cols)) {
+        size_t bytes = m_rows * m_stride * sizeof(T);
+        bytes = std::max<size_t>((bytes + 63) / 64 * 64, 64);
+        m_data = static_cast<T*>(aligned_alloc(64, bytes));
+        std::memset(m_data, 0, bytes);
+    }
+
+    ~buffer_2d() { free(m_data); }
+
+    buffer_2d(const buffer_2d&) = delete;
+    buffer_2d& operator=(const buffer_2d&) = delete;
+
+    buffer_2d(buffer_2d&& other) noexcept
+        : m_data(other.m_data), m_rows(other.m_rows), m_cols(other.m_cols), m_stride(other.m_stride) {
+        other.m_data = nullptr;
+        other.m_rows = other.m_cols = other.m_stride = 0;
+    }
+
+    buffer_2d& operator=(buffer_2d&& other) noexcept {
+        std::swap(m_data, other.m_data);
+        std::swap(m_rows, other.m_rows);
+        std::swap(m_cols, other.m_cols);
+        std::swap(m_stride, other.m_stride);
+        return *this;
+    }
+
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t stride() const { return m_stride; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+
+    T* row(size_t row) { return m_data + row * m_stride; }
+    const T* row(size_t row) const { return m_data + row * m_stride; }
+
+    T& operator()(size_t row, size_t col) { return m_data[row * m_stride + col]; }
+    const T& operator()(size_t row, size_t col) const { return m_data[row * m_stride + col]; }
+
+private:
+    T* m_data;
+    size_t m_rows;
+    size_t m_cols;
+    size_t m_stride;
+};
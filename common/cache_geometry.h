@@ -0,0 +1,136 @@
+#pragma once
+
+// Data cache geometry of the machine, read once from
+// /sys/devices/system/cpu/cpu0/cache/index*/. Falls back to sysconf and then
+// to a typical x86 configuration when sysfs is not available.
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct cache_level_info {
+    int level;
+    size_t size;
+    size_t ways;
+    size_t line_size;
+    size_t sets;
+};
+
+class cache_geometry {
+public:
+    static const cache_geometry& get() {
+        static const cache_geometry geometry;
+        return geometry;
+    }
+
+    // Data and unified caches, ordered from L1 outwards.
+    const std::vector<cache_level_info>& levels() const { return m_levels; }
+
+    size_t line_size() const { return m_levels.front().line_size; }
+
+    size_t last_level_size() const { return m_levels.back().size; }
+
+    const cache_level_info* level(int level) const {
+        for (const auto& l : m_levels) {
+            if (l.level == level) {
+                return &l;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::vector<cache_level_info> m_levels;
+
+    cache_geometry() {
+        read_sysfs();
+        if (m_levels.empty()) {
+            read_sysconf();
+        }
+        if (m_levels.empty()) {
+            m_levels.push_back({1, 32 * 1024, 8, 64, 64});
+            m_levels.push_back({2, 1024 * 1024, 16, 64, 1024});
+        }
+        std::sort(m_levels.begin(), m_levels.end(),
+                  [](const cache_level_info& a, const cache_level_info& b) { return a.level < b.level; });
+    }
+
+    static bool read_value(const std::string& path, std::string& value) {
+        std::ifstream file(path);
+        return static_cast<bool>(file >> value);
+    }
+
+    static size_t parse_size(const std::string& value) {
+        size_t size = std::stoul(value);
+        if (value.back() == 'K') {
+            size *= 1024;
+        } else if (value.back() == 'M') {
+            size *= 1024 * 1024;
+        }
+        return size;
+    }
+
+    void read_sysfs() {
+        const std::string base = "/sys/devices/system/cpu/cpu0/cache/index";
+
+        for (int index = 0; index < 16; index++) {
+            std::string dir = base + std::to_string(index) + "/";
+            std::string level, type, size, ways, line_size, sets;
+
+            if (!read_value(dir + "level", level)) {
+                break;
+            }
+            if (!read_value(dir + "type", type) || type == "Instruction") {
+                continue;
+            }
+            if (!read_value(dir + "size", size) || !read_value(dir + "ways_of_associativity", ways) ||
+                !read_value(dir + "coherency_line_size", line_size)) {
+                continue;
+            }
+
+            cache_level_info info;
+            info.level = std::stoi(level);
+            info.size = parse_size(size);
+            info.ways = std::max<size_t>(std::stoul(ways), 1);
+            info.line_size = std::stoul(line_size);
+            if (read_value(dir + "number_of_sets", sets)) {
+                info.sets = std::stoul(sets);
+            } else {
+                info.sets = info.size / (info.ways * info.line_size);
+            }
+
+            if (info.size > 0 && info.line_size > 0 && info.sets > 0) {
+                m_levels.push_back(info);
+            }
+        }
+    }
+
+    void read_sysconf() {
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+        const int names[3][3] = {
+            {_SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL1_DCACHE_ASSOC, _SC_LEVEL1_DCACHE_LINESIZE},
+            {_SC_LEVEL2_CACHE_SIZE, _SC_LEVEL2_CACHE_ASSOC, _SC_LEVEL2_CACHE_LINESIZE},
+            {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL3_CACHE_ASSOC, _SC_LEVEL3_CACHE_LINESIZE},
+        };
+
+        for (int i = 0; i < 3; i++) {
+            long size = sysconf(names[i][0]);
+            long ways = sysconf(names[i][1]);
+            long line_size = sysconf(names[i][2]);
+            if (size <= 0 || ways <= 0 || line_size <= 0) {
+                continue;
+            }
+            cache_level_info info;
+            info.level = i + 1;
+            info.size = size;
+            info.ways = ways;
+            info.line_size = line_size;
+            info.sets = info.size / (info.ways * info.line_size);
+            m_levels.push_back(info);
+        }
+#endif
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+// Sums a series until it converges, with the terms evaluated in SIMD chunks.
+//
+// converge_scalar() is the loop being replaced:
+//
+//     do {
+//         old = sum;
+//         sum += term_fn(k++);
+//     } while (std::abs(old - sum) > tolerance);
+//
+// The exit test depends on the sum of every previous term, which keeps the
+// compiler from vectorizing the loop (see 2024-08-convergence-loop).
+// converge() splits it in three parts per chunk of W terms:
+//  1. the terms are evaluated independently, in a loop that vectorizes;
+//  2. they are added to the sum one after another, exactly as the scalar loop
+//     adds them, and the exit tests of the chunk are combined without a
+//     branch;
+//  3. the combined test is checked once per chunk.
+// Evaluation speculates past the point of convergence by up to W - 1 terms.
+// When the test passes, the chunk is added again from its starting sum up to
+// the first term where the scalar loop would have stopped. The result, the
+// sum and the number of terms, is therefore bit-identical to
+// converge_scalar(); only the order of the term evaluations differs, so
+// term_fn must be a pure function of k.
+//
+// The addition chain in step 2 stays serial: one floating-point add latency
+// per term is the lower bound. The scalar loop pays for the term evaluation
+// and a branch on every term on top of that. Wider chunks amortize the branch
+// further but keep more terms in flight; 8 to 16 works well for AVX2.
+//
+// The evaluation loop is marked with `#pragma omp simd`; compile with
+// -fopenmp-simd (or -fopenmp), otherwise the compiler may unroll the short
+// loop completely instead of vectorizing it.
+//
+// term_fn receives k as a double (exact below 2^53), so the evaluation loop
+// needs no 64-bit integer conversions, which AVX2 lacks. max_terms bounds
+// series that do not converge; the result then has converged == false.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+struct converge_result {
+    double sum;
+    size_t terms;  // Number of terms added, including the last one.
+    bool converged;
+};
+
+template <typename TermFn>
+converge_result converge_scalar(TermFn term_fn,
+                                double tolerance,
+                                size_t max_terms = SIZE_MAX) {
+    double sum = 0.0;
+    double old;
+    size_t k = 0;
+    while (k < max_terms) {
+        old = sum;
+        sum += term_fn(static_cast<double>(k));
+        k++;
+        if (!(std::abs(old - sum) > tolerance)) {
+            return {sum, k, true};
+        }
+    }
+    return {sum, k, false};
+}
+
+template <int W = 8, typename TermFn>
+converge_result converge(TermFn term_fn,
+                         double tolerance,
+                         size_t max_terms = SIZE_MAX) {
+    static_assert(W > 0, "The chunk width must be positive");
+
+    double sum = 0.0;
+    size_t k = 0;
+    alignas(64) double terms[W];
+
+    while (max_terms - k >= static_cast<size_t>(W)) {
+        const double base = static_cast<double>(k);
+        #pragma omp simd
+        for (int j = 0; j < W; j++) {
+            terms[j] = term_fn(base + j);
+        }
+
+        // The exit test of every term is or-ed together instead of branched
+        // on. The scalar loop continues while the difference is greater than
+        // the tolerance, so a NaN difference also stops it.
+        const double chunk_start = sum;
+        bool stop = false;
+        for (int j = 0; j < W; j++) {
+            double old = sum;
+            sum += terms[j];
+            stop |= !(std::abs(old - sum) > tolerance);
+        }
+
+        if (stop) {
+            // Roll back to the start of the chunk and find the term.
+            sum = chunk_start;
+            for (int j = 0;; j++) {
+                double old = sum;
+                sum += terms[j];
+                if (!(std::abs(old - sum) > tolerance)) {
+                    return {sum, k + j + 1, true};
+                }
+            }
+        }
+
+        k += W;
+    }
+
+    // Fewer than W terms left before max_terms.
+    while (k < max_terms) {
+        double old = sum;
+        sum += term_fn(static_cast<double>(k));
+        k++;
+        if (!(std::abs(old - sum) > tolerance)) {
+            return {sum, k, true};
+        }
+    }
+    return {sum, k, false};
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// Runs a floating-point kernel over a range without per-element NaN or
+// overflow checks, and re-runs only the chunks that raised a floating-point
+// exception with a checked fallback.
+//
+//     fp_guarded_run(kernel, range, fallback, options)
+//
+// The range is split into chunks of options.chunk_size elements. For every
+// chunk [begin, end) kernel(begin, end) runs first. If it raises one of
+// options.excepts (FE_INVALID by default), the chunk is run again with
+// fallback(begin, end) under the caller's floating-point environment, so the
+// fallback can check its inputs, count or patch the bad elements, or let
+// NaNs through. Chunks without exceptions pay for the detection only once
+// per chunk. There are two ways to detect the exception
+// (see 2026-01-traps-as-exceptions):
+//
+//  - fp_guard_mode::STICKY clears the sticky exception flags before a chunk
+//    and tests them after it. The kernel always runs to the end of the chunk.
+//  - fp_guard_mode::TRAP unmasks the exceptions, so the first one raises
+//    SIGFPE. The handler jumps back out of the kernel with siglongjmp and the
+//    rest of the chunk is skipped. A chunk without exceptions costs one
+//    sigsetjmp, which does not save the signal mask; the handler is
+//    installed with SA_NODEFER so the mask does not need restoring.
+//
+// The jump target and the "inside a kernel" flag are per thread, and SIGFPE
+// from a trap is delivered to the thread that raised it, so any number of
+// threads can run guarded kernels at the same time. The handler is installed
+// once per process and stays installed; a SIGFPE raised outside a guarded
+// kernel is passed on to the handler that was installed before it.
+//
+// Requirements on the kernel:
+//  - It must only write elements of its own chunk and be safe to run again
+//    on the same chunk, since the fallback overwrites a partial result.
+//  - In TRAP mode it is left in the middle with a longjmp, so it must not own
+//    resources (no destructors, locks or allocations inside the kernel).
+//  - Compile without -ffast-math; the compiler must not assume the kernel
+//    raises no exceptions.
+
+#include <cfenv>
+#include <csignal>
+#include <cstddef>
+#include <mutex>
+#include <setjmp.h>
+
+enum class fp_guard_mode { STICKY, TRAP };
+
+struct fp_range {
+    size_t begin;
+    size_t end;
+};
+
+struct fp_guard_options {
+    fp_guard_mode mode = fp_guard_mode::TRAP;
+    int excepts = FE_INVALID;
+    size_t chunk_size = 4096;
+};
+
+struct fp_guard_result {
+    size_t chunks;
+    size_t fallback_chunks;  // Chunks that raised an exception.
+};
+
+struct fp_guard_thread_state {
+    sigjmp_buf env;
+    volatile sig_atomic_t active;
+};
+
+// Trivially constructible, so the signal handler can use it without any
+// lazy initialization.
+inline thread_local fp_guard_thread_state fp_guard_state;
+
+inline struct sigaction fp_guard_previous_action;
+
+inline void fp_guard_handler(int sig, siginfo_t* info, void* ucontext) {
+    fp_guard_thread_state& state = fp_guard_state;
+    if (state.active) {
+        state.active = 0;
+        siglongjmp(state.env, 1);
+    }
+
+    // Not raised by a guarded kernel.
+    const struct sigaction& previous = fp_guard_previous_action;
+    if ((previous.sa_flags & SA_SIGINFO) && previous.sa_sigaction != nullptr) {
+        previous.sa_sigaction(sig, info, ucontext);
+    } else if (previous.sa_handler == SIG_DFL) {
+        // Returning re-executes the faulting instruction, which now gets the
+        // default action.
+        signal(sig, SIG_DFL);
+    } else if (previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(sig);
+    }
+}
+
+inline bool fp_guard_install_handler() {
+    static std::once_flag once;
+    static bool installed = false;
+    std::call_once(once, [] {
+        struct sigaction act{};
+        act.sa_sigaction = fp_guard_handler;
+        act.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&act.sa_mask);
+        installed = sigaction(SIGFPE, &act, &fp_guard_previous_action) == 0;
+    });
+    return installed;
+}
+
+template <typename Kernel, typename Fallback>
+fp_guard_result fp_guarded_run(Kernel kernel,
+                               fp_range range,
+                               Fallback fallback,
+                               fp_guard_options options = {}) {
+    fp_guard_result result{0, 0};
+    const size_t chunk_size = options.chunk_size ? options.chunk_size : 1;
+
+    fenv_t caller_env;
+    fegetenv(&caller_env);
+
+    if (options.mode == fp_guard_mode::TRAP && !fp_guard_install_handler()) {
+        options.mode = fp_guard_mode::STICKY;
+    }
+
+    if (options.mode == fp_guard_mode::STICKY) {
+        for (size_t begin = range.begin; begin < range.end; begin += chunk_size) {
+            size_t end = begin + chunk_size < range.end ? begin + chunk_size : range.end;
+            feclearexcept(options.excepts);
+            kernel(begin, end);
+            result.chunks++;
+            if (fetestexcept(options.excepts)) {
+                feclearexcept(options.excepts);
+                fallback(begin, end);
+                result.fallback_chunks++;
+            }
+        }
+        fesetenv(&caller_env);
+        return result;
+    }
+
+    fp_guard_thread_state& state = fp_guard_state;
+    feclearexcept(options.excepts);
+    feenableexcept(options.excepts);
+
+    // volatile: modified between sigsetjmp and siglongjmp.
+    for (volatile size_t begin = range.begin; begin < range.end; begin += chunk_size) {
+        size_t end = begin + chunk_size < range.end ? begin + chunk_size : range.end;
+        result.chunks++;
+        if (sigsetjmp(state.env, 0) == 0) {
+            state.active = 1;
+            kernel(begin, end);
+            state.active = 0;
+        } else {
+            // The kernel may have left the floating-point environment of the
+            // signal handler behind; the fallback runs in the caller's one,
+            // with the exceptions masked.
+            fesetenv(&caller_env);
+            fallback(begin, end);
+            result.fallback_chunks++;
+            feclearexcept(options.excepts);
+            feenableexcept(options.excepts);
+        }
+    }
+
+    fesetenv(&caller_env);
+    return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Policies that map a hash value to a bucket of a table.
+//
+// set_limit(limit) is called when the table is created or resized with the
+// number of buckets, and limit_input(val) returns a bucket in [0, limit).
+// table_size(capacity) picks the number of buckets for a power-of-two
+// capacity: the power-of-two policies use the capacity itself, the others
+// the largest prime not above it. A prime number of buckets spreads keys
+// with a common stride over the whole table, which a power of two does not.
+//
+// A modulo by a number only known at runtime is a hardware division on every
+// probe. libdivide_hasher and fastmod_hasher precompute a multiplicative
+// inverse in set_limit() and replace the division with multiplications.
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "libdivide.h"
+
+namespace jsl {
+
+static inline size_t largest_prime_at_most(size_t n) {
+    auto is_prime = [](size_t v) {
+        if (v < 4) {
+            return v >= 2;
+        }
+        if (v % 2 == 0) {
+            return false;
+        }
+        for (size_t d = 3; d * d <= v; d += 2) {
+            if (v % d == 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    while (n > 2 && !is_prime(n)) {
+        n--;
+    }
+    return n;
+}
+
+struct simple_hasher {
+    size_t m_limit;
+    static size_t table_size(size_t capacity) { return capacity; }
+    void set_limit(size_t limit) { m_limit = limit; }
+    size_t limit_input(size_t val) { return val % m_limit; }
+};
+
+struct shift_hasher {
+    size_t m_limit;
+    static size_t table_size(size_t capacity) { return capacity; }
+    void set_limit(size_t limit) { m_limit = limit - 1; }
+    size_t limit_input(size_t val) { return (val & m_limit); }
+};
+
+// A prime number of buckets and a hardware division, the baseline for the
+// two below.
+struct prime_hasher {
+    size_t m_limit;
+    static size_t table_size(size_t capacity) {
+        return largest_prime_at_most(capacity);
+    }
+    void set_limit(size_t limit) { m_limit = limit; }
+    size_t limit_input(size_t val) { return val % m_limit; }
+};
+
+// val - (val / limit) * limit, with the quotient from libdivide: a 64x64-bit
+// high multiply and a shift. Exact for every 64-bit hash.
+struct libdivide_hasher {
+    size_t m_limit;
+    libdivide::libdivide_u64_t m_divider;
+    static size_t table_size(size_t capacity) {
+        return largest_prime_at_most(capacity);
+    }
+    void set_limit(size_t limit) {
+        m_limit = limit;
+        m_divider = libdivide::libdivide_u64_gen(limit);
+    }
+    size_t limit_input(size_t val) {
+        return val - libdivide::libdivide_u64_do(val, &m_divider) * m_limit;
+    }
+};
+
+// Lemire's fastmod: with M = 2^64 / limit rounded up, the remainder of a
+// 32-bit value is the upper half of (M * val mod 2^64) * limit, two
+// multiplications and no shift. The hash is folded to 32 bits first, so the
+// table can have at most 2^32 buckets.
+struct fastmod_hasher {
+    uint64_t m_M;
+    uint32_t m_limit;
+    static size_t table_size(size_t capacity) {
+        return largest_prime_at_most(capacity);
+    }
+    void set_limit(size_t limit) {
+        assert(limit > 0 && limit <= UINT32_MAX);
+        m_limit = limit;
+        m_M = UINT64_C(0xFFFFFFFFFFFFFFFF) / limit + 1;
+    }
+    size_t limit_input(size_t val) {
+        uint32_t folded = static_cast<uint32_t>(val ^ (val >> 32));
+        uint64_t lowbits = m_M * folded;
+        return (static_cast<unsigned __int128>(lowbits) * m_limit) >> 64;
+    }
+};
+
+}  // namespace jsl
@@ -0,0 +1,124 @@
+#pragma once
+
+// Per-thread copies of a value, each on its own cache line, so threads can
+// update "their" copy without false sharing. The copies are combined when the
+// value is read.
+//
+//     sharded<T> s;
+//     s.local() += x;                      // Slot of the calling thread
+//     T sum = s.reduce(T(), std::plus<T>());
+//
+//     per_thread_counter c;
+//     c.add();                             // Relaxed, no shared cache line
+//     uint64_t n = c.read_total();
+//
+// This is the `struct accum { int val; int padding[31]; }` pattern from
+// 2020-12-multithreading as a reusable type. Every thread gets a number the
+// first time it touches any sharded value, and uses slot number % SLOTS. With
+// more than SLOTS threads two threads can share a slot, so the slot type has
+// to tolerate concurrent updates: per_thread_counter uses relaxed atomic
+// adds, which cost about as much as a plain add when only one thread uses
+// the cache line.
+//
+// read_total() is not a snapshot of all slots at one instant, since the
+// slots are read one after another while other threads keep adding. But each
+// slot only grows, so the result is at least the total when read_total()
+// was called and at most the total when it returned. reset() does not
+// clear the slots, which could lose an add racing with it; it remembers the
+// current total and read_total() subtracts it, so the value stays in that
+// range after a reset too. reset() itself must not run at the same time as
+// read_total() or another reset().
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#ifdef __cpp_lib_hardware_interference_size
+// GCC warns that the value depends on -mtune; that is what we want here, the
+// slots are never shared between binaries.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+static constexpr size_t SHARDED_SLOT_ALIGN =
+    std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+static constexpr size_t SHARDED_SLOT_ALIGN = 64;
+#endif
+
+static constexpr size_t SHARDED_DEFAULT_SLOTS = 64;
+
+inline std::atomic<size_t> sharded_next_thread_number{0};
+
+// Numbers are handed out in the order threads first ask, and never reused.
+inline size_t sharded_thread_number() {
+    thread_local size_t number =
+        sharded_next_thread_number.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+template <typename T, size_t SLOTS = SHARDED_DEFAULT_SLOTS>
+class sharded {
+public:
+    sharded() = default;
+    sharded(const sharded&) = delete;
+    sharded& operator=(const sharded&) = delete;
+
+    T& local() { return m_slots[sharded_thread_number() % SLOTS].value; }
+
+    template <typename F>
+    void for_each(F f) {
+        for (slot& s : m_slots) {
+            f(s.value);
+        }
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (const slot& s : m_slots) {
+            f(s.value);
+        }
+    }
+
+    template <typename R, typename COMBINE>
+    R reduce(R init, COMBINE combine) const {
+        for (const slot& s : m_slots) {
+            init = combine(init, s.value);
+        }
+        return init;
+    }
+
+private:
+    struct alignas(SHARDED_SLOT_ALIGN) slot {
+        T value{};
+    };
+
+    slot m_slots[SLOTS];
+};
+
+class per_thread_counter {
+public:
+    void add(uint64_t n = 1) {
+        m_counts.local().fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t read_total() const {
+        return sum() - m_base.load(std::memory_order_relaxed);
+    }
+
+    void reset() { m_base.store(sum(), std::memory_order_relaxed); }
+
+private:
+    uint64_t sum() const {
+        return m_counts.reduce(uint64_t(0), [](uint64_t total, const std::atomic<uint64_t>& c) {
+            return total + c.load(std::memory_order_relaxed);
+        });
+    }
+
+    sharded<std::atomic<uint64_t>> m_counts;
+    std::atomic<uint64_t> m_base{0};
+};
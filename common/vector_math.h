@@ -0,0 +1,886 @@
+#pragma once
+
+// Vector math library built from cos_vector in 2022-09-ilp-computational:
+// sin, cos, sincos, exp, log and tanh on doubles, for every SIMD backend the
+// compiler targets.
+//
+// Every function comes in two accuracy tiers:
+//
+//   ULP1  At most 1 ULP over the whole domain. Handles NaN, infinities,
+//         overflow and underflow (subnormal results and inputs), and sin/cos
+//         arguments beyond 2^20 * pi/2, which go to libm lane by lane.
+//   FAST  At most about 3 ULP, for finite inputs whose result is a normal
+//         number and for sin/cos arguments up to 2^20 * pi/2. The range
+//         reduction is shorter, the polynomials are evaluated with Estrin's
+//         scheme (a shorter dependency chain than Horner's) and the checks
+//         for special values are left out.
+//
+// The functions work on vmath_pack<V, N>: N independent registers of the
+// backend V. Every step of a function is issued for all N registers before
+// the next step (the hand-written cos_vector_interleaved, for any function
+// and any N), so the latencies of one chain are hidden behind the others. The
+// array entry points, e.g. vmath_sin<vmath_accuracy::ULP1, 2>(in, out, n),
+// run over an array N registers at a time.
+//
+// Backends: vmath_scalar (always), vmath_avx2 (AVX2 + FMA), vmath_avx512
+// (AVX-512F), vmath_neon (AArch64) and vmath_sve (SVE with a fixed vector
+// length, -msve-vector-bits=N, so that SVE registers can be members of a
+// pack). vmath_native is the widest backend available.
+//
+// Build with -ffp-contract=off. All the operations are inlined into one
+// function, and GCC would otherwise fuse a multiplication and an addition of
+// different steps into an FMA. That breaks the error-compensated steps of the
+// ULP1 tier, and depending on the inlining a different N gives different bits.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__ARM_FEATURE_SVE) && defined(__ARM_FEATURE_SVE_BITS) && __ARM_FEATURE_SVE_BITS > 0
+#include <arm_sve.h>
+#endif
+
+#if defined(__GNUC__)
+#define VMATH_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define VMATH_INLINE __forceinline
+#else
+#define VMATH_INLINE inline
+#endif
+
+enum class vmath_accuracy {
+    ULP1,
+    FAST,
+};
+
+static inline uint64_t vmath_bits(double x) {
+    uint64_t r;
+    std::memcpy(&r, &x, sizeof(r));
+    return r;
+}
+
+static inline double vmath_from_bits(uint64_t x) {
+    double r;
+    std::memcpy(&r, &x, sizeof(r));
+    return r;
+}
+
+// Backends. Besides floating point arithmetic, a backend treats a register as
+// 64-bit integers for the bit operations (band ... sll). Masks are the result
+// of comparisons and are only used by select(), mask_or() and any().
+
+struct vmath_scalar {
+    using type = double;
+    using mask = bool;
+    static constexpr int width = 1;
+
+    static type load(const double* p) { return *p; }
+    static void store(double* p, type v) { *p = v; }
+    static type set1(double v) { return v; }
+    static type set1_bits(uint64_t v) { return vmath_from_bits(v); }
+
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type div(type a, type b) { return a / b; }
+    static type fma(type a, type b, type c) { return std::fma(a, b, c); }
+    static type fnma(type a, type b, type c) { return std::fma(-a, b, c); }
+    static type abs(type a) { return std::fabs(a); }
+
+    static type band(type a, type b) { return vmath_from_bits(vmath_bits(a) & vmath_bits(b)); }
+    static type bor(type a, type b) { return vmath_from_bits(vmath_bits(a) | vmath_bits(b)); }
+    static type bxor(type a, type b) { return vmath_from_bits(vmath_bits(a) ^ vmath_bits(b)); }
+    static type add_i64(type a, type b) { return vmath_from_bits(vmath_bits(a) + vmath_bits(b)); }
+    template <int n> static type srl(type a) { return vmath_from_bits(vmath_bits(a) >> n); }
+    template <int n> static type sll(type a) { return vmath_from_bits(vmath_bits(a) << n); }
+
+    static mask lt(type a, type b) { return a < b; }
+    static mask gt(type a, type b) { return a > b; }
+    static mask eq(type a, type b) { return a == b; }
+    static mask unord(type a, type b) { return std::isnan(a) || std::isnan(b); }
+    static mask test_bits(type a, type b) { return (vmath_bits(a) & vmath_bits(b)) != 0; }
+    static type select(mask m, type a, type b) { return m ? a : b; }
+    static mask mask_or(mask a, mask b) { return a || b; }
+    static bool any(mask m) { return m; }
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+struct vmath_avx2 {
+    using type = __m256d;
+    using mask = __m256d;
+    static constexpr int width = 4;
+
+    static type load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, type v) { _mm256_storeu_pd(p, v); }
+    static type set1(double v) { return _mm256_set1_pd(v); }
+    static type set1_bits(uint64_t v) { return _mm256_castsi256_pd(_mm256_set1_epi64x(v)); }
+
+    static type add(type a, type b) { return _mm256_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+    static type div(type a, type b) { return _mm256_div_pd(a, b); }
+    static type fma(type a, type b, type c) { return _mm256_fmadd_pd(a, b, c); }
+    static type fnma(type a, type b, type c) { return _mm256_fnmadd_pd(a, b, c); }
+    static type abs(type a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+
+    static type band(type a, type b) { return _mm256_and_pd(a, b); }
+    static type bor(type a, type b) { return _mm256_or_pd(a, b); }
+    static type bxor(type a, type b) { return _mm256_xor_pd(a, b); }
+    static type add_i64(type a, type b) {
+        return _mm256_castsi256_pd(_mm256_add_epi64(_mm256_castpd_si256(a), _mm256_castpd_si256(b)));
+    }
+    template <int n> static type srl(type a) { return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), n)); }
+    template <int n> static type sll(type a) { return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), n)); }
+
+    static mask lt(type a, type b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static mask gt(type a, type b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static mask eq(type a, type b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static mask unord(type a, type b) { return _mm256_cmp_pd(a, b, _CMP_UNORD_Q); }
+    static mask test_bits(type a, type b) {
+        __m256i zero = _mm256_cmpeq_epi64(_mm256_castpd_si256(_mm256_and_pd(a, b)), _mm256_setzero_si256());
+        return _mm256_castsi256_pd(_mm256_xor_si256(zero, _mm256_set1_epi64x(-1)));
+    }
+    static type select(mask m, type a, type b) { return _mm256_blendv_pd(b, a, m); }
+    static mask mask_or(mask a, mask b) { return _mm256_or_pd(a, b); }
+    static bool any(mask m) { return _mm256_movemask_pd(m) != 0; }
+};
+
+#endif
+
+#if defined(__AVX512F__)
+
+struct vmath_avx512 {
+    using type = __m512d;
+    using mask = __mmask8;
+    static constexpr int width = 8;
+
+    static type load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, type v) { _mm512_storeu_pd(p, v); }
+    static type set1(double v) { return _mm512_set1_pd(v); }
+    static type set1_bits(uint64_t v) { return _mm512_castsi512_pd(_mm512_set1_epi64(v)); }
+
+    static type add(type a, type b) { return _mm512_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+    static type div(type a, type b) { return _mm512_div_pd(a, b); }
+    static type fma(type a, type b, type c) { return _mm512_fmadd_pd(a, b, c); }
+    static type fnma(type a, type b, type c) { return _mm512_fnmadd_pd(a, b, c); }
+    static type abs(type a) { return _mm512_abs_pd(a); }
+
+    // The floating point and/or/xor need AVX-512DQ; the integer ones do not.
+    static type band(type a, type b) {
+        return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b)));
+    }
+    static type bor(type a, type b) {
+        return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b)));
+    }
+    static type bxor(type a, type b) {
+        return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b)));
+    }
+    static type add_i64(type a, type b) {
+        return _mm512_castsi512_pd(_mm512_add_epi64(_mm512_castpd_si512(a), _mm512_castpd_si512(b)));
+    }
+    template <int n> static type srl(type a) { return _mm512_castsi512_pd(_mm512_srli_epi64(_mm512_castpd_si512(a), n)); }
+    template <int n> static type sll(type a) { return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_castpd_si512(a), n)); }
+
+    static mask lt(type a, type b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static mask gt(type a, type b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static mask eq(type a, type b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static mask unord(type a, type b) { return _mm512_cmp_pd_mask(a, b, _CMP_UNORD_Q); }
+    static mask test_bits(type a, type b) { return _mm512_test_epi64_mask(_mm512_castpd_si512(a), _mm512_castpd_si512(b)); }
+    static type select(mask m, type a, type b) { return _mm512_mask_blend_pd(m, b, a); }
+    static mask mask_or(mask a, mask b) { return a | b; }
+    static bool any(mask m) { return m != 0; }
+};
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+struct vmath_neon {
+    using type = float64x2_t;
+    using mask = uint64x2_t;
+    static constexpr int width = 2;
+
+    static uint64x2_t u(type a) { return vreinterpretq_u64_f64(a); }
+    static type f(uint64x2_t a) { return vreinterpretq_f64_u64(a); }
+
+    static type load(const double* p) { return vld1q_f64(p); }
+    static void store(double* p, type v) { vst1q_f64(p, v); }
+    static type set1(double v) { return vmovq_n_f64(v); }
+    static type set1_bits(uint64_t v) { return f(vmovq_n_u64(v)); }
+
+    static type add(type a, type b) { return vaddq_f64(a, b); }
+    static type sub(type a, type b) { return vsubq_f64(a, b); }
+    static type mul(type a, type b) { return vmulq_f64(a, b); }
+    static type div(type a, type b) { return vdivq_f64(a, b); }
+    static type fma(type a, type b, type c) { return vfmaq_f64(c, a, b); }
+    static type fnma(type a, type b, type c) { return vfmsq_f64(c, a, b); }
+    static type abs(type a) { return vabsq_f64(a); }
+
+    static type band(type a, type b) { return f(vandq_u64(u(a), u(b))); }
+    static type bor(type a, type b) { return f(vorrq_u64(u(a), u(b))); }
+    static type bxor(type a, type b) { return f(veorq_u64(u(a), u(b))); }
+    static type add_i64(type a, type b) { return f(vaddq_u64(u(a), u(b))); }
+    template <int n> static type srl(type a) { return f(vshrq_n_u64(u(a), n)); }
+    template <int n> static type sll(type a) { return f(vshlq_n_u64(u(a), n)); }
+
+    static mask lt(type a, type b) { return vcltq_f64(a, b); }
+    static mask gt(type a, type b) { return vcgtq_f64(a, b); }
+    static mask eq(type a, type b) { return vceqq_f64(a, b); }
+    static mask unord(type a, type b) {
+        return veorq_u64(vandq_u64(vceqq_f64(a, a), vceqq_f64(b, b)), vmovq_n_u64(~0ull));
+    }
+    static mask test_bits(type a, type b) { return vtstq_u64(u(a), u(b)); }
+    static type select(mask m, type a, type b) { return vbslq_f64(m, a, b); }
+    static mask mask_or(mask a, mask b) { return vorrq_u64(a, b); }
+    static bool any(mask m) { return vmaxvq_u32(vreinterpretq_u32_u64(m)) != 0; }
+};
+
+#endif
+
+#if defined(__ARM_FEATURE_SVE) && defined(__ARM_FEATURE_SVE_BITS) && __ARM_FEATURE_SVE_BITS > 0
+
+typedef svfloat64_t vmath_sve_f64 __attribute__((arm_sve_vector_bits(__ARM_FEATURE_SVE_BITS)));
+typedef svuint64_t vmath_sve_u64 __attribute__((arm_sve_vector_bits(__ARM_FEATURE_SVE_BITS)));
+typedef svbool_t vmath_sve_bool __attribute__((arm_sve_vector_bits(__ARM_FEATURE_SVE_BITS)));
+
+struct vmath_sve {
+    using type = vmath_sve_f64;
+    using mask = vmath_sve_bool;
+    static constexpr int width = __ARM_FEATURE_SVE_BITS / 64;
+
+    static svbool_t all() { return svptrue_b64(); }
+    static vmath_sve_u64 u(type a) { return svreinterpret_u64_f64(a); }
+    static type f(vmath_sve_u64 a) { return svreinterpret_f64_u64(a); }
+
+    static type load(const double* p) { return svld1_f64(all(), p); }
+    static void store(double* p, type v) { svst1_f64(all(), p, v); }
+    static type set1(double v) { return svdup_n_f64(v); }
+    static type set1_bits(uint64_t v) { return f(svdup_n_u64(v)); }
+
+    static type add(type a, type b) { return svadd_f64_x(all(), a, b); }
+    static type sub(type a, type b) { return svsub_f64_x(all(), a, b); }
+    static type mul(type a, type b) { return svmul_f64_x(all(), a, b); }
+    static type div(type a, type b) { return svdiv_f64_x(all(), a, b); }
+    static type fma(type a, type b, type c) { return svmla_f64_x(all(), c, a, b); }
+    static type fnma(type a, type b, type c) { return svmls_f64_x(all(), c, a, b); }
+    static type abs(type a) { return svabs_f64_x(all(), a); }
+
+    static type band(type a, type b) { return f(svand_u64_x(all(), u(a), u(b))); }
+    static type bor(type a, type b) { return f(svorr_u64_x(all(), u(a), u(b))); }
+    static type bxor(type a, type b) { return f(sveor_u64_x(all(), u(a), u(b))); }
+    static type add_i64(type a, type b) { return f(svadd_u64_x(all(), u(a), u(b))); }
+    template <int n> static type srl(type a) { return f(svlsr_n_u64_x(all(), u(a), n)); }
+    template <int n> static type sll(type a) { return f(svlsl_n_u64_x(all(), u(a), n)); }
+
+    static mask lt(type a, type b) { return svcmplt_f64(all(), a, b); }
+    static mask gt(type a, type b) { return svcmpgt_f64(all(), a, b); }
+    static mask eq(type a, type b) { return svcmpeq_f64(all(), a, b); }
+    static mask unord(type a, type b) { return svcmpuo_f64(all(), a, b); }
+    static mask test_bits(type a, type b) { return svcmpne_n_u64(all(), svand_u64_x(all(), u(a), u(b)), 0); }
+    static type select(mask m, type a, type b) { return svsel_f64(m, a, b); }
+    static mask mask_or(mask a, mask b) { return svorr_b_z(all(), a, b); }
+    static bool any(mask m) { return svptest_any(all(), m); }
+};
+
+#endif
+
+#if defined(__AVX512F__)
+using vmath_native = vmath_avx512;
+#elif defined(__AVX2__) && defined(__FMA__)
+using vmath_native = vmath_avx2;
+#elif defined(__ARM_FEATURE_SVE) && defined(__ARM_FEATURE_SVE_BITS) && __ARM_FEATURE_SVE_BITS > 0
+using vmath_native = vmath_sve;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+using vmath_native = vmath_neon;
+#else
+using vmath_native = vmath_scalar;
+#endif
+
+// N registers of backend V; every operation is applied to all of them in turn.
+// The per-register steps are expanded at compile time over an index_sequence
+// and every operation is force-inlined: a loop over v[j] or an out of line
+// call would leave the registers of the pack in memory between the steps.
+template <typename V, int N>
+struct vmath_pack {
+    using backend = V;
+    static constexpr int count = N;
+    static constexpr int size = N * V::width;
+    using indices = std::make_index_sequence<N>;
+
+    typename V::type v[N];
+
+    struct mask {
+        typename V::mask m[N];
+    };
+
+    VMATH_INLINE static vmath_pack load(const double* p) { return load(p, indices()); }
+    VMATH_INLINE void store(double* p) const { store(p, indices()); }
+    VMATH_INLINE static vmath_pack set1(double x) { return set1(x, indices()); }
+    VMATH_INLINE static vmath_pack set1_bits(uint64_t x) { return set1_bits(x, indices()); }
+
+#define VMATH_PACK_UNARY(name) \
+    template <size_t... J> \
+    VMATH_INLINE static vmath_pack name(vmath_pack a, std::index_sequence<J...>) { \
+        return {{ V::name(a.v[J])... }}; \
+    } \
+    VMATH_INLINE static vmath_pack name(vmath_pack a) { return name(a, indices()); }
+#define VMATH_PACK_BINARY(name) \
+    template <size_t... J> \
+    VMATH_INLINE static vmath_pack name(vmath_pack a, vmath_pack b, std::index_sequence<J...>) { \
+        return {{ V::name(a.v[J], b.v[J])... }}; \
+    } \
+    VMATH_INLINE static vmath_pack name(vmath_pack a, vmath_pack b) { return name(a, b, indices()); }
+#define VMATH_PACK_COMPARE(name) \
+    template <size_t... J> \
+    VMATH_INLINE static mask name(vmath_pack a, vmath_pack b, std::index_sequence<J...>) { \
+        return {{ V::name(a.v[J], b.v[J])... }}; \
+    } \
+    VMATH_INLINE static mask name(vmath_pack a, vmath_pack b) { return name(a, b, indices()); }
+
+    VMATH_PACK_UNARY(abs)
+    VMATH_PACK_BINARY(add)
+    VMATH_PACK_BINARY(sub)
+    VMATH_PACK_BINARY(mul)
+    VMATH_PACK_BINARY(div)
+    VMATH_PACK_BINARY(band)
+    VMATH_PACK_BINARY(bor)
+    VMATH_PACK_BINARY(bxor)
+    VMATH_PACK_BINARY(add_i64)
+    VMATH_PACK_COMPARE(lt)
+    VMATH_PACK_COMPARE(gt)
+    VMATH_PACK_COMPARE(eq)
+    VMATH_PACK_COMPARE(unord)
+    VMATH_PACK_COMPARE(test_bits)
+
+#undef VMATH_PACK_UNARY
+#undef VMATH_PACK_BINARY
+#undef VMATH_PACK_COMPARE
+
+    // a * b + c
+    VMATH_INLINE static vmath_pack fma(vmath_pack a, vmath_pack b, vmath_pack c) { return fma(a, b, c, indices()); }
+    // c - a * b
+    VMATH_INLINE static vmath_pack fnma(vmath_pack a, vmath_pack b, vmath_pack c) { return fnma(a, b, c, indices()); }
+    template <int n> VMATH_INLINE static vmath_pack srl(vmath_pack a) { return srl<n>(a, indices()); }
+    template <int n> VMATH_INLINE static vmath_pack sll(vmath_pack a) { return sll<n>(a, indices()); }
+    // a where m is set, b elsewhere
+    VMATH_INLINE static vmath_pack select(mask m, vmath_pack a, vmath_pack b) { return select(m, a, b, indices()); }
+    VMATH_INLINE static mask mask_or(mask a, mask b) { return mask_or(a, b, indices()); }
+    VMATH_INLINE static bool any(mask m) { return any(m, indices()); }
+
+    VMATH_INLINE friend vmath_pack operator+(vmath_pack a, vmath_pack b) { return add(a, b); }
+    VMATH_INLINE friend vmath_pack operator-(vmath_pack a, vmath_pack b) { return sub(a, b); }
+    VMATH_INLINE friend vmath_pack operator*(vmath_pack a, vmath_pack b) { return mul(a, b); }
+    VMATH_INLINE friend vmath_pack operator/(vmath_pack a, vmath_pack b) { return div(a, b); }
+
+private:
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack load(const double* p, std::index_sequence<J...>) {
+        return {{ V::load(p + J * V::width)... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE void store(double* p, std::index_sequence<J...>) const {
+        (V::store(p + J * V::width, v[J]), ...);
+    }
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack set1(double x, std::index_sequence<J...>) {
+        return {{ (static_cast<void>(J), V::set1(x))... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack set1_bits(uint64_t x, std::index_sequence<J...>) {
+        return {{ (static_cast<void>(J), V::set1_bits(x))... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack fma(vmath_pack a, vmath_pack b, vmath_pack c, std::index_sequence<J...>) {
+        return {{ V::fma(a.v[J], b.v[J], c.v[J])... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack fnma(vmath_pack a, vmath_pack b, vmath_pack c, std::index_sequence<J...>) {
+        return {{ V::fnma(a.v[J], b.v[J], c.v[J])... }};
+    }
+    template <int n, size_t... J>
+    VMATH_INLINE static vmath_pack srl(vmath_pack a, std::index_sequence<J...>) {
+        return {{ V::template srl<n>(a.v[J])... }};
+    }
+    template <int n, size_t... J>
+    VMATH_INLINE static vmath_pack sll(vmath_pack a, std::index_sequence<J...>) {
+        return {{ V::template sll<n>(a.v[J])... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static vmath_pack select(mask m, vmath_pack a, vmath_pack b, std::index_sequence<J...>) {
+        return {{ V::select(m.m[J], a.v[J], b.v[J])... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static mask mask_or(mask a, mask b, std::index_sequence<J...>) {
+        return {{ V::mask_or(a.m[J], b.m[J])... }};
+    }
+    template <size_t... J>
+    VMATH_INLINE static bool any(mask m, std::index_sequence<J...>) {
+        return (false | ... | V::any(m.m[J]));
+    }
+};
+
+// Constants. The pi/2 and ln(2) splits are the ones of fdlibm: the leading
+// parts have trailing zero bits, so multiplying them by the reduction
+// multiple is exact.
+static constexpr double VMATH_ROUND_MAGIC = 0x1.8p52;     // x + magic rounds x to an integer in the low bits
+static constexpr double VMATH_2_PI = 0x1.45f306dc9c883p-1;
+static constexpr double VMATH_PIO2_1 = 0x1.921fb544p+0;
+static constexpr double VMATH_PIO2_2 = 0x1.0b4611a6p-34;
+static constexpr double VMATH_PIO2_3 = 0x1.3198a2ep-69;
+static constexpr double VMATH_PIO2_3T = 0x1.b839a252049c1p-104;
+static constexpr double VMATH_PIO2_HI = 0x1.921fb54442d18p+0;  // pi/2 as three doubles, for FMA reduction
+static constexpr double VMATH_PIO2_MID = 0x1.1a62633145c07p-54;
+static constexpr double VMATH_PIO2_LO = -0x1.f1976b7ed8fbcp-110;
+static constexpr double VMATH_TRIG_MAX = 0x1.921fb54442d18p+20;  // 2^20 * pi/2, beyond it sin/cos go to libm
+static constexpr double VMATH_LOG2E = 0x1.71547652b82fep+0;
+static constexpr double VMATH_LN2_HI = 0x1.62e42feep-1;
+static constexpr double VMATH_LN2_LO = 0x1.a39ef35793c76p-33;
+
+// fdlibm __kernel_sin and __kernel_cos
+static constexpr double VMATH_S[] = {
+    -1.66666666666666324348e-01, 8.33333333332248946124e-03, -1.98412698298579493134e-04,
+    2.75573137070700676789e-06, -2.50507602534068634195e-08, 1.58969099521155010221e-10,
+};
+static constexpr double VMATH_C[] = {
+    4.16666666666666019037e-02, -1.38888888888741095749e-03, 2.48015872894767294178e-05,
+    -2.75573143513906633035e-07, 2.08757232129817482790e-09, -1.13596475577881948265e-11,
+};
+
+// exp(r) - 1 = r + r^2 * (1/2! + r/3! + ... + r^11/13!) for |r| <= ln(2)/2
+static constexpr double VMATH_EXPM1[] = {
+    1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320, 1.0 / 362880,
+    1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800,
+};
+
+// fdlibm __ieee754_log: log(1 + f) = f - f^2/2 + s * (f^2/2 + R(s^2)), s = f / (2 + f)
+static constexpr double VMATH_LG[] = {
+    6.666666666666735130e-01, 3.999999999940941908e-01, 2.857142874366239149e-01, 2.222219843214978396e-01,
+    1.818357216161805012e-01, 1.531383769920937332e-01, 1.479819860511658591e-01,
+};
+
+// Horner's scheme, unrolled at compile time: I steps left, r is the value so
+// far.
+template <size_t I, typename P, size_t COUNT>
+VMATH_INLINE P vmath_horner_step(P r, P x, const double (&c)[COUNT]) {
+    if constexpr (I == 0) {
+        return r;
+    }
+    else {
+        return vmath_horner_step<I - 1>(P::fma(r, x, P::set1(c[I - 1])), x, c);
+    }
+}
+
+template <typename P, size_t COUNT>
+VMATH_INLINE P vmath_horner(P x, const double (&c)[COUNT]) {
+    return vmath_horner_step<COUNT - 1>(P::set1(c[COUNT - 1]), x, c);
+}
+
+// Estrin's scheme: pairs of coefficients are combined with x, pairs of pairs
+// with x^2 and so on, so the dependency chain is log2(COUNT) FMAs long. Each
+// level is a separate instantiation with COUNT terms, so all the indices are
+// constants and the terms stay in registers.
+template <typename P, size_t COUNT>
+struct vmath_estrin_level {
+    static constexpr size_t NEXT = (COUNT + 1) / 2;
+
+    // Term I of the next level; an odd last term is carried over as is.
+    template <size_t I>
+    VMATH_INLINE static P pair(const P (&terms)[COUNT], P power) {
+        if constexpr (2 * I + 1 < COUNT) {
+            return P::fma(terms[2 * I + 1], power, terms[2 * I]);
+        }
+        else {
+            return terms[2 * I];
+        }
+    }
+
+    template <size_t... I>
+    VMATH_INLINE static P eval(const P (&terms)[COUNT], P power, std::index_sequence<I...>) {
+        const P next[NEXT] = { pair<I>(terms, power)... };
+        return vmath_estrin_level<P, NEXT>::eval(next, power * power);
+    }
+
+    VMATH_INLINE static P eval(const P (&terms)[COUNT], P power) {
+        return eval(terms, power, std::make_index_sequence<NEXT>());
+    }
+};
+
+template <typename P>
+struct vmath_estrin_level<P, 1> {
+    VMATH_INLINE static P eval(const P (&terms)[1], P) { return terms[0]; }
+};
+
+template <typename P, size_t COUNT, size_t... I>
+VMATH_INLINE P vmath_estrin(P x, const double (&c)[COUNT], std::index_sequence<I...>) {
+    const P terms[COUNT] = { P::set1(c[I])... };
+    return vmath_estrin_level<P, COUNT>::eval(terms, x);
+}
+
+template <typename P, size_t COUNT>
+VMATH_INLINE P vmath_estrin(P x, const double (&c)[COUNT]) {
+    return vmath_estrin(x, c, std::make_index_sequence<COUNT>());
+}
+
+// Reduces x to r = x - n * pi/2, |r| <= pi/4, and returns sin(r) and cos(r).
+// The low bits of quadrant are n.
+template <vmath_accuracy A, typename P>
+VMATH_INLINE void vmath_sincos_reduced(P x, P& sin_r, P& cos_r, P& quadrant) {
+    const P magic = P::set1(VMATH_ROUND_MAGIC);
+    quadrant = P::fma(x, P::set1(VMATH_2_PI), magic);
+    P n = quadrant - magic;
+
+    if (A == vmath_accuracy::FAST) {
+        P r = P::fnma(n, P::set1(VMATH_PIO2_HI), x);
+        r = P::fnma(n, P::set1(VMATH_PIO2_MID), r);
+        r = P::fnma(n, P::set1(VMATH_PIO2_LO), r);
+
+        P z = r * r;
+        P z2 = z * z;
+        const double sin_c[] = { VMATH_S[1], VMATH_S[2], VMATH_S[3], VMATH_S[4], VMATH_S[5] };
+        sin_r = P::fma(r * z, P::fma(z, vmath_estrin(z, sin_c), P::set1(VMATH_S[0])), r);
+        cos_r = P::fma(z2, vmath_estrin(z, VMATH_C), P::fnma(z, P::set1(0.5), P::set1(1.0)));
+        return;
+    }
+
+    // fdlibm __ieee754_rem_pio2 for |x| < 2^20 * pi/2, always with all three
+    // iterations: r + y = x - n * pi/2 to about 118 bits.
+    // fdlibm skips the rounding error of the second iteration when it does
+    // the third one (the subtraction is exact then); here it is kept.
+    P t = P::fnma(n, P::set1(VMATH_PIO2_1), x);
+    P w = n * P::set1(VMATH_PIO2_2);
+    P r = t - w;
+    P e2 = (r - t) + w;
+    t = r;
+    w = n * P::set1(VMATH_PIO2_3);
+    r = t - w;
+    w = P::fma(n, P::set1(VMATH_PIO2_3T), (r - t) + w) + e2;
+    t = r;
+    r = t - w;
+    P y = (t - r) - w;
+
+    // __kernel_sin(r, y, 1)
+    P z = r * r;
+    P v = z * r;
+    const double sin_c[] = { VMATH_S[1], VMATH_S[2], VMATH_S[3], VMATH_S[4], VMATH_S[5] };
+    P s = vmath_horner(z, sin_c);
+    sin_r = r - (((z * P::fnma(v, s, P::set1(0.5) * y)) - y) - v * P::set1(VMATH_S[0]));
+
+    // __kernel_cos(r, y)
+    P z2 = z * z;
+    const double c_lo[] = { VMATH_C[0], VMATH_C[1], VMATH_C[2] };
+    const double c_hi[] = { VMATH_C[3], VMATH_C[4], VMATH_C[5] };
+    P c = P::fma(z2 * z2, vmath_horner(z, c_hi), z * vmath_horner(z, c_lo));
+    P hz = P::set1(0.5) * z;
+    P one = P::set1(1.0);
+    P wc = one - hz;
+    cos_r = wc + (((one - wc) - hz) + P::fnma(r, y, z * c));
+}
+
+// Lanes that the vector range reduction does not cover: |x| > 2^20 * pi/2,
+// infinities and NaN.
+template <typename P>
+VMATH_INLINE typename P::mask vmath_trig_out_of_range(P x) {
+    P limit = P::set1(VMATH_TRIG_MAX);
+    P ax = P::abs(x);
+    return P::mask_or(P::gt(ax, limit), P::unord(x, x));
+}
+
+template <typename P, typename F>
+P vmath_libm_lanes(P x, P result, typename P::mask m, F f) {
+    double in[P::size], out[P::size];
+    P flags = P::select(m, P::set1_bits(1), P::set1_bits(0));
+    double flag[P::size];
+    x.store(in);
+    result.store(out);
+    flags.store(flag);
+    for (int i = 0; i < P::size; i++) {
+        if (vmath_bits(flag[i]) != 0) {
+            out[i] = f(in[i]);
+        }
+    }
+    return P::load(out);
+}
+
+template <vmath_accuracy A, typename P>
+VMATH_INLINE P vmath_sin(P x) {
+    P s, c, quadrant;
+    vmath_sincos_reduced<A>(x, s, c, quadrant);
+    P r = P::select(P::test_bits(quadrant, P::set1_bits(1)), c, s);
+    r = P::bxor(r, P::template sll<62>(P::band(quadrant, P::set1_bits(2))));
+    if (A == vmath_accuracy::ULP1) {
+        typename P::mask m = vmath_trig_out_of_range(x);
+        if (P::any(m)) {
+            r = vmath_libm_lanes(x, r, m, [](double v) { return std::sin(v); });
+        }
+    }
+    return r;
+}
+
+template <vmath_accuracy A, typename P>
+VMATH_INLINE P vmath_cos(P x) {
+    P s, c, quadrant;
+    vmath_sincos_reduced<A>(x, s, c, quadrant);
+    P r = P::select(P::test_bits(quadrant, P::set1_bits(1)), s, c);
+    r = P::bxor(r, P::template sll<62>(P::band(P::add_i64(quadrant, P::set1_bits(1)), P::set1_bits(2))));
+    if (A == vmath_accuracy::ULP1) {
+        typename P::mask m = vmath_trig_out_of_range(x);
+        if (P::any(m)) {
+            r = vmath_libm_lanes(x, r, m, [](double v) { return std::cos(v); });
+        }
+    }
+    return r;
+}
+
+template <vmath_accuracy A, typename P>
+VMATH_INLINE void vmath_sincos(P x, P& sin_x, P& cos_x) {
+    P s, c, quadrant;
+    vmath_sincos_reduced<A>(x, s, c, quadrant);
+    typename P::mask odd = P::test_bits(quadrant, P::set1_bits(1));
+    sin_x = P::bxor(P::select(odd, c, s), P::template sll<62>(P::band(quadrant, P::set1_bits(2))));
+    cos_x = P::bxor(P::select(odd, s, c),
+                    P::template sll<62>(P::band(P::add_i64(quadrant, P::set1_bits(1)), P::set1_bits(2))));
+    if (A == vmath_accuracy::ULP1) {
+        typename P::mask m = vmath_trig_out_of_range(x);
+        if (P::any(m)) {
+            sin_x = vmath_libm_lanes(x, sin_x, m, [](double v) { return std::sin(v); });
+            cos_x = vmath_libm_lanes(x, cos_x, m, [](double v) { return std::cos(v); });
+        }
+    }
+}
+
+// 2^k for integral k in [-1022, 1023], given k + VMATH_ROUND_MAGIC.
+template <typename P>
+VMATH_INLINE P vmath_pow2(P k_magic) {
+    return P::template sll<52>(P::add_i64(k_magic, P::set1_bits(1023)));
+}
+
+// Splits x = k * ln(2) + r, |r| <= ln(2)/2, and returns exp(r) - 1 as
+// p + p_lo (p_lo is zero in the FAST tier). k_magic is k + VMATH_ROUND_MAGIC.
+template <vmath_accuracy A, typename P>
+VMATH_INLINE void vmath_exp_reduced(P x, P& k, P& k_magic, P& p, P& p_lo) {
+    const P magic = P::set1(VMATH_ROUND_MAGIC);
+    k_magic = P::fma(x, P::set1(VMATH_LOG2E), magic);
+    k = k_magic - magic;
+
+    if (A == vmath_accuracy::FAST) {
+        P r = P::fnma(k, P::set1(VMATH_LN2_HI), x);
+        r = P::fnma(k, P::set1(VMATH_LN2_LO), r);
+        p = P::fma(r * r, vmath_estrin(r, VMATH_EXPM1), r);
+        p_lo = P::set1(0.0);
+        return;
+    }
+
+    // r = hi - lo, with the rounding error of the subtraction kept in c.
+    P hi = P::fnma(k, P::set1(VMATH_LN2_HI), x);
+    P lo = k * P::set1(VMATH_LN2_LO);
+    P r = hi - lo;
+    P c = (hi - r) - lo;
+    P r2 = r * r;
+    P h = vmath_horner(r, VMATH_EXPM1);
+    p = P::fma(r2, h, r);
+    p_lo = P::fma(r2, h, r - p) + c;   // r - p is exact, p is within 20% of r
+}
+
+template <vmath_accuracy A, typename P>
+VMATH_INLINE P vmath_exp(P x) {
+    P k, k_magic, p, p_lo;
+
+    if (A == vmath_accuracy::FAST) {
+        vmath_exp_reduced<A>(x, k, k_magic, p, p_lo);
+        P s = vmath_pow2(k_magic);
+        return P::fma(s, p, s);
+    }
+
+    typename P::mask special = P::mask_or(P::gt(P::abs(x), P::set1(708.0)), P::unord(x, x));
+    if (!P::any(special)) {
+        vmath_exp_reduced<A>(x, k, k_magic, p, p_lo);
+        P s = vmath_pow2(k_magic);
+        return P::fma(s, p + p_lo, s);
+    }
+
+    // Clamp x so that 2^k stays representable in two factors; beyond the
+    // clamps the result overflows to infinity or underflows to zero.
+    P xc = P::select(P::gt(x, P::set1(710.0)), P::set1(710.0), x);
+    xc = P::select(P::lt(xc, P::set1(-746.0)), P::set1(-746.0), xc);
+    vmath_exp_reduced<A>(xc, k, k_magic, p, p_lo);
+    p = p + p_lo;
+    const P magic = P::set1(VMATH_ROUND_MAGIC);
+    P k1_magic = P::fma(k, P::set1(0.5), magic);
+    P k2_magic = (k - (k1_magic - magic)) + magic;
+    P s1 = vmath_pow2(k1_magic);
+    P s2 = vmath_pow2(k2_magic);
+    P r = P::fma(s1, p, s1) * s2;
+    return P::select(P::unord(x, x), x + x, r);
+}
+
+template <vmath_accuracy A, typename P>
+VMATH_INLINE P vmath_log(P x) {
+    const P one = P::set1(1.0);
+    const P magic_exp = P::set1_bits(0x4330000000000000ull);  // 2^52: or-ed into a small integer gives 2^52 + i
+    P scaled = x;
+    P k_adjust = P::set1(1023.0);
+    typename P::mask special;
+    bool any_special = false;
+
+    if (A == vmath_accuracy::ULP1) {
+        // Subnormals are scaled by 2^54 first.
+        special = P::mask_or(P::unord(x, x), P::mask_or(P::lt(x, P::set1(0x1p-1022)),
+                                                       P::gt(x, P::set1(0x1.fffffffffffffp1023))));
+        any_special = P::any(special);
+        if (any_special) {
+            typename P::mask subnormal = P::lt(P::abs(x), P::set1(0x1p-1022));
+            scaled = P::select(subnormal, x * P::set1(0x1p54), x);
+            k_adjust = P::select(subnormal, P::set1(1023.0 + 54.0), k_adjust);
+        }
+    }
+
+    // x = 2^k * m, sqrt(2)/2 <= m < sqrt(2)
+    P u = P::add_i64(scaled, P::set1_bits(0x3ff0000000000000ull - 0x3fe6a09e00000000ull));
+    P k = (P::bor(P::template srl<52>(u), magic_exp) - P::set1(0x1p52)) - k_adjust;
+    P m = P::add_i64(P::band(u, P::set1_bits(0x000fffffffffffffull)), P::set1_bits(0x3fe6a09e00000000ull));
+
+    P f = m - one;
+    P hfsq = P::set1(0.5) * f * f;
+    P s = f / (P::set1(2.0) + f);
+    P z = s * s;
+    P r;
+
+    if (A == vmath_accuracy::FAST) {
+        r = z * vmath_estrin(z, VMATH_LG);
+        return P::fma(k, P::set1(VMATH_LN2_HI), f - (hfsq - s * (hfsq + r)) + k * P::set1(VMATH_LN2_LO));
+    }
+
+    P w = z * z;
+    const double lg_even[] = { VMATH_LG[1], VMATH_LG[3], VMATH_LG[5] };
+    const double lg_odd[] = { VMATH_LG[0], VMATH_LG[2], VMATH_LG[4], VMATH_LG[6] };
+    r = z * vmath_horner(w, lg_odd) + w * vmath_horner(w, lg_even);
+    P result = (((P::fma(s, hfsq + r, k * P::set1(VMATH_LN2_LO))) - hfsq) + f) + k * P::set1(VMATH_LN2_HI);
+
+    if (any_special) {
+        // log(0) = -inf, log(x < 0) = NaN, log(inf) = inf, log(NaN) = NaN
+        P zero = P::set1(0.0);
+        P inf = P::set1(INFINITY);
+        result = P::select(P::gt(x, P::set1(0x1.fffffffffffffp1023)), inf, result);
+        result = P::select(P::eq(x, zero), P::set1(-INFINITY), result);
+        result = P::select(P::lt(x, zero), P::set1(NAN), result);
+        result = P::select(P::unord(x, x), x + x, result);
+    }
+    return result;
+}
+
+// tanh(|x|) = e / (e + 2) = 1 - 2 / (e + 2) with e = exp(2|x|) - 1; the
+// first form below tanh = 1/2 (e < 2), the second above. The ULP1 tier keeps e
+// and e + 2 in two parts and corrects the quotient with their low parts.
+template <vmath_accuracy A, typename P>
+VMATH_INLINE P vmath_tanh(P x) {
+    const P one = P::set1(1.0);
+    const P two = P::set1(2.0);
+    P ax = P::abs(x);
+    P ac = P::select(P::gt(ax, P::set1(22.0)), P::set1(22.0), ax);
+
+    P k, k_magic, p, p_lo;
+    vmath_exp_reduced<A>(ac + ac, k, k_magic, p, p_lo);
+    P s = vmath_pow2(k_magic);
+    P s1 = s - one;
+    P e = P::fma(s, p, s1);
+    P d = e + two;
+    P inv = one / d;
+    P q_small = e * inv;
+    P q_large = inv + inv;
+    P r;
+
+    if (A == vmath_accuracy::FAST) {
+        r = P::select(P::lt(e, two), q_small, one - q_large);
+    }
+    else {
+        // (s1 - e) is exact for k <= 1, i.e. whenever e < 2.
+        P e_lo = P::fma(s, p, s1 - e) + s * p_lo;
+        typename P::mask small = P::lt(e, two);
+        P d_lo = P::select(small, (two - d) + e, (e - d) + two) + e_lo;
+
+        q_small = P::fma(P::fnma(q_small, d_lo, P::fnma(q_small, d, e) + e_lo), inv, q_small);
+
+        P correction = P::fnma(q_large, d_lo, P::fnma(q_large, d, two)) * inv;
+        P t = one - q_large;
+        P large = t + (((one - t) - q_large) - correction);
+        r = P::select(small, q_small, large);
+    }
+    return P::bor(r, P::band(x, P::set1(-0.0)));
+}
+
+// Array entry points: N registers at a time, then single registers, then the
+// remainder through a padded register.
+
+template <typename V, int N, typename F>
+void vmath_array(const double* in, double* out, size_t n, F f) {
+    using P = vmath_pack<V, N>;
+    using P1 = vmath_pack<V, 1>;
+    size_t i = 0;
+    for (; i + P::size <= n; i += P::size) {
+        f(P::load(in + i)).store(out + i);
+    }
+    for (; i + P1::size <= n; i += P1::size) {
+        f(P1::load(in + i)).store(out + i);
+    }
+    if (i < n) {
+        double tmp[P1::size];
+        for (size_t j = 0; j < P1::size; j++) {
+            tmp[j] = i + j < n ? in[i + j] : 1.0;
+        }
+        f(P1::load(tmp)).store(tmp);
+        std::memcpy(out + i, tmp, (n - i) * sizeof(double));
+    }
+}
+
+#define VMATH_ARRAY_FUNCTION(name) \
+    template <vmath_accuracy A = vmath_accuracy::ULP1, int N = 2, typename V = vmath_native> \
+    void name(const double* in, double* out, size_t n) { \
+        vmath_array<V, N>(in, out, n, [](auto x) { return name<A>(x); }); \
+    }
+
+VMATH_ARRAY_FUNCTION(vmath_sin)
+VMATH_ARRAY_FUNCTION(vmath_cos)
+VMATH_ARRAY_FUNCTION(vmath_exp)
+VMATH_ARRAY_FUNCTION(vmath_log)
+VMATH_ARRAY_FUNCTION(vmath_tanh)
+
+#undef VMATH_ARRAY_FUNCTION
+
+template <vmath_accuracy A = vmath_accuracy::ULP1, int N = 2, typename V = vmath_native>
+void vmath_sincos(const double* in, double* sin_out, double* cos_out, size_t n) {
+    using P = vmath_pack<V, N>;
+    using P1 = vmath_pack<V, 1>;
+    size_t i = 0;
+    for (; i + P::size <= n; i += P::size) {
+        P s, c;
+        vmath_sincos<A>(P::load(in + i), s, c);
+        s.store(sin_out + i);
+        c.store(cos_out + i);
+    }
+    for (; i < n; i += P1::size) {
+        double tmp[P1::size], tmp_sin[P1::size], tmp_cos[P1::size];
+        size_t count = n - i < P1::size ? n - i : P1::size;
+        for (size_t j = 0; j < P1::size; j++) {
+            tmp[j] = j < count ? in[i + j] : 1.0;
+        }
+        P1 s, c;
+        vmath_sincos<A>(P1::load(tmp), s, c);
+        s.store(tmp_sin);
+        c.store(tmp_cos);
+        std::memcpy(sin_out + i, tmp_sin, count * sizeof(double));
+        std::memcpy(cos_out + i, tmp_cos, count * sizeof(double));
+    }
+}
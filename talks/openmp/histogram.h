@@ -0,0 +1,224 @@
+#pragma once
+
+// Multi-threaded histograms of 8-bit, 16-bit and 32-bit values.
+//
+//     histogram_u8(hist, image, n);            // 256 bins
+//     histogram_u16(hist, samples, n);         // 65536 bins
+//     histogram_u32(hist, bins, keys, n);      // Any number of bins
+//
+// The counts are added to hist. Keys of histogram_u32 that are not below bins
+// are not counted.
+//
+// In `hist[in[i]]++` an increment has to wait for the previous one when the
+// two values are the same: the load of the counter gets its value from the
+// store still in flight, which costs the store-to-load forwarding latency for
+// every element of a run of equal values. Methods:
+//
+//  - SCALAR: one histogram per thread, the plain loop.
+//  - REPLICATED: R interleaved sub-histograms per thread; element i goes to
+//    sub-histogram i % R, so equal neighbours update different counters and
+//    R increments can be in flight. R is 4 while the sub-histograms fit
+//    in L1/L2 and drops for large bin counts, where cache misses dominate.
+//  - AVX512: sixteen keys at a time with gather and scatter. VPCONFLICTD
+//    finds the lanes with equal keys; every lane adds the number of equal
+//    lanes up to itself, and since the scatter writes lanes in order the last
+//    of them stores the full count. Falls back to REPLICATED if the CPU has
+//    no AVX-512 CD.
+//
+// The sub-histograms count in 32 bits and are folded into a 64-bit private
+// histogram every HISTOGRAM_COUNT_CHUNK elements. The private histograms of the
+// threads are merged with a tree reduction: in round k every thread whose
+// number is a multiple of 2^(k+1) adds the histogram of thread + 2^k, so the
+// merge takes log2(threads) rounds of vectorizable additions and no lock.
+
+#include <omp.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <immintrin.h>
+
+enum class histogram_method { SCALAR, REPLICATED, AVX512 };
+
+static constexpr size_t HISTOGRAM_COUNT_CHUNK = size_t(1) << 30;
+
+// Adds in[0, n) to R sub-histograms of bins counters each, laid out one after
+// another. With CHECK, values not below bins are skipped.
+template <int R, bool CHECK, typename T>
+void histogram_replicated_kernel(uint32_t* sub, size_t bins, const T* in, size_t n) {
+    size_t i = 0;
+    for (; i + R <= n; i += R) {
+        for (int r = 0; r < R; r++) {
+            size_t v = in[i + r];
+            if (!CHECK || v < bins) {
+                sub[r * bins + v]++;
+            }
+        }
+    }
+    for (; i < n; i++) {
+        size_t v = in[i];
+        if (!CHECK || v < bins) {
+            sub[v]++;
+        }
+    }
+}
+
+#define HISTOGRAM_AVX512 __attribute__((target("avx512f,avx512cd")))
+
+HISTOGRAM_AVX512 static inline __m512i histogram_popcount_epi32(__m512i x) {
+    const __m512i m1 = _mm512_set1_epi32(0x55555555);
+    const __m512i m2 = _mm512_set1_epi32(0x33333333);
+    const __m512i m4 = _mm512_set1_epi32(0x0F0F0F0F);
+    x = _mm512_sub_epi32(x, _mm512_and_si512(_mm512_srli_epi32(x, 1), m1));
+    x = _mm512_add_epi32(_mm512_and_si512(x, m2), _mm512_and_si512(_mm512_srli_epi32(x, 2), m2));
+    x = _mm512_and_si512(_mm512_add_epi32(x, _mm512_srli_epi32(x, 4)), m4);
+    return _mm512_srli_epi32(_mm512_mullo_epi32(x, _mm512_set1_epi32(0x01010101)), 24);
+}
+
+HISTOGRAM_AVX512 static inline __m512i histogram_load16(const uint8_t* in) {
+    return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+}
+
+HISTOGRAM_AVX512 static inline __m512i histogram_load16(const uint16_t* in) {
+    return _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in)));
+}
+
+HISTOGRAM_AVX512 static inline __m512i histogram_load16(const uint32_t* in) {
+    return _mm512_loadu_si512(in);
+}
+
+template <bool CHECK, typename T>
+HISTOGRAM_AVX512 void histogram_avx512_kernel(uint32_t* hist, size_t bins, const T* in, size_t n) {
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i limit = _mm512_set1_epi32(static_cast<int32_t>(std::min<size_t>(bins, UINT32_MAX)));
+    int* base = reinterpret_cast<int*>(hist);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i idx = histogram_load16(in + i);
+        __mmask16 valid = CHECK ? _mm512_cmplt_epu32_mask(idx, limit) : __mmask16(0xFFFF);
+        // Bit j of lane k is set if lane j < k has the same key.
+        __m512i conflicts = _mm512_conflict_epi32(idx);
+        __m512i count = _mm512_add_epi32(histogram_popcount_epi32(conflicts), one);
+        __m512i old = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), valid, idx, base, 4);
+        _mm512_mask_i32scatter_epi32(base, valid, idx, _mm512_add_epi32(old, count), 4);
+    }
+    histogram_replicated_kernel<1, CHECK>(hist, bins, in + i, n - i);
+}
+
+static inline bool histogram_has_avx512() {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd");
+}
+
+static inline int histogram_replicas(size_t bins) {
+    // Keep the sub-histograms of a thread within about 256 kB.
+    size_t budget = 256 * 1024 / sizeof(uint32_t);
+    if (bins * 4 <= budget) {
+        return 4;
+    }
+    if (bins * 2 <= budget) {
+        return 2;
+    }
+    return 1;
+}
+
+template <bool CHECK, typename T>
+void histogram_parallel(size_t* hist,
+                        size_t bins,
+                        const T* in,
+                        size_t n,
+                        histogram_method method,
+                        int num_threads) {
+    // The gather and scatter indices are signed 32-bit.
+    if (method == histogram_method::AVX512 && (!histogram_has_avx512() || bins > INT32_MAX)) {
+        method = histogram_method::REPLICATED;
+    }
+    int replicas = 1;
+    if (method == histogram_method::REPLICATED) {
+        replicas = histogram_replicas(bins);
+    }
+    if (num_threads <= 0) {
+        num_threads = omp_get_max_threads();
+    }
+
+    std::vector<size_t*> partial(num_threads);
+
+    #pragma omp parallel num_threads(num_threads) shared(hist, bins, in, n, method, replicas, partial)
+    {
+        const size_t t = omp_get_thread_num();
+        const size_t nt = omp_get_num_threads();
+        const size_t begin = n * t / nt;
+        const size_t end = n * (t + 1) / nt;
+
+        std::vector<uint32_t> sub(replicas * bins);
+        std::vector<size_t> local(bins);
+
+        for (size_t chunk = begin; chunk < end; chunk += HISTOGRAM_COUNT_CHUNK) {
+            const size_t len = std::min(HISTOGRAM_COUNT_CHUNK, end - chunk);
+            if (method == histogram_method::AVX512) {
+                histogram_avx512_kernel<CHECK>(sub.data(), bins, in + chunk, len);
+            } else if (replicas == 4) {
+                histogram_replicated_kernel<4, CHECK>(sub.data(), bins, in + chunk, len);
+            } else if (replicas == 2) {
+                histogram_replicated_kernel<2, CHECK>(sub.data(), bins, in + chunk, len);
+            } else {
+                histogram_replicated_kernel<1, CHECK>(sub.data(), bins, in + chunk, len);
+            }
+
+            for (int r = 0; r < replicas; r++) {
+                uint32_t* s = sub.data() + r * bins;
+                for (size_t b = 0; b < bins; b++) {
+                    local[b] += s[b];
+                }
+            }
+            std::fill(sub.begin(), sub.end(), 0);
+        }
+
+        partial[t] = local.data();
+
+        for (size_t step = 1; step < nt; step *= 2) {
+            #pragma omp barrier
+            if (t % (2 * step) == 0 && t + step < nt) {
+                size_t* dst = partial[t];
+                const size_t* src = partial[t + step];
+                for (size_t b = 0; b < bins; b++) {
+                    dst[b] += src[b];
+                }
+            }
+        }
+
+        if (t == 0) {
+            for (size_t b = 0; b < bins; b++) {
+                hist[b] += local[b];
+            }
+        }
+        // Keep local alive until every merge that reads it is done.
+        #pragma omp barrier
+    }
+}
+
+inline void histogram_u8(size_t hist[256],
+                         const uint8_t* in,
+                         size_t n,
+                         histogram_method method = histogram_method::REPLICATED,
+                         int num_threads = 0) {
+    histogram_parallel<false>(hist, 256, in, n, method, num_threads);
+}
+
+inline void histogram_u16(size_t hist[65536],
+                          const uint16_t* in,
+                          size_t n,
+                          histogram_method method = histogram_method::REPLICATED,
+                          int num_threads = 0) {
+    histogram_parallel<false>(hist, 65536, in, n, method, num_threads);
+}
+
+inline void histogram_u32(size_t* hist,
+                          size_t bins,
+                          const uint32_t* in,
+                          size_t n,
+                          histogram_method method = histogram_method::REPLICATED,
+                          int num_threads = 0) {
+    histogram_parallel<true>(hist, bins, in, n, method, num_threads);
+}
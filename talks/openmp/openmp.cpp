@@ -1,11 +1,16 @@
 
 #include "omp.h"
 #include "likwid.h"
+#include "work_stealing.h"
+#include "histogram.h"
 #include <vector>
 #include <random>
 #include <iostream>
 #include <cassert>
 #include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <string>
 
 
 void add_scalar(float* c, float * a, float * b, size_t n) {
@@ -308,6 +313,292 @@ float find_min_openmp(node_t const * const root) {
     return min;
 }
 
+// The same algorithms on the work-stealing runtime. find_min_ws_eager spawns
+// a task for every node like find_min_naive, to measure the cost of a task.
+// The others use ws_lazy_invoke and need no depth cutoff.
+float find_min_ws_eager_internal(node_t const * const node) {
+    float min_left = std::numeric_limits<float>::max(), min_right = std::numeric_limits<float>::max();
+
+    if (node->left && node->right) {
+        ws_parallel_invoke([&] { min_left = find_min_ws_eager_internal(node->left); },
+                           [&] { min_right = find_min_ws_eager_internal(node->right); });
+    } else if (node->left) {
+        min_left = find_min_ws_eager_internal(node->left);
+    } else if (node->right) {
+        min_right = find_min_ws_eager_internal(node->right);
+    }
+
+    return std::min(min_right, std::min(min_left, node->value));
+}
+
+float find_min_ws_eager(ws_scheduler_t& scheduler, node_t const * const root) {
+    float min;
+    scheduler.run([&] { min = find_min_ws_eager_internal(root); });
+    return min;
+}
+
+float find_min_ws_internal(node_t const * const node) {
+    float min_left = std::numeric_limits<float>::max(), min_right = std::numeric_limits<float>::max();
+
+    ws_lazy_invoke([&] { if (node->left) min_left = find_min_ws_internal(node->left); },
+                   [&] { if (node->right) min_right = find_min_ws_internal(node->right); });
+
+    return std::min(min_right, std::min(min_left, node->value));
+}
+
+float find_min_ws(ws_scheduler_t& scheduler, node_t const * const root) {
+    float min;
+    scheduler.run([&] { min = find_min_ws_internal(root); });
+    return min;
+}
+
+// Unbalanced trees: every node splits its range 1:7, so the right spine is
+// about six times as deep as a balanced tree and the subtrees at a fixed
+// depth differ in size by orders of magnitude.
+static constexpr int SKEW = 8;
+
+node_t* create_skewed_from_array(const std::vector<float>& a, int left, int right) {
+    if (left > right) {
+        return nullptr;
+    }
+
+    int mid = left + (right - left) / SKEW;
+    node_t* node = new node_t;
+    node->value = a[mid];
+    node->left = create_skewed_from_array(a, left, mid - 1);
+    node->right = create_skewed_from_array(a, mid + 1, right);
+    return node;
+}
+
+node_t* create_from_array_ws_internal(const std::vector<float>& a, int left, int right, int skew) {
+    if (left > right) {
+        return nullptr;
+    }
+
+    int mid = left + (right - left) / skew;
+    node_t* node = new node_t;
+    node->value = a[mid];
+    ws_lazy_invoke([&] { node->left = create_from_array_ws_internal(a, left, mid - 1, skew); },
+                   [&] { node->right = create_from_array_ws_internal(a, mid + 1, right, skew); });
+    return node;
+}
+
+node_t* create_from_array_ws(ws_scheduler_t& scheduler, const std::vector<float>& a, int left, int right) {
+    node_t* root;
+    scheduler.run([&] { root = create_from_array_ws_internal(a, left, right, 2); });
+    return root;
+}
+
+node_t* create_skewed_from_array_ws(ws_scheduler_t& scheduler, const std::vector<float>& a, int left, int right) {
+    node_t* root;
+    scheduler.run([&] { root = create_from_array_ws_internal(a, left, right, SKEW); });
+    return root;
+}
+
+bool same_tree(node_t const * const a, node_t const * const b) {
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+    return a->value == b->value && same_tree(a->left, b->left) && same_tree(a->right, b->right);
+}
+
+// Quicksort with a Hoare partition around the median of three, and
+// insertion sort for short ranges.
+static void insertion_sort(float* a, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        float v = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > v; j--) {
+            a[j] = a[j - 1];
+        }
+        a[j] = v;
+    }
+}
+
+// Returns s in [1, n - 1] with a[0, s) <= pivot <= a[s, n).
+static size_t partition(float* a, size_t n) {
+    float x = a[0], y = a[n / 2], z = a[n - 1];
+    float pivot = std::max(std::min(x, y), std::min(std::max(x, y), z));
+
+    int64_t i = -1;
+    int64_t j = n;
+    while (true) {
+        do { i++; } while (a[i] < pivot);
+        do { j--; } while (a[j] > pivot);
+        if (i >= j) {
+            return j + 1;
+        }
+        std::swap(a[i], a[j]);
+    }
+}
+
+static constexpr size_t INSERTION_SORT_SIZE = 16;
+
+void quicksort_scalar(float* a, size_t n) {
+    if (n <= INSERTION_SORT_SIZE) {
+        insertion_sort(a, n);
+        return;
+    }
+    size_t s = partition(a, n);
+    quicksort_scalar(a, s);
+    quicksort_scalar(a + s, n - s);
+}
+
+// The usual OpenMP version: a task per partition above a size cutoff.
+static constexpr size_t QUICKSORT_TASK_CUTOFF = 16 * 1024;
+
+void quicksort_openmp_internal(float* a, size_t n) {
+    if (n <= QUICKSORT_TASK_CUTOFF) {
+        quicksort_scalar(a, n);
+        return;
+    }
+    size_t s = partition(a, n);
+
+    #pragma omp task firstprivate(a, s) default(none)
+    quicksort_openmp_internal(a, s);
+
+    #pragma omp task firstprivate(a, s, n) default(none)
+    quicksort_openmp_internal(a + s, n - s);
+
+    #pragma omp taskwait
+}
+
+void quicksort_openmp(float* a, size_t n) {
+    #pragma omp parallel firstprivate(a, n) default(none)
+    {
+        #pragma omp single
+        quicksort_openmp_internal(a, n);
+    }
+}
+
+void quicksort_ws_internal(float* a, size_t n) {
+    if (n <= INSERTION_SORT_SIZE) {
+        insertion_sort(a, n);
+        return;
+    }
+    size_t s = partition(a, n);
+    ws_lazy_invoke([&] { quicksort_ws_internal(a, s); },
+                   [&] { quicksort_ws_internal(a + s, n - s); });
+}
+
+void quicksort_ws(ws_scheduler_t& scheduler, float* a, size_t n) {
+    scheduler.run([&] { quicksort_ws_internal(a, n); });
+}
+
+template <typename F>
+double measure_seconds(const char* region, F f) {
+    LIKWID_MARKER_START(region);
+    double start = omp_get_wtime();
+    f();
+    double seconds = omp_get_wtime() - start;
+    LIKWID_MARKER_STOP(region);
+    return seconds;
+}
+
+// Find_min on a balanced and an unbalanced tree, the tree builders and
+// quicksort, with OpenMP tasks and with the work-stealing runtime.
+void run_task_tests(const std::vector<float>& a) {
+    int max_threads = omp_get_max_threads();
+    ws_scheduler_t scheduler(max_threads);
+
+    node_t* balanced0 = nullptr;
+    node_t* balanced1 = nullptr;
+    node_t* skewed0 = nullptr;
+    node_t* skewed1 = nullptr;
+    double t;
+
+    t = measure_seconds("create_balanced_scalar", [&] { balanced0 = create_from_array(a, 0, a.size() - 1); });
+    std::cout << "Create balanced tree: scalar " << t;
+    t = measure_seconds("create_balanced_ws", [&] { balanced1 = create_from_array_ws(scheduler, a, 0, a.size() - 1); });
+    std::cout << " s, work stealing " << t << " s\n";
+
+    t = measure_seconds("create_skewed_scalar", [&] { skewed0 = create_skewed_from_array(a, 0, a.size() - 1); });
+    std::cout << "Create unbalanced tree: scalar " << t;
+    t = measure_seconds("create_skewed_ws", [&] { skewed1 = create_skewed_from_array_ws(scheduler, a, 0, a.size() - 1); });
+    std::cout << " s, work stealing " << t << " s\n";
+
+    if (!same_tree(balanced0, balanced1) || !same_tree(skewed0, skewed1)) {
+        std::cout << "FAIL: Trees not same\n";
+    } else {
+        std::cout << "SUCC: Trees same\n";
+    }
+
+    size_t nodes = a.size();
+    size_t pairs = 0;  // Nodes with two children, a task each for find_min_ws_eager.
+    std::vector<node_t*> stack{balanced0};
+    while (!stack.empty()) {
+        node_t* n = stack.back();
+        stack.pop_back();
+        if (n->left && n->right) {
+            pairs++;
+        }
+        if (n->left) stack.push_back(n->left);
+        if (n->right) stack.push_back(n->right);
+    }
+
+    for (node_t* root : {balanced0, skewed0}) {
+        const char* name = root == balanced0 ? "balanced" : "unbalanced";
+        float min0 = 0, min1 = 0, min2 = 0, min3 = 0, min4 = 0;
+
+        double t_scalar = measure_seconds("task_find_min_scalar", [&] { min0 = find_min_scalar(root); });
+        double t_naive = measure_seconds("task_find_min_naive", [&] { min1 = find_min_naive(root); });
+        double t_openmp = measure_seconds("task_find_min_openmp", [&] { min2 = find_min_openmp(root); });
+        scheduler.reset_stats();
+        double t_eager = measure_seconds("task_find_min_ws_eager", [&] { min3 = find_min_ws_eager(scheduler, root); });
+        size_t eager_tasks = scheduler.tasks_executed();
+        scheduler.reset_stats();
+        double t_ws = measure_seconds("task_find_min_ws", [&] { min4 = find_min_ws(scheduler, root); });
+
+        std::cout << "Find_min " << name << " tree: scalar " << t_scalar << " s, OpenMP task per node " << t_naive
+                  << " s, OpenMP depth cutoff " << t_openmp << " s, work stealing task per node " << t_eager
+                  << " s, work stealing lazy " << t_ws << " s (" << scheduler.tasks_executed() << " tasks, "
+                  << scheduler.steals() << " steals)\n";
+        if (root == balanced0) {
+            std::cout << "Overhead per task: OpenMP " << (t_naive - t_scalar) / (nodes - 1) * 1e9
+                      << " ns, work stealing " << (t_eager - t_scalar) / eager_tasks * 1e9 << " ns ("
+                      << eager_tasks << " tasks, " << pairs << " expected)\n";
+        }
+
+        if (min0 != min1 || min0 != min2 || min0 != min3 || min0 != min4) {
+            std::cout << "FAIL: Find_min not same values\n";
+        } else {
+            std::cout << "SUCC: Find_min same values\n";
+        }
+    }
+
+    // Scaling on the unbalanced tree and in quicksort.
+    std::vector<float> sorted(a);
+    std::vector<float> unsorted0(a), unsorted1(a);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::cout << "Threads, find_min OpenMP, find_min work stealing, quicksort OpenMP, quicksort work stealing\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        ws_scheduler_t scaling_scheduler(threads);
+        omp_set_num_threads(threads);
+
+        float min0 = 0, min1 = 0;
+        double t0 = measure_seconds("scaling_find_min_openmp", [&] { min0 = find_min_openmp(skewed0); });
+        double t1 = measure_seconds("scaling_find_min_ws", [&] { min1 = find_min_ws(scaling_scheduler, skewed0); });
+
+        std::copy(a.begin(), a.end(), unsorted0.begin());
+        std::copy(a.begin(), a.end(), unsorted1.begin());
+        double t2 = measure_seconds("scaling_quicksort_openmp", [&] { quicksort_openmp(unsorted0.data(), unsorted0.size()); });
+        double t3 = measure_seconds("scaling_quicksort_ws", [&] { quicksort_ws(scaling_scheduler, unsorted1.data(), unsorted1.size()); });
+
+        std::cout << threads << ", " << t0 << ", " << t1 << ", " << t2 << ", " << t3 << "\n";
+
+        if (min0 != min1 || unsorted0 != sorted || unsorted1 != sorted) {
+            std::cout << "FAIL: Results not same\n";
+        }
+    }
+    omp_set_num_threads(max_threads);
+
+    destroy(balanced0);
+    destroy(balanced1);
+    destroy(skewed0);
+    destroy(skewed1);
+}
+
 void histogram_scalar(size_t * hist, uint8_t* image, size_t n) {
     for (size_t i = 0; i < n; i++) {
         hist[image[i]]++;
@@ -332,6 +623,66 @@ void histogram_openmp(size_t hist[256], uint8_t* image, size_t n) {
 
 }
 
+// The histogram engine on 8-bit pixels, random and with long runs of equal
+// values, 16-bit samples and 32-bit keys with 1000 bins.
+void run_histogram_tests(const std::vector<uint8_t>& pixels) {
+    static constexpr histogram_method methods[] = {histogram_method::SCALAR, histogram_method::REPLICATED, histogram_method::AVX512};
+    static constexpr const char* method_names[] = {"scalar", "replicated", "avx512"};
+    size_t n = pixels.size();
+
+    std::vector<uint8_t> runs(n);
+    for (size_t i = 0; i < n; i++) {
+        runs[i] = pixels[i / 4096] / 64;  // Four values in runs of 4096.
+    }
+
+    std::vector<uint16_t> samples(n);
+    std::vector<uint32_t> keys(n);
+    static constexpr size_t KEY_BINS = 1000;
+    for (size_t i = 0; i < n; i++) {
+        samples[i] = uint16_t(pixels[i] * 251 + pixels[(i * 7) % n]);
+        keys[i] = uint32_t(pixels[i] * 4 + pixels[(i * 13) % n] % 4);  // Up to 1023: some not counted.
+    }
+
+    std::vector<size_t> ref_pixels(256), ref_runs(256), ref_samples(65536), ref_keys(KEY_BINS);
+    histogram_scalar(ref_pixels.data(), const_cast<uint8_t*>(pixels.data()), n);
+    histogram_scalar(ref_runs.data(), runs.data(), n);
+    for (size_t i = 0; i < n; i++) {
+        ref_samples[samples[i]]++;
+        if (keys[i] < KEY_BINS) {
+            ref_keys[keys[i]]++;
+        }
+    }
+
+    bool same = true;
+    for (int m = 0; m < 3; m++) {
+        std::string name = method_names[m];
+        std::vector<size_t> h_pixels(256), h_runs(256), h_samples(65536), h_keys(KEY_BINS);
+
+        LIKWID_MARKER_START(("hist_u8_" + name).c_str());
+        histogram_u8(h_pixels.data(), pixels.data(), n, methods[m]);
+        LIKWID_MARKER_STOP(("hist_u8_" + name).c_str());
+
+        LIKWID_MARKER_START(("hist_u8_runs_" + name).c_str());
+        histogram_u8(h_runs.data(), runs.data(), n, methods[m]);
+        LIKWID_MARKER_STOP(("hist_u8_runs_" + name).c_str());
+
+        LIKWID_MARKER_START(("hist_u16_" + name).c_str());
+        histogram_u16(h_samples.data(), samples.data(), n, methods[m]);
+        LIKWID_MARKER_STOP(("hist_u16_" + name).c_str());
+
+        LIKWID_MARKER_START(("hist_u32_" + name).c_str());
+        histogram_u32(h_keys.data(), KEY_BINS, keys.data(), n, methods[m]);
+        LIKWID_MARKER_STOP(("hist_u32_" + name).c_str());
+
+        same = same && h_pixels == ref_pixels && h_runs == ref_runs && h_samples == ref_samples && h_keys == ref_keys;
+    }
+
+    if (!same) {
+        std::cout << "FAIL: Histogram engine not same\n";
+    } else {
+        std::cout << "SUCC: Histogram engine same\n";
+    }
+}
 
 template<typename T>
 bool near(T a, T b, T diff) {
@@ -459,6 +810,11 @@ int main() {
         std::cout << "SUCC: Histograms same\n";
     }
 
+    run_histogram_tests(pixels);
+
+    static constexpr size_t TASK_COUNT = 16*1024*1024;
+    run_task_tests(std::vector<float>(a.begin(), a.begin() + TASK_COUNT));
+
     LIKWID_MARKER_CLOSE;
 
     return 0;
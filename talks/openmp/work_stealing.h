@@ -0,0 +1,489 @@
+#pragma once
+
+// A small work-stealing runtime for recursive fork-join algorithms.
+//
+// Every worker has a Chase-Lev deque of tasks. The owner pushes and pops at
+// the bottom without atomic read-modify-write operations; idle workers steal
+// from the top of a random victim's deque. The thread that calls
+// ws_scheduler_t::run() becomes worker 0 for the duration of the call.
+//
+//     ws_scheduler_t scheduler(8);
+//     scheduler.run([&] { result = solve(root); });
+//
+// Inside run():
+//
+//  - ws_task_group_t::spawn(f) pushes a task (spawn_task() one that the
+//    caller keeps alive), sync() waits for all tasks of the group. While it waits, the worker runs its own tasks and steals.
+//  - ws_parallel_invoke(f, g) runs f and g in parallel; g is spawned as a task
+//    without a heap allocation.
+//  - ws_lazy_invoke(f, g) only spawns g if another worker is looking for work
+//    and the own deque is empty, so nothing there to steal. Otherwise f and g
+//    run one after another on the calling worker. A recursive algorithm calls
+//    it at every level; the check costs a few loads, so the recursion needs no
+//    cutoff depth or size, and tasks are created about as often as there are
+//    steals instead of once per call (lazy binary splitting).
+//  - ws_parallel_for(begin, end, body) splits a range lazily in halves the
+//    same way, calling body(i, j) on subranges of at least grain elements.
+//
+// Outside run() all of these run serially on the calling thread.
+//
+// Idle workers spin and yield while a run() is active and sleep on a
+// condition variable otherwise. The deques grow when they are full; the old
+// arrays are kept until the scheduler is destroyed, because a thief may still
+// be reading from one.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <emmintrin.h>
+
+class ws_task_group_t;
+
+class ws_task_t {
+public:
+    virtual ~ws_task_t() = default;
+    virtual void execute() = 0;
+
+    ws_task_group_t* group = nullptr;
+};
+
+template <typename F>
+class ws_function_task_t : public ws_task_t {
+public:
+    explicit ws_function_task_t(F f) : m_f(std::forward<F>(f)) { }
+    void execute() override { m_f(); }
+
+private:
+    F m_f;
+};
+
+// Spawned by ws_task_group_t::spawn(f): frees itself after running.
+template <typename F>
+class ws_heap_task_t : public ws_task_t {
+public:
+    explicit ws_heap_task_t(F f) : m_f(std::move(f)) { }
+    void execute() override {
+        m_f();
+        delete this;
+    }
+
+private:
+    F m_f;
+};
+
+// The deque of "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Le, Pop, Cohen, Zappa Nardelli, 2013).
+class ws_deque_t {
+public:
+    explicit ws_deque_t(int64_t capacity = 1024) :
+        m_top(0),
+        m_bottom(0)
+    {
+        m_arrays.emplace_back(new array_t(capacity));
+        m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    void push(ws_task_t* task) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        array_t* a = m_array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, t, b);
+        }
+        a->put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    ws_task_t* pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        array_t* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        ws_task_t* task = nullptr;
+        if (t <= b) {
+            task = a->get(b);
+            if (t == b) {
+                // The last task: race against the thieves for it.
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    task = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Any thread. Returns nullptr if the deque is empty or another thread
+    // won the race for the task.
+    ws_task_t* steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t < b) {
+            array_t* a = m_array.load(std::memory_order_acquire);
+            ws_task_t* task = a->get(t);
+            if (m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    // Owner only; a hint, the thieves may take the last task any time.
+    bool empty() const {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct array_t {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<ws_task_t*>[]> slots;
+
+        explicit array_t(int64_t capacity) :
+            capacity(capacity),
+            slots(new std::atomic<ws_task_t*>[capacity])
+        { }
+
+        ws_task_t* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, ws_task_t* task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+    };
+
+    array_t* grow(array_t* a, int64_t t, int64_t b) {
+        m_arrays.emplace_back(new array_t(a->capacity * 2));
+        array_t* bigger = m_arrays.back().get();
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, a->get(i));
+        }
+        m_array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    std::atomic<array_t*> m_array;
+    std::vector<std::unique_ptr<array_t>> m_arrays;  // Owner only.
+};
+
+class ws_scheduler_t;
+
+struct alignas(64) ws_worker_t {
+    ws_scheduler_t* scheduler;
+    size_t index;
+    ws_deque_t deque;
+    uint64_t rng;
+    size_t tasks_executed = 0;
+    size_t steals = 0;
+};
+
+inline thread_local ws_worker_t* ws_current_worker = nullptr;
+
+class ws_task_group_t {
+public:
+    ws_task_group_t() : m_pending(0) { }
+
+    ~ws_task_group_t() { sync(); }
+
+    template <typename F>
+    void spawn(F f) {
+        spawn_task(new ws_heap_task_t<F>(std::move(f)));
+    }
+
+    // The task must stay alive until sync() returns.
+    void spawn_task(ws_task_t* task);
+
+    void sync();
+
+private:
+    friend class ws_scheduler_t;
+    std::atomic<size_t> m_pending;
+};
+
+class ws_scheduler_t {
+public:
+    explicit ws_scheduler_t(size_t num_workers = std::thread::hardware_concurrency()) :
+        m_workers(num_workers > 0 ? num_workers : 1),
+        m_running(0),
+        m_thieves(0),
+        m_stop(false)
+    {
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            m_workers[i].scheduler = this;
+            m_workers[i].index = i;
+            m_workers[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        }
+        for (size_t i = 1; i < m_workers.size(); i++) {
+            m_threads.emplace_back([this, i] { worker_loop(&m_workers[i]); });
+        }
+    }
+
+    ~ws_scheduler_t() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& t : m_threads) {
+            t.join();
+        }
+    }
+
+    ws_scheduler_t(const ws_scheduler_t&) = delete;
+    ws_scheduler_t& operator=(const ws_scheduler_t&) = delete;
+
+    // Runs f on the calling thread as worker 0, with the other workers
+    // stealing the tasks it spawns. Only one run() at a time.
+    template <typename F>
+    void run(F f) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running.store(1, std::memory_order_relaxed);
+        }
+        m_wake.notify_all();
+
+        ws_worker_t* previous = ws_current_worker;
+        ws_current_worker = &m_workers[0];
+        f();
+        ws_current_worker = previous;
+
+        m_running.store(0, std::memory_order_relaxed);
+    }
+
+    size_t num_workers() const { return m_workers.size(); }
+
+    size_t tasks_executed() const {
+        size_t total = 0;
+        for (const ws_worker_t& w : m_workers) {
+            total += w.tasks_executed;
+        }
+        return total;
+    }
+
+    size_t steals() const {
+        size_t total = 0;
+        for (const ws_worker_t& w : m_workers) {
+            total += w.steals;
+        }
+        return total;
+    }
+
+    void reset_stats() {
+        for (ws_worker_t& w : m_workers) {
+            w.tasks_executed = 0;
+            w.steals = 0;
+        }
+    }
+
+    // True if a task spawned now would probably be stolen soon.
+    bool hungry(ws_worker_t* self) const {
+        return m_thieves.load(std::memory_order_relaxed) > 0 && self->deque.empty();
+    }
+
+    static void execute(ws_worker_t* self, ws_task_t* task) {
+        ws_task_group_t* group = task->group;
+        task->execute();
+        self->tasks_executed++;
+        group->m_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Runs a task from the own deque, or steals one. Returns false if there
+    // was none.
+    bool run_one(ws_worker_t* self) {
+        ws_task_t* task = self->deque.pop();
+        if (task == nullptr) {
+            task = steal(self);
+        }
+        if (task == nullptr) {
+            return false;
+        }
+        execute(self, task);
+        return true;
+    }
+
+private:
+    ws_task_t* steal(ws_worker_t* self) {
+        size_t n = m_workers.size();
+        if (n == 1) {
+            return nullptr;
+        }
+        // xorshift64
+        self->rng ^= self->rng << 13;
+        self->rng ^= self->rng >> 7;
+        self->rng ^= self->rng << 17;
+        size_t start = self->rng % n;
+        for (size_t k = 0; k < n; k++) {
+            size_t victim = (start + k) % n;
+            if (victim == self->index) {
+                continue;
+            }
+            ws_task_t* task = m_workers[victim].deque.steal();
+            if (task != nullptr) {
+                self->steals++;
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    friend class ws_task_group_t;
+
+    // Called while waiting for something: first spin, then yield the core.
+    void idle_backoff(size_t& failures) {
+        failures++;
+        if (failures < 64) {
+            _mm_pause();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    void worker_loop(ws_worker_t* self) {
+        ws_current_worker = self;
+        size_t failures = 0;
+        bool thief = false;
+        while (true) {
+            if (m_running.load(std::memory_order_relaxed) == 0) {
+                if (thief) {
+                    m_thieves.fetch_sub(1, std::memory_order_relaxed);
+                    thief = false;
+                }
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_stop || m_running.load(std::memory_order_relaxed) != 0; });
+                if (m_stop) {
+                    return;
+                }
+                failures = 0;
+            }
+
+            if (!thief) {
+                m_thieves.fetch_add(1, std::memory_order_relaxed);
+                thief = true;
+            }
+            ws_task_t* task = steal(self);
+            if (task != nullptr) {
+                m_thieves.fetch_sub(1, std::memory_order_relaxed);
+                thief = false;
+                failures = 0;
+                execute(self, task);
+                // Run what the task left behind before stealing again.
+                while (ws_task_t* own = self->deque.pop()) {
+                    execute(self, own);
+                }
+            } else {
+                idle_backoff(failures);
+            }
+        }
+    }
+
+    std::vector<ws_worker_t> m_workers;
+    std::vector<std::thread> m_threads;
+    alignas(64) std::atomic<int> m_running;
+    alignas(64) std::atomic<int> m_thieves;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+};
+
+inline void ws_task_group_t::spawn_task(ws_task_t* task) {
+    task->group = this;
+    ws_worker_t* self = ws_current_worker;
+    if (self == nullptr) {
+        // Not inside ws_scheduler_t::run(), run it right away.
+        task->execute();
+        return;
+    }
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    self->deque.push(task);
+}
+
+inline void ws_task_group_t::sync() {
+    if (m_pending.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+
+    ws_worker_t* self = ws_current_worker;
+    ws_scheduler_t* scheduler = self->scheduler;
+    size_t failures = 0;
+    bool thief = false;
+    while (m_pending.load(std::memory_order_acquire) != 0) {
+        ws_task_t* task = self->deque.pop();
+        if (task == nullptr) {
+            // Everything left of this group was stolen: help the thieves.
+            if (!thief) {
+                scheduler->m_thieves.fetch_add(1, std::memory_order_relaxed);
+                thief = true;
+            }
+            task = scheduler->steal(self);
+        }
+        if (task != nullptr) {
+            if (thief) {
+                scheduler->m_thieves.fetch_sub(1, std::memory_order_relaxed);
+                thief = false;
+            }
+            failures = 0;
+            ws_scheduler_t::execute(self, task);
+        } else {
+            scheduler->idle_backoff(failures);
+        }
+    }
+    if (thief) {
+        scheduler->m_thieves.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename F, typename G>
+void ws_parallel_invoke(F&& f, G&& g) {
+    ws_function_task_t<std::remove_reference_t<G>&> task(g);
+    ws_task_group_t group;
+    group.spawn_task(&task);
+    f();
+    group.sync();
+}
+
+template <typename F, typename G>
+void ws_lazy_invoke(F&& f, G&& g) {
+    ws_worker_t* self = ws_current_worker;
+    if (self != nullptr && self->scheduler->hungry(self)) {
+        ws_parallel_invoke(f, g);
+    } else {
+        f();
+        g();
+    }
+}
+
+template <typename Body>
+void ws_parallel_for(size_t begin, size_t end, Body&& body, size_t grain = 1024) {
+    if (grain == 0) {
+        grain = 1;
+    }
+    // Run grain-sized pieces from the front; whenever a worker is hungry,
+    // hand it the back half of what is left.
+    while (end - begin > grain) {
+        ws_worker_t* self = ws_current_worker;
+        if (self != nullptr && self->scheduler->hungry(self)) {
+            size_t mid = begin + (end - begin) / 2;
+            ws_parallel_invoke([&] { ws_parallel_for(begin, mid, body, grain); },
+                               [&] { ws_parallel_for(mid, end, body, grain); });
+            return;
+        }
+        body(begin, begin + grain);
+        begin += grain;
+    }
+    if (begin < end) {
+        body(begin, end);
+    }
+}
@@ -1,21 +1,29 @@
 #include <immintrin.h>
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
+#include "../../common/buffer_2d.h"
 
+// Row-major matrix in one contiguous, 64-byte aligned buffer_2d. Row i starts
+// at m_data + i * m_stride. By default the stride is picked by buffer_2d to
+// avoid cache set conflicts between rows.
 template <typename T>
 class matrix {
    public:
-    matrix(int rows, int cols)
-        : m_data(allocate_matrix(rows, cols)), m_rows(rows), m_cols(cols) {}
-
-    ~matrix() { free_matrix(m_data, m_rows, m_cols); }
+    matrix(int rows, int cols, int stride = buffer_2d<T>::AUTO_STRIDE)
+        : m_buffer(rows, cols, stride),
+          m_rows(rows),
+          m_cols(cols),
+          m_stride(m_buffer.stride()),
+          m_data(m_buffer.data()) {}
 
     matrix(const matrix& m) = delete;
 
     static bool multiply_mul1(matrix& out, matrix& in1, matrix& in2) {
-        T** c = out.m_data;
-        T** a = in1.m_data;
-        T** b = in2.m_data;
+        row_view c(out);
+        row_view a(in1);
+        row_view b(in2);
         int n;
 
         if (!verify_multiplication_params(out, in1, in2)) {
@@ -37,9 +45,9 @@ class matrix {
     }
 
     static bool multiply_mul2(matrix& out, matrix& in1, matrix& in2) {
-        T** c = out.m_data;
-        T** a = in1.m_data;
-        T** b = in2.m_data;
+        row_view c(out);
+        row_view a(in1);
+        row_view b(in2);
         int n;
 
         if (!verify_multiplication_params(out, in1, in2)) {
@@ -65,10 +73,15 @@ class matrix {
     }
 
 
-    int rows() { return m_rows; }
-    int cols() { return m_cols; }
+    int rows() const { return m_rows; }
+    int cols() const { return m_cols; }
+    int stride() const { return m_stride; }
+
+    T* row(int row) { return m_data + static_cast<size_t>(row) * m_stride; }
+    const T* row(int row) const { return m_data + static_cast<size_t>(row) * m_stride; }
 
-    T& operator()(int row, int col) { return m_data[row][col]; }
+    T& operator()(int row, int col) { return this->row(row)[col]; }
+    const T& operator()(int row, int col) const { return this->row(row)[col]; }
 
     bool operator==(const matrix& m) {
         if (m.m_rows != m_rows)
@@ -78,7 +91,7 @@ class matrix {
 
         for (int i = 0; i < m_rows; i++) {
             for (int j = 0; j < m_cols; j++) {
-                if (m.m_data[i][j] != m_data[i][j])
+                if (m(i, j) != (*this)(i, j))
                     return false;
             }
         }
@@ -89,26 +102,23 @@ class matrix {
     bool operator!=(const matrix& m) { return !(*this == m); }
 
    private:
-    T** m_data;
+    buffer_2d<T> m_buffer;
+    // Copies of the buffer geometry, in the types the kernels use.
     int m_rows;
     int m_cols;
+    int m_stride;
+    T* m_data;
 
-    static T** allocate_matrix(int rows, int cols) {
-        T** matrix = new T*[rows];
-        if (rows) {
-            matrix[0] = new T[rows * cols];
-            for (int i = 1; i < rows; ++i)
-                matrix[i] = matrix[0] + i * cols;
-        }
-
-        return matrix;
-    }
+    // Gives the kernels c[i][j] syntax on top of the strided storage.
+    class row_view {
+       public:
+        row_view(matrix& m) : m_data(m.m_data), m_stride(m.m_stride) {}
+        T* operator[](int row) const { return m_data + static_cast<size_t>(row) * m_stride; }
 
-    static void free_matrix(T** matrix, int rows, int cols) {
-        if (rows)
-            delete[] matrix[0];
-        delete[] matrix;
-    }
+       private:
+        T* m_data;
+        int m_stride;
+    };
 
     static bool verify_multiplication_params(const matrix& out1,
                                              const matrix& in1,
@@ -130,7 +140,7 @@ template <typename T>
 std::ostream& operator<<(std::ostream& os, const matrix<T>& m) {
     for (int i = 0; i < m.m_rows; i++) {
         for (int j = 0; j < m.m_cols; j++) {
-            os << m.m_data[i][j] << " ";
+            os << m(i, j) << " ";
         }
         os << "\n";
     }